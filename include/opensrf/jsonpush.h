@@ -42,11 +42,27 @@ GNU General Public License for more details.
 
 	This parser does @em not give any special attention to OSRF-specific conventions for
 	encoding class information.
+
+	For the common case of simply wanting a jsonObject at the end, a JSONPushBuilder wraps
+	a push parser with callbacks that build the tree as the chunks arrive, decoding class
+	hints the way jsonParse() does if asked to:
+
+	1. Call jsonNewPushBuilder() to create a builder.
+
+	2. Pass each chunk to jsonPushBuilderPush() as it becomes available.  The chunk is no
+	longer needed once the call returns.
+
+	3. Call jsonPushBuilderFinish() to collect the resulting jsonObject.  The builder is
+	then ready for another value.
+
+	4. Call jsonPushBuilderFree() to free the builder when you're done with it.
 */
 
 #ifndef JSONPUSH_H
 #define JSONPUSH_H
 
+#include <opensrf/osrf_json.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -54,6 +70,9 @@ extern "C" {
 struct JSONPushParserStruct;
 typedef struct JSONPushParserStruct JSONPushParser;
 
+struct JSONPushBuilderStruct;
+typedef struct JSONPushBuilderStruct JSONPushBuilder;
+
 /** @brief A collection of callback pointers */
 typedef struct {
 
@@ -83,6 +102,16 @@ void jsonPushParserFree( JSONPushParser* parser );
 
 int jsonPush( JSONPushParser* parser, const char* str, size_t length );
 
+JSONPushBuilder* jsonNewPushBuilder( int decode );
+
+int jsonPushBuilderPush( JSONPushBuilder* builder, const char* str, size_t length );
+
+jsonObject* jsonPushBuilderFinish( JSONPushBuilder* builder );
+
+void jsonPushBuilderReset( JSONPushBuilder* builder );
+
+void jsonPushBuilderFree( JSONPushBuilder* builder );
+
 #ifdef __cplusplus
 }
 #endif
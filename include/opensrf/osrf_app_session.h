@@ -100,6 +100,10 @@ struct osrf_app_session_struct {
 
 	/** Buffer used by server drone to collect outbound response messages */
 	growing_buffer* outbuf;
+
+	/** Boolean: true if the remote party has said that it can read message bodies in
+	    binary form (see osrfMessageSerializeBatchBinary()). */
+	int binary;
 };
 typedef struct osrf_app_session_struct osrfAppSession;
 
@@ -147,6 +151,11 @@ int osrfSendChunkedResult(
 		osrfAppSession* session, int request_id, const char* payload,
 		size_t payload_size, size_t chunk_size );
 
+int osrfSendPartialResult(
+		osrfAppSession* session, int request_id, const char* partial, size_t partial_size );
+
+int osrfSendPartialComplete( osrfAppSession* session, int request_id );
+
 int osrfSendTransportPayload( osrfAppSession* session, const char* payload );
 
 void osrf_app_session_reset_remote( osrfAppSession* );
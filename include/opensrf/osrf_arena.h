@@ -0,0 +1,55 @@
+/**
+	@file osrf_arena.h
+	@brief Header for osrfArena, a region allocator.
+
+	An osrfArena hands out memory from a series of large chunks, using a simple bump
+	pointer.  There is no way to free an individual allocation.  Instead, everything
+	allocated from an osrfArena is released at once, by calling osrfArenaReset() or
+	osrfArenaFree().
+
+	This arrangement suits data structures that are built, used, and thrown away as a
+	unit -- such as a jsonObject tree parsed from an incoming message.  Building such a
+	structure in an osrfArena replaces thousands of calls to malloc() and free() with a few
+	pointer increments, and releasing it costs the same no matter how big it is.
+
+	An osrfList or osrfHash may be created within an osrfArena; see osrfNewArenaList() and
+	osrfNewArenaHash().  Such containers draw all of their internal storage from the arena,
+	and osrfListFree() or osrfHashFree() leaves them alone.
+
+	An osrfArena is not thread-safe.  Each thread should use its own.
+*/
+
+#ifndef OSRF_ARENA_H
+#define OSRF_ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	@brief The default size of a chunk, used when osrfNewArena() is passed a zero.
+*/
+#define OSRF_ARENA_DEFAULT_CHUNK 65536
+
+struct _osrfArenaStruct;
+typedef struct _osrfArenaStruct osrfArena;
+
+osrfArena* osrfNewArena( size_t chunk_size );
+
+void* osrfArenaAlloc( osrfArena* arena, size_t size );
+
+char* osrfArenaStrdup( osrfArena* arena, const char* str );
+
+char* osrfArenaStrndup( osrfArena* arena, const char* str, size_t len );
+
+void osrfArenaReset( osrfArena* arena );
+
+void osrfArenaFree( osrfArena* arena );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
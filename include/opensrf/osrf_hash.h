@@ -3,15 +3,25 @@
 
 /**
 	@file osrf_hash.h
-	@brief A hybrid between a hash table and a doubly linked list.
+	@brief A key/value store that remembers the order of insertion.
 
-	The hash table supports random lookups by key.  The list supports iterative traversals.
-	The sequence of entries in the list reflects the sequence in which the keys were added.
+	Entries live in a flat array, in the sequence in which the keys were added, which
+	supports iterative traversals.  A small osrfHash finds keys by scanning the array; a
+	larger one maintains a hash table for random lookups by key.  The switch from one
+	layout to the other is invisible to the calling code.
 
 	osrfHashIterators are somewhat unusual in that, if an iterator is positioned on a given
 	entry, deletion of that entry does not invalidate the iterator.  The entry to which it
 	points is logically but not physically deleted.  You can still advance the iterator to the
-	next entry in the list.
+	next entry.
+
+	The functions that take a key as a printf-style format string have counterparts
+	ending in "Len", which take the key and its length verbatim, and "Key", which take an
+	osrfHashKey prepared by osrfHashMakeKey().  Prefer them for keys that arrive from
+	outside, which might contain a percent sign, and for keys used more than once.
+
+	An osrfHash created by osrfNewArenaHash() keeps all of its internal storage in an
+	osrfArena, and osrfHashFree() leaves it alone.
 */
 #include <opensrf/utils.h>
 #include <opensrf/string_array.h>
@@ -27,26 +37,65 @@ typedef struct _osrfHashStruct osrfHash;
 struct _osrfHashIteratorStruct;
 typedef struct _osrfHashIteratorStruct osrfHashIterator;
 
+/**
+	@brief A key for an osrfHash, with its length and hash code computed in advance.
+
+	Fill one in with osrfHashMakeKey() when the same key is to be used for several
+	operations, perhaps on several hashes.
+*/
+typedef struct {
+	/** @brief Pointer to the characters of the key (not necessarily nul-terminated) */
+	const char* str;
+	/** @brief The length of the key */
+	size_t len;
+	/** @brief The hash code of the key */
+	unsigned int code;
+} osrfHashKey;
+
 osrfHash* osrfNewHash();
 
+osrfHash* osrfNewArenaHash( osrfArena* arena );
+
 void osrfHashSetCallback( osrfHash* hash, void (*callback) (char* key, void* item) );
 
+void osrfHashInternKeys( osrfHash* hash );
+
 void* osrfHashSet( osrfHash* hash, void* item, const char* key, ... );
 
+void* osrfHashSetLen( osrfHash* hash, void* item, const char* key, size_t len );
+
+void* osrfHashSetKey( osrfHash* hash, void* item, const osrfHashKey* hkey );
+
 void* osrfHashRemove( osrfHash* hash, const char* key, ... );
 
+void* osrfHashRemoveLen( osrfHash* hash, const char* key, size_t len );
+
+void* osrfHashRemoveKey( osrfHash* hash, const osrfHashKey* hkey );
+
 void* osrfHashExtract( osrfHash* hash, const char* key, ... );
 
+void* osrfHashExtractLen( osrfHash* hash, const char* key, size_t len );
+
+void* osrfHashExtractKey( osrfHash* hash, const osrfHashKey* hkey );
+
 void* osrfHashGet( osrfHash* hash, const char* key );
 
 void* osrfHashGetFmt( osrfHash* hash, const char* key, ... );
 
+void* osrfHashGetLen( const osrfHash* hash, const char* key, size_t len );
+
+void* osrfHashGetKey( const osrfHash* hash, const osrfHashKey* hkey );
+
+void osrfHashMakeKey( osrfHashKey* hkey, const char* key, size_t len );
+
 osrfStringArray* osrfHashKeys( osrfHash* hash );
 
 void osrfHashFree( osrfHash* hash );
 
 unsigned long osrfHashGetCount( osrfHash* hash );
 
+osrfArena* osrfHashGetArena( const osrfHash* hash );
+
 osrfHashIterator* osrfNewHashIterator( osrfHash* hash );
 
 int osrfHashIteratorHasNext( osrfHashIterator* itr );
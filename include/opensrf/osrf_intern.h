@@ -0,0 +1,56 @@
+/**
+	@file osrf_intern.h
+	@brief Header for a process-wide table of interned strings.
+
+	The same few dozen strings turn up as hash keys and class names in nearly every
+	message: "__c", "__p", "threadTrace", "payload", "statusCode", and the class names of
+	whatever objects an application traffics in.  Instead of allocating a fresh copy of each
+	one for every jsonObject, we can store a single copy in an intern table and share it.
+
+	Interned strings live in a fixed-size static pool, and are never freed.  Hence the
+	table has a fixed capacity; once it fills up, osrfIntern() simply declines to intern
+	anything new.  To keep the table from filling up with one-off strings, we intern only
+	strings that look like identifiers: short, and beginning with a letter or an
+	underscore.
+
+	Nor do we let clients fill the table.  It starts out with the keys and class names of
+	the OpenSRF protocol.  After that, only whatever an application interns for itself
+	with osrfIntern() is added, such as the class names it works with.  Hash keys and
+	class names, including those of a parsed JSON object, merely look for an interned
+	copy with osrfInternLookup().
+
+	The table is shared by all threads, without locking: entries are added with an atomic
+	compare-and-swap, and never change thereafter.  Without compiler support for atomic
+	operations, osrfIntern() interns nothing.
+
+	Since two equal interned strings are the same string, code comparing a string to an
+	interned string may compare pointers before resorting to strcmp().
+*/
+
+#ifndef OSRF_INTERN_H
+#define OSRF_INTERN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief The longest string that osrfIntern() will intern. */
+#define OSRF_INTERN_MAX_LEN 32
+
+const char* osrfIntern( const char* str );
+
+const char* osrfInternLookup( const char* str );
+
+int osrfIsInterned( const char* str );
+
+char* osrfInternStrdup( const char* str );
+
+char* osrfInternLookupStrdup( const char* str );
+
+void osrfInternFree( char* str );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
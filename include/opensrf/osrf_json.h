@@ -43,14 +43,37 @@ GNU General Public License for more details.
 	database table or view.  Such an object can be translated into a JSON string where the
 	class is encoded as the value of a name/value pair, with the original jsonObject encoded
 	as the value of a second name/value pair.
+
+	A jsonObject tree may be built within an osrfArena (see osrf_arena.h), by calling
+	jsonParseInArena() or the other ...InArena() functions.  Such a tree is cheap to build
+	and costs nothing to free, but it is meant to be transient and read-only.  It lives
+	only until the arena is reset or freed, and jsonObjectFree() ignores it.  Don't modify
+	it, and don't mix it with heap-based jsonObjects.  If you need to keep or modify any
+	part of it, use jsonObjectClone() to make a heap-based copy.
+
+	jsonParseInSitu() goes a step further, by parsing a writable buffer in place.  The
+	strings and numbers in the resulting tree point into that buffer instead of being
+	copied, so the buffer must outlive the tree.
+
+	When you need only a few values from a large document, jsonTapeParse() avoids building
+	a jsonObject tree at all.  It records the position of each token in a jsonTape, through
+	which you can look up values by key or index, decode just the strings you need, build
+	jsonObjects for just the subtrees you need (jsonTapeToObject()), and pass along the rest
+	as verbatim text (jsonTapeText()).
+
+	jsonObjectToBinary() and jsonObjectFromBinary() translate a jsonObject to and from a
+	compact binary encoding (a subset of CBOR), for peers that can read it.  Unlike JSON, it
+	needs no escaping of strings, and carries class names without wrapper objects.
 */
 
 #ifndef JSON_H
 #define JSON_H
 
+#include <stdint.h>
 #include <opensrf/utils.h>
 #include <opensrf/osrf_list.h>
 #include <opensrf/osrf_hash.h>
+#include <opensrf/osrf_arena.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -91,6 +114,40 @@ extern "C" {
 #endif
 /*@}*/
 
+/**
+	@name Binary encoding tags
+
+	CBOR tag numbers used by jsonObjectToBinary().  @em JSON_BINARY_TAG_CLASS (the standard
+	tag for an object with a type name) wraps a class name and an associated value.
+	@em JSON_BINARY_TAG_NUMBER marks a numeric string that can't travel as an integer.
+*/
+/*@{*/
+#define JSON_BINARY_TAG_CLASS  27
+#define JSON_BINARY_TAG_NUMBER 0x4F53
+/*@}*/
+
+/**
+	@name jsonObject flags
+	@brief Bits in the @em flags member of a jsonObject.
+
+	These flags describe how a jsonObject is stored.  They are for internal use; client
+	code should treat them as read-only.
+*/
+/*@{*/
+#define JSON_NODE_ARENA 0x01   /**< The node and its cargo live in an osrfArena. */
+#define JSON_NODE_BORROWED_STRING 0x02  /**< value.s points into a buffer we don't own. */
+#define JSON_NODE_BORROWED_CLASS  0x04  /**< classname points into a buffer we don't own. */
+#define JSON_NODE_NUM_INT    0x08  /**< num.i holds the value of a JSON_NUMBER. */
+#define JSON_NODE_NUM_DOUBLE 0x10  /**< num.d holds the value of a JSON_NUMBER. */
+/** Either of the bits saying that a JSON_NUMBER has cached its value. */
+#define JSON_NODE_NUM_CACHED ( JSON_NODE_NUM_INT | JSON_NODE_NUM_DOUBLE )
+/** Something attached below the node borrows a string (set when it's attached). */
+#define JSON_NODE_HOLDS_BORROWED 0x20
+/** Any of the bits saying that a node or its contents borrow a string. */
+#define JSON_NODE_ANY_BORROWED \
+	( JSON_NODE_BORROWED_STRING | JSON_NODE_BORROWED_CLASS | JSON_NODE_HOLDS_BORROWED )
+/*@}*/
+
 /**
 	@brief Representation of a JSON string in memory
 
@@ -100,6 +157,23 @@ extern "C" {
 	strings.  As a result, a JSON_NUMBER can store numbers that cannot be represented
 	by native C types.
 
+	Converting the string to a native type every time someone asks for it gets expensive
+	when, for example, a service walks through thousands of ids.  So whatever builds or
+	parses a JSON_NUMBER caches the converted value in the @em num member, by calling
+	jsonObjectCacheNumber(): as an integer if the string is an integer that fits in 64 bits
+	(other than "-0"), or otherwise as a double.  The flags JSON_NODE_NUM_INT and
+	JSON_NODE_NUM_DOUBLE say which, if either, is valid.  Anything that changes the string
+	must clear them.  jsonObjectGetNumber() and jsonObjectGetInt64() never write to the
+	cache, so they are safe on a tree shared between threads.
+
+	A jsonObject may have more than one owner, through jsonObjectShare().  The @em refs
+	member counts the owners beyond the first; jsonObjectFree() only drops a reference
+	until the last owner calls it.  Shared trees are read-only by convention.  An owner
+	who wants to change one calls jsonObjectUnshare() first, which copies the tree if
+	anybody else still holds it.  Since the mutators can't enforce that convention, the
+	library shares only trees that it built itself, such as parsed messages.  Functions
+	that take a jsonObject from application code, such as osrfAppRespond(), still copy it.
+
 	(We used to store numbers as doubles.  We still have the @em n member lying around as
 	a relic of those times, but we don't use it.  We can't get rid of it yet, either.  Long
 	story.)
@@ -108,6 +182,8 @@ struct _jsonObjectStruct {
 	unsigned long size;     /**< Number of sub-items. */
 	char* classname;        /**< Optional class hint (not part of the JSON spec). */
 	int type;               /**< JSON type. */
+	int flags;              /**< Storage flags; see JSON_NODE_ARENA et al. */
+	int refs;               /**< Number of owners besides the first; see jsonObjectShare(). */
 	struct _jsonObjectStruct* parent;   /**< Whom we're attached to. */
 	/** Union used for various types of cargo. */
 	union _jsonValue {
@@ -117,6 +193,11 @@ struct _jsonObjectStruct {
 		int 		b;      /**< Bool. */
 		double	n;          /**< Number (no longer used). */
 	} value;
+	/** Cached value of a JSON_NUMBER; see JSON_NODE_NUM_CACHED. */
+	union _jsonNumCache {
+		int64_t i;          /**< Valid if flags include JSON_NODE_NUM_INT. */
+		double  d;          /**< Valid if flags include JSON_NODE_NUM_DOUBLE. */
+	} num;
 };
 typedef struct _jsonObjectStruct jsonObject;
 
@@ -134,6 +215,59 @@ struct _jsonIteratorStruct {
 };
 typedef struct _jsonIteratorStruct jsonIterator;
 
+/** @brief Window size used when jsonNewSink() is passed a zero. */
+#define JSON_SINK_DEFAULT_WINDOW 8192
+
+/**
+	@brief Callback through which a jsonSink delivers serialized JSON.
+	@param userdata The opaque pointer supplied to jsonNewSink().
+	@param data Pointer to the staged text (not nul-terminated).
+	@param len Number of bytes staged.
+	@return The number of bytes consumed, or -1 upon error.
+
+	The writer may consume fewer than @a len bytes.  The jsonSink keeps whatever is left
+	over at the front of its staging buffer, and offers it again next time, followed
+	by whatever has been added since.
+*/
+typedef long (*jsonSinkWriter)( void* userdata, const char* data, size_t len );
+
+/**
+	@brief Destination for incremental serialization of a jsonObject.
+
+	The serializer appends text to a staging buffer.  Whenever the staged text reaches
+	@em window bytes, the jsonSink hands it to the writer.  Thus a large document can be
+	emitted in pieces, without ever holding the whole thing in memory.
+
+	The window is a threshold, not a hard limit: we check it between elements, so the
+	staged text may overshoot by the length of a single scalar or key.  Long strings
+	are escaped in window-sized slices, so that the overshoot stays proportional to
+	the window.
+*/
+struct _jsonSinkStruct {
+	growing_buffer* buf;     /**< Staging buffer. */
+	size_t window;           /**< Flush whenever this many bytes are staged. */
+	jsonSinkWriter write;    /**< Callback for delivering the staged text. */
+	void* userdata;          /**< Opaque pointer passed to the writer. */
+	size_t total;            /**< How many bytes the writer has consumed so far. */
+	int error;               /**< Boolean; true if the writer has reported an error. */
+};
+typedef struct _jsonSinkStruct jsonSink;
+
+/**
+	@brief A structural index of a JSON string, recording where each token lies.
+
+	The structure is opaque; use the jsonTape... functions.  A node of a jsonTape is
+	identified by an int: 0 for the outermost node, or -1 for one that isn't there.
+*/
+typedef struct _jsonTapeStruct jsonTape;
+
+/**
+	@brief A search path for jsonObjectFindPath(), compiled by jsonPathCompile().
+
+	The structure is opaque; apply it with jsonPathEval() and free it with jsonPathFree().
+*/
+typedef struct _jsonPathStruct jsonPath;
+
 /**
 	@brief Macros for upward compatibility with an old, defunct version
     of the JSON parser.
@@ -150,16 +284,54 @@ jsonObject* jsonParseRaw( const char* str );
 
 jsonObject* jsonParseFmt( const char* str, ... );
 
+jsonObject* jsonParseInArena( osrfArena* arena, const char* str );
+
+jsonObject* jsonParseRawInArena( osrfArena* arena, const char* str );
+
+jsonObject* jsonParseInSitu( osrfArena* arena, char* str );
+
+jsonObject* jsonParseRawInSitu( osrfArena* arena, char* str );
+
+jsonObject* jsonParseLegacy( const char* str );
+
+jsonTape* jsonTapeParse( const char* str );
+
+jsonTape* jsonTapeParseRaw( const char* str );
+
+void jsonTapeFree( jsonTape* tape );
+
+int jsonTapeType( const jsonTape* tape, int node );
+
+unsigned long jsonTapeSize( const jsonTape* tape, int node );
+
+int jsonTapeGetIndex( const jsonTape* tape, int node, unsigned long index );
+
+int jsonTapeGetKey( jsonTape* tape, int node, const char* key );
+
+const char* jsonTapeGetString( jsonTape* tape, int node );
+
+const char* jsonTapeGetClass( jsonTape* tape, int node );
+
+const char* jsonTapeText( const jsonTape* tape, int node, size_t* len );
+
+jsonObject* jsonTapeToObject( const jsonTape* tape, int node );
+
 jsonObject* jsonNewObject(const char* data);
 
 jsonObject* jsonNewObjectFmt(const char* data, ...);
 
 jsonObject* jsonNewObjectType(int type);
 
+jsonObject* jsonNewObjectInArena( osrfArena* arena, const char* data );
+
+jsonObject* jsonNewObjectTypeInArena( osrfArena* arena, int type );
+
 jsonObject* jsonNewNumberObject( double num );
 
 jsonObject* jsonNewNumberStringObject( const char* numstr );
 
+void jsonObjectCacheNumber( jsonObject* obj );
+
 jsonObject* jsonNewBoolObject(int val);
 
 void jsonObjectFree( jsonObject* o );
@@ -175,6 +347,25 @@ unsigned long jsonObjectSetKey(
  * Turns the object into a JSON string.  The string must be freed by the caller */
 char* jsonObjectToJSON( const jsonObject* obj );
 char* jsonObjectToJSONRaw( const jsonObject* obj );
+char* jsonObjectToJSONDecoded( const jsonObject* obj );
+
+jsonSink* jsonNewSink( size_t window, jsonSinkWriter write, void* userdata );
+
+void jsonSinkFree( jsonSink* sink );
+
+int jsonSinkAdd( jsonSink* sink, const char* data, size_t len );
+
+int jsonSinkFlush( jsonSink* sink );
+
+int jsonObjectToSink( const jsonObject* obj, jsonSink* sink );
+
+int jsonObjectToSinkRaw( const jsonObject* obj, jsonSink* sink );
+
+int jsonObjectToFd( const jsonObject* obj, int fd, size_t window );
+
+int jsonObjectToBinary( const jsonObject* obj, growing_buffer* buf );
+
+jsonObject* jsonObjectFromBinary( const char* data, size_t len, size_t* used );
 
 jsonObject* jsonObjectGetKey( jsonObject* obj, const char* key );
 
@@ -202,6 +393,8 @@ const char* jsonObjectGetString(const jsonObject*);
 
 double jsonObjectGetNumber( const jsonObject* obj );
 
+int64_t jsonObjectGetInt64( const jsonObject* obj );
+
 void jsonObjectSetString(jsonObject* dest, const char* string);
 
 void jsonObjectSetNumber(jsonObject* dest, double num);
@@ -210,6 +403,8 @@ int jsonObjectSetNumberString(jsonObject* dest, const char* string);
 
 void jsonObjectSetClass(jsonObject* dest, const char* classname );
 
+void jsonObjectSetClassInArena( osrfArena* arena, jsonObject* dest, const char* classname );
+
 const char* jsonObjectGetClass(const jsonObject* dest);
 
 int jsonBoolIsTrue( const jsonObject* boolObj );
@@ -218,6 +413,12 @@ void jsonSetBool(jsonObject* bl, int val);
 
 jsonObject* jsonObjectClone( const jsonObject* o );
 
+jsonObject* jsonObjectShare( const jsonObject* o );
+
+jsonObject* jsonObjectUnshare( jsonObject* o );
+
+int jsonObjectIsShared( const jsonObject* o );
+
 char* jsonObjectToSimpleString( const jsonObject* o );
 
 char* doubleToString( double num );
@@ -235,13 +436,27 @@ char* jsonScrubNumber( const char* s );
 
 	Example search path: /some/node/here.
 	
-	Every element in the path must be a proper object, a JSON_HASH.
+	Every element in the path must be a proper object, a JSON_HASH.  If the path leads
+	nowhere, the result is a JSON_NULL.
+
+	A path beginning with "//", such as //node/here, may start anywhere: the result is a
+	JSON_ARRAY of whatever the rest of the path finds under every member of the tree whose
+	key is the first element, with any JSON_ARRAYs among those results flattened into it.
+
+	Each distinct path is parsed only once per thread, as long as it stays among the most
+	recently used few.  To avoid even the cache lookup, see jsonPathCompile().
 
 	The calling code is responsible for freeing the jsonObject to which the returned pointer
 	points.
 */
 jsonObject* jsonObjectFindPath( const jsonObject* obj, const char* path, ... );
 
+jsonPath* jsonPathCompile( const char* path );
+
+jsonObject* jsonPathEval( const jsonPath* path, const jsonObject* obj );
+
+void jsonPathFree( jsonPath* path );
+
 
 /**
 	@brief Prettify a JSON string for printing, by adding newlines and other white space.
@@ -266,6 +481,14 @@ char* jsonFormatString( const char* jsonString );
  * JSON_CLASS_KEY and JSON_DATA_KEY
  * To revive a serialized object, simply call
  * jsonObjectDecodeClass()
+ *
+ * Both functions build a complete transformed copy of the tree.  When
+ * the copy is only going to be parsed or serialized, apply the
+ * transform on the fly instead:
+ *   jsonObjectToJSONRaw( jsonObjectEncodeClass( obj ) )  ->  jsonObjectToJSON( obj )
+ *   jsonObjectToJSONRaw( jsonObjectDecodeClass( obj ) )  ->  jsonObjectToJSONDecoded( obj )
+ *   jsonObjectDecodeClass( jsonParseRaw( str ) )         ->  jsonParse( str )
+ *   jsonObjectEncodeClass( jsonParse( str ) )            ->  jsonParseRaw( str )
  */
 
 
@@ -275,6 +498,12 @@ char* jsonFormatString( const char* jsonString );
  */ 
 jsonObject* jsonObjectDecodeClass( const jsonObject* obj );
 
+/* Like jsonObjectDecodeClass(), but returns a shared reference
+ * instead of a copy if there is nothing to decode
+ * Caller must free the returned object, and unshare it before changing it
+ */
+jsonObject* jsonObjectDecodeClassShared( const jsonObject* obj );
+
 
 /* Converts an object with a classname into a
  * class-wrapped (serialized) object
@@ -23,6 +23,11 @@ extern "C" {
  *	Generates an XML representation of a JSON object */
 char* jsonObjectToXML( const jsonObject*);
 
+/**
+ *	Generates the same XML as jsonObjectToXML(), delivering it
+ *	through a jsonSink as it goes */
+int jsonObjectToXMLSink( const jsonObject* obj, jsonSink* sink );
+
 
 /*
  * Builds a JSON object from the provided XML 
@@ -21,12 +21,18 @@
 	stored, treating it as disposable.  Conclusion: you can store NULLs in an osrfList, but
 	not safely, unless you are familiar with the internal details of the implementation and
 	work around them accordingly.
+
+	An osrfList created by osrfNewArenaList() draws its array from an osrfArena.  When it
+	grows, the old array is simply abandoned to the arena.  osrfListFree() does nothing with
+	such a list, not even call the freeItem callback; the memory goes away when the arena
+	is reset or freed.
  */
 
 #ifndef OSRF_LIST_H
 #define OSRF_LIST_H
 
 #include <opensrf/utils.h>
+#include <opensrf/osrf_arena.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -51,6 +57,8 @@ struct _osrfListStruct {
 	void** arrlist;
 	/** @brief Capacity of the currently allocated array. */
 	int arrsize;
+	/** @brief The osrfArena that owns the array and the list itself, if any; normally NULL. */
+	osrfArena* arena;
 };
 typedef struct _osrfListStruct osrfList;
 
@@ -68,6 +76,8 @@ typedef struct _osrfListIteratorStruct osrfListIterator;
 
 osrfList* osrfNewListSize( unsigned int size );
 
+osrfList* osrfNewArenaList( osrfArena* arena, unsigned int size );
+
 osrfListIterator* osrfNewListIterator( const osrfList* list );
 
 void* osrfListIteratorNext( osrfListIterator* itr );
@@ -11,6 +11,12 @@
 	transport_message, which (together with its JSON cargo) is translated into XML as
 	a Jabber message.
 
+	Alternatively, when the recipient has said that it can read them, the messages may
+	travel in a binary body: OSRF_BINARY_BODY_MARK, followed by one or more segments of
+	base64 text separated by commas.  Each segment decodes to a series of messages in
+	the encoding of jsonObjectToBinary().  A sender advertises that it can read binary
+	bodies by setting the "binary" member of its messages.
+
 	There are five kinds of messages:
 	- CONNECT -- request to establish a stateful session.
 	- DISCONNECT -- ends a stateful session.
@@ -56,6 +62,9 @@ extern "C" {
 #define OSRF_STATUS_VERSIONNOTSUPPORTED  505
 
 
+/** @brief First character of a message body in binary form, instead of '['. */
+#define OSRF_BINARY_BODY_MARK '!'
+
 enum M_TYPE { CONNECT, REQUEST, RESULT, STATUS, DISCONNECT };
 
 struct osrf_message_struct {
@@ -101,6 +110,9 @@ struct osrf_message_struct {
 
 	/** Magical TZ hint. */
 	char* sender_tz;
+
+	/** Boolean: true if the sender can read message bodies in binary form. */
+	int binary;
 };
 typedef struct osrf_message_struct osrfMessage;
 
@@ -137,6 +149,12 @@ osrfList* osrfMessageDeserialize( const char* string, osrfList* list );
 
 int osrf_message_deserialize(const char* json, osrfMessage* msgs[], int count);
 
+int osrf_message_deserialize_in_arena( const char* json, osrfMessage* msgs[], int count,
+		osrfArena* arena );
+
+int osrf_message_deserialize_in_situ( char* json, osrfMessage* msgs[], int count,
+		osrfArena* arena );
+
 void osrf_message_set_params( osrfMessage* msg, const jsonObject* o );
 
 void osrf_message_set_method( osrfMessage* msg, const char* method_name );
@@ -149,6 +167,8 @@ const jsonObject* osrfMessageGetResult( osrfMessage* msg );
 
 char* osrfMessageSerializeBatch( osrfMessage* msgs [], int count );
 
+char* osrfMessageSerializeBatchBinary( osrfMessage* msgs [], int count );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,46 @@
+/**
+	@file osrf_string_set.h
+	@brief Header for osrfStringSet, a set of strings with fast membership tests.
+
+	An osrfStringSet answers two questions in roughly constant time, no matter how many
+	strings it holds: is a given string a member, and is any member a prefix of a given
+	string?  The latter suits lists of method name prefixes, such as the log_protect list
+	in opensrf_core.xml.
+
+	Unlike an osrfStringArray, an osrfStringSet remembers no particular order, and holds
+	no duplicates.
+*/
+
+#ifndef OSRF_STRING_SET_H
+#define OSRF_STRING_SET_H
+
+#include <opensrf/string_array.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct _osrfStringSetStruct;
+typedef struct _osrfStringSetStruct osrfStringSet;
+
+osrfStringSet* osrfNewStringSet( void );
+
+osrfStringSet* osrfNewStringSetFromArray( const osrfStringArray* arr );
+
+void osrfStringSetAdd( osrfStringSet* set, const char* str );
+
+int osrfStringSetContains( const osrfStringSet* set, const char* str );
+
+int osrfStringSetContainsLen( const osrfStringSet* set, const char* str, size_t len );
+
+int osrfStringSetMatchPrefix( const osrfStringSet* set, const char* str );
+
+unsigned long osrfStringSetGetCount( const osrfStringSet* set );
+
+void osrfStringSetFree( osrfStringSet* set );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -12,6 +12,7 @@
 #include <opensrf/osrf_settings.h>
 #include <opensrf/osrfConfig.h>
 #include <opensrf/osrf_cache.h>
+#include <opensrf/osrf_string_set.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,6 +45,8 @@ int osrfSystemInitCache(void);
 
 extern osrfStringArray* log_protect_arr;
 
+extern osrfStringSet* log_protect_set;
+
 #ifdef __cplusplus
 }
 #endif
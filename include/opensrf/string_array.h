@@ -54,6 +54,10 @@ void osrfStringArrayFree( osrfStringArray* );
 
 void osrfStringArrayRemove( osrfStringArray* arr, const char* str );
 
+void osrfStringArrayClear( osrfStringArray* arr );
+
+void osrfStringArraySwap( osrfStringArray* one, osrfStringArray* two );
+
 osrfStringArray* osrfStringArrayTokenize( const char* src, char delim );
 
 #ifdef __cplusplus
@@ -297,7 +297,9 @@ void* safe_calloc(int size);
 	when the string gets too big for its buffer.
 
 	A growing_buffer is designed for text, not binary data.  In particular: if you
-	try to store embedded nuls in one, something bad will almost certainly happen.
+	try to store embedded nuls in one, something bad will almost certainly happen --
+	unless you add data only by buffer_add_n() or buffer_add_unbase64(), and measure
+	it only by buffer_length(), as jsonObjectToBinary() does.
 */
 struct growing_buffer_struct {
 	/** @brief Pointer to the internal buffer */
@@ -326,6 +328,10 @@ char* buffer_release( growing_buffer* gb );
 int buffer_free( growing_buffer* gb );
 int buffer_add_char(growing_buffer* gb, char c);
 char buffer_chomp(growing_buffer* gb); // removes the last character from the buffer
+int buffer_add_base64( growing_buffer* gb, const char* data, size_t len );
+int buffer_add_unbase64( growing_buffer* gb, const char* text, size_t len );
+int buffer_add_xml_escaped( growing_buffer* gb, const char* str, int attribute );
+int buffer_add_xml_escaped_n( growing_buffer* gb, const char* str, size_t len, int attribute );
 
 /*
 	returns the size needed to fill in the vsnprintf buffer.
@@ -383,6 +389,12 @@ int osrfUtilsCheckFileDescriptor( int fd );
 */
 size_t osrfXmlEscapingLength ( const char* str );
 
+/*
+	Returns how many leading bytes of a string fit within a limit
+	once XML-escaped, using the same weights as osrfXmlEscapingLength().
+*/
+size_t osrfXmlEscapeSpan( const char* str, size_t len, size_t limit, size_t* width );
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,12 +22,15 @@ GNU General Public License for more details.
 
 	Synopsis:
 
-		format_json  [ filename [ ... ] ]
+		format_json  [ -t ]  [ filename [ ... ] ]
 
 	Each command-line argument is the name of a file that format_json will read in turn
 	and format as JSON.  A single hyphen denotes standard input.  If no file is specified,
 	format_json reads standard input.
 
+	The -t option reports to standard error how many bytes were read and written, and how
+	fast.
+
 	The input file[s] may contain multiple JSON values, but a JSON value may not span more
 	than a single file.  In the output, successive JSON values are separated by blank lines.
 
@@ -43,6 +46,11 @@ GNU General Public License for more details.
 	for files that are too big to be loaded into memory at once.  To that end, the internal
 	logic is extensively commented.
 
+	Memory use doesn't depend on the size of the input.  A regular file is mapped into
+	memory and fed to the parser a window at a time, and each window is released once it
+	has been parsed; anything else, such as a pipe, is read in blocks.  Output accumulates
+	in a buffer, which is written out whenever it fills up.
+
 	Implementation details:
 
 	When using a stream parser it is almost always necessary to implement a finite state
@@ -72,10 +80,24 @@ GNU General Public License for more details.
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "opensrf/utils.h"
 #include "opensrf/osrf_utf8.h"
 #include "opensrf/jsonpush.h"
 
+/** How much of a mapped file to feed the parser at a time; a multiple of the page size. */
+#define MAP_WINDOW (1024 * 1024)
+
+/** How much to read at a time from a file that we can't map. */
+#define READ_SIZE (64 * 1024)
+
+/** How much output to accumulate before writing it. */
+#define OUTPUT_FLUSH (64 * 1024)
+
 /**
 	@brief Enumeration of states for a finite state automaton.
 */
@@ -105,14 +127,19 @@ typedef struct {
 	Context context;              /**< Current state. */
 	ContextNode* context_stack;   /**< Stack of previous states. */
 	int indent;                   /**< How many current levels of indentation. */
-	growing_buffer* buf;          /**< For formatting strings with escaped characters. */
+	growing_buffer* out;          /**< Formatted output not yet written. */
+	unsigned long long bytes_in;  /**< Total input so far. */
+	unsigned long long bytes_out; /**< Total output so far. */
 	JSONPushParser* parser;       /**< Points to the current parser. */
 } Formatter;
 
 static int format_file( Formatter* formatter, FILE* infile );
+static int format_mapped( Formatter* formatter, int fd, size_t size );
 static void install_parser( Formatter* formatter );
+static void write_output( Formatter* formatter );
+static void report_throughput( const Formatter* formatter, const struct timespec* start );
 
-static void indent( unsigned n );
+static void indent( Formatter* formatter, unsigned n );
 static int formatString( void* blob, const char* str );
 static int formatNumber( void* blob, const char* str );
 static int formatLeftBracket( void* blob );
@@ -140,6 +167,20 @@ static ContextNode* free_context = NULL;    // Free list for ContextNodes
 int main( int argc, char* argv[] ) {
 
 	int rc = EXIT_SUCCESS;
+	int report = 0;
+
+	int opt;
+	while( (opt = getopt( argc, argv, "t" )) != -1 ) {
+		if( 't' == opt )
+			report = 1;
+		else {
+			fprintf( stderr, "Usage: %s [ -t ] [ filename [ ... ] ]\n", argv[ 0 ] );
+			return EXIT_FAILURE;
+		}
+	}
+
+	struct timespec start;
+	clock_gettime( CLOCK_MONOTONIC, &start );
 
 	// Declare and initialize a Formatter
 	static Formatter formatter;
@@ -147,11 +188,13 @@ int main( int argc, char* argv[] ) {
 	formatter.context = CTX_OPEN;
 	formatter.context_stack = NULL;
 	formatter.indent = 0;
-	formatter.buf = buffer_init( 32 );
+	formatter.out = buffer_init( OUTPUT_FLUSH + 1024 );
+	formatter.bytes_in = 0;
+	formatter.bytes_out = 0;
 	install_parser( &formatter );
 
-	if( argc > 1 ) {
-		int i = 0;
+	if( optind < argc ) {
+		int i = optind - 1;
 		while( (++i < argc) && (0 == rc) ) {
 			// Iterate over the command line arguments.
 			// An argument "-" means to read standard input.
@@ -184,12 +227,17 @@ int main( int argc, char* argv[] ) {
 	} else {
 		// No command line arguments?  Read standard input.  Note that we don't have to
 		// reset the parser in this case, because we're only parsing once anyway.
-		format_file( &formatter, stdin );
+		if( format_file( &formatter, stdin ) )
+			rc = EXIT_FAILURE;
 	}
 
+	write_output( &formatter );
+	if( report )
+		report_throughput( &formatter, &start );
+
 	// Clean up the formatter
 	jsonPushParserFree( formatter.parser );
-	buffer_free( formatter.buf );
+	buffer_free( formatter.out );
 	while( formatter.context_stack )
 		pop_context( &formatter );
 
@@ -208,30 +256,113 @@ int main( int argc, char* argv[] ) {
 	@param formatter Pointer to the current Formatter.
 	@param infile Pointer to the input file.
 	@return 0 if successful, or 1 upon error.
+
+	If the file is a regular file, and we're at the beginning of it, let format_mapped()
+	map it into memory.  Otherwise, or if the mapping fails, read it in blocks.
 */
 static int format_file( Formatter* formatter, FILE* infile ) {
 
-	const int bufsize = 4096;
-	char buf[ bufsize ];
-	int num_read;
-	int rc = 0;
-
-	do {
-		num_read = fread( buf, 1, bufsize, infile );
-		if( num_read > 0 )
-			if( jsonPush( formatter->parser, buf, num_read ) )
-				rc = 1;
-	} while( num_read == bufsize && 0 == rc );
+	int rc = -1;
+	int fd = fileno( infile );
+	struct stat st;
+	if( fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) && st.st_size > 0
+			&& lseek( fd, 0, SEEK_CUR ) == 0 )
+		rc = format_mapped( formatter, fd, st.st_size );
+
+	if( -1 == rc ) {
+		// Couldn't map it; read it instead
+		static char buf[ READ_SIZE ];
+		size_t num_read;
+		rc = 0;
+
+		do {
+			num_read = fread( buf, 1, READ_SIZE, infile );
+			formatter->bytes_in += num_read;
+			if( num_read > 0 )
+				if( jsonPush( formatter->parser, buf, num_read ) )
+					rc = 1;
+		} while( num_read == READ_SIZE && 0 == rc );
+	}
 
 	if( jsonPushParserFinish( formatter->parser ) )
 		rc = 1;
 
-	if( rc )
+	if( rc ) {
+		write_output( formatter );
 		fprintf( stderr, "\nError found in JSON file\n" );
+	}
+
+	return rc;
+}
+
+/**
+	@brief Map a file into memory and feed it to the parser.
+	@param formatter Pointer to the current Formatter.
+	@param fd File descriptor of the input file.
+	@param size Size of the input file.
+	@return 0 if successful, 1 upon a JSON error, or -1 if we couldn't map the file.
+
+	We map the whole file at once, but feed it to the parser a window at a time.  After
+	each window, we tell the kernel that we're done with it, so that it can drop the pages.
+	Hence memory use stays the same no matter how big the file is.
+*/
+static int format_mapped( Formatter* formatter, int fd, size_t size ) {
 
+	char* map = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if( MAP_FAILED == map )
+		return -1;
+	madvise( map, size, MADV_SEQUENTIAL );
+
+	int rc = 0;
+	size_t offset = 0;
+	while( offset < size && 0 == rc ) {
+		size_t len = size - offset;
+		if( len > MAP_WINDOW )
+			len = MAP_WINDOW;
+
+		if( jsonPush( formatter->parser, map + offset, len ) )
+			rc = 1;
+		madvise( map + offset, len, MADV_DONTNEED );
+
+		formatter->bytes_in += len;
+		offset += len;
+	}
+
+	munmap( map, size );
 	return rc;
 }
 
+/**
+	@brief Write whatever output has accumulated.
+	@param formatter Pointer to the current Formatter.
+*/
+static void write_output( Formatter* formatter ) {
+	growing_buffer* out = formatter->out;
+	if( out->n_used ) {
+		fwrite( out->buf, 1, out->n_used, stdout );
+		formatter->bytes_out += out->n_used;
+		out->n_used = 0;
+		out->buf[ 0 ] = '\0';
+	}
+	fflush( stdout );
+}
+
+/**
+	@brief Report to standard error how much we read and wrote, and how fast.
+	@param formatter Pointer to the current Formatter.
+	@param start When we started.
+*/
+static void report_throughput( const Formatter* formatter, const struct timespec* start ) {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	double seconds = ( now.tv_sec - start->tv_sec ) + ( now.tv_nsec - start->tv_nsec ) / 1e9;
+	double mb = formatter->bytes_in / ( 1024.0 * 1024.0 );
+
+	fprintf( stderr, "%llu bytes in, %llu bytes out, %.3f seconds, %.1f MB/s\n",
+		formatter->bytes_in, formatter->bytes_out, seconds,
+		seconds > 0 ? mb / seconds : 0.0 );
+}
+
 /**
 	@brief Create a JSONPushParser and install it in a Formatter.
 	@param formatter Pointer to the Formatter in which the parser is to be installed.
@@ -275,18 +406,17 @@ static void install_parser( Formatter* formatter ) {
 static int formatString( void* blob, const char* str ) {
 	Formatter* formatter = (Formatter*) blob;
 	if( CTX_ARRAY == formatter->context )
-		printf( ",\n" );
+		OSRF_BUFFER_ADD( formatter->out, ",\n" );
 	else if( formatter->context != CTX_OBJ_KEY )
-		printf( "\n" );
+		OSRF_BUFFER_ADD_CHAR( formatter->out, '\n' );
 
 	if( formatter->context != CTX_OBJ_KEY )
-		indent( formatter->indent );
+		indent( formatter, formatter->indent );
 
 	// Escape characters as needed
-	buffer_reset( formatter->buf );
-	buffer_append_utf8( formatter->buf, str );
-
-	printf( "\"%s\"", OSRF_BUFFER_C_STR( formatter->buf ) );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, '\"' );
+	buffer_append_utf8( formatter->out, str );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, '\"' );
 
 	// Pick the next state
 	if( CTX_ARRAY_BEGIN == formatter->context )
@@ -310,14 +440,14 @@ static int formatString( void* blob, const char* str ) {
 static int formatNumber( void* blob, const char* str ) {
 	Formatter* formatter = (Formatter*) blob;
 	if( CTX_ARRAY == formatter->context )
-		printf( ",\n" );
+		OSRF_BUFFER_ADD( formatter->out, ",\n" );
 	else if( formatter->context != CTX_OBJ_KEY )
-		printf( "\n" );
+		OSRF_BUFFER_ADD_CHAR( formatter->out, '\n' );
 
 	if( formatter->context != CTX_OBJ_KEY )
-		indent( formatter->indent );
+		indent( formatter, formatter->indent );
 
-	printf( "%s", str );
+	buffer_add( formatter->out, str );
 
 	// Pick the next state
 	if( CTX_ARRAY_BEGIN == formatter->context )
@@ -340,10 +470,10 @@ static int formatNumber( void* blob, const char* str ) {
 static int formatLeftBracket( void* blob ) {
 	Formatter* formatter = blob;
 	if( CTX_ARRAY == formatter->context || CTX_OBJ == formatter->context )
-		printf( "," );
-	printf( "\n" );
-	indent( formatter->indent++ );
-	printf( "[" );
+		OSRF_BUFFER_ADD_CHAR( formatter->out, ',' );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, '\n' );
+	indent( formatter, formatter->indent++ );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, '[' );
 
 	// Pick the state to return to when we close the array.
 	if( CTX_ARRAY_BEGIN == formatter->context )
@@ -367,9 +497,9 @@ static int formatLeftBracket( void* blob ) {
 */
 static int formatRightBracket( void* blob ) {
 	Formatter* formatter = blob;
-	printf( "\n" );
-	indent( --formatter->indent );
-	printf( "]" );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, '\n' );
+	indent( formatter, --formatter->indent );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, ']' );
 
 	pop_context( formatter );
 	return 0;
@@ -387,10 +517,10 @@ static int formatRightBracket( void* blob ) {
 static int formatLeftBrace( void* blob ) {
 	Formatter* formatter = blob;
 	if( CTX_ARRAY == formatter->context || CTX_OBJ == formatter->context )
-		printf( "," );
-	printf( "\n" );
-	indent( formatter->indent++ );
-	printf( "{" );
+		OSRF_BUFFER_ADD_CHAR( formatter->out, ',' );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, '\n' );
+	indent( formatter, formatter->indent++ );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, '{' );
 
 	// Pick the state to return to when we close the object.
 	if( CTX_ARRAY_BEGIN == formatter->context )
@@ -414,9 +544,9 @@ static int formatLeftBrace( void* blob ) {
 */
 static int formatRightBrace( void* blob ) {
 	Formatter* formatter = blob;
-	printf( "\n" );
-	indent( --formatter->indent );
-	printf( "}" );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, '\n' );
+	indent( formatter, --formatter->indent );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, '}' );
 
 	pop_context( formatter );
 	return 0;
@@ -436,16 +566,15 @@ static int formatRightBrace( void* blob ) {
 static int formatKey( void* blob, const char* str ) {
 	Formatter* formatter = blob;
 	if( CTX_OBJ == formatter->context )
-		printf( ",\n" );
+		OSRF_BUFFER_ADD( formatter->out, ",\n" );
 	else
-		printf( "\n" );
-	indent( formatter->indent );
+		OSRF_BUFFER_ADD_CHAR( formatter->out, '\n' );
+	indent( formatter, formatter->indent );
 
 	// Escape characters as needed
-	buffer_reset( formatter->buf );
-	buffer_append_utf8( formatter->buf, str );
-
-	printf( "\"%s\" : ", OSRF_BUFFER_C_STR( formatter->buf ) );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, '\"' );
+	buffer_append_utf8( formatter->out, str );
+	OSRF_BUFFER_ADD( formatter->out, "\" : " );
 
 	formatter->context = CTX_OBJ_KEY;
 	return 0;
@@ -464,14 +593,14 @@ static int formatKey( void* blob, const char* str ) {
 static int formatBool( void* blob, int b ) {
 	Formatter* formatter = (Formatter*) blob;
 	if( CTX_ARRAY == formatter->context )
-		printf( ",\n" );
+		OSRF_BUFFER_ADD( formatter->out, ",\n" );
 	else if( formatter->context != CTX_OBJ_KEY )
-		printf( "\n" );
+		OSRF_BUFFER_ADD_CHAR( formatter->out, '\n' );
 
 	if( formatter->context != CTX_OBJ_KEY )
-		indent( formatter->indent );
+		indent( formatter, formatter->indent );
 
-	printf( "%s", b ? "true" : "false" );
+	OSRF_BUFFER_ADD( formatter->out, b ? "true" : "false" );
 
 	// Pick the next state.
 	if( CTX_ARRAY_BEGIN == formatter->context )
@@ -494,14 +623,14 @@ static int formatBool( void* blob, int b ) {
 static int formatNull( void* blob ) {
 	Formatter* formatter = (Formatter*) blob;
 	if( CTX_ARRAY == formatter->context )
-		printf( ",\n" );
+		OSRF_BUFFER_ADD( formatter->out, ",\n" );
 	else if( formatter->context != CTX_OBJ_KEY )
-		printf( "\n" );
+		OSRF_BUFFER_ADD_CHAR( formatter->out, '\n' );
 
 	if( formatter->context != CTX_OBJ_KEY )
-		indent( formatter->indent );
+		indent( formatter, formatter->indent );
 
-	printf( "null" );
+	OSRF_BUFFER_ADD( formatter->out, "null" );
 
 	if( CTX_ARRAY_BEGIN == formatter->context )
 		formatter->context = CTX_ARRAY;
@@ -527,7 +656,7 @@ static int formatNull( void* blob ) {
 static void formatEnd( void* blob ) {
 	Formatter* formatter = blob;
 	jsonPushParserResume( formatter->parser );
-	printf( "\n" );
+	OSRF_BUFFER_ADD_CHAR( formatter->out, '\n' );
 }
 
 /**
@@ -544,6 +673,7 @@ static void formatEnd( void* blob ) {
 */
 static void show_error( void* blob, const char* msg, unsigned line, unsigned pos ) {
 	Formatter* formatter = (Formatter*) blob;
+	write_output( formatter );
 	const char* filename = formatter->filename;
 	if( !filename )
 		filename = "standard input";
@@ -553,12 +683,23 @@ static void show_error( void* blob, const char* msg, unsigned line, unsigned pos
 
 /**
 	@brief Write a specified number of indents, four spaces per indent.
+	@param formatter Pointer to the current Formatter.
 	@param n How many indents to write.
+
+	Every line of output but the first starts with an indent, so this is also a convenient
+	place to write out the output buffer when it gets full.
 */
-static void indent( unsigned n ) {
+static void indent( Formatter* formatter, unsigned n ) {
+	static const char spaces[] = "                                                                ";
+	const unsigned per_chunk = ( sizeof( spaces ) - 1 ) / 4;
+
+	if( formatter->out->n_used >= OUTPUT_FLUSH )
+		write_output( formatter );
+
 	while( n ) {
-		printf( "    " );
-		--n;
+		unsigned chunk = n < per_chunk ? n : per_chunk;
+		buffer_add_n( formatter->out, spaces, chunk * 4 );
+		n -= chunk;
 	}
 }
 
@@ -100,6 +100,14 @@ static void osrf_json_gateway_child_init(apr_pool_t *p, server_rec *s) {
 	//apr_pool_cleanup_register(p, NULL, child_exit, apr_pool_cleanup_null);
 }
 
+/* jsonSinkWriter that streams serialized output to the client */
+static long osrf_json_gateway_write( void* userdata, const char* data, size_t len ) {
+	request_rec* r = userdata;
+	if( ap_rwrite( data, (int) len, r ) < 0 )
+		return -1;
+	return (long) len;
+}
+
 static int osrf_json_gateway_method_handler (request_rec *r) {
 
 	/* make sure we're needed first thing*/
@@ -302,18 +310,9 @@ static int osrf_json_gateway_method_handler (request_rec *r) {
 #endif
 
 		const char* str; int i = 0;
-		int redact_params = 0;
-		while( (str = osrfStringArrayGetString(log_protect_arr, i++)) ) {
-			//osrfLogInternal(OSRF_LOG_MARK, "Checking for log protection [%s]", str);
-			if(!strncmp(method, str, strlen(str))) {
-				redact_params = 1;
-				break;
-			}
-		}
-		if(redact_params) {
+		if(osrfStringSetMatchPrefix(log_protect_set, method)) {
 			OSRF_BUFFER_ADD(act, " **PARAMS REDACTED**");
 		} else {
-			i = 0;
 			while( (str = osrfStringArrayGetString(mparams, i++)) ) {
 				if( i == 1 ) {
 					OSRF_BUFFER_ADD(act, " ");
@@ -345,6 +344,11 @@ static int osrf_json_gateway_method_handler (request_rec *r) {
 		char* statusname    = NULL;
 		char* statustext    = NULL;
 		char* output        = NULL;
+		jsonSink* xml_sink  = NULL;
+
+		/* XML results are streamed to the client as they are generated */
+		if (isXML)
+			xml_sink = jsonNewSink( 0, osrf_json_gateway_write, r );
 
 		while((omsg = osrfAppSessionRequestRecv( session, req_id, timeout ))) {
 
@@ -354,13 +358,14 @@ static int osrf_json_gateway_method_handler (request_rec *r) {
 			if( ( res = osrfMessageGetResult(omsg)) ) {
 
 				if (isXML) {
-					output = jsonObjectToXML( res );
+					jsonObjectToXMLSink( res, xml_sink );
+					jsonSinkFlush( xml_sink );
 				} else {
 					output = jsonToStringFunc( res );
 					if( morethan1 ) ap_rputs(",", r); /* comma between JSON array items */
+					ap_rputs(output, r);
+					free(output);
 				}
-				ap_rputs(output, r);
-				free(output);
 				morethan1 = 1;
 
 			} else {
@@ -378,6 +383,8 @@ static int osrf_json_gateway_method_handler (request_rec *r) {
 			if(statusname) break;
 		}
 
+		jsonSinkFree( xml_sink );
+
 		double duration = get_timestamp_millis() - starttime;
 		osrfLogDebug(OSRF_LOG_MARK, "gateway request took %f seconds", duration);
 
@@ -79,6 +79,7 @@
 #include "websocket_plugin.h"
 #include "opensrf/log.h"
 #include "opensrf/osrf_json.h"
+#include "opensrf/osrf_utf8.h"
 #include "opensrf/transport_client.h"
 #include "opensrf/transport_message.h"
 #include "opensrf/osrf_system.h"                                                
@@ -232,30 +233,64 @@ static void clear_cached_recipient(const char* thread) {
     }
 }
 
+/**
+ * Append a string to a buffer as a JSON string literal, or append
+ * null if there is no string.
+ */
+static void append_json_string(growing_buffer *buf, const char *str) {
+    if (str) {
+        OSRF_BUFFER_ADD_CHAR(buf, '"');
+        buffer_append_utf8(buf, str);
+        OSRF_BUFFER_ADD_CHAR(buf, '"');
+    } else {
+        OSRF_BUFFER_ADD(buf, "null");
+    }
+}
+
 void* osrf_responder_thread_main_body(transport_message *tmsg) {
 
-    osrfList *msg_list = NULL;
-    osrfMessage *one_msg = NULL;
+    jsonTape *tape = NULL;
+    int one_msg = -1;
     int i;
+    unsigned long num_msgs;
 
     osrfLogDebug(OSRF_LOG_MARK, 
         "WS received opensrf response for thread=%s", tmsg->thread);
 
-    // first we need to perform some maintenance
-    msg_list = osrfMessageDeserialize(tmsg->body, NULL);
+    // first we need to perform some maintenance.  We only need a few
+    // fields from each message, and we pass the body along verbatim,
+    // so index it rather than parsing it into jsonObjects.
+    tape = jsonTapeParse(tmsg->body);
+    num_msgs = jsonTapeSize(tape, 0);
+
+    for (i = 0; i < num_msgs; i++) {
+        one_msg = jsonTapeGetIndex(tape, 0, i);
+
+        const char *class = jsonTapeGetClass(tape, one_msg);
+        if (!class || strcmp(class, "osrfMessage"))
+            continue;
 
-    for (i = 0; i < msg_list->size; i++) {
-        one_msg = OSRF_LIST_GET_INDEX(msg_list, i);
+        const char *type = 
+            jsonTapeGetString(tape, jsonTapeGetKey(tape, one_msg, "type"));
 
         osrfLogDebug(OSRF_LOG_MARK, 
-            "WS returned response of type %d", one_msg->m_type);
+            "WS returned response of type %s", type ? type : "CONNECT");
 
         /*  if our client just successfully connected to an opensrf service,
             cache the sender so that future calls on this thread will use
             the correct recipient. */
-        if (one_msg && one_msg->m_type == STATUS) {
+        if (type && !strcmp(type, "STATUS")) {
+
+            int payload = jsonTapeGetKey(tape, one_msg, "payload");
+            int code_node = jsonTapeGetKey(tape, payload, "statusCode");
+            const char *code = jsonTapeGetString(tape, code_node);
+            int status_code = 0;
+            if (code) {
+                status_code = jsonTapeType(tape, code_node) == JSON_NUMBER ?
+                    (int) strtod(code, NULL) : atoi(code);
+            }
 
-            if (one_msg->status_code == OSRF_STATUS_OK) {
+            if (status_code == OSRF_STATUS_OK) {
 
                 if (!apr_hash_get(trans->stateful_session_cache, 
                         tmsg->thread, APR_HASH_KEY_STRING)) {
@@ -286,47 +321,47 @@ void* osrf_responder_thread_main_body(transport_message *tmsg) {
             } else {
 
                 // connection timed out; clear the cached recipient
-                if (one_msg->status_code == OSRF_STATUS_TIMEOUT) {
+                if (status_code == OSRF_STATUS_TIMEOUT) {
                     clear_cached_recipient(tmsg->thread);
 
                 } else {
-                    if (one_msg->status_code == OSRF_STATUS_COMPLETE)
+                    if (status_code == OSRF_STATUS_COMPLETE)
                         requests_in_flight--;
                 }
             }
         }
     }
 
-    // osrfMessageDeserialize applies the freeItem handler to the 
-    // newly created osrfList.  We only need to free the list and 
-    // the individual osrfMessage's will be freed along with it
-    osrfListFree(msg_list);
-    
-    // relay the response messages to the client
-    jsonObject *msg_wrapper = NULL;
-    char *msg_string = NULL;
-
-    // build the wrapper object
-    msg_wrapper = jsonNewObject(NULL);
-    jsonObjectSetKey(msg_wrapper, "thread", jsonNewObject(tmsg->thread));
-    jsonObjectSetKey(msg_wrapper, "log_xid", jsonNewObject(tmsg->osrf_xid));
-    jsonObjectSetKey(msg_wrapper, "osrf_msg", jsonParseRaw(tmsg->body));
+    // relay the response messages to the client, wrapping
+    // the original message body without re-serializing it
+    size_t body_len = 0;
+    const char *body = jsonTapeText(tape, 0, &body_len);
+    growing_buffer *msg_buf = buffer_init(body_len + 256);
+
+    OSRF_BUFFER_ADD(msg_buf, "{\"thread\":");
+    append_json_string(msg_buf, tmsg->thread);
+    OSRF_BUFFER_ADD(msg_buf, ",\"log_xid\":");
+    append_json_string(msg_buf, tmsg->osrf_xid);
+    OSRF_BUFFER_ADD(msg_buf, ",\"osrf_msg\":");
+    if (body)
+        buffer_add_n(msg_buf, body, body_len);
+    else
+        OSRF_BUFFER_ADD(msg_buf, "null");
 
     if (tmsg->is_error) {
         osrfLogError(OSRF_LOG_MARK, 
             "WS received jabber error message in response to thread=%s", 
             tmsg->thread);
-        jsonObjectSetKey(msg_wrapper, "transport_error", jsonNewBoolObject(1));
+        OSRF_BUFFER_ADD(msg_buf, ",\"transport_error\":true");
     }
-
-    msg_string = jsonObjectToJSONRaw(msg_wrapper);
+    OSRF_BUFFER_ADD_CHAR(msg_buf, '}');
 
     // drop the JSON on the outbound wire
     trans->server->send(trans->server, MESSAGE_TYPE_TEXT, 
-        (unsigned char*) msg_string, strlen(msg_string));
+        (unsigned char*) OSRF_BUFFER_C_STR(msg_buf), msg_buf->n_used);
 
-    free(msg_string);
-    jsonObjectFree(msg_wrapper);
+    buffer_free(msg_buf);
+    jsonTapeFree(tape);
 }
 
 /**
@@ -760,18 +795,9 @@ static char* extract_inbound_messages(
 
                 const jsonObject* obj = NULL;
                 int i = 0;
-                const char* str;
-                int redactParams = 0;
-                while( (str = osrfStringArrayGetString(log_protect_arr, i++)) ) {
-                    if(!strncmp(method, str, strlen(str))) {
-                        redactParams = 1;
-                        break;
-                    }
-                }
-                if(redactParams) {
+                if(osrfStringSetMatchPrefix(log_protect_set, method)) {
                     OSRF_BUFFER_ADD(act, " **PARAMS REDACTED**");
                 } else {
-                    i = 0;
                     while((obj = jsonObjectGetIndex(params, i++))) {
                         char* str = jsonObjectToJSON(obj);
                         if( i == 1 )
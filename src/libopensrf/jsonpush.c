@@ -120,6 +120,8 @@ static void push_pp_state( JSONPushParser* parser, PPState state );
 static void pop_pp_state( JSONPushParser* parser );
 static void check_pp_end( JSONPushParser* parser );
 static void report_pp_error( JSONPushParser* parser, const char* msg, ... );
+static size_t plain_run( const char* str, size_t length );
+static inline void reset_buf( JSONPushParser* parser );
 
 /**
 	@brief Create a new JSONPushParser.
@@ -158,13 +160,19 @@ JSONPushParser* jsonNewPushParser( const JSONHandlerMap* map, void* blob )
 
 	This function makes it possible to reuse the same parser for multiple documents, e.g.
 	multiple input files, without having to destroy and recreate it.  The expectation is
-	that it be called after jsonPush() returns.
+	that it be called after jsonPush() returns, possibly in the middle of a document that
+	will never be finished.
 */
 void jsonPushParserReset( JSONPushParser* parser ) {
 	if( parser ) {
+		// Discard any levels of nesting left over from an incomplete document
+		while( parser->state_stack )
+			pop_pp_state( parser );
+		osrfStringArrayClear( parser->keylist );
 		parser->line = 1;
 		parser->pos = 1;
 		parser->state = PP_BEGIN;
+		parser->again = '\0';
 	}
 }
 
@@ -356,8 +364,23 @@ int jsonPush( JSONPushParser* parser, const char* str, size_t length ) {
 
 	int rc = 0;
 	// Loop through the chunk
-	int i = 0;
-	while( str[i] && i < length && parser->state != PP_ERROR ) {
+	size_t i = 0;
+	while( i < length && str[i] && parser->state != PP_ERROR ) {
+		if( PP_STR == parser->state && ! parser->again ) {
+			// Copy a run of ordinary characters in one go
+			size_t run = plain_run( str + i, length - i );
+			if( run ) {
+				buffer_add_n( parser->buf, str + i, run );
+				parser->pos += run;
+				i += run;
+				if( i < length && '\n' == str[i] ) {
+					++parser->line;
+					parser->pos = 0;
+				}
+				continue;
+			}
+		}
+
 		// branch on the current parser state
 		switch( parser->state ) {
 			case PP_BEGIN :
@@ -421,7 +444,7 @@ int jsonPush( JSONPushParser* parser, const char* str, size_t length ) {
 		else {
 			// Advance to the next character
 			++i;
-			if( '\n' == str[i] ) {
+			if( i < length && '\n' == str[i] ) {
 				++parser->line;
 				parser->pos = 0;
 			} else
@@ -451,7 +474,7 @@ static int do_begin( JSONPushParser* parser, char c ) {
 	if( isspace( (unsigned char) c ) )   // skip white space
 		;
 	else if( '\"' == c ) {         // Found a string
-		buffer_reset( parser->buf );
+		reset_buf( parser );
 		push_pp_state( parser, PP_END );
 		parser->state = PP_STR;
 	} else if( '[' == c ) {        // Found an array
@@ -483,7 +506,7 @@ static int do_begin( JSONPushParser* parser, char c ) {
 			   || '.' == c
 			   || 'e' == c
 			   || 'E' == c ) {      // Found a number
-		buffer_reset( parser->buf );
+		reset_buf( parser );
 		buffer_add_char( parser->buf, c );
 		push_pp_state( parser, PP_END );
 		parser->state = PP_NUM;
@@ -528,9 +551,9 @@ static int do_str    ( JSONPushParser* parser, char c ) {
 		}
 	} else if( '\\' == c ) {
 		parser->state = PP_SLASH;       // Handle an escaped special character
-	} else if( iscntrl( (unsigned char) c ) || ! isprint( (unsigned char) c ) ) {
+	} else if( (unsigned char) c < 0x20 ) {
 		report_pp_error( parser, "Illegal character 0x%02X in string literal",
-			(unsigned int) c );
+			(unsigned int) (unsigned char) c );
 		rc = 1;
 	} else {
 		buffer_add_char( parser->buf, c );
@@ -736,7 +759,7 @@ static int do_array_begin( JSONPushParser* parser, char c ) {
 	if( isspace( (unsigned char) c ) )   // skip white space
 		;
 	else if( '\"' == c ) {    // Found a string
-		buffer_reset( parser->buf );
+		reset_buf( parser );
 		push_pp_state( parser, PP_ARRAY_VALUE );
 		parser->state = PP_STR;
 	} else if( '[' == c ) {     // Found a nested array
@@ -773,7 +796,7 @@ static int do_array_begin( JSONPushParser* parser, char c ) {
 				|| '.' == c
 				|| 'e' == c
 				|| 'E' == c ) {
-		buffer_reset( parser->buf );
+		reset_buf( parser );
 		buffer_add_char( parser->buf, c );
 		push_pp_state( parser, PP_ARRAY_VALUE );
 		parser->state = PP_NUM;
@@ -828,7 +851,7 @@ static int do_array_comma( JSONPushParser* parser, char c ) {
 	if( isspace( (unsigned char) c ) )   // skip white space
 		;
 	else if( '\"' == c ) {    // Found a string
-		buffer_reset( parser->buf );
+		reset_buf( parser );
 		push_pp_state( parser, PP_ARRAY_VALUE );
 		parser->state = PP_STR;
 	} else if( '[' == c ) {     // Found a nested array
@@ -860,7 +883,7 @@ static int do_array_comma( JSONPushParser* parser, char c ) {
 				|| '.' == c
 				|| 'e' == c
 				|| 'E' == c ) {
-		buffer_reset( parser->buf );
+		reset_buf( parser );
 		buffer_add_char( parser->buf, c );
 		push_pp_state( parser, PP_ARRAY_VALUE );
 		parser->state = PP_NUM;
@@ -886,7 +909,7 @@ static int do_obj_begin( JSONPushParser* parser, char c ) {
 	if( isspace( (unsigned char) c ) )   // skip white space
 		;
 	else if( '\"' == c ) {    // Found a string
-		buffer_reset( parser->buf );
+		reset_buf( parser );
 		push_pp_state( parser, PP_OBJ_KEY );
 		parser->state = PP_STR;
 	} else if( '}' == c ) {     // End of object
@@ -939,7 +962,7 @@ static int do_obj_colon( JSONPushParser* parser, char c ) {
 	if( isspace( (unsigned char) c ) )   // skip white space
 		;
 	else if( '\"' == c ) {    // Found a string
-		buffer_reset( parser->buf );
+		reset_buf( parser );
 		push_pp_state( parser, PP_OBJ_VALUE );
 		parser->state = PP_STR;
 	} else if( '[' == c ) {     // Found a nested array
@@ -971,7 +994,7 @@ static int do_obj_colon( JSONPushParser* parser, char c ) {
 				|| '.' == c
 				|| 'e' == c
 				|| 'E' == c ) {
-		buffer_reset( parser->buf );
+		reset_buf( parser );
 		buffer_add_char( parser->buf, c );
 		push_pp_state( parser, PP_OBJ_VALUE );
 		parser->state = PP_NUM;
@@ -1026,7 +1049,7 @@ static int do_obj_comma( JSONPushParser* parser, char c ) {
 	if( isspace( (unsigned char) c ) )   // skip white space
 		;
 	else if( '\"' == c ) {    // Found a string
-		buffer_reset( parser->buf );
+		reset_buf( parser );
 		push_pp_state( parser, PP_OBJ_KEY );
 		parser->state = PP_STR;
 	} else {
@@ -1182,6 +1205,39 @@ static int do_end( JSONPushParser* parser, char c ) {
 
 // -------- End of state handlers --------------------------
 
+/**
+	@brief Measure a run of characters that can go into a string literal as they are.
+	@param str Pointer to the current position within a string literal.
+	@param length Number of characters available at @a str.
+	@return Number of leading characters that are neither quotation marks, backslashes,
+		nor control characters.
+
+	This lets jsonPush() copy most of a string literal in bulk rather than a character
+	at a time.
+*/
+static size_t plain_run( const char* str, size_t length ) {
+	size_t n = 0;
+	while( n < length ) {
+		unsigned char c = (unsigned char) str[ n ];
+		if( '"' == c || '\\' == c || c < 0x20 )
+			break;
+		++n;
+	}
+	return n;
+}
+
+/**
+	@brief Empty the working buffer.
+	@param parser Pointer to the current JSONPushParser.
+
+	We empty the buffer directly rather than call buffer_reset(), which would fill the
+	whole buffer -- however big it has grown -- for every token.
+*/
+static inline void reset_buf( JSONPushParser* parser ) {
+	parser->buf->n_used = 0;
+	parser->buf->buf[ 0 ] = '\0';
+}
+
 /**
 	@brief Push the current parser state onto a stack.
 	@param parser Pointer to the current JSONPushParser.
@@ -1279,3 +1335,307 @@ void jsonPushParserFree( JSONPushParser* parser ) {
 		free( parser );
 	}
 }
+
+// -------- Tree builder --------------------------
+
+/**
+	@brief One level of nesting in a JSONPushBuilder: a container under construction.
+*/
+typedef struct {
+	jsonObject* obj;    /**< The JSON_ARRAY or JSON_HASH being populated. */
+	char* key;          /**< Key for the next member, if @a obj is a JSON_HASH. */
+} BuildFrame;
+
+/**
+	@brief Builds a jsonObject tree from the callbacks of a JSONPushParser.
+
+	Containers are kept on a stack of their own until they are closed, and only then are
+	attached to their parents.  By then we know whether a JSON_HASH is really a class
+	hint, and can collapse it before anybody sees it.
+*/
+struct JSONPushBuilderStruct {
+	JSONPushParser* parser;   /**< The parser doing the tokenizing. */
+	int decode;               /**< Boolean; true if we decode class hints. */
+	int error;                /**< Boolean; true if anything has gone wrong. */
+	jsonObject* root;         /**< The finished value, once there is one. */
+	BuildFrame* frames;       /**< Stack of open containers. */
+	size_t depth;             /**< Number of open containers. */
+	size_t capacity;          /**< Number of BuildFrames allocated. */
+};
+
+static int build_add_value( JSONPushBuilder* builder, jsonObject* obj );
+static int build_begin( JSONPushBuilder* builder, int type );
+static jsonObject* build_decode_class( jsonObject* hash );
+static void build_clear( JSONPushBuilder* builder );
+
+static int build_string( void* blob, const char* str );
+static int build_number( void* blob, const char* str );
+static int build_begin_array( void* blob );
+static int build_end_array( void* blob );
+static int build_begin_obj( void* blob );
+static int build_obj_key( void* blob, const char* key );
+static int build_end_obj( void* blob );
+static int build_bool( void* blob, int b );
+static int build_null( void* blob );
+static void build_error( void* blob, const char* msg, unsigned line, unsigned pos );
+
+/** @brief The callbacks through which a JSONPushBuilder hears from its parser. */
+static const JSONHandlerMap build_handlers = {
+	build_string,
+	build_number,
+	build_begin_array,
+	build_end_array,
+	build_begin_obj,
+	build_obj_key,
+	build_end_obj,
+	build_bool,
+	build_null,
+	NULL,
+	build_error
+};
+
+/**
+	@brief Create a new JSONPushBuilder.
+	@param decode Boolean; true if the builder should decode class hints the way
+		jsonParse() does, or false if it should leave them alone the way jsonParseRaw() does.
+	@return A pointer to the new builder.
+
+	The calling code is responsible for freeing the builder by calling jsonPushBuilderFree().
+*/
+JSONPushBuilder* jsonNewPushBuilder( int decode ) {
+	JSONPushBuilder* builder = safe_malloc( sizeof( JSONPushBuilder ) );
+	builder->parser   = jsonNewPushParser( &build_handlers, builder );
+	builder->decode   = decode;
+	builder->error    = 0;
+	builder->root     = NULL;
+	builder->frames   = NULL;
+	builder->depth    = 0;
+	builder->capacity = 0;
+	return builder;
+}
+
+/**
+	@brief Feed the next chunk of JSON text to a JSONPushBuilder.
+	@param builder Pointer to the JSONPushBuilder.
+	@param str Pointer to the chunk of JSON.
+	@param length Length of the chunk.
+	@return 0 if successful, or 1 upon error.
+
+	The chunk may begin and end anywhere, even in the middle of a token.  Once this
+	function returns, the builder no longer needs the chunk, and the caller may discard it.
+
+	After an error, the builder ignores further input until it is reset.
+*/
+int jsonPushBuilderPush( JSONPushBuilder* builder, const char* str, size_t length ) {
+	if( !builder )
+		return 1;
+	if( builder->error )
+		return 1;
+	if( jsonPush( builder->parser, str, length ) )
+		builder->error = 1;
+	return builder->error;
+}
+
+/**
+	@brief Tell a JSONPushBuilder that there is no more input, and collect the result.
+	@param builder Pointer to the JSONPushBuilder.
+	@return A pointer to the resulting jsonObject, or NULL upon error.
+
+	The calling code is responsible for freeing the resulting jsonObject.  Either way, the
+	builder is reset, and may be used for another JSON value.
+*/
+jsonObject* jsonPushBuilderFinish( JSONPushBuilder* builder ) {
+	if( !builder )
+		return NULL;
+
+	jsonObject* result = NULL;
+	if( !builder->error && !jsonPushParserFinish( builder->parser )
+			&& !builder->error && 0 == builder->depth ) {
+		result = builder->root;
+		builder->root = NULL;
+	}
+
+	jsonPushBuilderReset( builder );
+	return result;
+}
+
+/**
+	@brief Discard whatever a JSONPushBuilder has built so far, and start over.
+	@param builder Pointer to the JSONPushBuilder.
+*/
+void jsonPushBuilderReset( JSONPushBuilder* builder ) {
+	if( builder ) {
+		build_clear( builder );
+		jsonPushParserReset( builder->parser );
+		builder->error = 0;
+	}
+}
+
+/**
+	@brief Free a JSONPushBuilder and everything it owns, including any partial result.
+	@param builder Pointer to the JSONPushBuilder.
+*/
+void jsonPushBuilderFree( JSONPushBuilder* builder ) {
+	if( builder ) {
+		build_clear( builder );
+		free( builder->frames );
+		jsonPushParserFree( builder->parser );
+		free( builder );
+	}
+}
+
+/**
+	@brief Free the partial tree and the stack of open containers.
+	@param builder Pointer to the JSONPushBuilder.
+*/
+static void build_clear( JSONPushBuilder* builder ) {
+	while( builder->depth ) {
+		BuildFrame* frame = &builder->frames[ --builder->depth ];
+		jsonObjectFree( frame->obj );
+		free( frame->key );
+	}
+	jsonObjectFree( builder->root );
+	builder->root = NULL;
+}
+
+/**
+	@brief Attach a finished value to the innermost open container, or make it the root.
+	@param builder Pointer to the JSONPushBuilder.
+	@param obj Pointer to the finished value.  The builder takes ownership of it.
+	@return 0 if successful, or 1 upon error.
+*/
+static int build_add_value( JSONPushBuilder* builder, jsonObject* obj ) {
+	if( 0 == builder->depth ) {
+		if( builder->root ) {     // shouldn't happen; the parser rejects trailing values
+			jsonObjectFree( obj );
+			builder->error = 1;
+			return 1;
+		}
+		builder->root = obj;
+		return 0;
+	}
+
+	BuildFrame* frame = &builder->frames[ builder->depth - 1 ];
+	if( JSON_HASH == frame->obj->type ) {
+		if( !frame->key ) {      // shouldn't happen; the parser insists on keys
+			jsonObjectFree( obj );
+			builder->error = 1;
+			return 1;
+		}
+		jsonObjectSetKey( frame->obj, frame->key, obj );
+		free( frame->key );
+		frame->key = NULL;
+	} else
+		jsonObjectPush( frame->obj, obj );
+
+	return 0;
+}
+
+/**
+	@brief Open a new container.
+	@param builder Pointer to the JSONPushBuilder.
+	@param type Either JSON_ARRAY or JSON_HASH.
+	@return 0 (always succeeds).
+*/
+static int build_begin( JSONPushBuilder* builder, int type ) {
+	if( builder->depth == builder->capacity ) {
+		builder->capacity = builder->capacity ? builder->capacity * 2 : 16;
+		builder->frames = realloc( builder->frames, builder->capacity * sizeof( BuildFrame ) );
+		if( !builder->frames ) {
+			osrfLogError( OSRF_LOG_MARK, "Out of memory in JSON push builder" );
+			exit( 99 );
+		}
+	}
+
+	BuildFrame* frame = &builder->frames[ builder->depth++ ];
+	frame->obj = jsonNewObjectType( type );
+	frame->key = NULL;
+	return 0;
+}
+
+/**
+	@brief Collapse a class hint, the way jsonParse() does.
+	@param hash Pointer to a JSON_HASH that has just been closed.
+	@return Pointer to the jsonObject that should take the place of @a hash.
+
+	If @a hash has a member keyed by JSON_CLASS_KEY, return its JSON_DATA_KEY member,
+	labeled with the class name, or a JSON_NULL if there is no such member; and free
+	@a hash.  Otherwise return @a hash unchanged.
+*/
+static jsonObject* build_decode_class( jsonObject* hash ) {
+	char* class_name = jsonObjectToSimpleString( jsonObjectGetKeyConst( hash, JSON_CLASS_KEY ) );
+	if( !class_name )
+		return hash;
+
+	jsonObject* class_data = osrfHashExtract( hash->value.h, JSON_DATA_KEY );
+	jsonObjectFree( hash );
+	if( class_data ) {
+		class_data->parent = NULL;
+		jsonObjectSetClass( class_data, class_name );
+	} else
+		class_data = jsonNewObjectType( JSON_NULL );
+
+	free( class_name );
+	return class_data;
+}
+
+// Callbacks for the parser
+
+static int build_string( void* blob, const char* str ) {
+	return build_add_value( (JSONPushBuilder*) blob, jsonNewObject( str ) );
+}
+
+static int build_number( void* blob, const char* str ) {
+	return build_add_value( (JSONPushBuilder*) blob, jsonNewNumberStringObject( str ) );
+}
+
+static int build_begin_array( void* blob ) {
+	return build_begin( (JSONPushBuilder*) blob, JSON_ARRAY );
+}
+
+static int build_begin_obj( void* blob ) {
+	return build_begin( (JSONPushBuilder*) blob, JSON_HASH );
+}
+
+static int build_obj_key( void* blob, const char* key ) {
+	JSONPushBuilder* builder = (JSONPushBuilder*) blob;
+	if( 0 == builder->depth )
+		return 1;        // shouldn't happen
+	BuildFrame* frame = &builder->frames[ builder->depth - 1 ];
+	free( frame->key );
+	frame->key = strdup( key );
+	return 0;
+}
+
+static int build_end_array( void* blob ) {
+	JSONPushBuilder* builder = (JSONPushBuilder*) blob;
+	if( 0 == builder->depth )
+		return 1;        // shouldn't happen
+	jsonObject* obj = builder->frames[ --builder->depth ].obj;
+	return build_add_value( builder, obj );
+}
+
+static int build_end_obj( void* blob ) {
+	JSONPushBuilder* builder = (JSONPushBuilder*) blob;
+	if( 0 == builder->depth )
+		return 1;        // shouldn't happen
+	BuildFrame* frame = &builder->frames[ --builder->depth ];
+	free( frame->key );
+	jsonObject* obj = frame->obj;
+	if( builder->decode )
+		obj = build_decode_class( obj );
+	return build_add_value( builder, obj );
+}
+
+static int build_bool( void* blob, int b ) {
+	return build_add_value( (JSONPushBuilder*) blob, jsonNewBoolObject( b ) );
+}
+
+static int build_null( void* blob ) {
+	return build_add_value( (JSONPushBuilder*) blob, jsonNewObject( NULL ) );
+}
+
+static void build_error( void* blob, const char* msg, unsigned line, unsigned pos ) {
+	((JSONPushBuilder*) blob)->error = 1;
+	osrfLogError( OSRF_LOG_MARK, "JSON Error at line %u, position %u: %s", line, pos, msg );
+}
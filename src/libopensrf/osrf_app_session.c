@@ -4,8 +4,10 @@
 */
 
 #include <time.h>
+#include <pthread.h>
 #include "opensrf/osrf_app_session.h"
 #include "opensrf/osrf_stack.h"
+#include "opensrf/jsonpush.h"
 
 static char* current_ingress = NULL;
 
@@ -24,8 +26,10 @@ struct osrf_app_request_struct {
 	/** Linked list of responses to the request. */
 	osrfMessage* result;
 
-    /** Buffer used to collect partial response messages */
-    growing_buffer* part_response_buffer;
+	/** Builds the result of a partial response message by message, as the pieces arrive */
+	JSONPushBuilder* part_response_builder;
+	/** Number of bytes of partial response fed to part_response_builder so far */
+	size_t part_response_size;
 
 	/** Boolean; if true, then a call that is waiting on a response will reset the
 	timeout and set this variable back to false. */
@@ -47,11 +51,45 @@ static int osrfAppSessionMakeLocaleRequest(
 		osrfAppSession* session, const jsonObject* params, const char* method_name,
 		int protocol, osrfStringArray* param_strings, char* locale );
 
-/** @brief The global session cache.
+/** @brief Number of shards in the global session cache.  Must be a power of 2. */
+#define SESSION_SHARD_COUNT 16
+
+/**
+	@brief One shard of the global session cache.
 
 	Key: session_id.  Data: osrfAppSession.
 */
-static osrfHash* osrfAppSessionCache = NULL;
+typedef struct {
+	/** @brief Guards the sessions hash */
+	pthread_mutex_t lock;
+	/** @brief The sessions in this shard; NULL until the first one arrives */
+	osrfHash* sessions;
+} SessionShard;
+
+/** @brief The global session cache.
+
+	The cache is split into shards, each with its own lock, so that threads looking up
+	different sessions seldom wait for one another.  The high-order bits of the hash code
+	of the session id choose the shard; the low-order bits are left for the osrfHash
+	within the shard.
+
+	The locks make the registry itself thread-safe: registering, finding, and removing
+	sessions.  They do nothing for the osrfAppSessions in it.  A session has no lock of its
+	own, and neither do its list of pending requests and their queues of responses.  So a
+	session belongs to one thread at a time, normally the one that created it, and only
+	that thread may use it or free it.  Another thread may find it, but not touch it.
+
+	Nor does the registry let one process multiplex sessions across threads by itself.
+	All sessions send and receive through the one transport_client returned by
+	osrfSystemGetTransportClient(), which has no locking either.
+*/
+static SessionShard session_shards[ SESSION_SHARD_COUNT ];
+
+/** @brief Ensures that the locks of the session shards are initialized only once. */
+static pthread_once_t session_shards_once = PTHREAD_ONCE_INIT;
+
+static void init_session_shards( void );
+static SessionShard* find_session_shard( osrfHashKey* key, const char* session_id );
 
 // --------------------------------------------------------------------------
 // Request API
@@ -79,7 +117,8 @@ static osrfAppRequest* _osrf_app_request_init(
 	req->reset_timeout  = 0;
 	req->next           = NULL;
 	req->prev           = NULL;
-	req->part_response_buffer = NULL;
+	req->part_response_builder = NULL;
+	req->part_response_size = 0;
 
 	return req;
 }
@@ -102,8 +141,8 @@ static void _osrf_app_request_free( osrfAppRequest * req ) {
 			req->result = next_msg;
 		}
 
-        if (req->part_response_buffer)
-            buffer_free(req->part_response_buffer);
+		if( req->part_response_builder )
+			jsonPushBuilderFree( req->part_response_builder );
 
 		free( req );
 	}
@@ -124,43 +163,54 @@ static void _osrf_app_request_push_queue( osrfAppRequest* req, osrfMessage* resu
     if (result->status_code == OSRF_STATUS_PARTIAL) {
         osrfLogDebug(OSRF_LOG_MARK, "received partial message response");
 
-        if (!req->part_response_buffer) {
-            // assume the max_chunk_size of the server matches ours for
-            // buffer initialization,  since the setting will usually be 
-            // a site-wide value.
-	        req->part_response_buffer = buffer_init(OSRF_MSG_CHUNK_SIZE + 1);
-        }
+        if (!req->part_response_builder)
+            req->part_response_builder = jsonNewPushBuilder(1);
 
         const char* partial = jsonObjectGetString(result->_result_content);
 
         if (partial != NULL) {
+            size_t len = strlen(partial);
             osrfLogDebug(OSRF_LOG_MARK, 
-                "adding %d bytes to response buffer", strlen(partial));
+                "parsing %d bytes of partial response", (int) len);
         
-            // add the partial contents of the message to the buffer
-            buffer_add(req->part_response_buffer, partial);
+            // parse the partial contents of the message now, while we
+            // wait for the rest; the text itself need not be kept
+            jsonPushBuilderPush(req->part_response_builder, partial, len);
+            req->part_response_size += len;
         }
 
         // all done.  req and result are freed by the caller
         return;
 
     } else if (result->status_code == OSRF_STATUS_NOCONTENT) {
-        if (req->part_response_buffer && req->part_response_buffer->n_used) {
+        if (req->part_response_builder && req->part_response_size) {
 
-            // part_response_buffer contains a stitched-together JSON string
+            // part_response_builder holds the tree parsed from the pieces
             osrfLogDebug(OSRF_LOG_MARK, 
-                "partial response complete, parsing %d bytes", 
-                req->part_response_buffer->n_used);
+                "partial response complete, parsed %d bytes", 
+                (int) req->part_response_size);
 
             // coerce the partial-complete response into a standard RESULT.
             osrf_message_set_status_info(result, NULL, "OK", OSRF_STATUS_OK);
 
-            // use the stitched-together JSON string as the result conten
-            osrf_message_set_result_content(
-                result, req->part_response_buffer->buf);
-
-            // free string, keep the buffer
-            buffer_reset(req->part_response_buffer); 
+            // use the tree built from the pieces as the result content;
+            // the builder is reset, ready for the next partial response.
+            // The builder already decoded the class hints, so the message
+            // takes the tree itself rather than a copy of it.
+            jsonObject* content =
+                jsonPushBuilderFinish(req->part_response_builder);
+            req->part_response_size = 0;
+
+            if (content) {
+                jsonObjectFree(result->_result_content);
+                result->_result_content = content;
+            } else {
+                osrfLogError(OSRF_LOG_MARK,
+                    "Unable to parse partial response for request %d",
+                    req->request_id);
+                jsonObjectFree(result->_result_content);
+                result->_result_content = NULL;
+            }
 
         } else {
             osrfLogDebug(OSRF_LOG_MARK, 
@@ -478,11 +528,48 @@ const char* osrfAppSessionGetIngress() {
 	@return Pointer to the corresponding osrfAppSession if found, or NULL if not.
 
 	Search the global session cache for the specified session id.
+
+	The lookup is safe from any thread, but the session that it finds belongs to whichever
+	thread owns it (see the notes on the session cache).
 */
 osrfAppSession* osrf_app_session_find_session( const char* session_id ) {
-	if(session_id)
-		return osrfHashGet( osrfAppSessionCache, session_id );
-	return NULL;
+	if( !session_id )
+		return NULL;
+
+	osrfHashKey key;
+	SessionShard* shard = find_session_shard( &key, session_id );
+	pthread_mutex_lock( &shard->lock );
+	osrfAppSession* session = osrfHashGetKey( shard->sessions, &key );
+	pthread_mutex_unlock( &shard->lock );
+	return session;
+}
+
+/**
+	@brief Initialize the locks of the shards of the global session cache.
+
+	Called via pthread_once(), by find_session_shard().
+*/
+static void init_session_shards( void ) {
+	int i;
+	for( i = 0; i < SESSION_SHARD_COUNT; ++i ) {
+		pthread_mutex_init( &session_shards[ i ].lock, NULL );
+		session_shards[ i ].sessions = NULL;
+	}
+}
+
+/**
+	@brief Find the shard of the global session cache for a given session id.
+	@param key Pointer to an osrfHashKey, to be filled in for the session id.
+	@param session_id The session id.
+	@return Pointer to the SessionShard.
+
+	The osrfHashKey serves for subsequent operations on the shard's osrfHash, so that
+	we hash the session id only once.
+*/
+static SessionShard* find_session_shard( osrfHashKey* key, const char* session_id ) {
+	pthread_once( &session_shards_once, init_session_shards );
+	osrfHashMakeKey( key, session_id, strlen( session_id ) );
+	return session_shards + ( key->code >> 28 ) % SESSION_SHARD_COUNT;
 }
 
 
@@ -490,16 +577,20 @@ osrfAppSession* osrf_app_session_find_session( const char* session_id ) {
 	@brief Add a session to the global session cache, keyed by session id.
 	@param session Pointer to the osrfAppSession to be added.
 
-	If a cache doesn't exist yet, create one.  It's an osrfHash using session ids for the
-	key and osrfAppSessions for the data.
+	If the session's shard of the cache doesn't have an osrfHash yet, create one, using
+	session ids for the key and osrfAppSessions for the data.
 */
 static void _osrf_app_session_push_session( osrfAppSession* session ) {
 	if( session ) {
-		if( osrfAppSessionCache == NULL )
-			osrfAppSessionCache = osrfNewHash();
-		if( osrfHashGet( osrfAppSessionCache, session->session_id ) )
-			return;   // A session with this id is already in the cache.  Shouldn't happen.
-		osrfHashSet( osrfAppSessionCache, session, session->session_id );
+		osrfHashKey key;
+		SessionShard* shard = find_session_shard( &key, session->session_id );
+		pthread_mutex_lock( &shard->lock );
+		if( shard->sessions == NULL )
+			shard->sessions = osrfNewHash();
+		// A session with this id shouldn't already be in the cache.  If it is, leave it.
+		if( !osrfHashGetKey( shard->sessions, &key ) )
+			osrfHashSetKey( shard->sessions, session, &key );
+		pthread_mutex_unlock( &shard->lock );
 	}
 }
 
@@ -584,6 +675,7 @@ osrfAppSession* osrfAppSessionClientInit( const char* remote_service ) {
 	session->transport_error = 0;
 	session->panic = 0;
 	session->outbuf = NULL;   // Not used by client
+	session->binary = 0;
 
 	#ifdef ASSUME_STATELESS
 	session->stateless = 1;
@@ -698,6 +790,7 @@ osrfAppSession* osrf_app_server_session_init(
 
 	session->panic = 0;
 	session->outbuf = buffer_init( 4096 );
+	session->binary = 0;
 
 	_osrf_app_session_push_session( session );
 	return session;
@@ -1069,8 +1162,16 @@ static int osrfAppSessionSendBatch( osrfAppSession* session, osrfMessage* msgs[]
 		}
 	}
 
-	// Translate the collection of osrfMessages into a JSON array
-	char* string = osrfMessageSerializeBatch(msgs, size);
+	// Advertise that we can read binary bodies, so that the other party may send them.
+	int i;
+	for( i = 0; i < size && msgs[i]; ++i )
+		msgs[i]->binary = 1;
+
+	// Translate the collection of osrfMessages into a JSON array, or into the binary
+	// equivalent if the other party has said that it can read it
+	char* string = session->binary
+		? osrfMessageSerializeBatchBinary(msgs, size)
+		: osrfMessageSerializeBatch(msgs, size);
 
 	// Send the JSON as the payload of a transport_message
 	if( string ) {
@@ -1098,12 +1199,6 @@ int osrfSendChunkedResult(
 	// chunking payload
 	int i;
 	for (i = 0; i < payload_size; i += chunk_size) {
-		osrfMessage* msg = osrf_message_init(RESULT, request_id, 1);
-		osrf_message_set_status_info(msg,
-			"osrfResultPartial",
-			"Partial Response",
-			OSRF_STATUS_PARTIAL
-		);
 
 		// see how long this chunk is.  If this is the last
 		// chunk, it will likely be less than chunk_size
@@ -1111,31 +1206,65 @@ int osrfSendChunkedResult(
 		if (partial_size > chunk_size)
 			partial_size = chunk_size;
 
-		// substr(data, i, partial_size)
-		char partial_buf[partial_size + 1];
-		memcpy(partial_buf, &payload[i], partial_size);
-		partial_buf[partial_size] = '\0';
+		osrfSendPartialResult(session, request_id, &payload[i], partial_size);
+	}
 
-		// package the partial chunk as a JSON string object
-		jsonObject*  partial_obj = jsonNewObject(partial_buf);
-		osrf_message_set_result(msg, partial_obj);
-		jsonObjectFree(partial_obj);
+	// all chunks sent; send the final partial-complete msg
+	return osrfSendPartialComplete(session, request_id);
+}
 
-		// package the osrf message within an array then
-		// serialize to json for delivery
-		jsonObject* arr = jsonNewObject(NULL);
+/**
+	@brief Send one piece of a chunked result as a partial RESULT message.
+	@param session Pointer to the osrfAppSession responsible for sending the message.
+	@param request_id Request ID of the osrfAppRequest.
+	@param partial Pointer to the piece of serialized JSON to be sent (need not be
+		nul-terminated).
+	@param partial_size Length of the piece.
+	@return 0 upon success, or -1 upon failure.
 
-		// msg json freed when arr is freed
-		jsonObjectPush(arr, osrfMessageToJSON(msg));
-		char* json = jsonObjectToJSON(arr);
+	The receiver concatenates the pieces and parses the result once it sees the message
+	sent by osrfSendPartialComplete().
+*/
+int osrfSendPartialResult(
+        osrfAppSession* session, int request_id, const char* partial, size_t partial_size ) {
 
-		osrfSendTransportPayload(session, json);
-		osrfMessageFree(msg);
-		jsonObjectFree(arr);
-		free(json);
-	}
+	osrfMessage* msg = osrf_message_init(RESULT, request_id, 1);
+	osrf_message_set_status_info(msg,
+		"osrfResultPartial",
+		"Partial Response",
+		OSRF_STATUS_PARTIAL
+	);
 
-	// all chunks sent; send the final partial-complete msg
+	// package the partial chunk as a JSON string object
+	char* partial_buf = strndup(partial, partial_size);
+	jsonObject*  partial_obj = jsonNewObject(partial_buf);
+	free(partial_buf);
+	osrf_message_set_result(msg, partial_obj);
+	jsonObjectFree(partial_obj);
+
+	// package the osrf message within an array then
+	// serialize to json for delivery
+	jsonObject* arr = jsonNewObject(NULL);
+
+	// msg json freed when arr is freed
+	jsonObjectPush(arr, osrfMessageToJSON(msg));
+	char* json = jsonObjectToJSON(arr);
+
+	int rc = osrfSendTransportPayload(session, json);
+	osrfMessageFree(msg);
+	jsonObjectFree(arr);
+	free(json);
+
+	return rc ? -1 : 0;
+}
+
+/**
+	@brief Send the message that finishes a chunked result.
+	@param session Pointer to the osrfAppSession responsible for sending the message.
+	@param request_id Request ID of the osrfAppRequest.
+	@return 0 upon success, or -1 upon failure.
+*/
+int osrfSendPartialComplete( osrfAppSession* session, int request_id ) {
 	osrfMessage* msg = osrf_message_init(RESULT, request_id, 1);
 	osrf_message_set_status_info(msg,
 		"osrfResultPartialComplete",
@@ -1146,12 +1275,12 @@ int osrfSendChunkedResult(
 	jsonObject* arr = jsonNewObject(NULL);
 	jsonObjectPush(arr, osrfMessageToJSON(msg));
 	char* json = jsonObjectToJSON(arr);
-	osrfSendTransportPayload(session, json);
+	int rc = osrfSendTransportPayload(session, json);
 	osrfMessageFree(msg);
 	jsonObjectFree(arr);
 	free(json);
 
-	return 0;
+	return rc ? -1 : 0;
 }
 
 /**
@@ -1258,7 +1387,11 @@ void osrfAppSessionFree( osrfAppSession* session ){
 
 	/* Remove self from the global session cache */
 
-	osrfHashRemove( osrfAppSessionCache, session->session_id );
+	osrfHashKey key;
+	SessionShard* shard = find_session_shard( &key, session->session_id );
+	pthread_mutex_lock( &shard->lock );
+	osrfHashRemoveKey( shard->sessions, &key );
+	pthread_mutex_unlock( &shard->lock );
 
 	/* Free the memory */
 
@@ -1433,14 +1566,21 @@ int osrfAppSessionStatus( osrfAppSession* ses, int type,
 /**
 	@brief Free the global session cache.
 
-	Note that the osrfHash that implements the global session cache does @em not have a
-	callback function installed for freeing its cargo.  As a result, any remaining
+	Note that the osrfHashes that implement the global session cache do @em not have a
+	callback function installed for freeing their cargo.  As a result, any remaining
 	osrfAppSessions are leaked, along with all the osrfAppRequests and osrfMessages they
 	own.
 */
 void osrfAppSessionCleanup( void ) {
-	osrfHashFree(osrfAppSessionCache);
-	osrfAppSessionCache = NULL;
+	pthread_once( &session_shards_once, init_session_shards );
+	int i;
+	for( i = 0; i < SESSION_SHARD_COUNT; ++i ) {
+		SessionShard* shard = session_shards + i;
+		pthread_mutex_lock( &shard->lock );
+		osrfHashFree( shard->sessions );
+		shard->sessions = NULL;
+		pthread_mutex_unlock( &shard->lock );
+	}
 }
 
 /**
@@ -670,7 +670,8 @@ static int flush_responses( osrfAppSession* ses, growing_buffer* outbuf ) {
 
 	int rc = 0;
 	if( buffer_length( outbuf ) > 0 ) {    // If there's anything to send...
-		buffer_add_char( outbuf, ']' );    // Close the JSON array
+		if( '[' == outbuf->buf[ 0 ] )
+			buffer_add_char( outbuf, ']' );    // Close the JSON array
 		if( osrfSendTransportPayload( ses, OSRF_BUFFER_C_STR( ses->outbuf ))) {
 			osrfLogError( OSRF_LOG_MARK, "Unable to flush response buffer" );
 			rc = -1;
@@ -680,22 +681,113 @@ static int flush_responses( osrfAppSession* ses, growing_buffer* outbuf ) {
 	return rc;
 }
 
+/**
+	@brief Serialize a response message for the output buffer.
+	@param ses Pointer to the current application session.
+	@param outbuf Pointer to the output buffer.
+	@param msg Pointer to the message to be serialized.
+	@return Pointer to the serialized message, which the calling code must free.
+
+	If the client can read binary bodies, the result is a binary body of one message, as
+	from osrfMessageSerializeBatchBinary().  Otherwise it's the message as JSON text,
+	without an enclosing array.  Either way, the message advertises that we can read
+	binary bodies.
+
+	Once the output buffer holds anything, we stick to its form until it's flushed.
+
+	Used only by servers to respond to clients.
+*/
+static char* serialize_response( const osrfAppSession* ses, const growing_buffer* outbuf,
+		osrfMessage* msg ) {
+	msg->binary = 1;
+
+	int binary = buffer_length( outbuf ) > 0
+		? OSRF_BINARY_BODY_MARK == outbuf->buf[ 0 ]
+		: ses->binary;
+
+	if( binary )
+		return osrfMessageSerializeBatchBinary( &msg, 1 );
+
+	jsonObject* json = osrfMessageToJSON( msg );
+	char* text = jsonObjectToJSON( json );
+	jsonObjectFree( json );
+	return text;
+}
+
 /**
 	@brief Add a message to an output buffer.
 	@param outbuf Pointer to the output buffer.
-	@param msg Pointer to the message to be added, in the form of a JSON string.
+	@param msg Pointer to the message to be added, as returned by serialize_response().
 
-	Since the output buffer is in the form of a JSON array, prepend a left bracket to the
+	If the output buffer is in the form of a JSON array, prepend a left bracket to the
 	first message, and a comma to subsequent ones.
 
+	If it's a binary body, the first message brings its OSRF_BINARY_BODY_MARK with it.
+	Subsequent ones drop theirs, and their base64 text follows a comma as a new segment.
+
 	Used only by servers to respond to clients.
 */
 static inline void append_msg( growing_buffer* outbuf, const char* msg ) {
 	if( outbuf && msg ) {
-		char prefix = buffer_length( outbuf ) > 0 ? ',' : '[';
-		buffer_add_char( outbuf, prefix );
-		buffer_add( outbuf, msg );
+		if( OSRF_BINARY_BODY_MARK == msg[ 0 ] ) {
+			if( buffer_length( outbuf ) > 0 ) {
+				buffer_add_char( outbuf, ',' );
+				buffer_add( outbuf, msg + 1 );
+			} else
+				buffer_add( outbuf, msg );
+		} else {
+			char prefix = buffer_length( outbuf ) > 0 ? ',' : '[';
+			buffer_add_char( outbuf, prefix );
+			buffer_add( outbuf, msg );
+		}
+	}
+}
+
+/**
+	@brief State shared between _osrfAppRespond() and send_partial_chunks().
+*/
+typedef struct {
+	osrfMethodContext* ctx;  /**< The method context we're responding for. */
+	size_t chunk_size;       /**< Maximum size of a chunk, after XML escaping. */
+	int started;             /**< Boolean; true once we have sent a partial result. */
+} partialResponder;
+
+/**
+	@brief jsonSinkWriter that sends serialized JSON as a series of partial results.
+	@param userdata Pointer to a partialResponder.
+	@param data Pointer to the JSON text.
+	@param len Length of the JSON text.
+	@return The number of bytes sent, or -1 upon error.
+
+	Send as many full chunks as we can, where a chunk is as long as it can be without
+	exceeding the chunk size once it is XML-escaped (see osrfXmlEscapeSpan()).
+	Leave the remainder for later, when there will be more text behind it.
+*/
+static long send_partial_chunks( void* userdata, const char* data, size_t len ) {
+	partialResponder* responder = userdata;
+	size_t start = 0;     // Where the current chunk begins
+
+	while( start < len ) {
+		size_t n = osrfXmlEscapeSpan( data + start, len - start, responder->chunk_size, NULL );
+		if( start + n == len )
+			break;        // The rest fits in a chunk; wait for more text behind it
+
+		// A character too wide for any chunk goes out by itself.  If it's the last one,
+		// though, leave it for later along with whatever follows it.
+		if( n == 0 ) {
+			if( start + 1 == len )
+				break;
+			n = 1;
+		}
+
+		if( osrfSendPartialResult( responder->ctx->session, responder->ctx->request,
+				data + start, n ))
+			return -1;
+		responder->started = 1;
+		start += n;
 	}
+
+	return (long) start;
 }
 
 /**
@@ -713,6 +805,9 @@ static inline void append_msg( growing_buffer* outbuf, const char* msg ) {
 	If the method is not atomic, translate the message into JSON and append it to a buffer,
 	flushing the buffer as needed to avoid overflow.  If @a complete is true, append
 	a STATUS message (as JSON) to the buffer and flush the buffer.
+
+	If the JSON for the response is bigger than the method's maximum chunk size, send it
+	instead as a series of partial results, serializing it a chunk at a time.
 */
 static int _osrfAppRespond( osrfMethodContext* ctx, const jsonObject* data, int complete ) {
 	if(!(ctx && ctx->method)) return -1;
@@ -725,7 +820,10 @@ static int _osrfAppRespond( osrfMethodContext* ctx, const jsonObject* data, int
 		if( ctx->responses == NULL )
 			ctx->responses = jsonNewObjectType( JSON_ARRAY );
 
-		// Add a copy of the data object to the cache.
+		// Add a copy of the data object to the cache.  Sharing it would save the
+		// copy, but the method still owns @a data and may change it and respond
+		// with it again.  The mutators don't check for other owners (see
+		// jsonObjectShare()), so the change would show up in the cached response.
 		if ( data != NULL )
 			jsonObjectPush( ctx->responses, jsonObjectClone(data) );
 	} else {
@@ -733,23 +831,40 @@ static int _osrfAppRespond( osrfMethodContext* ctx, const jsonObject* data, int
 			"Adding responses to stash for method %s", ctx->method->name );
 
 		if( data ) {
-            char* data_str = jsonObjectToJSON(data); // free me (below)
-            size_t raw_size = strlen(data_str);
-            size_t extra_size = osrfXmlEscapingLength(data_str);
-            size_t data_size = raw_size + extra_size;
-            size_t chunk_size = ctx->method->max_chunk_size;
-
-            if (data_size > chunk_size) // calculate an escape-scaled chunk size
-                chunk_size = ((double)raw_size / (double)data_size) * (double)chunk_size;
-
-            if (chunk_size > 0 && chunk_size < raw_size) {
-                // chunking -- response message exceeds max message size.
-                // break it up into chunks for partial delivery
+			size_t chunk_size = ctx->method->max_chunk_size;
+			jsonSink* sink = NULL;
+			partialResponder responder = { ctx, chunk_size, 0 };
+
+			if( chunk_size > 0 ) {
+				// Serialize through a sink no bigger than a chunk.  If the response
+				// overflows it, the writer starts sending partial results on the spot,
+				// so that we never hold more than about a chunk of JSON text at a time.
+				sink = jsonNewSink( chunk_size, send_partial_chunks, &responder );
+				jsonObjectToSink( data, sink );
+
+				if( !responder.started ) {
+					// It all fit in the window.  Does it still fit once escaped?
+					size_t data_len = sink->buf->n_used;
+					if( osrfXmlEscapeSpan( OSRF_BUFFER_C_STR( sink->buf ), data_len,
+							chunk_size, NULL ) == data_len ) {
+						jsonSinkFree( sink );
+						sink = NULL;
+					}
+				}
+			}
 
-				osrfSendChunkedResult(ctx->session, ctx->request,
-									  data_str, raw_size, chunk_size);
+			if( sink ) {
+				// chunking -- response message exceeds max message size.
+				// Send whatever is left over as the last partial chunk(s).
+				int rc = jsonSinkFlush( sink );
+				if( !rc && sink->buf->n_used > 0 )
+					rc = osrfSendPartialResult( ctx->session, ctx->request,
+						OSRF_BUFFER_C_STR( sink->buf ), sink->buf->n_used );
+				jsonSinkFree( sink );
+				if( rc || osrfSendPartialComplete( ctx->session, ctx->request ))
+					return -1;
 
-            } else {
+			} else {
 
                 // bundling -- message body (may be) too small for single
                 // delivery.  prepare message for bundling.
@@ -759,8 +874,8 @@ static int _osrfAppRespond( osrfMethodContext* ctx, const jsonObject* data, int
                 osrf_message_set_status_info( msg, NULL, "OK", OSRF_STATUS_OK );
                 osrf_message_set_result( msg, data );
 
-                // Serialize the OSRF message into JSON text
-                char* json = jsonObjectToJSON( osrfMessageToJSON( msg ));
+                // Serialize the OSRF message into JSON text (or a binary body)
+                char* json = serialize_response( ctx->session, ctx->session->outbuf, msg );
                 osrfMessageFree( msg );
 
                 // If the new message would overflow the buffer, flush the output buffer first
@@ -774,8 +889,6 @@ static int _osrfAppRespond( osrfMethodContext* ctx, const jsonObject* data, int
                 append_msg( ctx->session->outbuf, json );
                 free( json );
             }
-
-            free(data_str);
 		}
 
 		if(complete) {
@@ -784,8 +897,8 @@ static int _osrfAppRespond( osrfMethodContext* ctx, const jsonObject* data, int
 			osrf_message_set_status_info( status_msg, "osrfConnectStatus", "Request Complete",
 				OSRF_STATUS_COMPLETE );
 
-			// Serialize the STATUS message into JSON text
-			char* json = jsonObjectToJSON( osrfMessageToJSON( status_msg ));
+			// Serialize the STATUS message into JSON text (or a binary body)
+			char* json = serialize_response( ctx->session, ctx->session->outbuf, status_msg );
 			osrfMessageFree( status_msg );
 
 			// Add the STATUS message to the output buffer.
@@ -1052,17 +1165,7 @@ int osrfMethodVerifyContext( osrfMethodContext* ctx )
 	char* params_str = jsonObjectToJSON( ctx->params );
 	if( params_str ) {
 		// params_str will at minimum be "[]"
-		int i = 0;
-		const char* str;
-		char* method = ctx->method->name;
-		int redact_params = 0;
-		while( (str = osrfStringArrayGetString(log_protect_arr, i++)) ) {
-			//osrfLogInternal(OSRF_LOG_MARK, "Checking for log protection [%s]", str);
-			if(!strncmp(method, str, strlen(str))) {
-				redact_params = 1;
-				break;
-			}
-		}
+		int redact_params = osrfStringSetMatchPrefix( log_protect_set, ctx->method->name );
 
 		char* params_logged;
 		if(redact_params) {
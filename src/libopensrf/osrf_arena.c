@@ -0,0 +1,208 @@
+/**
+	@file osrf_arena.c
+	@brief Implementation of osrfArena, a region allocator.
+
+	An osrfArena maintains a linked list of chunks.  Allocations are carved from the
+	current chunk by advancing an offset.  When the current chunk runs out of room, we
+	allocate another one and push it onto the front of the list.
+
+	A request too big to fit comfortably in an ordinary chunk gets a chunk of its own,
+	which we insert behind the current chunk so that the remaining space in the latter
+	is not wasted.
+
+	On reset we keep the first chunk allocated (which is always of ordinary size) and
+	return the rest to the heap.  Hence an osrfArena that is reset after each use settles down to
+	a single chunk and no calls to malloc(), as long as the loads are small enough to fit.
+*/
+
+#include <opensrf/utils.h>
+#include <opensrf/osrf_arena.h>
+
+/**
+	@brief Alignment of each allocation.
+
+	Must be a power of 2.  Eight bytes is enough for pointers, longs, and doubles, which
+	are the most demanding types we store.
+*/
+#define OSRF_ARENA_ALIGN 8
+
+/** @brief Round a size up to the next multiple of OSRF_ARENA_ALIGN. */
+#define OSRF_ARENA_ROUND(n) ( ((n) + (OSRF_ARENA_ALIGN - 1)) & ~((size_t) OSRF_ARENA_ALIGN - 1) )
+
+/**
+	@brief A block of memory from which allocations are carved.
+*/
+struct _osrfArenaChunkStruct {
+	/** @brief Pointer to the next (older) chunk in the list */
+	struct _osrfArenaChunkStruct* next;
+	/** @brief How many bytes of the data area are available in total */
+	size_t size;
+	/** @brief How many bytes of the data area have been handed out */
+	size_t used;
+};
+typedef struct _osrfArenaChunkStruct osrfArenaChunk;
+
+/** @brief Address of the data area following a chunk header. */
+#define CHUNK_DATA(c) ( ((char*) (c)) + OSRF_ARENA_ROUND( sizeof( osrfArenaChunk ) ) )
+
+/**
+	@brief Structure of an osrfArena.
+*/
+struct _osrfArenaStruct {
+	/** @brief The chunk currently being carved up; head of a linked list */
+	osrfArenaChunk* current;
+	/** @brief The first chunk allocated, which survives a reset */
+	osrfArenaChunk* first;
+	/** @brief The size of an ordinary chunk */
+	size_t chunk_size;
+};
+
+static osrfArenaChunk* new_chunk( size_t size );
+
+/**
+	@brief Create a new, empty osrfArena.
+	@param chunk_size The size of each chunk of memory to allocate, or zero for the default.
+	@return Pointer to the newly created osrfArena.
+
+	The first chunk is allocated up front.
+
+	The calling code is responsible for freeing the osrfArena by calling osrfArenaFree().
+*/
+osrfArena* osrfNewArena( size_t chunk_size ) {
+	if( 0 == chunk_size )
+		chunk_size = OSRF_ARENA_DEFAULT_CHUNK;
+
+	osrfArena* arena = safe_malloc( sizeof( osrfArena ) );
+	arena->chunk_size = OSRF_ARENA_ROUND( chunk_size );
+	arena->current = arena->first = new_chunk( arena->chunk_size );
+	return arena;
+}
+
+/**
+	@brief Allocate a chunk with a data area of a specified size.
+	@param size Size of the data area.
+	@return Pointer to the new chunk.
+*/
+static osrfArenaChunk* new_chunk( size_t size ) {
+	osrfArenaChunk* chunk = malloc( OSRF_ARENA_ROUND( sizeof( osrfArenaChunk ) ) + size );
+	if( !chunk ) {
+		perror( "osrfArena: Out of Memory" );
+		exit( 99 );
+	}
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+/**
+	@brief Allocate memory from an osrfArena.
+	@param arena Pointer to the osrfArena.
+	@param size How many bytes to allocate.
+	@return Pointer to the allocated memory, suitably aligned for any of the types we store.
+
+	Unlike safe_malloc(), osrfArenaAlloc() does @em not zero the memory it returns.
+
+	The memory remains valid until the next call to osrfArenaReset() or osrfArenaFree().
+	Don't try to free it any other way.
+*/
+void* osrfArenaAlloc( osrfArena* arena, size_t size ) {
+	if( !arena )
+		return NULL;
+
+	size = OSRF_ARENA_ROUND( size ? size : 1 );
+	osrfArenaChunk* chunk = arena->current;
+
+	if( chunk->size - chunk->used < size ) {
+		if( size > arena->chunk_size / 4 ) {
+			// Too big to share a chunk; give it a dedicated one, and tuck it
+			// behind the current chunk so that we keep filling the latter.
+			osrfArenaChunk* big = new_chunk( size );
+			big->used = size;
+			big->next = chunk->next;
+			chunk->next = big;
+			return CHUNK_DATA( big );
+		}
+
+		chunk = new_chunk( arena->chunk_size );
+		chunk->next = arena->current;
+		arena->current = chunk;
+	}
+
+	void* p = CHUNK_DATA( chunk ) + chunk->used;
+	chunk->used += size;
+	return p;
+}
+
+/**
+	@brief Copy a nul-terminated string into an osrfArena.
+	@param arena Pointer to the osrfArena.
+	@param str Pointer to the string to be copied.
+	@return Pointer to the copy, or NULL if either parameter is NULL.
+*/
+char* osrfArenaStrdup( osrfArena* arena, const char* str ) {
+	if( !( arena && str ) )
+		return NULL;
+	return osrfArenaStrndup( arena, str, strlen( str ) );
+}
+
+/**
+	@brief Copy a specified number of characters into an osrfArena as a nul-terminated string.
+	@param arena Pointer to the osrfArena.
+	@param str Pointer to the characters to be copied.
+	@param len How many characters to copy.
+	@return Pointer to the copy, or NULL if either pointer parameter is NULL.
+
+	Unlike strndup(), this function does not stop at an embedded nul.  The calling code
+	should make sure that @a len is accurate.
+*/
+char* osrfArenaStrndup( osrfArena* arena, const char* str, size_t len ) {
+	if( !( arena && str ) )
+		return NULL;
+	char* copy = osrfArenaAlloc( arena, len + 1 );
+	memcpy( copy, str, len );
+	copy[ len ] = '\0';
+	return copy;
+}
+
+/**
+	@brief Release everything allocated from an osrfArena, keeping the arena itself.
+	@param arena Pointer to the osrfArena to be reset.
+
+	Every pointer previously returned from the arena becomes invalid.  The first chunk
+	is kept for reuse; all others are returned to the heap.
+*/
+void osrfArenaReset( osrfArena* arena ) {
+	if( !arena )
+		return;
+
+	osrfArenaChunk* chunk = arena->current;
+	while( chunk ) {
+		osrfArenaChunk* next = chunk->next;
+		if( chunk != arena->first )
+			free( chunk );
+		chunk = next;
+	}
+
+	arena->first->next = NULL;
+	arena->first->used = 0;
+	arena->current = arena->first;
+}
+
+/**
+	@brief Free an osrfArena and everything allocated from it.
+	@param arena Pointer to the osrfArena to be freed.
+*/
+void osrfArenaFree( osrfArena* arena ) {
+	if( !arena )
+		return;
+
+	osrfArenaChunk* chunk = arena->current;
+	while( chunk ) {
+		osrfArenaChunk* next = chunk->next;
+		free( chunk );
+		chunk = next;
+	}
+
+	free( arena );
+}
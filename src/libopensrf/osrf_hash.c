@@ -1,6 +1,6 @@
 /**
 	@file osrf_hash.c
-	@brief A hybrid between a hash table and a doubly linked list.
+	@brief A key/value store that remembers the order of insertion.
 */
 
 /*
@@ -19,138 +19,264 @@ GNU General Public License for more details.
 */
 
 #include <opensrf/osrf_hash.h>
+#include <opensrf/osrf_intern.h>
 
 /**
-	@brief A node storing a single item within an osrfHash.
+	@brief A slot storing a single item within an osrfHash.
+
+	A slot whose key is NULL has been logically deleted.
 */
-struct _osrfHashNodeStruct {
+struct _osrfHashEntryStruct {
 	/** @brief String containing the key for the item */
 	char* key;
 	/** @brief Pointer to the stored item data */
 	void* item;
-	/** @brief Pointer to the next node in a doubly linked list */
-	struct _osrfHashNodeStruct* prev;
-	/** @brief Pointer to the previous node in a doubly linked list */
-	struct _osrfHashNodeStruct* next;
+	/** @brief Hash code of the key; valid only while the osrfHash has an index */
+	unsigned int code;
 };
-typedef struct _osrfHashNodeStruct osrfHashNode;
+typedef struct _osrfHashEntryStruct osrfHashEntry;
 
 /**
 	@brief osrfHash structure
 
-	An osrfHash is partly a key/value store based on a hash table, and partly a linear
-	structure implemented as a linked list.
-
-	The hash table is an array of pointers, managed by an osrfList.  Each pointer in that array
-	points to another layer of osrfList, which stores pointers to osrfHashNodes for keys that
-	hash to the same value.
+	An osrfHash stores its entries in a flat array, in the sequence in which the keys were
+	added.  Removing an entry leaves a logically deleted slot behind, so that the positions
+	of the other entries never change.
 
-	Besides residing in this hash table structure, each osrfHashNode resides in a doubly
-	linked list that includes all the osrfHashNodes in the osrfHash (except for any nodes
-	that have been logically deleted).  New nodes are added to the end of the list.
+	Most hashes hold only a handful of entries -- think of the payload objects in a typical
+	message.  For these, a linear scan of the array is faster than hashing, and much more
+	compact than a hash table.  Once the number of slots exceeds OSRF_HASH_SMALL_MAX, we
+	add an index: an open-addressed table of slot numbers, which supports lookups by key
+	in roughly constant time.  Each indexed slot caches the hash code of its key, so that
+	a probe rarely needs to compare strings except to confirm a match.
 
-	The hash table supports lookups based on a key.
+	When the array fills up, we grow it (and the index) by doubling -- unless at least half
+	of the slots have been deleted, in which case we squeeze them out instead.  Hence a
+	hash with a lot of turnover, such as a session cache, stays the size of its contents.
+	Squeezing moves slots, which would confuse an iterator, so a hash that has ever had an
+	iterator is never squeezed.
 
-	The linked list supports sequential traversal, reflecting the sequence in which the nodes
-	were added.
+	Traversals simply walk the array, skipping deleted slots.
 */
 struct _osrfHashStruct {
-	/** @brief Pointer to the osrfList used as a hash table */
-	osrfList* hash;
+	/** @brief Array of slots, in order of insertion */
+	osrfHashEntry* entries;
 	/** @brief Callback function for freeing stored items */
 	void (*freeItem) (char* key, void* item);
 	/** @brief How many items are in the osrfHash */
 	unsigned int size;
-	/** @brief Pointer to the first node in the linked list */
-	osrfHashNode* first_key;
-	/** @brief Pointer to the last node in the linked list */
-	osrfHashNode* last_key;
+	/** @brief How many slots are in use, including deleted ones */
+	unsigned int used;
+	/** @brief How many slots are allocated */
+	unsigned int capacity;
+	/** @brief Index table of slot numbers plus one (zero means empty); NULL if small */
+	unsigned int* index;
+	/** @brief Number of buckets in the index table; always a power of 2 */
+	unsigned int index_size;
+	/** @brief The osrfArena that owns the slots, index, and keys, if any; normally NULL */
+	osrfArena* arena;
+	/** @brief Boolean; true if we should intern keys where possible (see osrf_intern.h) */
+	int intern_keys;
+	/** @brief Live iterators, linked through their next members; slots stay put while any are */
+	osrfHashIterator* iterators;
 };
 
 /**
-	@brief Maintains a position in an osrfHash, for traversing the linked list
+	@brief Maintains a position in an osrfHash, for traversing its entries
 */
 struct _osrfHashIteratorStruct {
 	/** @brief Pointer to the associated osrfHash */
 	osrfHash* hash;
-	/** @brief Pointer to the current osrfHashNode (the one previously returned, if any) */
-	osrfHashNode* curr_node;
+	/** @brief Slot number of the current entry (the one previously returned), plus one */
+	unsigned int curr;
+	/** @brief Boolean; true if the iterator is on the hash's list of live iterators */
+	int linked;
+	/** @brief Next live iterator for the same osrfHash */
+	osrfHashIterator* next;
 };
 
 /**
-	@brief How many slots in the hash table.
-
-	Must be a power of 2, or the hashing algorithm won't work properly.
-*/
-/* 0x100 is a good size for small hashes */
-//#define OSRF_HASH_LIST_SIZE 0x100  /* size of the main hash list */
-#define OSRF_HASH_LIST_SIZE 0x10  /* size of the main hash list */
-
-
-/* used internally */
-/**
-	@brief Free an osrfHashNode, and its cargo, from within a given osrfHash.
-	@param h Pointer to the osrfHash
-	@param n Pointer to the osrfHashNode
-
-	If there is a callback function for freeing the item, call it.
-
-	We use this macro only when freeing an entire osrfHash.
+	@brief The most slots an osrfHash may use before we give it an index.
 */
-#define OSRF_HASH_NODE_FREE(h, n) \
-	if(h && n) { \
-		if(h->freeItem && n->key) h->freeItem(n->key, n->item);\
-		free(n->key); free(n); \
-}
+#define OSRF_HASH_SMALL_MAX 8
 
 /**
 	@brief Create and initialize a new (and empty) osrfHash.
 	@return Pointer to the newly created osrfHash.
 
+	No slots are allocated until the first item is stored.
+
 	The calling code is responsible for freeing the osrfHash.
 */
 osrfHash* osrfNewHash() {
 	osrfHash* hash;
 	OSRF_MALLOC(hash, sizeof(osrfHash));
-	hash->hash		= osrfNewListSize( OSRF_HASH_LIST_SIZE );
-	hash->first_key = NULL;
-	hash->last_key  = NULL;
 	return hash;
 }
 
-static osrfHashNode* osrfNewHashNode(char* key, void* item);
+/**
+	@brief Create and initialize a new (and empty) osrfHash within an osrfArena.
+	@param arena Pointer to the osrfArena from which to allocate memory.
+	@return Pointer to the newly created osrfHash.
 
-/*
-static unsigned int osrfHashMakeKey(char* str) {
-	if(!str) return 0;
-	unsigned int len = strlen(str);
-	unsigned int h = len;
-	unsigned int i = 0;
-	for(i = 0; i < len; str++, i++)
-		h = ((h << 5) ^ (h >> 27)) ^ (*str);
-	return (h & (OSRF_HASH_LIST_SIZE-1));
-}
+	The osrfHash, its slots, its index, and its copies of the keys all live in the
+	osrfArena.  osrfHashFree() does nothing with such a hash, and never calls the callback
+	function for freeing items; everything goes away when the arena is reset or freed.
+
+	If @a arena is NULL, the result is an ordinary osrfHash, as from osrfNewHash().
 */
+osrfHash* osrfNewArenaHash( osrfArena* arena ) {
+	if( !arena )
+		return osrfNewHash();
+
+	osrfHash* hash = osrfArenaAlloc( arena, sizeof(osrfHash) );
+	hash->entries    = NULL;
+	hash->freeItem   = NULL;
+	hash->size       = 0;
+	hash->used       = 0;
+	hash->capacity   = 0;
+	hash->index      = NULL;
+	hash->index_size = 0;
+	hash->arena      = arena;
+	hash->intern_keys = 0;
+	hash->iterators  = NULL;
+	return hash;
+}
 
-/* macro version of the above function */
 /**
 	@brief Hashing algorithm: derive a mangled number from a string.
 	@param str Pointer to the string to be hashed.
-	@param num A numeric variable to receive the resulting value.
+	@param len The length of the string.
+	@return The hash value, to be masked by the calling code.
 
-	This macro implements an algorithm proposed by Donald E. Knuth
+	This function implements an algorithm proposed by Donald E. Knuth
 	in The Art of Computer Programming Volume 3 (more or less..)
+
+	The rotations leave little but the last character in the low-order bits, which are the
+	ones that the index uses, so we finish by mixing all the bits together (with the
+	finalizer from MurmurHash3).
+*/
+static inline unsigned int hash_key( const char* str, size_t len ) {
+	unsigned int h = 0;
+	const char* p = str;
+	const char* end = str + len;
+	for( ; p < end; ++p )
+		h = ((h << 5) ^ (h >> 27)) ^ (*p);
+	h ^= len;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+/**
+	@brief Allocate memory for an osrfHash, from its arena if it has one.
+	@param hash Pointer to the osrfHash.
+	@param size How many bytes to allocate.
+	@return Pointer to the allocated memory, which is zeroed.
+*/
+static void* hash_alloc( osrfHash* hash, size_t size ) {
+	void* mem;
+	if( hash->arena ) {
+		mem = osrfArenaAlloc( hash->arena, size );
+		memset( mem, 0, size );
+	} else
+		OSRF_MALLOC( mem, size );
+	return mem;
+}
+
+/**
+	@brief Record a slot in the index of an osrfHash.
+	@param hash Pointer to the osrfHash.
+	@param code The hash code of the key stored in the slot.
+	@param slot The slot number.
+*/
+static void index_slot( osrfHash* hash, unsigned int code, unsigned int slot ) {
+	unsigned int mask = hash->index_size - 1;
+	unsigned int i = code & mask;
+	while( hash->index[ i ] )
+		i = ( i + 1 ) & mask;
+	hash->index[ i ] = slot + 1;
+}
+
+/**
+	@brief Build (or rebuild) the index of an osrfHash to suit its current capacity.
+	@param hash Pointer to the osrfHash.
+
+	Deleted slots don't need index entries, so we leave them out.  If the hash didn't have
+	an index before, its slots don't have hash codes yet either, so we compute them.
 */
-#define OSRF_HASH_MAKE_KEY(str,num) \
-   do {\
-      const char* k__ = str;\
-      unsigned int len__ = strlen(k__); \
-      unsigned int h__ = len__;\
-      unsigned int i__ = 0;\
-      for(i__ = 0; i__ < len__; k__++, i__++)\
-         h__ = ((h__ << 5) ^ (h__ >> 27)) ^ (*k__);\
-      num = (h__ & (OSRF_HASH_LIST_SIZE-1));\
-   } while(0)
+static void build_index( osrfHash* hash ) {
+	int have_codes = hash->index != NULL;
+	if( hash->index && !hash->arena )
+		free( hash->index );
+
+	// Keep the load factor at or below one half
+	unsigned int index_size = 16;
+	while( index_size < hash->capacity * 2 )
+		index_size *= 2;
+
+	hash->index_size = index_size;
+	hash->index = hash_alloc( hash, index_size * sizeof( unsigned int ) );
+
+	unsigned int i;
+	for( i = 0; i < hash->used; ++i ) {
+		osrfHashEntry* entry = hash->entries + i;
+		if( entry->key ) {
+			if( !have_codes )
+				entry->code = hash_key( entry->key, strlen( entry->key ) );
+			index_slot( hash, entry->code, i );
+		}
+	}
+}
+
+/**
+	@brief Make room for another slot in an osrfHash.
+	@param hash Pointer to the osrfHash.
+
+	If at least half of the slots have been deleted, and no iterator depends on the slots
+	staying put, close up the gaps.  Otherwise double the capacity.
+
+	We don't keep track of the iterators for an osrfHash in an osrfArena, since the arena
+	may be reset before they are freed.  So we never close up the gaps in such a hash; the
+	arena reclaims them soon enough anyway.
+*/
+static void make_room( osrfHash* hash ) {
+	if( !hash->arena && !hash->iterators && hash->size < hash->used
+			&& ( hash->used - hash->size ) * 2 >= hash->used ) {
+		unsigned int from;
+		unsigned int to = 0;
+		for( from = 0; from < hash->used; ++from ) {
+			if( hash->entries[ from ].key )
+				hash->entries[ to++ ] = hash->entries[ from ];
+		}
+		hash->used = to;
+
+		if( hash->index ) {
+			// Same capacity, so the index keeps its size; just refill it
+			memset( hash->index, 0, hash->index_size * sizeof( unsigned int ) );
+			for( from = 0; from < hash->used; ++from )
+				index_slot( hash, hash->entries[ from ].code, from );
+		}
+		return;
+	}
+
+	unsigned int capacity = hash->capacity ? hash->capacity * 2 : 4;
+	osrfHashEntry* entries = hash_alloc( hash, capacity * sizeof( osrfHashEntry ) );
+	if( hash->used )
+		memcpy( entries, hash->entries, hash->used * sizeof( osrfHashEntry ) );
+	if( !hash->arena )
+		free( hash->entries );
+	hash->entries = entries;
+	hash->capacity = capacity;
+
+	// Give the hash an index, or a bigger one, if it needs it
+	if( capacity > OSRF_HASH_SMALL_MAX )
+		build_index( hash );
+}
 
 /**
 	@brief Install a callback function for freeing a stored item.
@@ -166,73 +292,185 @@ void osrfHashSetCallback( osrfHash* hash, void (*callback) (char* key, void* ite
 	if( hash ) hash->freeItem = callback;
 }
 
-/* Returns a pointer to the item's node if found; otherwise returns NULL. */
 /**
-	@brief Search for a given key in an osrfHash.
+	@brief Arrange for an osrfHash to intern its keys.
+	@param hash Pointer to the osrfHash.
+
+	Subsequently added keys will share an interned copy if osrfInternLookup() finds one,
+	instead of being copied.  This arrangement suits hashes whose keys come from a limited
+	vocabulary, such as the keys of JSON objects.  The hash never adds to the intern table,
+	so keys from untrusted input can't fill it up.
+*/
+void osrfHashInternKeys( osrfHash* hash ) {
+	if( hash ) hash->intern_keys = 1;
+}
+
+/**
+	@brief Prepare an osrfHashKey for use with a given osrfHash.
 	@param hash Pointer to the osrfHash.
-	@param key The key to be sought.
-	@param bucketkey Pointer through which we can report which slot the item belongs in.
-	@return A pointer to the osrfHashNode where the item resides; or NULL, if it isn't there.
+	@param hkey Pointer to the osrfHashKey to be filled in.
+	@param str Pointer to the characters of the key.
+	@param len The length of the key.
 
-	If the bucketkey parameter is not NULL, we update the index of the hash bucket where the
-	item belongs (whether or not we actually found it).  In some cases this feedback enables the
-	calling function to avoid hashing the same key twice.
+	Unlike osrfHashMakeKey(), this function computes the hash code only if the osrfHash has
+	an index to use it with.
 */
-static osrfHashNode* find_item( const osrfHash* hash,
-		const char* key, unsigned int* bucketkey ) {
+static inline void init_key( const osrfHash* hash, osrfHashKey* hkey,
+		const char* str, size_t len ) {
+	hkey->str  = str;
+	hkey->len  = len;
+	hkey->code = hash->index ? hash_key( str, len ) : 0;
+}
 
-	// Find the sub-list in the hash table
+/**
+	@brief Search for a given key in an osrfHash.
+	@param hash Pointer to the osrfHash.
+	@param hkey Pointer to the key to be sought.  If the osrfHash has an index, the hash code
+		must be valid.
+	@return A pointer to the osrfHashEntry where the item resides; or NULL, if it isn't there.
+*/
+static osrfHashEntry* find_item( const osrfHash* hash, const osrfHashKey* hkey ) {
+
+	const char* key = hkey->str;
+	size_t len = hkey->len;
+
+	if( !hash->index ) {
+		// Small hash: scan the slots, comparing the first characters before
+		// bothering with strncmp().
+		osrfHashEntry* entry = hash->entries;
+		osrfHashEntry* end = entry + hash->used;
+		for( ; entry < end; ++entry ) {
+			if( entry->key == key ) {
+				if( !entry->key[ len ] )
+					return entry;
+			} else if( entry->key && ( !len || entry->key[ 0 ] == key[ 0 ] )
+					&& !strncmp( entry->key, key, len ) && !entry->key[ len ] )
+				return entry;
+		}
+		return NULL;
+	}
 
-	if( hash->size < 6 && !bucketkey )
-	{
-		// For only a few entries, when we don't need to identify
-		// the hash bucket, it's probably faster to search the
-		// linked list instead of hashing
+	unsigned int h = hkey->code;
+	unsigned int mask = hash->index_size - 1;
+	unsigned int i = h & mask;
+	unsigned int slot;
+	while( ( slot = hash->index[ i ] ) ) {
+		osrfHashEntry* entry = hash->entries + slot - 1;
+		if( entry->code == h && entry->key
+				&& ( entry->key == key || !strncmp( entry->key, key, len ) )
+				&& !entry->key[ len ] )
+			return entry;
+		i = ( i + 1 ) & mask;
+	}
 
-		osrfHashNode* currnode = hash->first_key;
-		while( currnode && strcmp( currnode->key, key ) )
-			 currnode = currnode->next;
+	return NULL;
+}
 
-		return currnode;
+/**
+	@brief Remove an entry from an osrfHash, leaving a logically deleted slot.
+	@param hash Pointer to the osrfHash.
+	@param entry Pointer to the slot.
+
+	The slot keeps its place in the index, so that it doesn't break the chain of any other
+	key that probed past it.
+*/
+static void delete_entry( osrfHash* hash, osrfHashEntry* entry ) {
+	hash->size--;
+	if( !hash->arena )
+		osrfInternFree( entry->key );
+	entry->key = NULL;
+	entry->item = NULL;
+}
+
+/**
+	@brief Make a nul-terminated copy of a key for an osrfHash to keep.
+	@param hash Pointer to the osrfHash.
+	@param str Pointer to the characters of the key.
+	@param len The length of the key.
+	@return Pointer to the copy, which may be interned.
+*/
+static char* copy_key( osrfHash* hash, const char* str, size_t len ) {
+	if( hash->intern_keys && len <= OSRF_INTERN_MAX_LEN ) {
+		char buf[ OSRF_INTERN_MAX_LEN + 1 ];
+		memcpy( buf, str, len );
+		buf[ len ] = '\0';
+		char* key = (char*) osrfInternLookup( buf );
+		if( key )
+			return key;
 	}
 
-	unsigned int i = 0;
-	OSRF_HASH_MAKE_KEY(key,i);
+	if( hash->arena )
+		return osrfArenaStrndup( hash->arena, str, len );
+
+	return strndup( str, len );
+}
+
+/**
+	@brief Store an item for a given key in an osrfHash (see osrfHashSet()).
+	@param hash Pointer to the osrfHash.
+	@param item Pointer to the item to be stored.
+	@param hkey Pointer to the key.  If the osrfHash has an index, the hash code must be valid.
+	@return Pointer to an item previously stored for the same key, if any.
+*/
+static void* store_item( osrfHash* hash, void* item, const osrfHashKey* hkey ) {
+	osrfHashEntry* entry = find_item( hash, hkey );
+	if( entry ) {
+
+		// We already have an item for this key.  Update it in place.
+		void* olditem = NULL;
 
-	// If asked, report which slot the key hashes to
-	if( bucketkey ) *bucketkey = i;
+		if( hash->freeItem ) {
+			hash->freeItem( entry->key, entry->item );
+		}
+		else
+			olditem = entry->item;
 
-	osrfList* list = OSRF_LIST_GET_INDEX( hash->hash, i );
-	if( !list ) { return NULL; }
+		entry->item = item;
+		return olditem;
+	}
 
-	// Search the sub-list
+	// There is no entry for this key.  Append a new one.
+	unsigned int code = hkey->code;
+	if( hash->used == hash->capacity ) {
+		int had_index = hash->index != NULL;
+		make_room( hash );
+		if( hash->index && !had_index )
+			code = hash_key( hkey->str, hkey->len );   // The caller may not have computed it
+	}
 
-	int k;
-	osrfHashNode* node = NULL;
-	for( k = 0; k < list->size; k++ ) {
-		node = OSRF_LIST_GET_INDEX(list, k);
-		if( node && node->key && !strcmp(node->key, key) )
-			return node;
+	unsigned int slot = hash->used++;
+	entry = hash->entries + slot;
+	entry->key = copy_key( hash, hkey->str, hkey->len );
+	entry->item = item;
+	if( hash->index ) {
+		entry->code = code;
+		index_slot( hash, code, slot );
 	}
 
+	hash->size++;
 	return NULL;
 }
 
 /**
-	@brief Create and populate a new osrfHashNode.
-	@param key The key string.
-	@param item A pointer to the item associated with the key.
-	@return A pointer to the newly created node.
+	@brief Remove the item for a given key from an osrfHash (see osrfHashRemove()).
+	@param hash Pointer to the osrfHash.
+	@param hkey Pointer to the key.  If the osrfHash has an index, the hash code must be valid.
+	@param destroy Boolean; if true, and there is a callback function for freeing items, free
+		the item instead of returning it.
+	@return Pointer to the removed item, if any.
 */
-static osrfHashNode* osrfNewHashNode(char* key, void* item) {
-	if(!(key && item)) return NULL;
-	osrfHashNode* n;
-	OSRF_MALLOC(n, sizeof(osrfHashNode));
-	n->key = strdup(key);
-	n->item = item;
-	n->prev = NULL;
-	n->prev = NULL;
-	return n;
+static void* remove_item( osrfHash* hash, const osrfHashKey* hkey, int destroy ) {
+	osrfHashEntry* entry = find_item( hash, hkey );
+	if( !entry ) return NULL;
+
+	void* item = NULL;  // to be returned
+	if( destroy && hash->freeItem )
+		hash->freeItem( entry->key, entry->item );
+	else
+		item = entry->item;
+
+	delete_entry( hash, entry );
+	return item;
 }
 
 /**
@@ -252,52 +490,46 @@ static osrfHashNode* osrfNewHashNode(char* key, void* item) {
 	previously stored item, so that the calling function can dispose of it.
 
 	osrfHashSet returns NULL if any of its first three parameters is NULL.
+
+	A key that doesn't come from a literal format string may contain a percent sign; store
+	it with osrfHashSetLen() or osrfHashSetKey() instead.
 */
 void* osrfHashSet( osrfHash* hash, void* item, const char* key, ... ) {
 	if(!(hash && item && key )) return NULL;
 
-	unsigned int bucketkey;
+	if( !strchr( key, '%' ) )   // Nothing to format
+		return osrfHashSetLen( hash, item, key, strlen( key ) );
 
 	VA_LIST_TO_STRING(key);
-	osrfHashNode* node = find_item( hash, VA_BUF, &bucketkey );
-	if( node ) {
-
-		// We already have an item for this key.  Update it in place.
-		void* olditem = NULL;
-
-		if( hash->freeItem ) {
-			hash->freeItem( node->key, node->item );
-		}
-		else
-			olditem = node->item;
-
-		node->item = item;
-		return olditem;
-	}
-
-	// There is no entry for this key.  Create a new one.
-	osrfList* bucket;
-	if( !(bucket = OSRF_LIST_GET_INDEX(hash->hash, bucketkey)) ) {
-		bucket = osrfNewList();
-		osrfListSet( hash->hash, bucket, bucketkey );
-	}
-
-	node = osrfNewHashNode(VA_BUF, item);
-	osrfListPushFirst( bucket, node );
-
-	hash->size++;
+	return osrfHashSetLen( hash, item, VA_BUF, strlen( VA_BUF ) );
+}
 
-	// Add the new hash node to the end of the linked list
+/**
+	@brief Store an item for a given key in an osrfHash, without formatting the key.
+	@param hash Pointer to the osrfHash in which the item is to be stored.
+	@param item Pointer to the item to be stored.
+	@param key Pointer to the characters of the key, which need not be nul-terminated.
+	@param len The length of the key, which must not contain a nul byte.
+	@return Pointer to an item previously stored for the same key, if any (see osrfHashSet()).
+*/
+void* osrfHashSetLen( osrfHash* hash, void* item, const char* key, size_t len ) {
+	if(!(hash && item && key )) return NULL;
 
-	if( NULL == hash->first_key )
-		hash->first_key = hash->last_key = node;
-	else {
-		node->prev = hash->last_key;
-		hash->last_key->next = node;
-		hash->last_key = node;
-	}
+	osrfHashKey hkey;
+	init_key( hash, &hkey, key, len );
+	return store_item( hash, item, &hkey );
+}
 
-	return NULL;
+/**
+	@brief Store an item for a given key in an osrfHash, using a prepared key.
+	@param hash Pointer to the osrfHash in which the item is to be stored.
+	@param item Pointer to the item to be stored.
+	@param hkey Pointer to an osrfHashKey filled in by osrfHashMakeKey().
+	@return Pointer to an item previously stored for the same key, if any (see osrfHashSet()).
+*/
+void* osrfHashSetKey( osrfHash* hash, void* item, const osrfHashKey* hkey ) {
+	if(!(hash && item && hkey )) return NULL;
+	return store_item( hash, item, hkey );
 }
 
 /**
@@ -316,50 +548,46 @@ void* osrfHashSet( osrfHash* hash, void* item, const char* key, ... ) {
 
 	osrfHashRemove returns NULL if either of its first two parameters is NULL.
 
-	Note: the osrfHashNode for the removed item is logically deleted so that subsequent searches
+	Note: the slot for the removed item is logically deleted so that subsequent searches
 	and traversals will ignore it.  However it is physically left in place so that an
-	osrfHashIterator pointing to it can advance to the next node.  The downside of this
-	design is that, if a lot of items are removed, the accumulation of logically deleted nodes
-	will slow down searches.  In addition, the memory used by a logically deleted osrfHashNode
-	remains allocated until the entire osrfHashNode is freed.
+	osrfHashIterator pointing to it can advance to the next slot.  Deleted slots are
+	reclaimed when the osrfHash next runs out of room, provided that no iterator for it
+	is live at the time.
 */
 void* osrfHashRemove( osrfHash* hash, const char* key, ... ) {
 	if(!(hash && key )) return NULL;
 
-	VA_LIST_TO_STRING(key);
-
-	osrfHashNode* node = find_item( hash, VA_BUF, NULL );
-	if( !node ) return NULL;
-
-	hash->size--;
-
-	void* item = NULL;  // to be returned
-	if( hash->freeItem )
-		hash->freeItem( node->key, node->item );
-	else
-		item = node->item;
-
-	// Mark the node as logically deleted
-
-	free(node->key);
-	node->key = NULL;
-	node->item = NULL;
+	if( !strchr( key, '%' ) )   // Nothing to format
+		return osrfHashRemoveLen( hash, key, strlen( key ) );
 
-	// Make the node unreachable from the rest of the linked list.
-	// We leave the next and prev pointers in place so that an
-	// iterator parked here can find its way to an adjacent node.
+	VA_LIST_TO_STRING(key);
+	return osrfHashRemoveLen( hash, VA_BUF, strlen( VA_BUF ) );
+}
 
-	if( node->prev )
-		node->prev->next = node->next;
-	else
-		hash->first_key = node->next;
+/**
+	@brief Remove the item for a specified key from an osrfHash, without formatting the key.
+	@param hash Pointer to the osrfHash from which the item is to be removed.
+	@param key Pointer to the characters of the key, which need not be nul-terminated.
+	@param len The length of the key.
+	@return Pointer to the removed item, if any (see osrfHashRemove()).
+*/
+void* osrfHashRemoveLen( osrfHash* hash, const char* key, size_t len ) {
+	if(!(hash && key )) return NULL;
 
-	if( node->next )
-		node->next->prev = node->prev;
-	else
-		hash->last_key = node->prev;
+	osrfHashKey hkey;
+	init_key( hash, &hkey, key, len );
+	return remove_item( hash, &hkey, 1 );
+}
 
-	return item;
+/**
+	@brief Remove the item for a specified key from an osrfHash, using a prepared key.
+	@param hash Pointer to the osrfHash from which the item is to be removed.
+	@param hkey Pointer to an osrfHashKey filled in by osrfHashMakeKey().
+	@return Pointer to the removed item, if any (see osrfHashRemove()).
+*/
+void* osrfHashRemoveKey( osrfHash* hash, const osrfHashKey* hkey ) {
+	if(!(hash && hkey )) return NULL;
+	return remove_item( hash, hkey, 1 );
 }
 
 /**
@@ -378,34 +606,37 @@ void* osrfHashRemove( osrfHash* hash, const char* key, ... ) {
 void* osrfHashExtract( osrfHash* hash, const char* key, ... ) {
 	if(!(hash && key )) return NULL;
 
-	VA_LIST_TO_STRING(key);
-
-	osrfHashNode* node = find_item( hash, VA_BUF, NULL );
-	if( !node ) return NULL;
-
-	hash->size--;
+	if( !strchr( key, '%' ) )   // Nothing to format
+		return osrfHashExtractLen( hash, key, strlen( key ) );
 
-	void* item = node->item;  // to be returned
-
-	// Mark the node as logically deleted
-	free(node->key);
-	node->key = NULL;
-	node->item = NULL;
+	VA_LIST_TO_STRING(key);
+	return osrfHashExtractLen( hash, VA_BUF, strlen( VA_BUF ) );
+}
 
-	// Make the node unreachable from the rest of the linked list.
-	// We leave the next and prev pointers in place so that an
-	// iterator parked here can find its way to an adjacent node.
-	if( node->prev )
-		node->prev->next = node->next;
-	else
-		hash->first_key = node->next;
+/**
+	@brief Extract the item for a specified key from an osrfHash, without formatting the key.
+	@param hash Pointer to the osrfHash from which the item is to be extracted.
+	@param key Pointer to the characters of the key, which need not be nul-terminated.
+	@param len The length of the key.
+	@return Pointer to the extracted item, if any (see osrfHashExtract()).
+*/
+void* osrfHashExtractLen( osrfHash* hash, const char* key, size_t len ) {
+	if(!(hash && key )) return NULL;
 
-	if( node->next )
-		node->next->prev = node->prev;
-	else
-		hash->last_key = node->prev;
+	osrfHashKey hkey;
+	init_key( hash, &hkey, key, len );
+	return remove_item( hash, &hkey, 0 );
+}
 
-	return item;
+/**
+	@brief Extract the item for a specified key from an osrfHash, using a prepared key.
+	@param hash Pointer to the osrfHash from which the item is to be extracted.
+	@param hkey Pointer to an osrfHashKey filled in by osrfHashMakeKey().
+	@return Pointer to the extracted item, if any (see osrfHashExtract()).
+*/
+void* osrfHashExtractKey( osrfHash* hash, const osrfHashKey* hkey ) {
+	if(!(hash && hkey )) return NULL;
+	return remove_item( hash, hkey, 0 );
 }
 
 /**
@@ -416,10 +647,7 @@ void* osrfHashExtract( osrfHash* hash, const char* key, ... ) {
 */
 void* osrfHashGet( osrfHash* hash, const char* key ) {
 	if(!(hash && key )) return NULL;
-
-	osrfHashNode* node = find_item( hash, key, NULL );
-	if( !node ) return NULL;
-	return node->item;
+	return osrfHashGetLen( hash, key, strlen( key ) );
 }
 
 /**
@@ -431,11 +659,63 @@ void* osrfHashGet( osrfHash* hash, const char* key ) {
  */
 void* osrfHashGetFmt( osrfHash* hash, const char* key, ... ) {
 	if(!(hash && key )) return NULL;
+
+	if( !strchr( key, '%' ) )   // Nothing to format
+		return osrfHashGetLen( hash, key, strlen( key ) );
+
 	VA_LIST_TO_STRING(key);
+	return osrfHashGetLen( hash, VA_BUF, strlen( VA_BUF ) );
+}
+
+/**
+	@brief Fetch the item stored in an osrfHash for a given key, specified by its length.
+	@param hash Pointer to the osrfHash from which to fetch the item.
+	@param key Pointer to the characters of the key, which need not be nul-terminated.
+	@param len The length of the key.
+	@return A pointer to the item, if it exists; otherwise NULL.
+
+	This function is handy for looking up a key that is part of a longer string, without
+	copying it.
+*/
+void* osrfHashGetLen( const osrfHash* hash, const char* key, size_t len ) {
+	if(!(hash && key )) return NULL;
+
+	osrfHashKey hkey;
+	init_key( hash, &hkey, key, len );
+	osrfHashEntry* entry = find_item( hash, &hkey );
+	if( !entry ) return NULL;
+	return entry->item;
+}
+
+/**
+	@brief Fetch the item stored in an osrfHash for a given key, using a prepared key.
+	@param hash Pointer to the osrfHash from which to fetch the item.
+	@param hkey Pointer to an osrfHashKey filled in by osrfHashMakeKey().
+	@return A pointer to the item, if it exists; otherwise NULL.
+*/
+void* osrfHashGetKey( const osrfHash* hash, const osrfHashKey* hkey ) {
+	if(!(hash && hkey )) return NULL;
+
+	osrfHashEntry* entry = find_item( hash, hkey );
+	if( !entry ) return NULL;
+	return entry->item;
+}
 
-	osrfHashNode* node = find_item( hash, (char*) VA_BUF, NULL );
-	if( !node ) return NULL;
-	return node->item;
+/**
+	@brief Prepare a key for repeated use with osrfHashGetKey() and friends.
+	@param hkey Pointer to the osrfHashKey to be filled in.
+	@param key Pointer to the characters of the key, which need not be nul-terminated.
+	@param len The length of the key, which must not contain a nul byte.
+
+	The osrfHashKey records the key's length and hash code, so that they needn't be
+	computed again for each lookup.  It doesn't copy the key, which must stay put for as
+	long as the osrfHashKey is in use.  The same osrfHashKey works with any osrfHash.
+*/
+void osrfHashMakeKey( osrfHashKey* hkey, const char* key, size_t len ) {
+	if( !hkey ) return;
+	hkey->str  = key;
+	hkey->len  = len;
+	hkey->code = hash_key( key, len );
 }
 
 /**
@@ -454,16 +734,14 @@ void* osrfHashGetFmt( osrfHash* hash, const char* key, ... ) {
 osrfStringArray* osrfHashKeys( osrfHash* hash ) {
 	if(!hash) return NULL;
 
-	osrfHashNode* node;
 	osrfStringArray* strings = osrfNewStringArray( hash->size );
 
-	// Add every key on the linked list
+	// Add every key that hasn't been deleted
 
-	node = hash->first_key;
-	while( node ) {
-		if( node->key )  // should always be true
-			osrfStringArrayAdd( strings, node->key );
-		node = node->next;
+	unsigned int i;
+	for( i = 0; i < hash->used; ++i ) {
+		if( hash->entries[ i ].key )
+			osrfStringArrayAdd( strings, hash->entries[ i ].key );
 	}
 
 	return strings;
@@ -482,33 +760,49 @@ unsigned long osrfHashGetCount( osrfHash* hash ) {
 	return hash->size;
 }
 
+/**
+	@brief Fetch the osrfArena that owns an osrfHash.
+	@param hash Pointer to the osrfHash.
+	@return Pointer to the osrfArena, or NULL if the osrfHash lives on the heap.
+*/
+osrfArena* osrfHashGetArena( const osrfHash* hash ) {
+	return hash ? hash->arena : NULL;
+}
+
 /**
 	@brief Free an osrfHash and all of its contents.
 	@param hash Pointer to the osrfHash to be freed.
 
 	If a callback function has been defined for freeing items, osrfHashFree calls it for
 		each stored item.
+
+	An osrfHash allocated from an osrfArena is left alone, along with its contents.
+
+	Any iterators still live for the osrfHash are detached from it, so that they may still
+	be freed afterwards.  They return nothing more.
 */
 void osrfHashFree( osrfHash* hash ) {
-	if(!hash) return;
-
-	int i, j;
-	osrfList* list;
-	osrfHashNode* node;
-
-	for( i = 0; i != hash->hash->size; i++ ) {
-		if( ( list = OSRF_LIST_GET_INDEX( hash->hash, i )) ) {
-			for( j = 0; j != list->size; j++ ) {
-				if( (node = OSRF_LIST_GET_INDEX( list, j )) ) {
-					OSRF_HASH_NODE_FREE(hash, node);
-				}
-			}
-			osrfListFree(list);
+	if(!hash || hash->arena) return;
+
+	osrfHashIterator* itr;
+	for( itr = hash->iterators; itr; itr = itr->next ) {
+		itr->hash = NULL;
+		itr->linked = 0;
+	}
+
+	unsigned int i;
+	for( i = 0; i < hash->used; ++i ) {
+		osrfHashEntry* entry = hash->entries + i;
+		if( entry->key ) {
+			if( hash->freeItem )
+				hash->freeItem( entry->key, entry->item );
+			osrfInternFree( entry->key );
 		}
 	}
 
-	osrfListFree(hash->hash);
-	free(hash);
+	free( hash->entries );
+	free( hash->index );
+	free( hash );
 }
 
 /**
@@ -519,14 +813,23 @@ void osrfHashFree( osrfHash* hash ) {
 	An osrfHashIterator may be used to traverse the items stored in an osrfHash.
 
 	The calling code is responsible for freeing the osrfHashIterator by calling
-	osrfHashIteratorFree().
+	osrfHashIteratorFree().  While any iterator is live, the osrfHash does not close up the
+	gaps left by removed entries.
 */
 osrfHashIterator* osrfNewHashIterator( osrfHash* hash ) {
 	if(!hash) return NULL;
 	osrfHashIterator* itr;
 	OSRF_MALLOC(itr, sizeof(osrfHashIterator));
 	itr->hash = hash;
-	itr->curr_node = NULL;
+	itr->curr = 0;
+	itr->linked = 0;
+	itr->next = NULL;
+	if( !hash->arena ) {
+		// Until the iterator is freed, slots stay where they are
+		itr->linked = 1;
+		itr->next = hash->iterators;
+		hash->iterators = itr;
+	}
 	return itr;
 }
 
@@ -540,17 +843,15 @@ osrfHashIterator* osrfNewHashIterator( osrfHash* hash ) {
 void* osrfHashIteratorNext( osrfHashIterator* itr ) {
 	if(!(itr && itr->hash)) return NULL;
 
-	// Advance to the next node in the linked list
+	// Advance to the next slot that hasn't been deleted
 
-	if( NULL == itr->curr_node )
-		itr->curr_node = itr->hash->first_key;
-	else
-		itr->curr_node = itr->curr_node->next;
+	const osrfHash* hash = itr->hash;
+	while( itr->curr < hash->used ) {
+		if( hash->entries[ itr->curr++ ].key )
+			return hash->entries[ itr->curr - 1 ].item;
+	}
 
-	if( itr->curr_node )
-		return itr->curr_node->item;
-	else
-		return NULL;
+	return NULL;
 }
 
 /**
@@ -563,8 +864,8 @@ void* osrfHashIteratorNext( osrfHashIterator* itr ) {
 	unless there has been a call to osrfHashIteratorReset() in the meanwhile.
 */
 const char* osrfHashIteratorKey( const osrfHashIterator* itr ) {
-	if( itr && itr->curr_node )
-		return itr->curr_node->key;
+	if( itr && itr->hash && itr->curr )
+		return itr->hash->entries[ itr->curr - 1 ].key;
 	else
 		return NULL;
 }
@@ -572,10 +873,20 @@ const char* osrfHashIteratorKey( const osrfHashIterator* itr ) {
 /**
 	@brief Free an osrfHashIterator.
 	@param itr Pointer to the osrfHashIterator to be freed.
+
+	The osrfHash may already have been freed, in which case osrfHashFree() has detached
+	the iterator from it.
 */
 void osrfHashIteratorFree( osrfHashIterator* itr ) {
-	if(itr)
-		free(itr);
+	if(!itr) return;
+
+	if( itr->linked ) {
+		osrfHashIterator** link = &itr->hash->iterators;
+		while( *link != itr )
+			link = &(*link)->next;
+		*link = itr->next;
+	}
+	free(itr);
 }
 
 /**
@@ -587,7 +898,7 @@ void osrfHashIteratorFree( osrfHashIterator* itr ) {
 */
 void osrfHashIteratorReset( osrfHashIterator* itr ) {
 	if(!itr) return;
-	itr->curr_node = NULL;
+	itr->curr = 0;
 }
 
 
@@ -601,8 +912,12 @@ void osrfHashIteratorReset( osrfHashIterator* itr ) {
 int osrfHashIteratorHasNext( osrfHashIterator* itr ) {
 	if( !itr || !itr->hash )
 		return 0;
-	else if( itr->curr_node )
-		return itr->curr_node->next ? 1 : 0;
-	else
-		return itr->hash->first_key ? 1 : 0;
+
+	const osrfHash* hash = itr->hash;
+	unsigned int i;
+	for( i = itr->curr; i < hash->used; ++i ) {
+		if( hash->entries[ i ].key )
+			return 1;
+	}
+	return 0;
 }
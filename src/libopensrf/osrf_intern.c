@@ -0,0 +1,242 @@
+/**
+	@file osrf_intern.c
+	@brief Implementation of a process-wide table of interned strings.
+
+	The table is an open-addressed array of pointers into a static pool of characters.
+	To add a string, we carve space for it from the pool by atomically advancing an offset,
+	copy the string there, and then install a pointer to it in an empty slot with an atomic
+	compare-and-swap.  If another thread beats us to the slot with the same string, we use
+	that one instead, and the space we carved out goes to waste -- a rare and harmless
+	outcome.
+
+	Slots are never emptied, so a reader needs no lock: it sees either NULL or a pointer to
+	a complete, immutable string.
+*/
+
+#include <stdint.h>
+#include <pthread.h>
+#include <opensrf/utils.h>
+#include <opensrf/osrf_intern.h>
+
+/** @brief Number of slots in the table.  Must be a power of 2. */
+#define INTERN_TABLE_SIZE 4096
+
+/** @brief Stop adding strings when this many slots are full, to keep probe chains short. */
+#define INTERN_TABLE_MAX ( INTERN_TABLE_SIZE / 4 * 3 )
+
+/** @brief Number of bytes in the pool of interned characters. */
+#define INTERN_POOL_SIZE 65536
+
+#if defined(__GNUC__) && ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 7 ) )
+#define OSRF_INTERN_ATOMIC
+#endif
+
+/** @brief The table of interned strings, each pointing into intern_pool. */
+static const char* intern_table[ INTERN_TABLE_SIZE ];
+
+/** @brief How many slots of the table are full. */
+static unsigned int intern_count = 0;
+
+/** @brief Storage for the interned strings themselves. */
+static char intern_pool[ INTERN_POOL_SIZE ];
+
+/** @brief How many bytes of intern_pool have been handed out. */
+static size_t intern_pool_used = 0;
+
+/** @brief Hash keys and class names of the OpenSRF protocol, interned before anything else. */
+static const char* seed_strings[] = {
+	"__c", "__p", "threadTrace", "locale", "tz", "ingress", "api_level", "binary",
+	"type", "payload", "method", "params", "status", "statusCode", "content",
+	"osrfMessage", "osrfMethod", "osrfResult", "osrfConnectStatus",
+	"osrfResultPartial", "osrfResultPartialComplete", "osrfMethodException",
+	NULL
+};
+
+/** @brief Ensures that the table is seeded only once. */
+static pthread_once_t seed_once = PTHREAD_ONCE_INIT;
+
+/**
+	@brief Determine whether a string is eligible for interning.
+	@param str Pointer to the string.
+	@param len Pointer through which to report the length of the string.
+	@return Boolean: 1 if the string is short and looks like an identifier; otherwise 0.
+*/
+static int internable( const char* str, size_t* len ) {
+	char c = str[ 0 ];
+	if( !( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || '_' == c ) )
+		return 0;
+
+	size_t n = 1;
+	while( str[ n ] ) {
+		if( ++n > OSRF_INTERN_MAX_LEN )
+			return 0;
+	}
+	*len = n;
+	return 1;
+}
+
+/**
+	@brief Hash a string of known length.
+	@param str Pointer to the string.
+	@param len Length of the string.
+	@return The hash value, to be masked by the calling code.
+
+	This is the FNV-1a algorithm.
+*/
+static inline unsigned int intern_hash( const char* str, size_t len ) {
+	unsigned int h = 2166136261u;
+	size_t i;
+	for( i = 0; i < len; ++i ) {
+		h ^= (unsigned char) str[ i ];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+	@brief Find the interned copy of a string, optionally interning it first.
+	@param str Pointer to the string.
+	@param add Boolean; true if we should intern the string if it isn't already.
+	@return Pointer to the interned copy, or NULL if there isn't one.
+*/
+static const char* intern_string( const char* str, int add ) {
+#ifdef OSRF_INTERN_ATOMIC
+	size_t len;
+	if( !str || !internable( str, &len ) )
+		return NULL;
+
+	char* copy = NULL;
+	unsigned int mask = INTERN_TABLE_SIZE - 1;
+	unsigned int i = intern_hash( str, len ) & mask;
+
+	for( ;; ) {
+		const char* slot = __atomic_load_n( &intern_table[ i ], __ATOMIC_ACQUIRE );
+		if( slot ) {
+			if( slot == str || ( slot[ 0 ] == str[ 0 ] && !strcmp( slot, str ) ) )
+				return slot;
+			i = ( i + 1 ) & mask;
+			continue;
+		}
+
+		// We've come to an empty slot without finding the string.  Add it, if asked to.
+		if( !add )
+			return NULL;
+		if( !copy ) {
+			if( __atomic_load_n( &intern_count, __ATOMIC_RELAXED ) >= INTERN_TABLE_MAX )
+				return NULL;
+			size_t offset = __atomic_fetch_add( &intern_pool_used, len + 1, __ATOMIC_RELAXED );
+			if( offset + len + 1 > INTERN_POOL_SIZE )
+				return NULL;
+			copy = intern_pool + offset;
+			memcpy( copy, str, len + 1 );
+		}
+
+		const char* expected = NULL;
+		if( __atomic_compare_exchange_n( &intern_table[ i ], &expected, copy, 0,
+				__ATOMIC_RELEASE, __ATOMIC_ACQUIRE ) ) {
+			__atomic_fetch_add( &intern_count, 1, __ATOMIC_RELAXED );
+			return copy;
+		}
+
+		// Another thread filled the slot first.  Go around again to see what it put there.
+	}
+#else
+	return NULL;
+#endif
+}
+
+/**
+	@brief Intern the strings that every OpenSRF message uses.
+
+	Called via pthread_once(), by osrfIntern() and osrfInternLookup().
+*/
+static void seed_table( void ) {
+	const char** seed;
+	for( seed = seed_strings; *seed; ++seed )
+		intern_string( *seed, 1 );
+}
+
+/**
+	@brief Find the interned copy of a string, interning it first if necessary.
+	@param str Pointer to the string.
+	@return Pointer to the interned copy, or NULL if the string isn't eligible for interning,
+		or if the table is full.
+
+	The interned copy lives as long as the process.  Don't try to free it, except through
+	osrfInternFree(), which knows to leave it alone.
+
+	Since nothing ever leaves the table, call this function only for strings from a
+	limited vocabulary, such as the class names that an application sets up when it
+	starts.  For strings that arrive from outside, such as the keys and class names of a
+	parsed JSON object, use osrfInternLookup() instead.
+*/
+const char* osrfIntern( const char* str ) {
+	pthread_once( &seed_once, seed_table );
+	return intern_string( str, 1 );
+}
+
+/**
+	@brief Find the interned copy of a string, without interning it.
+	@param str Pointer to the string.
+	@return Pointer to the interned copy, or NULL if the string hasn't been interned.
+
+	This is like osrfIntern(), except that it never adds to the table.  Hence a client
+	sending arbitrary keys can't use up the table and crowd out the ones we care about.
+*/
+const char* osrfInternLookup( const char* str ) {
+	pthread_once( &seed_once, seed_table );
+	return intern_string( str, 0 );
+}
+
+/**
+	@brief Determine whether a pointer points to an interned string.
+	@param str The pointer.
+	@return Boolean: 1 if it points to an interned string, or 0 if not.
+*/
+int osrfIsInterned( const char* str ) {
+	uintptr_t p = (uintptr_t) str;
+	return p >= (uintptr_t) intern_pool && p < (uintptr_t) ( intern_pool + INTERN_POOL_SIZE );
+}
+
+/**
+	@brief Intern a string if possible, or else make a copy of it on the heap.
+	@param str Pointer to the string.
+	@return Pointer to the interned string or to the copy, or NULL if @a str is NULL.
+
+	The calling code should dispose of the result by calling osrfInternFree(), which frees
+	it if it's a copy, and leaves it alone if it's interned.  Nobody should modify it.
+*/
+char* osrfInternStrdup( const char* str ) {
+	if( !str )
+		return NULL;
+	const char* interned = osrfIntern( str );
+	return interned ? (char*) interned : strdup( str );
+}
+
+/**
+	@brief Share an interned copy of a string if there is one, or else make a copy of it on
+		the heap.
+	@param str Pointer to the string.
+	@return Pointer to the interned string or to the copy, or NULL if @a str is NULL.
+
+	This is like osrfInternStrdup(), except that it never adds to the table, so it is safe
+	for strings that arrive from outside (see osrfInternLookup()).  Dispose of the result
+	by calling osrfInternFree().
+*/
+char* osrfInternLookupStrdup( const char* str ) {
+	if( !str )
+		return NULL;
+	const char* interned = osrfInternLookup( str );
+	return interned ? (char*) interned : strdup( str );
+}
+
+/**
+	@brief Free a string returned by osrfInternStrdup() or osrfInternLookupStrdup().
+	@param str Pointer to the string.
+
+	If the string is interned, leave it alone; otherwise free it.
+*/
+void osrfInternFree( char* str ) {
+	if( !osrfIsInterned( str ) )
+		free( str );
+}
@@ -0,0 +1,478 @@
+/**
+	@file osrf_json_binary.c
+	@brief Translate jsonObjects to and from a compact binary encoding.
+
+	The encoding is CBOR (RFC 7049), restricted to what a jsonObject can express:
+
+	- A JSON_NULL is the simple value null (0xf6), and a JSON_BOOL is true (0xf5) or
+	false (0xf4).
+	- A JSON_STRING is a text string.
+	- A JSON_ARRAY is an array, and a JSON_HASH is a map with text string keys.
+	- A JSON_NUMBER whose numeric string is an integer in canonical form (no plus sign,
+	no leading zeros, no "-0") that fits in 64 bits is an integer.  Any other JSON_NUMBER
+	is its numeric string, as a text string under tag JSON_BINARY_TAG_NUMBER.  Either way
+	the numeric string survives a round trip unchanged.
+	- A jsonObject with a class name is wrapped in tag 27 ("object with type name"), as an
+	array of two: the class name, and the jsonObject without its class name.
+
+	Thus the encoding carries everything that jsonObjectToJSON() would, without the need
+	to escape strings on the way out or to scan for quotation marks on the way in.
+
+	We decode only the kinds of item that we produce, plus double-precision floats,
+	for the sake of other encoders.  In particular we don't accept byte strings, or
+	items of indefinite length.  Nor do we accept a NaN or infinite double, which has
+	no JSON representation.
+*/
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <math.h>
+#include <opensrf/osrf_json.h>
+
+/** @brief CBOR major types. */
+#define CBOR_UINT   0
+#define CBOR_NEGINT 1
+#define CBOR_TEXT   3
+#define CBOR_ARRAY  4
+#define CBOR_MAP    5
+#define CBOR_TAG    6
+#define CBOR_SIMPLE 7
+
+/** @brief The complete initial bytes of CBOR items with no argument. */
+#define CBOR_FALSE  0xf4
+#define CBOR_TRUE   0xf5
+#define CBOR_NULL   0xf6
+#define CBOR_DOUBLE 0xfb
+
+/** @brief Nesting depth beyond which we refuse to decode, to protect the stack. */
+#define JSON_BINARY_MAX_DEPTH 1000
+
+/**
+	@brief A position within some encoded input.
+*/
+typedef struct {
+	const unsigned char* p;     /**< The next byte to be read */
+	const unsigned char* end;   /**< One past the last byte */
+} Reader;
+
+static void encode_item( const jsonObject* obj, growing_buffer* buf );
+static void encode_head( growing_buffer* buf, int major, uint64_t arg );
+static void encode_text( growing_buffer* buf, const char* str, size_t len );
+static int is_canonical_integer( const jsonObject* obj );
+static jsonObject* decode_item( Reader* reader, int depth );
+static int decode_head( Reader* reader, int* major, uint64_t* arg );
+static char* decode_text( Reader* reader, char* small, size_t small_size );
+
+/**
+	@brief Append the binary encoding of a jsonObject to a growing_buffer.
+	@param obj Pointer to the jsonObject to be encoded.
+	@param buf Pointer to the growing_buffer.
+	@return 0 if successful, or -1 if either pointer is NULL.
+
+	The encoding is binary, and may include nul bytes; use buffer_length() to find out how
+	long it is.  Several encoded jsonObjects may be appended to the same buffer one after
+	another, and decoded one at a time by jsonObjectFromBinary().
+*/
+int jsonObjectToBinary( const jsonObject* obj, growing_buffer* buf ) {
+	if( !( obj && buf ) )
+		return -1;
+	encode_item( obj, buf );
+	return 0;
+}
+
+/**
+	@brief Append the encoding of a jsonObject and everything below it.
+	@param obj Pointer to the jsonObject; may be NULL, which we encode as a null.
+	@param buf Pointer to the growing_buffer.
+*/
+static void encode_item( const jsonObject* obj, growing_buffer* buf ) {
+
+	if( !obj ) {
+		OSRF_BUFFER_ADD_CHAR( buf, (char) CBOR_NULL );
+		return;
+	}
+
+	if( obj->classname ) {
+		encode_head( buf, CBOR_TAG, JSON_BINARY_TAG_CLASS );
+		encode_head( buf, CBOR_ARRAY, 2 );
+		encode_text( buf, obj->classname, strlen( obj->classname ) );
+	}
+
+	switch( obj->type ) {
+		case JSON_NULL :
+			OSRF_BUFFER_ADD_CHAR( buf, (char) CBOR_NULL );
+			break;
+
+		case JSON_BOOL :
+			OSRF_BUFFER_ADD_CHAR( buf, (char) ( obj->value.b ? CBOR_TRUE : CBOR_FALSE ) );
+			break;
+
+		case JSON_STRING :
+			encode_text( buf, obj->value.s, strlen( obj->value.s ) );
+			break;
+
+		case JSON_NUMBER : {
+			if( is_canonical_integer( obj ) ) {
+				int64_t n = jsonObjectGetInt64( obj );
+				if( n >= 0 )
+					encode_head( buf, CBOR_UINT, (uint64_t) n );
+				else
+					encode_head( buf, CBOR_NEGINT, (uint64_t) ( -1 - n ) );
+			} else {
+				const char* s = obj->value.s ? obj->value.s : "0";
+				encode_head( buf, CBOR_TAG, JSON_BINARY_TAG_NUMBER );
+				encode_text( buf, s, strlen( s ) );
+			}
+			break;
+		}
+
+		case JSON_ARRAY : {
+			// An empty array may have no osrfList at all.
+			unsigned long count = obj->value.l ? obj->value.l->size : 0;
+			encode_head( buf, CBOR_ARRAY, count );
+			unsigned long i;
+			for( i = 0; i < count; ++i )
+				encode_item( OSRF_LIST_GET_INDEX( obj->value.l, i ), buf );
+			break;
+		}
+
+		case JSON_HASH : {
+			if( !obj->value.h ) {
+				encode_head( buf, CBOR_MAP, 0 );
+				break;
+			}
+			encode_head( buf, CBOR_MAP, osrfHashGetCount( obj->value.h ) );
+			osrfHashIterator* itr = osrfNewHashIterator( obj->value.h );
+			const jsonObject* item;
+			while( ( item = osrfHashIteratorNext( itr ) ) ) {
+				const char* key = osrfHashIteratorKey( itr );
+				encode_text( buf, key, strlen( key ) );
+				encode_item( item, buf );
+			}
+			osrfHashIteratorFree( itr );
+			break;
+		}
+
+		default :
+			OSRF_BUFFER_ADD_CHAR( buf, (char) CBOR_NULL );
+			break;
+	}
+}
+
+/**
+	@brief Append the initial bytes of a CBOR item: its major type and argument.
+	@param buf Pointer to the growing_buffer.
+	@param major The major type.
+	@param arg The argument: a length, a count, a tag number, or the value of an integer.
+
+	The argument goes into the low five bits of the first byte if it's small enough, or
+	else into the shortest of 1, 2, 4, or 8 following bytes that will hold it, most
+	significant byte first.
+*/
+static void encode_head( growing_buffer* buf, int major, uint64_t arg ) {
+	unsigned char head[ 9 ];
+	size_t len;
+	unsigned char type = major << 5;
+
+	if( arg < 24 ) {
+		head[ 0 ] = type | arg;
+		len = 1;
+	} else if( arg <= 0xff ) {
+		head[ 0 ] = type | 24;
+		head[ 1 ] = arg;
+		len = 2;
+	} else if( arg <= 0xffff ) {
+		head[ 0 ] = type | 25;
+		head[ 1 ] = arg >> 8;
+		head[ 2 ] = arg;
+		len = 3;
+	} else if( arg <= 0xffffffff ) {
+		head[ 0 ] = type | 26;
+		head[ 1 ] = arg >> 24;
+		head[ 2 ] = arg >> 16;
+		head[ 3 ] = arg >> 8;
+		head[ 4 ] = arg;
+		len = 5;
+	} else {
+		head[ 0 ] = type | 27;
+		int i;
+		for( i = 8; i > 0; --i ) {
+			head[ i ] = arg;
+			arg >>= 8;
+		}
+		len = 9;
+	}
+
+	buffer_add_n( buf, (const char*) head, len );
+}
+
+/**
+	@brief Append a CBOR text string.
+	@param buf Pointer to the growing_buffer.
+	@param str Pointer to the characters.
+	@param len How many characters there are.
+*/
+static void encode_text( growing_buffer* buf, const char* str, size_t len ) {
+	encode_head( buf, CBOR_TEXT, len );
+	buffer_add_n( buf, str, len );
+}
+
+/**
+	@brief Determine whether a JSON_NUMBER can be encoded as a CBOR integer.
+	@param obj Pointer to the JSON_NUMBER.
+	@return Boolean: 1 if formatting the integer would reproduce the numeric string
+		exactly, or 0 if not.
+*/
+static int is_canonical_integer( const jsonObject* obj ) {
+	const char* s = obj->value.s;
+	if( !s )
+		return 0;
+
+	const char* digits = ( '-' == *s ) ? s + 1 : s;
+	if( '0' == digits[ 0 ] && ( digits[ 1 ] || digits != s ) )
+		return 0;     // Leading zero, or "-0"
+
+	size_t len = 0;
+	while( isdigit( (unsigned char) digits[ len ] ) )
+		++len;
+	if( !len || digits[ len ] )
+		return 0;     // Not an integer
+
+	// Compare against the largest magnitude that fits in an int64_t.
+	const char* limit = ( digits != s ) ? "9223372036854775808" : "9223372036854775807";
+	return len < 19 || ( 19 == len && strcmp( digits, limit ) <= 0 );
+}
+
+/**
+	@brief Decode a jsonObject from its binary encoding.
+	@param data Pointer to the encoded bytes.
+	@param len How many bytes are available.
+	@param used Pointer through which to report how many bytes we decoded; may be NULL.
+	@return Pointer to a newly created jsonObject, or NULL if the data are invalid or
+		incomplete.
+
+	We decode a single item, ignoring anything after it.  To decode a series of items
+	encoded one after another, call this function repeatedly, advancing @a data by
+	whatever it reports through @a used.
+
+	The calling code is responsible for freeing the jsonObject by calling jsonObjectFree().
+*/
+jsonObject* jsonObjectFromBinary( const char* data, size_t len, size_t* used ) {
+	if( !data )
+		return NULL;
+
+	Reader reader;
+	reader.p = (const unsigned char*) data;
+	reader.end = reader.p + len;
+
+	jsonObject* obj = decode_item( &reader, 0 );
+	if( obj ) {
+		if( used )
+			*used = reader.p - (const unsigned char*) data;
+	} else
+		osrfLogError( OSRF_LOG_MARK, "Invalid binary JSON at offset %ld",
+			(long) ( reader.p - (const unsigned char*) data ) );
+
+	return obj;
+}
+
+/**
+	@brief Decode a jsonObject and everything below it.
+	@param reader Pointer to the current position in the input.
+	@param depth How many containers enclose the item.
+	@return Pointer to a newly created jsonObject, or NULL upon error.
+*/
+static jsonObject* decode_item( Reader* reader, int depth ) {
+
+	if( depth > JSON_BINARY_MAX_DEPTH )
+		return NULL;
+
+	// Check for the items that have no argument.
+	if( reader->p < reader->end ) {
+		unsigned char c = *reader->p;
+		if( CBOR_NULL == c ) {
+			++reader->p;
+			return jsonNewObject( NULL );
+		} else if( CBOR_TRUE == c || CBOR_FALSE == c ) {
+			++reader->p;
+			return jsonNewBoolObject( CBOR_TRUE == c );
+		} else if( CBOR_DOUBLE == c ) {
+			if( reader->end - reader->p < 9 )
+				return NULL;
+			uint64_t bits = 0;
+			int i;
+			for( i = 1; i <= 8; ++i )
+				bits = ( bits << 8 ) | reader->p[ i ];
+			reader->p += 9;
+			double d;
+			memcpy( &d, &bits, sizeof( d ) );
+			if( !isfinite( d ) )
+				return NULL;   // JSON has no way to say NaN or infinity
+			return jsonNewNumberObject( d );
+		}
+	}
+
+	int major;
+	uint64_t arg;
+	if( decode_head( reader, &major, &arg ) )
+		return NULL;
+
+	jsonObject* obj = NULL;
+	char numbuf[ 32 ];
+	char small[ 128 ];
+
+	switch( major ) {
+		case CBOR_UINT :
+			snprintf( numbuf, sizeof( numbuf ), "%" PRIu64, arg );
+			obj = jsonNewObject( NULL );
+			obj->type = JSON_NUMBER;
+			obj->value.s = strdup( numbuf );
+			jsonObjectCacheNumber( obj );
+			break;
+
+		case CBOR_NEGINT :
+			// The value is -1 - arg.  Format it without overflowing.
+			if( arg < UINT64_MAX )
+				snprintf( numbuf, sizeof( numbuf ), "-%" PRIu64, arg + 1 );
+			else
+				strcpy( numbuf, "-18446744073709551616" );
+			obj = jsonNewObject( NULL );
+			obj->type = JSON_NUMBER;
+			obj->value.s = strdup( numbuf );
+			jsonObjectCacheNumber( obj );
+			break;
+
+		case CBOR_TEXT :
+			if( arg > (uint64_t) ( reader->end - reader->p ) )
+				return NULL;
+			obj = jsonNewObject( NULL );
+			obj->type = JSON_STRING;
+			obj->value.s = safe_malloc( arg + 1 );
+			memcpy( obj->value.s, reader->p, arg );
+			obj->value.s[ arg ] = '\0';
+			reader->p += arg;
+			break;
+
+		case CBOR_ARRAY : {
+			obj = jsonNewObjectType( JSON_ARRAY );
+			uint64_t i;
+			for( i = 0; i < arg; ++i ) {
+				jsonObject* item = decode_item( reader, depth + 1 );
+				if( !item ) {
+					jsonObjectFree( obj );
+					return NULL;
+				}
+				jsonObjectPush( obj, item );
+			}
+			break;
+		}
+
+		case CBOR_MAP : {
+			obj = jsonNewObjectType( JSON_HASH );
+			uint64_t i;
+			for( i = 0; i < arg; ++i ) {
+				char* key = decode_text( reader, small, sizeof( small ) );
+				jsonObject* item = key ? decode_item( reader, depth + 1 ) : NULL;
+				if( !item ) {
+					if( key != small )
+						free( key );
+					jsonObjectFree( obj );
+					return NULL;
+				}
+				jsonObjectSetKey( obj, key, item );
+				if( key != small )
+					free( key );
+			}
+			break;
+		}
+
+		case CBOR_TAG :
+			if( JSON_BINARY_TAG_CLASS == arg ) {
+				int inner;
+				uint64_t count;
+				if( decode_head( reader, &inner, &count ) || inner != CBOR_ARRAY || count != 2 )
+					return NULL;
+				char* classname = decode_text( reader, small, sizeof( small ) );
+				if( !classname )
+					return NULL;
+				obj = decode_item( reader, depth + 1 );
+				if( obj )
+					jsonObjectSetClass( obj, classname );
+				if( classname != small )
+					free( classname );
+			} else if( JSON_BINARY_TAG_NUMBER == arg ) {
+				char* numstr = decode_text( reader, small, sizeof( small ) );
+				if( !numstr )
+					return NULL;
+				obj = jsonNewNumberStringObject( numstr );
+				if( numstr != small )
+					free( numstr );
+			}
+			break;
+
+		default :
+			break;
+	}
+
+	return obj;
+}
+
+/**
+	@brief Read the initial bytes of a CBOR item: its major type and argument.
+	@param reader Pointer to the current position in the input.
+	@param major Pointer through which to return the major type.
+	@param arg Pointer through which to return the argument.
+	@return 0 if successful, or -1 if the input is incomplete, or if the item has an
+		indefinite length or a reserved argument size.
+*/
+static int decode_head( Reader* reader, int* major, uint64_t* arg ) {
+	if( reader->p >= reader->end )
+		return -1;
+
+	unsigned char c = *reader->p++;
+	*major = c >> 5;
+	c &= 0x1f;
+
+	if( c < 24 ) {
+		*arg = c;
+		return 0;
+	} else if( c > 27 )
+		return -1;
+
+	size_t len = (size_t) 1 << ( c - 24 );
+	if( (size_t) ( reader->end - reader->p ) < len )
+		return -1;
+
+	uint64_t n = 0;
+	size_t i;
+	for( i = 0; i < len; ++i )
+		n = ( n << 8 ) | *reader->p++;
+
+	*arg = n;
+	return 0;
+}
+
+/**
+	@brief Read a CBOR text string, and make a nul-terminated copy of it.
+	@param reader Pointer to the current position in the input.
+	@param small Pointer to a buffer for the copy, if it fits.
+	@param small_size Size of the @a small buffer.
+	@return Pointer to the copy -- either @a small or a newly allocated string, which the
+		calling code must free -- or NULL upon error.
+
+	Hash keys and class names are usually short, so we can often avoid a malloc().
+*/
+static char* decode_text( Reader* reader, char* small, size_t small_size ) {
+	int major;
+	uint64_t len;
+	if( decode_head( reader, &major, &len ) || major != CBOR_TEXT
+			|| len > (uint64_t) ( reader->end - reader->p ) )
+		return NULL;
+
+	char* str = ( len < small_size ) ? small : safe_malloc( len + 1 );
+	memcpy( str, reader->p, len );
+	str[ len ] = '\0';
+	reader->p += len;
+	return str;
+}
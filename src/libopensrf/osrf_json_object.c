@@ -22,15 +22,26 @@ GNU General Public License for more details.
 	we can take one from the free list, if one is available, instead of calling
 	malloc().  Likewise when we free a jsonObject, we can stick it on the free list
 	for potential reuse instead of calling free().
+
+	Each thread has a free list of its own, so that threads don't need to lock anything
+	to create or free jsonObjects.  When a thread's free list grows too long, it hands a
+	batch of jsonObjects (a "magazine") to a shared depot, from which a thread with an
+	empty free list can take a batch later.  The depot holds only a limited number of
+	magazines; beyond that, the surplus goes back to the heap.  When a thread exits, its
+	free list goes to the depot, or to the heap.
 */
 
 #include <stdlib.h>
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <opensrf/log.h>
 #include <opensrf/osrf_json.h>
 #include <opensrf/osrf_utf8.h>
+#include <opensrf/osrf_intern.h>
 
 /* cleans up an object if it is morphing another object, also
  * verifies that the appropriate storage container exists where appropriate */
@@ -42,7 +53,8 @@ GNU General Public License for more details.
 	If the old type and the new type don't match, discard and free the old contents.
 
 	If the old type is JSON_STRING or JSON_NUMBER, free the internal string buffer even
-	if the type is not changing.
+	if the type is not changing -- unless it lives in an osrfArena, or is borrowed from
+	someone else's buffer.
 
 	If the new type is JSON_ARRAY or JSON_HASH, make sure there is an osrfList or osrfHash
 	in the jsonObject, respectively.
@@ -55,61 +67,264 @@ GNU General Public License for more details.
 		osrfListFree(_obj_->value.l);			\
 		_obj_->value.l = NULL;					\
 	} else if( _obj_->type == JSON_STRING || _obj_->type == JSON_NUMBER ) { \
-		free(_obj_->value.s);					\
+		if( !(_obj_->flags & (JSON_NODE_ARENA | JSON_NODE_BORROWED_STRING)) ) \
+			free(_obj_->value.s);				\
+		_obj_->flags &= ~JSON_NODE_BORROWED_STRING; \
 		_obj_->value.s = NULL;					\
 	} else if( _obj_->type == JSON_BOOL && newtype != JSON_BOOL ) { \
 		_obj_->value.l = NULL;					\
 	} \
 	_obj_->type = newtype; \
+	_obj_->flags &= ~JSON_NODE_NUM_CACHED; \
 	if( newtype == JSON_HASH && _obj_->value.h == NULL ) {	\
 		_obj_->value.h = osrfNewHash();		\
 		osrfHashSetCallback( _obj_->value.h, _jsonFreeHashItem ); \
+		osrfHashInternKeys( _obj_->value.h ); \
 	} else if( newtype == JSON_ARRAY && _obj_->value.l == NULL ) {	\
 		_obj_->value.l = osrfNewList();		\
 		_obj_->value.l->freeItem = _jsonFreeListItem;\
 	}
 
+#if defined(__GNUC__) && ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 7 ) )
+/** Adjust the reference count of a shared jsonObject, returning the previous count */
+#define JSON_REFS_ADD( _obj_, _n_ ) __atomic_fetch_add( &(_obj_)->refs, (_n_), __ATOMIC_ACQ_REL )
+#else
+#define JSON_REFS_ADD( _obj_, _n_ ) ( ( (_obj_)->refs += (_n_) ) - (_n_) )
+#endif
+
+/** How many jsonObjects make up a magazine, the unit of exchange with the depot */
+#define JSON_MAGAZINE_SIZE 64
+/** The most magazines the depot will hold; the surplus goes back to the heap */
+#define JSON_DEPOT_MAX 32
+
 /** Count of the times we put a freed jsonObject on the free list instead of calling free() */
-static int unusedObjCapture = 0;
+static __thread int unusedObjCapture = 0;
 /** Count of the times we reused a jsonObject from the free list instead of calling malloc() */
-static int unusedObjRelease = 0;
+static __thread int unusedObjRelease = 0;
 /** Count of the times we allocated a jsonObject with malloc() */
-static int mallocObjCreate = 0;
+static __thread int mallocObjCreate = 0;
 /** Number of unused jsonObjects currently on the free list */
-static int currentListLen = 0;
+static __thread int currentListLen = 0;
 
 /**
-	Union overlaying a jsonObject with a pointer.  When the jsonObject is not in use as a
-	jsonObject, we use the overlaid pointer to maintain a linked list of unused jsonObjects.
+	Union overlaying a jsonObject with a pair of pointers.  When the jsonObject is not in use
+	as a jsonObject, we use the overlaid pointers to maintain linked lists of unused
+	jsonObjects.
 */
 union unusedObjUnion{
 
-	union unusedObjUnion* next;
+	struct {
+		/** Next unused jsonObject on the same free list or in the same magazine */
+		union unusedObjUnion* next;
+		/** In the depot: first jsonObject of the next magazine */
+		union unusedObjUnion* next_mag;
+	} link;
 	jsonObject obj;
 };
 typedef union unusedObjUnion unusedObj;
 
-/** Pointer to the head of the free list */
-static unusedObj* freeObjList = NULL;
+/** Pointer to the head of this thread's free list */
+static __thread unusedObj* freeObjList = NULL;
+
+/** 1 if we have arranged to dispose of this thread's free list when it exits; -1 once we
+	have done so, and the thread is exiting; otherwise 0 */
+static __thread int freeListRegistered = 0;
+
+/** Linked list of magazines, each of them a linked list of JSON_MAGAZINE_SIZE jsonObjects */
+static unusedObj* depot = NULL;
+/** How many magazines are in the depot */
+static int depotLen = 0;
+/** Mutex guarding the depot */
+static pthread_mutex_t depotLock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Key whose destructor disposes of a thread's free list when the thread exits */
+static pthread_key_t freeListKey;
+/** For creating freeListKey exactly once */
+static pthread_once_t freeListKeyOnce = PTHREAD_ONCE_INIT;
+
+/** For add_json_to_sink(): write class names as if they weren't there */
+#define JSON_CLASS_IGNORE 0
+/** For add_json_to_sink(): expand class names into JSON_CLASS_KEY / JSON_DATA_KEY wrappers */
+#define JSON_CLASS_ENCODE 1
+/** For add_json_to_sink(): collapse JSON_CLASS_KEY / JSON_DATA_KEY wrappers into their data */
+#define JSON_CLASS_DECODE 2
+
+static void add_json_to_sink( const jsonObject* obj, jsonSink* sink, int class_mode );
+static void add_json_value_to_sink( const jsonObject* obj, jsonSink* sink, int class_mode );
+static void _jsonFreeHashItem(char* key, void* item);
+static void _jsonFreeListItem(void* item);
 
-static void add_json_to_buffer( const jsonObject* obj,
-	growing_buffer * buf, int do_classname, int second_pass );
+/**
+	@brief Free a linked list of unused jsonObjects.
+	@param list Pointer to the first jsonObject in the list.
+*/
+static void free_obj_chain( unusedObj* list ) {
+	unusedObj* temp;
+	while( list ) {
+		temp = list->link.next;
+		free( list );
+		list = temp;
+	}
+}
+
+/**
+	@brief Move a magazine from the front of this thread's free list to the depot.
+
+	If the depot is already full, return the magazine to the heap instead.
+
+	The free list must hold at least JSON_MAGAZINE_SIZE jsonObjects.
+*/
+static void release_magazine( void ) {
+	unusedObj* mag = freeObjList;
+	unusedObj* last = mag;
+	int i;
+	for( i = 1; i < JSON_MAGAZINE_SIZE; ++i )
+		last = last->link.next;
+
+	freeObjList = last->link.next;
+	last->link.next = NULL;
+	currentListLen -= JSON_MAGAZINE_SIZE;
+
+	pthread_mutex_lock( &depotLock );
+	if( depotLen < JSON_DEPOT_MAX ) {
+		mag->link.next_mag = depot;
+		__atomic_store_n( &depot, mag, __ATOMIC_RELAXED );
+		++depotLen;
+		mag = NULL;
+	}
+	pthread_mutex_unlock( &depotLock );
+
+	free_obj_chain( mag );    // If the depot had no room for it
+}
+
+/**
+	@brief Refill this thread's empty free list with a magazine from the depot, if the
+	depot has one.
+*/
+static void acquire_magazine( void ) {
+	if( !__atomic_load_n( &depot, __ATOMIC_RELAXED ) )
+		return;    // Not worth locking just to find out for sure
+
+	pthread_mutex_lock( &depotLock );
+	unusedObj* mag = depot;
+	if( mag ) {
+		__atomic_store_n( &depot, mag->link.next_mag, __ATOMIC_RELAXED );
+		--depotLen;
+	}
+	pthread_mutex_unlock( &depotLock );
+
+	if( mag ) {
+		freeObjList = mag;
+		currentListLen = JSON_MAGAZINE_SIZE;
+	}
+}
+
+/**
+	@brief Dispose of a thread's free list when the thread exits.
+	@param unused Not used.
+
+	Whole magazines go to the depot, if it has room; the rest go back to the heap.
+
+	Other destructors may still create and free jsonObjects after this one runs.  From
+	here on the thread bypasses the free list and uses the heap directly, since nobody
+	would reclaim the list again.
+*/
+static void release_free_list( void* unused ) {
+	while( currentListLen >= JSON_MAGAZINE_SIZE )
+		release_magazine();
+	free_obj_chain( freeObjList );
+	freeObjList = NULL;
+	currentListLen = 0;
+	freeListRegistered = -1;
+}
+
+/**
+	@brief Create the key whose destructor disposes of each thread's free list.
+*/
+static void make_free_list_key( void ) {
+	pthread_key_create( &freeListKey, release_free_list );
+}
+
+/**
+	@brief Allocate a jsonObject from this thread's free list if possible, or else from
+	the heap.
+	@return Pointer to the jsonObject, whose contents are indeterminate.
+*/
+static jsonObject* alloc_json_object( void ) {
+	jsonObject* o;
+
+	if( !freeObjList && freeListRegistered >= 0 )
+		acquire_magazine();
+
+	if( freeObjList ) {
+		o = (jsonObject*) freeObjList;
+		freeObjList = freeObjList->link.next;
+		unusedObjRelease++;
+		currentListLen--;
+	} else {
+		OSRF_MALLOC( o, sizeof(jsonObject) );
+		mallocObjCreate++;
+	}
+
+	return o;
+}
+
+/**
+	@brief Stick an unwanted jsonObject onto this thread's free list for potential reuse.
+	@param o Pointer to the jsonObject, whose contents have already been disposed of.
+*/
+static void recycle_json_object( jsonObject* o ) {
+	if( freeListRegistered < 0 ) {
+		free( o );    // The thread is exiting; see release_free_list()
+		return;
+	} else if( !freeListRegistered ) {
+		pthread_once( &freeListKeyOnce, make_free_list_key );
+		pthread_setspecific( freeListKey, &freeListRegistered );
+		freeListRegistered = 1;
+	}
+
+	unusedObj* unused = (unusedObj*) o;
+	unused->link.next = freeObjList;
+	freeObjList = unused;
+
+	unusedObjCapture++;
+	currentListLen++;
+	if (unusedObjCapture > 1 && !(unusedObjCapture % 1000))
+		osrfLogDebug( OSRF_LOG_MARK, "Objects malloc()'d: %d, "
+			"Reusable objects captured: %d, Objects reused: %d, "
+			"Current List Length: %d",
+			mallocObjCreate, unusedObjCapture, unusedObjRelease, currentListLen );
+
+	// Trim policy: keep no more than two magazines' worth for this thread
+	if( currentListLen >= 2 * JSON_MAGAZINE_SIZE )
+		release_magazine();
+}
 
 /**
 	@brief Return all jsonObjects in the free list to the heap.
 
-	Reclaims memory occupied by unused jsonObjects in the free list.  It is never really
-	necessary to call this function, assuming that we don't run out of memory.  However
-	it might be worth calling if we have built and destroyed a lot of jsonObjects that
-	we don't expect to need again, in order to reduce our memory footprint.
+	Reclaims memory occupied by unused jsonObjects in the calling thread's free list, and
+	in the shared depot.  It is never really necessary to call this function, assuming
+	that we don't run out of memory.  However it might be worth calling if we have built
+	and destroyed a lot of jsonObjects that we don't expect to need again, in order to
+	reduce our memory footprint.
 */
 void jsonObjectFreeUnused( void ) {
 
-	unusedObj* temp;
-	while( freeObjList ) {
-		temp = freeObjList->next;
-		free( freeObjList );
-		freeObjList = temp;
+	free_obj_chain( freeObjList );
+	freeObjList = NULL;
+	currentListLen = 0;
+
+	pthread_mutex_lock( &depotLock );
+	unusedObj* mag = depot;
+	__atomic_store_n( &depot, NULL, __ATOMIC_RELAXED );
+	depotLen = 0;
+	pthread_mutex_unlock( &depotLock );
+
+	while( mag ) {
+		unusedObj* next_mag = mag->link.next_mag;
+		free_obj_chain( mag );
+		mag = next_mag;
 	}
 }
 
@@ -129,19 +344,13 @@ jsonObject* jsonNewObject(const char* data) {
 
 	// Allocate a jsonObject; from the free list if possible,
 	// or from the heap if necessary.
-	if( freeObjList ) {
-		o = (jsonObject*) freeObjList;
-		freeObjList = freeObjList->next;
-        unusedObjRelease++;
-        currentListLen--;
-	} else {
-		OSRF_MALLOC( o, sizeof(jsonObject) );
-        mallocObjCreate++;
-    }
+	o = alloc_json_object();
 
 	o->size = 0;
 	o->classname = NULL;
 	o->parent = NULL;
+	o->flags = 0;
+	o->refs = 0;
 
 	if(data) {
 		o->type = JSON_STRING;
@@ -169,19 +378,13 @@ jsonObject* jsonNewObjectFmt(const char* data, ...) {
 
 	jsonObject* o;
 
-	if( freeObjList ) {
-		o = (jsonObject*) freeObjList;
-		freeObjList = freeObjList->next;
-        unusedObjRelease++;
-        currentListLen--;
-	} else {
-		OSRF_MALLOC( o, sizeof(jsonObject) );
-        mallocObjCreate++;
-    }
+	o = alloc_json_object();
 
 	o->size = 0;
 	o->classname = NULL;
 	o->parent = NULL;
+	o->flags = 0;
+	o->refs = 0;
 
 	if(data) {
 		VA_LIST_TO_STRING(data);
@@ -196,6 +399,443 @@ jsonObject* jsonNewObjectFmt(const char* data, ...) {
 	return o;
 }
 
+/**
+	@brief Convert a numeric string to a 64-bit integer, if it is one.
+	@param str Pointer to the numeric string.
+	@param result Pointer through which to return the integer.
+	@return 1 if the string is an optional minus sign followed by nothing but digits, and
+		its value fits in an int64_t; otherwise 0.
+*/
+static int string_to_int64( const char* str, int64_t* result ) {
+	int negative = 0;
+	if( '-' == *str ) {
+		negative = 1;
+		++str;
+	}
+	if( !*str )
+		return 0;
+
+	// Accumulate as a negative number, since the negative range is the larger one.
+	int64_t n = 0;
+	do {
+		unsigned int digit = (unsigned char) *str - '0';
+		if( digit > 9 || n < ( INT64_MIN + (int64_t) digit ) / 10 )
+			return 0;
+		n = n * 10 - digit;
+	} while( *++str );
+
+	if( !negative ) {
+		if( INT64_MIN == n )
+			return 0;
+		n = -n;
+	}
+	*result = n;
+	return 1;
+}
+
+/**
+	@brief Convert a numeric string to the value we cache for it.
+	@param str Pointer to the numeric string.
+	@param num Pointer through which to return the value.
+	@return JSON_NODE_NUM_INT if @a num now holds an integer, or JSON_NODE_NUM_DOUBLE if it
+		holds a double.
+
+	"-0" and its kin have no integer form that keeps the sign, so they become doubles.
+*/
+static int number_value( const char* str, union _jsonNumCache* num ) {
+	if( string_to_int64( str, &num->i ) && !( 0 == num->i && '-' == *str ) )
+		return JSON_NODE_NUM_INT;
+
+	num->d = strtod( str, NULL );
+	return JSON_NODE_NUM_DOUBLE;
+}
+
+/**
+	@brief Cache the value of a JSON_NUMBER's numeric string.
+	@param obj Pointer to the jsonObject.
+
+	Whatever stores a numeric string in a jsonObject should call this function before
+	anybody else can see the jsonObject.  jsonObjectGetNumber() and jsonObjectGetInt64()
+	only read the cache, so that several threads may read a shared tree at once.
+
+	If @a obj is NULL, or isn't a JSON_NUMBER with a numeric string, nothing happens.
+*/
+void jsonObjectCacheNumber( jsonObject* obj ) {
+	if( !( obj && obj->type == JSON_NUMBER && obj->value.s ) )
+		return;
+
+	obj->flags &= ~JSON_NODE_NUM_CACHED;
+	obj->flags |= number_value( obj->value.s, &obj->num );
+}
+
+/**
+	@brief Cache the value of a JSON_NUMBER that we have just formatted from a double.
+	@param obj Pointer to the jsonObject.
+	@param num The number from which its string was formatted.
+
+	doubleToString() loses nothing, so we can skip converting the string back.  We cache
+	the same thing that jsonObjectCacheNumber() would: an integer if the number is integral
+	and in range, or else the double -- including negative zero, whose sign an integer
+	would lose.
+*/
+static void cache_double( jsonObject* obj, double num ) {
+	if( num >= -9223372036854775808.0 && num < 9223372036854775808.0
+			&& num == (double) (int64_t) num && !( 0 == num && signbit( num ) ) ) {
+		obj->num.i = (int64_t) num;
+		obj->flags |= JSON_NODE_NUM_INT;
+	} else {
+		obj->num.d = num;
+		obj->flags |= JSON_NODE_NUM_DOUBLE;
+	}
+}
+
+/*
+	Number formatting.
+
+	For integral values we format the digits directly.  For everything else we use the
+	Grisu2 algorithm (Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+	Accurately with Integers", PLDI 2010) to find a short string of digits that reads back
+	as the same double, and then lay them out the way ECMAScript's Number.prototype.toString
+	does.  Either way the result is a valid JSON number, usually much shorter than the
+	"%.30g" format we used to use.
+*/
+
+/** @brief Big enough for any number we format, e.g. "-2.2250738585072014e-308". */
+#define NUMBER_BUF_SIZE 32
+
+/** @brief Pairs of decimal digits, for formatting two digits at a time. */
+static const char digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/**
+	@brief Format a 64-bit integer in decimal.
+	@param buf Pointer to a buffer of at least NUMBER_BUF_SIZE bytes.
+	@param n The integer.
+	@return The length of the resulting nul-terminated string.
+*/
+static size_t format_int64( char* buf, int64_t n ) {
+	char digits[ 20 ];
+	char* p = digits + sizeof( digits );
+	uint64_t u = n < 0 ? -(uint64_t) n : (uint64_t) n;
+
+	while( u >= 100 ) {
+		unsigned int pair = ( u % 100 ) * 2;
+		u /= 100;
+		*--p = digit_pairs[ pair + 1 ];
+		*--p = digit_pairs[ pair ];
+	}
+	if( u >= 10 ) {
+		*--p = digit_pairs[ u * 2 + 1 ];
+		*--p = digit_pairs[ u * 2 ];
+	} else
+		*--p = '0' + u;
+
+	size_t len = 0;
+	if( n < 0 )
+		buf[ len++ ] = '-';
+	size_t ndigits = digits + sizeof( digits ) - p;
+	memcpy( buf + len, p, ndigits );
+	len += ndigits;
+	buf[ len ] = '\0';
+	return len;
+}
+
+/** @brief A floating point number with a 64-bit significand: f * 2^e. */
+typedef struct {
+	uint64_t f;
+	int e;
+} DiyFp;
+
+/**
+	@brief Multiply two DiyFps, keeping the upper 64 bits of the product (rounded).
+*/
+static DiyFp diyfp_mul( DiyFp x, DiyFp y ) {
+	const uint64_t mask32 = 0xFFFFFFFF;
+	uint64_t a = x.f >> 32, b = x.f & mask32;
+	uint64_t c = y.f >> 32, d = y.f & mask32;
+	uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uint64_t tmp = ( bd >> 32 ) + ( ad & mask32 ) + ( bc & mask32 );
+	tmp += 1U << 31;   // round
+	DiyFp r = { ac + ( ad >> 32 ) + ( bc >> 32 ) + ( tmp >> 32 ), x.e + y.e + 64 };
+	return r;
+}
+
+/**
+	@brief Shift a DiyFp left until its most significant bit is set.
+*/
+static DiyFp diyfp_normalize( DiyFp x ) {
+	int shift = __builtin_clzll( x.f );
+	x.f <<= shift;
+	x.e -= shift;
+	return x;
+}
+
+/**
+	@brief Normalized powers of ten, 10^-348 through 10^340 in steps of 8: significands.
+*/
+static const uint64_t cached_powers_f[] = {
+	UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76),
+	UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+	UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f), UINT64_C(0xbe5691ef416bd60c),
+	UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+	UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57),
+	UINT64_C(0xc21094364dfb5637), UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+	UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5), UINT64_C(0xb23867fb2a35b28e),
+	UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+	UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126),
+	UINT64_C(0xb5b5ada8aaff80b8), UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+	UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd), UINT64_C(0xa6dfbd9fb8e5b88f),
+	UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+	UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06),
+	UINT64_C(0xaa242499697392d3), UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+	UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c), UINT64_C(0x9c40000000000000),
+	UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+	UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068),
+	UINT64_C(0x9f4f2726179a2245), UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+	UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a), UINT64_C(0x924d692ca61be758),
+	UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+	UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d),
+	UINT64_C(0x952ab45cfa97a0b3), UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+	UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece), UINT64_C(0x88fcf317f22241e2),
+	UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+	UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410),
+	UINT64_C(0x8bab8eefb6409c1a), UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+	UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429), UINT64_C(0x80444b5e7aa7cf85),
+	UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+	UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b),
+};
+
+/**
+	@brief Normalized powers of ten, 10^-348 through 10^340 in steps of 8: binary exponents.
+*/
+static const short cached_powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+	-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+	-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+	-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+	109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+	641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+/** @brief Powers of ten that fit in a uint64_t. */
+static const uint64_t pow10_64[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+	100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+	10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/**
+	@brief Nudge the last digit generated by grisu_digits() toward the exact value.
+*/
+static void grisu_round( char* buf, int len, uint64_t delta, uint64_t rest,
+		uint64_t ten_kappa, uint64_t wp_w ) {
+	while( rest < wp_w && delta - rest >= ten_kappa
+			&& ( rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w ) ) {
+		buf[ len - 1 ]--;
+		rest += ten_kappa;
+	}
+}
+
+/**
+	@brief Generate the digits of a scaled number, stopping as soon as they're precise enough.
+	@param w The scaled number.
+	@param mp The scaled upper boundary of the interval that rounds to the same double.
+	@param delta The width of that interval.
+	@param buf Where to put the digits.
+	@param K Pointer to the decimal exponent, which we adjust.
+	@return The number of digits.
+*/
+static int grisu_digits( DiyFp w, DiyFp mp, uint64_t delta, char* buf, int* K ) {
+	const int shift = -mp.e;
+	const uint64_t one = (uint64_t) 1 << shift;
+	const uint64_t wp_w = mp.f - w.f;
+	uint32_t p1 = (uint32_t) ( mp.f >> shift );
+	uint64_t p2 = mp.f & ( one - 1 );
+	int len = 0;
+
+	int kappa = 1;
+	while( kappa < 10 && p1 >= pow10_64[ kappa ] )
+		++kappa;
+
+	while( kappa > 0 ) {
+		uint32_t div = (uint32_t) pow10_64[ kappa - 1 ];
+		uint32_t d = p1 / div;
+		p1 %= div;
+		if( d || len )
+			buf[ len++ ] = '0' + d;
+		--kappa;
+		uint64_t rest = ( (uint64_t) p1 << shift ) + p2;
+		if( rest <= delta ) {
+			*K += kappa;
+			grisu_round( buf, len, delta, rest, pow10_64[ kappa ] << shift, wp_w );
+			return len;
+		}
+	}
+
+	for( ;; ) {
+		p2 *= 10;
+		delta *= 10;
+		char d = (char) ( p2 >> shift );
+		if( d || len )
+			buf[ len++ ] = '0' + d;
+		p2 &= one - 1;
+		--kappa;
+		if( p2 < delta ) {
+			*K += kappa;
+			grisu_round( buf, len, delta, p2, one, -kappa < 20 ? wp_w * pow10_64[ -kappa ] : 0 );
+			return len;
+		}
+	}
+}
+
+/**
+	@brief Find a short string of digits that reads back as a given double.
+	@param num The number, which must be finite and positive.
+	@param buf Where to put the digits (at least 18 bytes).
+	@param K Pointer through which to return the decimal exponent.
+	@return The number of digits.
+
+	The value of the digits, read as an integer and multiplied by 10^K, rounds to @a num.
+*/
+static int grisu2( double num, char* buf, int* K ) {
+	uint64_t bits;
+	memcpy( &bits, &num, sizeof( bits ) );
+	const uint64_t hidden = (uint64_t) 1 << 52;
+	int biased_e = (int) ( ( bits >> 52 ) & 0x7FF );
+	DiyFp v;
+	v.f = bits & ( hidden - 1 );
+	if( biased_e ) {
+		v.f += hidden;
+		v.e = biased_e - 1075;
+	} else
+		v.e = -1074;
+
+	// The boundaries halfway to the neighboring doubles, with a common exponent.
+	DiyFp plus = { ( v.f << 1 ) + 1, v.e - 1 };
+	plus = diyfp_normalize( plus );
+	DiyFp minus;
+	if( v.f == hidden ) {
+		minus.f = ( v.f << 2 ) - 1;
+		minus.e = v.e - 2;
+	} else {
+		minus.f = ( v.f << 1 ) - 1;
+		minus.e = v.e - 1;
+	}
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+
+	// Pick a power of ten that scales the upper boundary into a convenient range.
+	double dk = ( -61 - plus.e ) * 0.30102999566398114 + 347;
+	int k = (int) dk;
+	if( dk - k > 0.0 )
+		++k;
+	unsigned int index = ( k >> 3 ) + 1;
+	*K = -( -348 + (int) ( index << 3 ) );
+	DiyFp c_mk = { cached_powers_f[ index ], cached_powers_e[ index ] };
+
+	DiyFp w = diyfp_mul( diyfp_normalize( v ), c_mk );
+	DiyFp wp = diyfp_mul( plus, c_mk );
+	DiyFp wm = diyfp_mul( minus, c_mk );
+	++wm.f;
+	--wp.f;
+	return grisu_digits( w, wp, wp.f - wm.f, buf, K );
+}
+
+/**
+	@brief Format a double as a JSON number.
+	@param buf Pointer to a buffer of at least NUMBER_BUF_SIZE bytes.
+	@param num The number.
+	@return The length of the resulting nul-terminated string.
+
+	Integral values that fit in an int64_t come out as integers.  Other values come out
+	in the shortest form (or nearly so) that reads back as the same double: in plain decimal
+	notation if the decimal exponent is between -6 and 20, or in scientific notation
+	otherwise.  Infinities and NaNs, which JSON has no way to express, come out as "inf",
+	"-inf", or "nan", as they always have.
+*/
+static size_t format_double( char* buf, double num ) {
+	if( !isfinite( num ) )
+		return snprintf( buf, NUMBER_BUF_SIZE, "%g", num );
+
+	if( num >= -9223372036854775808.0 && num < 9223372036854775808.0
+			&& num == (double) (int64_t) num ) {
+		if( 0.0 == num && signbit( num ) ) {
+			strcpy( buf, "-0" );
+			return 2;
+		}
+		return format_int64( buf, (int64_t) num );
+	}
+
+	char* p = buf;
+	if( num < 0 ) {
+		*p++ = '-';
+		num = -num;
+	}
+
+	char digits[ 20 ];
+	int K;
+	int len = grisu2( num, digits, &K );
+	int point = len + K;  // The value is 0.<digits> times 10^point
+
+	if( point > 0 && point <= 21 ) {
+		if( len <= point ) {
+			// An integer too big for an int64_t
+			memcpy( p, digits, len );
+			memset( p + len, '0', point - len );
+			p += point;
+		} else {
+			memcpy( p, digits, point );
+			p[ point ] = '.';
+			memcpy( p + point + 1, digits + point, len - point );
+			p += len + 1;
+		}
+	} else if( point > -6 && point <= 0 ) {
+		*p++ = '0';
+		*p++ = '.';
+		memset( p, '0', -point );
+		p += -point;
+		memcpy( p, digits, len );
+		p += len;
+	} else {
+		*p++ = digits[ 0 ];
+		if( len > 1 ) {
+			*p++ = '.';
+			memcpy( p, digits + 1, len - 1 );
+			p += len - 1;
+		}
+		*p++ = 'e';
+		int exp = point - 1;
+		if( exp < 0 ) {
+			*p++ = '-';
+			exp = -exp;
+		} else
+			*p++ = '+';
+		p += format_int64( p, exp );
+	}
+
+	*p = '\0';
+	return p - buf;
+}
+
+/**
+	@brief Store a double in a JSON_NUMBER, as a string and in the cache.
+	@param obj Pointer to the jsonObject, whose string has already been freed.
+	@param num The number.
+*/
+static void set_number_from_double( jsonObject* obj, double num ) {
+	char buf[ NUMBER_BUF_SIZE ];
+	size_t len = format_double( buf, num );
+	obj->value.s = safe_malloc( len + 1 );
+	memcpy( obj->value.s, buf, len + 1 );
+	cache_double( obj, num );
+}
+
 /**
 	@brief Create a new jsonObject of type JSON_NUMBER.
 	@param num The number to store in the jsonObject.
@@ -209,7 +849,7 @@ jsonObject* jsonNewObjectFmt(const char* data, ...) {
 jsonObject* jsonNewNumberObject( double num ) {
 	jsonObject* o = jsonNewObject(NULL);
 	o->type = JSON_NUMBER;
-	o->value.s = doubleToString( num );
+	set_number_from_double( o, num );
 	return o;
 }
 
@@ -232,6 +872,7 @@ jsonObject* jsonNewNumberStringObject( const char* numstr ) {
 	jsonObject* o = jsonNewObject(NULL);
 	o->type = JSON_NUMBER;
 	o->value.s = strdup( numstr );
+	jsonObjectCacheNumber( o );
 	return o;
 }
 
@@ -275,39 +916,106 @@ jsonObject* jsonNewObjectType(int type) {
 	return o;
 }
 
+/**
+	@brief Create a new jsonObject within an osrfArena, optionally containing a string.
+	@param arena Pointer to the osrfArena from which to allocate memory.
+	@param data Pointer to a string to be stored in the jsonObject; may be NULL.
+	@return Pointer to the new jsonObject.
+
+	This function is like jsonNewObject(), except that the jsonObject and its copy of the
+	string live in @a arena.  If @a arena is NULL, it behaves exactly like jsonNewObject().
+
+	The jsonObject is released when the arena is reset or freed.  Calling jsonObjectFree()
+	for it is harmless but does nothing.
+*/
+jsonObject* jsonNewObjectInArena( osrfArena* arena, const char* data ) {
+	if( !arena )
+		return jsonNewObject( data );
+
+	jsonObject* o = osrfArenaAlloc( arena, sizeof(jsonObject) );
+	o->size = 0;
+	o->classname = NULL;
+	o->parent = NULL;
+	o->flags = JSON_NODE_ARENA;
+	o->refs = 0;
+
+	if(data) {
+		o->type = JSON_STRING;
+		o->value.s = osrfArenaStrdup( arena, data );
+	} else {
+		o->type = JSON_NULL;
+		o->value.s = NULL;
+	}
+
+	return o;
+}
+
+/**
+	@brief Create a new jsonObject of a specified type within an osrfArena.
+	@param arena Pointer to the osrfArena from which to allocate memory.
+	@param type One of the 6 JSON types, as specified by the JSON_* macros.
+	@return Pointer to the new jsonObject.
+
+	This function is like jsonNewObjectType(), except that the jsonObject lives in
+	@a arena.  So does its osrfHash or osrfList, if it is a JSON_HASH or a JSON_ARRAY.
+	If @a arena is NULL, it behaves exactly like jsonNewObjectType().
+*/
+jsonObject* jsonNewObjectTypeInArena( osrfArena* arena, int type ) {
+	if( !arena )
+		return jsonNewObjectType( type );
+
+	jsonObject* o = jsonNewObjectInArena( arena, NULL );
+	o->type = type;
+	if( JSON_BOOL == type )
+		o->value.b = 0;
+	else if( JSON_HASH == type ) {
+		o->value.h = osrfNewArenaHash( arena );
+		osrfHashSetCallback( o->value.h, _jsonFreeHashItem );
+		osrfHashInternKeys( o->value.h );
+	} else if( JSON_ARRAY == type ) {
+		o->value.l = osrfNewArenaList( arena, 8 );
+		o->value.l->freeItem = _jsonFreeListItem;
+	}
+	return o;
+}
+
 /**
 	@brief Free a jsonObject and everything in it.
 	@param o Pointer to the jsonObject to be freed.
 
 	Any jsonObjects stored inside the jsonObject (in hashes or arrays) will be freed as
 	well, and so one, recursively.
+
+	A jsonObject living in an osrfArena is left alone; it goes away with the arena.  If
+	the jsonObject is shared (see jsonObjectShare()), we free it only when the last owner
+	lets go of it.
 */
 void jsonObjectFree( jsonObject* o ) {
 
-	if(!o || o->parent) return;
-	free(o->classname);
+	if(!o || (o->flags & JSON_NODE_ARENA)) return;
+
+	// If someone else still owns it, just drop our reference.  A shared jsonObject
+	// may be attached to several parents, so check before the parent.
+	if( o->refs && JSON_REFS_ADD( o, -1 ) > 0 )
+		return;
+
+	if( o->parent ) return;
+	if( !(o->flags & JSON_NODE_BORROWED_CLASS) )
+		osrfInternFree(o->classname);
 
 	switch(o->type) {
 		case JSON_HASH		: osrfHashFree(o->value.h); break;
 		case JSON_ARRAY	: osrfListFree(o->value.l); break;
-		case JSON_STRING	: free(o->value.s); break;
-		case JSON_NUMBER	: free(o->value.s); break;
+		case JSON_STRING	:
+		case JSON_NUMBER	:
+			if( !(o->flags & JSON_NODE_BORROWED_STRING) )
+				free(o->value.s);
+			break;
 	}
 
 	// Stick the old jsonObject onto a free list
 	// for potential reuse
-	
-	unusedObj* unused = (unusedObj*) o;
-	unused->next = freeObjList;
-	freeObjList = unused;
-
-    unusedObjCapture++;
-    currentListLen++;
-    if (unusedObjCapture > 1 && !(unusedObjCapture % 1000))
-        osrfLogDebug( OSRF_LOG_MARK, "Objects malloc()'d: %d, "
-			"Reusable objects captured: %d, Objects reused: %d, "
-			"Current List Length: %d",
-			mallocObjCreate, unusedObjCapture, unusedObjRelease, currentListLen );
+	recycle_json_object( o );
 }
 
 /**
@@ -375,6 +1083,7 @@ unsigned long jsonObjectPush(jsonObject* o, jsonObject* newo) {
     if(!newo) newo = jsonNewObject(NULL);
 	JSON_INIT_CLEAR(o, JSON_ARRAY);
 	newo->parent = o;
+	o->flags |= ( newo->flags & JSON_NODE_ANY_BORROWED ) ? JSON_NODE_HOLDS_BORROWED : 0;
 	osrfListPush( o->value.l, newo );
 	o->size = o->value.l->size;
 	return o->size;
@@ -407,6 +1116,7 @@ unsigned long jsonObjectSetIndex(jsonObject* dest, unsigned long index, jsonObje
 	if(!newObj) newObj = jsonNewObject(NULL);
 	JSON_INIT_CLEAR(dest, JSON_ARRAY);
 	newObj->parent = dest;
+	dest->flags |= ( newObj->flags & JSON_NODE_ANY_BORROWED ) ? JSON_NODE_HOLDS_BORROWED : 0;
 	osrfListSet( dest->value.l, newObj, index );
 	dest->size = dest->value.l->size;
 	return dest->value.l->size;
@@ -437,7 +1147,9 @@ unsigned long jsonObjectSetKey( jsonObject* o, const char* key, jsonObject* newo
     if(!newo) newo = jsonNewObject(NULL);
 	JSON_INIT_CLEAR(o, JSON_HASH);
 	newo->parent = o;
-	osrfHashSet( o->value.h, newo, key );
+	o->flags |= ( newo->flags & JSON_NODE_ANY_BORROWED ) ? JSON_NODE_HOLDS_BORROWED : 0;
+	if( key )
+		osrfHashSetLen( o->value.h, newo, key, strlen( key ) );
 	o->size = osrfHashGetCount(o->value.h);
 	return o->size;
 }
@@ -475,48 +1187,206 @@ const jsonObject* jsonObjectGetKeyConst( const jsonObject* obj, const char* key
 }
 
 /**
-	@brief Recursively traverse a jsonObject, translating it into a JSON string.
-	@param obj Pointer to the jsonObject to be translated.
-	@param buf Pointer to a growing_buffer that will receive the JSON string.
-	@param do_classname Boolean; if true, expand (i.e. encode) class names.
-	@param second_pass Boolean; should always be false except for some recursive calls.
- 
-	If @a do_classname is true, expand any class names, as described in the discussion of
-	jsonObjectToJSON().
-
-	@a second_pass should always be false except for some recursive calls.  It is used
-	when expanding classnames, to distinguish between the first and second passes
-	through a given node.
-*/
-static void add_json_to_buffer( const jsonObject* obj,
-	growing_buffer * buf, int do_classname, int second_pass ) {
-
-    if(NULL == obj) {
-        OSRF_BUFFER_ADD(buf, "null");
-        return;
-    }
+	@brief Hand the staged text of a jsonSink to its writer, if enough has accumulated.
+	@param sink Pointer to the jsonSink.
 
-	if( obj->classname && do_classname )
-	{
-		if( second_pass )
-			second_pass = 0;
-		else
-		{
-			// Pretend we see an extra layer of JSON_HASH
-			
-			OSRF_BUFFER_ADD( buf, "{\"" );
-			OSRF_BUFFER_ADD( buf, JSON_CLASS_KEY );
-			OSRF_BUFFER_ADD( buf, "\":\"" );
-			OSRF_BUFFER_ADD( buf, obj->classname );
-			OSRF_BUFFER_ADD( buf, "\",\"" );
-			OSRF_BUFFER_ADD( buf, JSON_DATA_KEY );
-			OSRF_BUFFER_ADD( buf, "\":" );
-			add_json_to_buffer( obj, buf, 1, 1 );
-			buffer_add_char( buf, '}' );
-			return;
+	A jsonSink without a writer simply accumulates everything, as jsonObjectToJSON() needs.
+*/
+#define JSON_SINK_CHECK(sink) \
+	do { \
+		if( (sink)->write && (sink)->buf->n_used >= (sink)->window ) \
+			jsonSinkFlush( sink ); \
+	} while(0)
+
+/**
+	@brief Create a jsonSink for incremental serialization.
+	@param window How many bytes to stage before handing them to the writer, or zero
+		for JSON_SINK_DEFAULT_WINDOW.
+	@param write Callback that receives the serialized text.
+	@param userdata An opaque pointer to be passed to the writer.
+	@return Pointer to the newly created jsonSink.
+
+	The calling code is responsible for freeing the jsonSink by calling jsonSinkFree().
+*/
+jsonSink* jsonNewSink( size_t window, jsonSinkWriter write, void* userdata ) {
+	if( 0 == window )
+		window = JSON_SINK_DEFAULT_WINDOW;
+
+	// Leave some room for overshoot, so that the staging buffer seldom has to grow.
+	size_t initial = window + window / 4 + 64;
+	if( initial >= BUFFER_MAX_SIZE )
+		initial = BUFFER_MAX_SIZE - 1;
+
+	jsonSink* sink = safe_malloc( sizeof( jsonSink ) );
+	sink->buf = buffer_init( (int) initial );
+	sink->window = window;
+	sink->write = write;
+	sink->userdata = userdata;
+	sink->total = 0;
+	sink->error = 0;
+	return sink;
+}
+
+/**
+	@brief Free a jsonSink, discarding any text still staged in it.
+	@param sink Pointer to the jsonSink to be freed.
+
+	To deliver the staged text, call jsonSinkFlush() first.
+*/
+void jsonSinkFree( jsonSink* sink ) {
+	if( sink ) {
+		buffer_free( sink->buf );
+		free( sink );
+	}
+}
+
+/**
+	@brief Append arbitrary text to a jsonSink.
+	@param sink Pointer to the jsonSink.
+	@param data Pointer to the text to be appended.
+	@param len Number of bytes to append.
+	@return Zero if successful, or -1 if the writer has reported an error.
+
+	This function is useful for framing a serialized jsonObject with other text.
+*/
+int jsonSinkAdd( jsonSink* sink, const char* data, size_t len ) {
+	if( !( sink && data ) || sink->error )
+		return -1;
+	buffer_add_n( sink->buf, data, len );
+	JSON_SINK_CHECK( sink );
+	return sink->error ? -1 : 0;
+}
+
+/**
+	@brief Offer everything staged in a jsonSink to its writer.
+	@param sink Pointer to the jsonSink.
+	@return Zero if successful, or -1 if the writer reports an error.
+
+	Whatever the writer declines to consume remains staged.  After an error, the jsonSink
+	discards all further text.
+*/
+int jsonSinkFlush( jsonSink* sink ) {
+	if( !sink )
+		return -1;
+
+	growing_buffer* buf = sink->buf;
+	if( !sink->error && sink->write && buf->n_used > 0 ) {
+		long n = sink->write( sink->userdata, buf->buf, buf->n_used );
+		if( n < 0 || (size_t) n > buf->n_used ) {
+			osrfLogError( OSRF_LOG_MARK, "jsonSink writer failed; discarding output" );
+			sink->error = 1;
+		} else if( n > 0 ) {
+			size_t left = buf->n_used - n;
+			memmove( buf->buf, buf->buf + n, left );
+			buf->n_used = left;
+			buf->buf[ left ] = '\0';
+			sink->total += n;
+		}
+	}
+
+	if( sink->error ) {
+		buf->n_used = 0;
+		buf->buf[ 0 ] = '\0';
+		return -1;
+	}
+	return 0;
+}
+
+/**
+	@brief Append a string to a jsonSink, escaped as JSON (but without the quotation marks).
+	@param sink Pointer to the jsonSink.
+	@param str Pointer to the string to be escaped.
+
+	If the sink has a writer, we escape a long string in window-sized slices, flushing as
+	we go.  We slice only at the beginning of a UTF-8 character, so that each slice is
+	escaped exactly as it would be as part of the whole.
+*/
+static void add_string_to_sink( jsonSink* sink, const char* str ) {
+	size_t len;
+	if( !sink->write || ( len = strlen( str ) ) <= sink->window ) {
+		buffer_append_utf8( sink->buf, str );
+		return;
+	}
+
+	char* slice = safe_malloc( sink->window + 1 );
+	while( len > 0 && !sink->error ) {
+		size_t n = sink->window;
+		if( n >= len )
+			n = len;
+		else {
+			// Back up to the first byte of a character.
+			while( n > 0 && ( (unsigned char) str[ n ] & 0xC0 ) == 0x80 )
+				--n;
+			if( 0 == n )
+				n = sink->window;   // Not UTF-8 anyway; just cut it.
 		}
+
+		memcpy( slice, str, n );
+		slice[ n ] = '\0';
+		buffer_append_utf8( sink->buf, slice );
+		JSON_SINK_CHECK( sink );
+
+		str += n;
+		len -= n;
+	}
+	free( slice );
+}
+
+/**
+	@brief Recursively traverse a jsonObject, translating it into JSON text in a jsonSink.
+	@param obj Pointer to the jsonObject to be translated.
+	@param sink Pointer to the jsonSink that will receive the JSON text.
+	@param class_mode What to do about class names: JSON_CLASS_IGNORE, JSON_CLASS_ENCODE,
+		or JSON_CLASS_DECODE.
+
+	With JSON_CLASS_ENCODE, expand any class names, as described in the discussion of
+	jsonObjectToJSON().  With JSON_CLASS_DECODE, collapse any class wrappers already in
+	the tree, as described in the discussion of jsonObjectToJSONDecoded().  Either way the
+	transformation happens on the fly, in the same traversal that writes the text.
+
+	We check the sink's window after each element of an array or hash, so that a large
+	tree is delivered in pieces as it is translated.
+*/
+static void add_json_to_sink( const jsonObject* obj, jsonSink* sink, int class_mode ) {
+
+	if( NULL == obj ) {
+		OSRF_BUFFER_ADD( sink->buf, "null" );
+		return;
 	}
 
+	if( JSON_CLASS_ENCODE == class_mode && obj->classname ) {
+		// Pretend we see an extra layer of JSON_HASH
+		growing_buffer* buf = sink->buf;
+		OSRF_BUFFER_ADD( buf, "{\"" );
+		OSRF_BUFFER_ADD( buf, JSON_CLASS_KEY );
+		OSRF_BUFFER_ADD( buf, "\":\"" );
+		add_string_to_sink( sink, obj->classname );
+		OSRF_BUFFER_ADD( buf, "\",\"" );
+		OSRF_BUFFER_ADD( buf, JSON_DATA_KEY );
+		OSRF_BUFFER_ADD( buf, "\":" );
+		add_json_value_to_sink( obj, sink, class_mode );
+		buffer_add_char( buf, '}' );
+	} else if( JSON_CLASS_DECODE == class_mode && JSON_HASH == obj->type
+			&& jsonObjectGetKeyConst( obj, JSON_CLASS_KEY ) ) {
+		// Pretend the wrapper isn't there.  Without any data, it stands for a JSON_NULL.
+		add_json_to_sink( jsonObjectGetKeyConst( obj, JSON_DATA_KEY ), sink, class_mode );
+	} else
+		add_json_value_to_sink( obj, sink, class_mode );
+}
+
+/**
+	@brief Translate a jsonObject into JSON text in a jsonSink, apart from its class name.
+	@param obj Pointer to the jsonObject to be translated.
+	@param sink Pointer to the jsonSink that will receive the JSON text.
+	@param class_mode What to do about the class names of subordinate nodes.
+
+	This function does the real work for add_json_to_sink(), which decides what to do
+	about the node's own class name.
+*/
+static void add_json_value_to_sink( const jsonObject* obj, jsonSink* sink, int class_mode ) {
+
+	growing_buffer* buf = sink->buf;
+
 	switch(obj->type) {
 
 		case JSON_BOOL :
@@ -536,7 +1406,7 @@ static void add_json_to_buffer( const jsonObject* obj,
 
 		case JSON_STRING:
 			OSRF_BUFFER_ADD_CHAR(buf, '"');
-			buffer_append_utf8(buf, obj->value.s);
+			add_string_to_sink(sink, obj->value.s);
 			OSRF_BUFFER_ADD_CHAR(buf, '"');
 			break;
 			
@@ -544,10 +1414,10 @@ static void add_json_to_buffer( const jsonObject* obj,
 			OSRF_BUFFER_ADD_CHAR(buf, '[');
 			if( obj->value.l ) {
 				int i;
-				for( i = 0; i != obj->value.l->size; i++ ) {
+				for( i = 0; i != obj->value.l->size && !sink->error; i++ ) {
 					if(i > 0) OSRF_BUFFER_ADD(buf, ",");
-					add_json_to_buffer(
-						OSRF_LIST_GET_INDEX(obj->value.l, i), buf, do_classname, second_pass );
+					add_json_to_sink( OSRF_LIST_GET_INDEX(obj->value.l, i), sink, class_mode );
+					JSON_SINK_CHECK( sink );
 				}
 			}
 			OSRF_BUFFER_ADD_CHAR(buf, ']');
@@ -561,12 +1431,13 @@ static void add_json_to_buffer( const jsonObject* obj,
 			jsonObject* item;
 			int i = 0;
 
-			while( (item = osrfHashIteratorNext(itr)) ) {
+			while( !sink->error && (item = osrfHashIteratorNext(itr)) ) {
 				if(i++ > 0) OSRF_BUFFER_ADD_CHAR(buf, ',');
 				OSRF_BUFFER_ADD_CHAR(buf, '"');
-				buffer_append_utf8(buf, osrfHashIteratorKey(itr));
+				add_string_to_sink(sink, osrfHashIteratorKey(itr));
 				OSRF_BUFFER_ADD(buf, "\":");
-				add_json_to_buffer( item, buf, do_classname, second_pass );
+				add_json_to_sink( item, sink, class_mode );
+				JSON_SINK_CHECK( sink );
 			}
 
 			osrfHashIteratorFree(itr);
@@ -585,9 +1456,9 @@ static void add_json_to_buffer( const jsonObject* obj,
 */
 char* jsonObjectToJSONRaw( const jsonObject* obj ) {
 	if(!obj) return NULL;
-	growing_buffer* buf = buffer_init(32);
-	add_json_to_buffer( obj, buf, 0, 0 );
-	return buffer_release( buf );
+	jsonSink sink = { buffer_init(32), 0, NULL, NULL, 0, 0 };
+	add_json_to_sink( obj, &sink, JSON_CLASS_IGNORE );
+	return buffer_release( sink.buf );
 }
 
 /**
@@ -603,9 +1474,107 @@ char* jsonObjectToJSONRaw( const jsonObject* obj ) {
  */
 char* jsonObjectToJSON( const jsonObject* obj ) {
 	if(!obj) return NULL;
-	growing_buffer* buf = buffer_init(32);
-	add_json_to_buffer( obj, buf, 1, 0 );
-	return buffer_release( buf );
+	jsonSink sink = { buffer_init(32), 0, NULL, NULL, 0, 0 };
+	add_json_to_sink( obj, &sink, JSON_CLASS_ENCODE );
+	return buffer_release( sink.buf );
+}
+
+/**
+	@brief Translate a jsonObject into a JSON string, collapsing class wrappers.
+	@param obj Pointer to the jsonObject to be translated.
+	@return A pointer to a newly allocated string containing the JSON.
+
+	At every level, any JSON_HASH with a JSON_CLASS_KEY member is translated as if it were
+	its JSON_DATA_KEY member (or a JSON_NULL, if there is none), and class names are not
+	expanded.  The result is the same as that of
+	jsonObjectToJSONRaw( jsonObjectDecodeClass( obj ) ), but without building a decoded
+	copy of the tree.
+
+	The calling code is responsible for freeing the resulting string.
+*/
+char* jsonObjectToJSONDecoded( const jsonObject* obj ) {
+	if(!obj) return NULL;
+	jsonSink sink = { buffer_init(32), 0, NULL, NULL, 0, 0 };
+	add_json_to_sink( obj, &sink, JSON_CLASS_DECODE );
+	return buffer_release( sink.buf );
+}
+
+/**
+	@brief Translate a jsonObject into JSON text, with expansion of class names, and
+	deliver it through a jsonSink.
+	@param obj Pointer to the jsonObject to be translated.
+	@param sink Pointer to the jsonSink.
+	@return Zero if successful, or -1 upon error.
+
+	Whenever the staged text fills the sink's window, it goes to the writer.  Anything
+	left over at the end remains staged, so that the calling code may append more text
+	before calling jsonSinkFlush().
+*/
+int jsonObjectToSink( const jsonObject* obj, jsonSink* sink ) {
+	if( !( obj && sink ) || sink->error )
+		return -1;
+	add_json_to_sink( obj, sink, JSON_CLASS_ENCODE );
+	JSON_SINK_CHECK( sink );
+	return sink->error ? -1 : 0;
+}
+
+/**
+	@brief Translate a jsonObject into JSON text, without expanding class names, and
+	deliver it through a jsonSink.
+	@param obj Pointer to the jsonObject to be translated.
+	@param sink Pointer to the jsonSink.
+	@return Zero if successful, or -1 upon error.
+
+	See jsonObjectToSink().
+*/
+int jsonObjectToSinkRaw( const jsonObject* obj, jsonSink* sink ) {
+	if( !( obj && sink ) || sink->error )
+		return -1;
+	add_json_to_sink( obj, sink, JSON_CLASS_IGNORE );
+	JSON_SINK_CHECK( sink );
+	return sink->error ? -1 : 0;
+}
+
+/**
+	@brief jsonSinkWriter that writes to a file descriptor.
+	@param userdata Pointer to the file descriptor.
+	@param data Pointer to the text to be written.
+	@param len Number of bytes to write.
+	@return The number of bytes written (i.e. all of them), or -1 upon error.
+*/
+static long fd_writer( void* userdata, const char* data, size_t len ) {
+	int fd = *(int*) userdata;
+	size_t done = 0;
+	while( done < len ) {
+		ssize_t n = write( fd, data + done, len - done );
+		if( n < 0 ) {
+			if( EINTR == errno )
+				continue;
+			return -1;
+		}
+		done += n;
+	}
+	return (long) done;
+}
+
+/**
+	@brief Translate a jsonObject into JSON text, with expansion of class names, and
+	write it to a file descriptor.
+	@param obj Pointer to the jsonObject to be translated.
+	@param fd The file descriptor.
+	@param window How many bytes to stage between writes, or zero for
+		JSON_SINK_DEFAULT_WINDOW.
+	@return Zero if successful, or -1 upon error.
+*/
+int jsonObjectToFd( const jsonObject* obj, int fd, size_t window ) {
+	if( !obj )
+		return -1;
+	jsonSink* sink = jsonNewSink( window, fd_writer, &fd );
+	int rc = jsonObjectToSink( obj, sink );
+	if( jsonSinkFlush( sink ) )
+		rc = -1;
+	jsonSinkFree( sink );
+	return rc;
 }
 
 /**
@@ -779,7 +1748,7 @@ jsonObject* jsonObjectExtractIndex(jsonObject* dest, unsigned long index) {
 */
 unsigned long jsonObjectRemoveKey( jsonObject* dest, const char* key) {
 	if( dest && key && dest->type == JSON_HASH ) {
-		osrfHashRemove(dest->value.h, key);
+		osrfHashRemoveLen( dest->value.h, key, strlen( key ) );
 		return 1;
 	}
 	return -1;
@@ -790,25 +1759,18 @@ unsigned long jsonObjectRemoveKey( jsonObject* dest, const char* key) {
 	@param num The double to be formatted.
 	@return A newly allocated character string containing the formatted number.
 
-	The number is formatted according to the printf-style format specification "%.30g". and
-	will therefore contain no more than 30 significant digits.
+	The result is the shortest (or nearly so) JSON number that reads back as the same
+	double: for example "123.456", "1e+21", or "5e-324".  Integral values within the range
+	of an int64_t come out as plain integers.
 
 	The calling code is responsible for freeing the resulting string.
 */
 char* doubleToString( double num ) {
-
-	char buf[ 64 ];
-	size_t len = snprintf(buf, sizeof( buf ), "%.30g", num) + 1;
-	if( len < sizeof( buf ) )
-		return strdup( buf );
-	else
-	{
-		// Need a bigger buffer (should never be necessary)
-		
-		char* bigger_buff = safe_malloc( len + 1 );
-		(void) snprintf(bigger_buff, len + 1, "%.30g", num);
-		return bigger_buff;
-	}
+	char buf[ NUMBER_BUF_SIZE ];
+	size_t len = format_double( buf, num );
+	char* s = safe_malloc( len + 1 );
+	memcpy( s, buf, len + 1 );
+	return s;
 }
 
 /**
@@ -834,6 +1796,24 @@ const char* jsonObjectGetString(const jsonObject* obj) {
 		return NULL;
 }
 
+/**
+	@brief Fetch the value of a JSON_NUMBER, from the cache if possible.
+	@param obj Pointer to the jsonObject, which must be a JSON_NUMBER with a non-NULL string.
+	@param num Pointer through which to return the value.
+	@return JSON_NODE_NUM_INT or JSON_NODE_NUM_DOUBLE, to say which member of @a num is valid.
+
+	This function doesn't touch @a obj.  A jsonObject whose cache nobody filled in, because
+	some code outside this library built it, gets its string converted every time.
+*/
+static int obj_number( const jsonObject* obj, union _jsonNumCache* num ) {
+	int kind = obj->flags & JSON_NODE_NUM_CACHED;
+	if( kind ) {
+		*num = obj->num;
+		return kind;
+	}
+	return number_value( obj->value.s, num );
+}
+
 /**
 	@brief Translate a jsonObject to a double.
 	@param @obj Pointer to the jsonObject.
@@ -843,8 +1823,44 @@ const char* jsonObjectGetString(const jsonObject* obj) {
 	returned is zero.
 */
 double jsonObjectGetNumber( const jsonObject* obj ) {
-	return (obj && obj->type == JSON_NUMBER && obj->value.s)
-			? strtod( obj->value.s, NULL ) : 0;
+	if( !(obj && obj->type == JSON_NUMBER && obj->value.s) )
+		return 0;
+
+	union _jsonNumCache num;
+	if( JSON_NODE_NUM_INT == obj_number( obj, &num ) )
+		return (double) num.i;
+	else
+		return num.d;
+}
+
+/**
+	@brief Translate a jsonObject to a 64-bit integer.
+	@param obj Pointer to the jsonObject.
+	@return The numeric value stored in the jsonObject, as an integer.
+
+	If @a obj is NULL, or if it points to a jsonObject not of type JSON_NUMBER, the value
+	returned is zero.
+
+	An integer that fits in 64 bits comes back exactly, even if a double couldn't hold it.
+	Any other number is truncated toward zero, and clamped to the range of an int64_t.
+*/
+int64_t jsonObjectGetInt64( const jsonObject* obj ) {
+	if( !(obj && obj->type == JSON_NUMBER && obj->value.s) )
+		return 0;
+
+	union _jsonNumCache num;
+	if( JSON_NODE_NUM_INT == obj_number( obj, &num ) )
+		return num.i;
+
+	double d = num.d;
+	if( d != d )
+		return 0;      // NaN
+	else if( d >= 9223372036854775808.0 )
+		return INT64_MAX;
+	else if( d <= -9223372036854775808.0 )
+		return INT64_MIN;
+	else
+		return (int64_t) d;
 }
 
 /**
@@ -887,6 +1903,7 @@ int jsonObjectSetNumberString(jsonObject* dest, const char* string) {
 
 	if( jsonIsNumeric( string ) ) {
 		dest->value.s = strdup(string);
+		jsonObjectCacheNumber( dest );
 		return 0;
 	}
 	else {
@@ -906,7 +1923,23 @@ int jsonObjectSetNumberString(jsonObject* dest, const char* string) {
 void jsonObjectSetNumber(jsonObject* dest, double num) {
 	if(!dest) return;
 	JSON_INIT_CLEAR(dest, JSON_NUMBER);
-	dest->value.s = doubleToString( num );
+	set_number_from_double( dest, num );
+}
+
+/**
+	@brief Find the osrfArena in which a jsonObject lives.
+	@param o Pointer to the jsonObject.
+	@return Pointer to the osrfArena of the nearest JSON_HASH or JSON_ARRAY at or above
+		@a o, or NULL if there isn't one, or if it lives on the heap.
+*/
+static osrfArena* node_arena( const jsonObject* o ) {
+	for( ; o; o = o->parent ) {
+		if( JSON_HASH == o->type )
+			return osrfHashGetArena( o->value.h );
+		else if( JSON_ARRAY == o->type )
+			return o->value.l->arena;
+	}
+	return NULL;
 }
 
 /**
@@ -915,11 +1948,50 @@ void jsonObjectSetNumber(jsonObject* dest, double num) {
 	@param classname Pointer to a string containing the class name.
 
 	Both dest and classname must be non-NULL.
+
+	Class names come from a limited vocabulary, so we share an interned copy where there is
+	one (see osrf_intern.h) instead of copying them.  We don't add to the intern table,
+	because the class name may have come from whoever sent us a message.  An application
+	may intern its own class names up front with osrfIntern().
+
+	A jsonObject in an osrfArena gets its copy from the arena, which we find through the
+	nearest JSON_HASH or JSON_ARRAY at or above it.  A detached scalar in an arena can't
+	tell us its arena, so use jsonObjectSetClassInArena() for one of those.
 */
 void jsonObjectSetClass(jsonObject* dest, const char* classname ) {
 	if(!(dest && classname)) return;
-	free(dest->classname);
-	dest->classname = strdup(classname);
+	if( dest->flags & JSON_NODE_ARENA ) {
+		osrfArena* arena = node_arena( dest );
+		if( arena ) {
+			jsonObjectSetClassInArena( arena, dest, classname );
+			return;
+		}
+	}
+	if( !(dest->flags & (JSON_NODE_ARENA | JSON_NODE_BORROWED_CLASS)) )
+		osrfInternFree(dest->classname);
+	dest->flags &= ~JSON_NODE_BORROWED_CLASS;
+	dest->classname = osrfInternLookupStrdup(classname);
+}
+
+/**
+	@brief Assign a class name to a jsonObject in an osrfArena.
+	@param arena Pointer to the osrfArena in which @a dest lives.
+	@param dest Pointer to the jsonObject.
+	@param classname Pointer to a string containing the class name.
+
+	This function is like jsonObjectSetClass(), except that the copy of the class name
+	lives in @a arena, and goes away with it.  If @a arena is NULL, or @a dest doesn't
+	live in an arena, it behaves exactly like jsonObjectSetClass().
+*/
+void jsonObjectSetClassInArena( osrfArena* arena, jsonObject* dest, const char* classname ) {
+	if(!(dest && classname)) return;
+	if( !arena || !(dest->flags & JSON_NODE_ARENA) ) {
+		jsonObjectSetClass( dest, classname );
+		return;
+	}
+	dest->flags &= ~JSON_NODE_BORROWED_CLASS;
+	const char* interned = osrfInternLookup( classname );
+	dest->classname = interned ? (char*) interned : osrfArenaStrdup( arena, classname );
 }
 
 /**
@@ -962,6 +2034,8 @@ jsonObject* jsonObjectClone( const jsonObject* o ) {
         case JSON_NUMBER:
 			result = jsonNewObject( o->value.s );
 			result->type = JSON_NUMBER;
+			result->flags |= o->flags & JSON_NODE_NUM_CACHED;
+			result->num = o->num;
             break;
         case JSON_BOOL:
             result = jsonNewBoolObject(jsonBoolIsTrue((jsonObject*) o));
@@ -988,6 +2062,87 @@ jsonObject* jsonObjectClone( const jsonObject* o ) {
     return result;
 }
 
+/**
+	@brief Acquire a reference to a jsonObject, instead of a copy.
+	@param o Pointer to the jsonObject to be shared.
+	@return Pointer to the same jsonObject, or to a copy of it if it can't be shared; or
+		NULL if @a o is NULL.
+
+	Where jsonObjectClone() copies an entire tree, this function merely counts another
+	owner, and returns the same pointer.  Each owner disposes of its reference by calling
+	jsonObjectFree(), and the tree goes away when the last owner does so.  An owner may
+	also attach the jsonObject to a JSON_ARRAY or JSON_HASH, which then owns that
+	reference instead.  The same jsonObject may thus appear in several trees at once.
+
+	Nobody may modify a shared jsonObject, or anything below it, because the changes would
+	show up for every owner.  Before making any changes, call jsonObjectUnshare().  The
+	mutators, such as jsonObjectSetKey(), don't check, and couldn't copy on write if they
+	did: every owner holds the same pointer.  So the library shares only trees that it
+	built itself, and that nobody changes afterwards.
+
+	A jsonObject in an osrfArena can't outlive the arena, so for one of those we return a
+	heap-based copy instead.  Likewise a tree built by jsonParseInSitu() may borrow
+	strings from the buffer it was parsed from; if anything in the tree does so, we
+	return a copy, which owns all of its strings.  We find out from JSON_NODE_HOLDS_BORROWED
+	rather than by searching the tree, so sharing costs the same no matter how big the tree
+	is.  That flag is set as each node is attached to its parent, so it misses a borrowed
+	string attached to a node that had already been attached to the tree we're sharing.
+	Only jsonParseInSitu() makes borrowed strings, and it builds from the bottom up.
+*/
+jsonObject* jsonObjectShare( const jsonObject* o ) {
+	if( !o )
+		return NULL;
+	if( o->flags & ( JSON_NODE_ARENA | JSON_NODE_ANY_BORROWED ) )
+		return jsonObjectClone( o );
+
+	jsonObject* shared = (jsonObject*) o;
+	JSON_REFS_ADD( shared, 1 );
+	return shared;
+}
+
+/**
+	@brief Make sure that a jsonObject belongs exclusively to the caller, so that it may
+		be modified.
+	@param o Pointer to a jsonObject that the caller owns.
+	@return Pointer to either @a o itself or a copy of it, whichever the caller may modify.
+
+	If nobody else shares the jsonObject, return it unchanged.  Otherwise make a copy for
+	the caller, and release the caller's reference to the original.  This is the copy
+	in copy-on-write.
+
+	The caller must own @a o outright, as returned by jsonObjectShare() or one of the
+	jsonNew... functions, and not merely have a pointer into someone else's tree.  For the
+	same reason, this function considers only whether @a o itself is shared.  To modify a
+	node within a tree, unshare the root of the tree first.
+*/
+jsonObject* jsonObjectUnshare( jsonObject* o ) {
+	if( !o || !o->refs )
+		return o;
+
+	jsonObject* copy = jsonObjectClone( o );
+	jsonObjectFree( o );
+	return copy;
+}
+
+/**
+	@brief Determine whether a jsonObject has more than one owner.
+	@param o Pointer to the jsonObject.
+	@return Boolean: 1 if @a o, or any node above it, has been shared by
+		jsonObjectShare(); otherwise 0.
+
+	Since a shared jsonObject may be attached to more than one parent, the search upward
+	follows whichever parent attached it most recently.  The answer is reliable anyway,
+	because a node with more than one parent is itself shared.
+*/
+int jsonObjectIsShared( const jsonObject* o ) {
+	while( o ) {
+		if( o->refs )
+			return 1;
+		o = o->parent;
+	}
+	return 0;
+}
+
 /**
 	@brief Return the truth or falsity of a jsonObject of type JSON_BOOL.
 	@param boolObj Pointer to the jsonObject.
@@ -1186,7 +2341,11 @@ char* jsonScrubNumber( const char* s ) {
 	}
 	// Skip any leading zeros
 
-	while( '0' == *s ) ++s;
+	int zeros = 0;  // boolean
+	while( '0' == *s ) {
+		++s;
+		zeros = 1;
+	}
 
 	// Capture digits to the left of the decimal,
 	// and note whether there are any.
@@ -1196,6 +2355,10 @@ char* jsonScrubNumber( const char* s ) {
 	if( isdigit( (unsigned char) *s ) ) {
 		buffer_add_char( buf, *s++ );
 		left_digit = 1;
+	} else if( zeros ) {
+		// Nothing but zeros; keep one of them
+		buffer_add_char( buf, '0' );
+		left_digit = 1;
 	}
 	
 	while( isdigit( (unsigned char) *s  ) )
@@ -14,12 +14,54 @@ GNU General Public License for more details.
 */
 
 #include <ctype.h>
+#include <pthread.h>
 #include "opensrf/osrf_json.h"
 
-static jsonObject* findMultiPath( const jsonObject* o,
-		const char* root, const char* path );
-static jsonObject* findMultiPathRecurse( const jsonObject* o, const char* root );
+/**
+	@brief A search path for jsonObjectFindPath(), compiled for repeated use.
+
+	A path beginning with "//" is a multi-path: @a root is the key to look for anywhere in
+	the tree, and @a rest, if @a has_rest is true, is the path to follow from each match.
+	Otherwise the path is simple: @a steps is the series of keys to follow from the top.
+*/
+struct _jsonPathStruct {
+	char* root;            /**< For a multi-path: key to look for anywhere. */
+	int has_rest;          /**< For a multi-path: boolean; true if there's more to the path. */
+	jsonPath* rest;        /**< For a multi-path: the rest of the path (NULL if it's empty). */
+	char** steps;          /**< For a simple path: keys to follow, in order. */
+	int step_count;        /**< For a simple path: number of keys in @a steps. */
+};
+
+/** @brief Number of compiled paths that jsonObjectFindPath() caches, per thread. */
+#define JSON_PATH_CACHE_SIZE 32
+
+/** @brief An entry in the cache of compiled paths. */
+typedef struct {
+	char* key;             /**< The path string, as passed to jsonObjectFindPath(). */
+	unsigned long hash;    /**< Hash of @a key, to avoid most string comparisons. */
+	jsonPath* path;        /**< The compiled path. */
+	unsigned long used;    /**< When the entry was last used, according to pathCacheClock. */
+} PathCacheEntry;
+
+/** This thread's cache of compiled paths, least recently used first to go */
+static __thread PathCacheEntry pathCache[ JSON_PATH_CACHE_SIZE ];
+/** Counts lookups in this thread's cache, to tell which entry is least recently used */
+static __thread unsigned long pathCacheClock = 0;
+/** Boolean; true if we have arranged to free this thread's cache when it exits */
+static __thread int pathCacheRegistered = 0;
+/** Key whose destructor frees a thread's cache of compiled paths when the thread exits */
+static pthread_key_t pathCacheKey;
+/** For creating pathCacheKey exactly once */
+static pthread_once_t pathCacheKeyOnce = PTHREAD_ONCE_INIT;
+
+static const jsonObject* path_walk( const jsonPath* path, const jsonObject* obj );
+static void path_collect( const jsonObject* obj, const char* root, osrfList* matches );
+static void path_push_flat( jsonObject* arr, const jsonObject* thing );
+static jsonPath* path_cache_lookup( const char* path );
+static void make_path_cache_key( void );
+static void release_path_cache( void* unused );
 static jsonObject* _jsonObjectEncodeClass( const jsonObject* obj, int ignoreClass );
+static int has_class_wrapper( const jsonObject* obj );
 
 /**
 	@brief Append some spaces to a growing_buffer, for indentation.
@@ -172,6 +214,55 @@ jsonObject* jsonObjectDecodeClass( const jsonObject* obj ) {
 	return newObj;
 }
 
+/**
+	@brief Decode class wrappers like jsonObjectDecodeClass(), sharing instead of copying
+		when there is nothing to decode.
+	@param obj Pointer to the jsonObject to be decoded.
+	@return Pointer to the decoded jsonObject.
+
+	Usually the class wrappers were decoded when the JSON was parsed, and
+	jsonObjectDecodeClass() ends up copying the whole tree without changing anything.
+	Here we look for class wrappers first.  If there aren't any, we return a shared
+	reference to @a obj (see jsonObjectShare()) instead of a copy.
+
+	The calling code is responsible for freeing the result, and must call
+	jsonObjectUnshare() on it before changing it.
+*/
+jsonObject* jsonObjectDecodeClassShared( const jsonObject* obj ) {
+	if( !obj || ( obj->flags & JSON_NODE_ARENA ) || has_class_wrapper( obj ) )
+		return jsonObjectDecodeClass( obj );
+	else
+		return jsonObjectShare( obj );
+}
+
+/**
+	@brief Determine whether a jsonObject contains any raw class wrappers.
+	@param obj Pointer to the jsonObject to be searched.
+	@return Boolean: 1 if @a obj, or anything below it, is a JSON_HASH with a
+		JSON_CLASS_KEY entry; otherwise 0.
+*/
+static int has_class_wrapper( const jsonObject* obj ) {
+	if( obj->type == JSON_HASH ) {
+		if( jsonObjectGetKeyConst( obj, JSON_CLASS_KEY ) )
+			return 1;
+		jsonIterator* itr = jsonNewIterator( obj );
+		const jsonObject* item;
+		int found = 0;
+		while( !found && ( item = jsonIteratorNext( itr ) ) )
+			found = has_class_wrapper( item );
+		jsonIteratorFree( itr );
+		return found;
+	} else if( obj->type == JSON_ARRAY ) {
+		unsigned long i;
+		for( i = 0; i < obj->size; ++i ) {
+			const jsonObject* item = jsonObjectGetIndex( obj, i );
+			if( item && has_class_wrapper( item ) )
+				return 1;
+		}
+	}
+	return 0;
+}
+
 jsonObject* jsonObjectEncodeClass( const jsonObject* obj ) {
 	return _jsonObjectEncodeClass( obj, 0 );
 }
@@ -219,119 +310,280 @@ static jsonObject* _jsonObjectEncodeClass( const jsonObject* obj, int ignoreClas
 	return newObj;
 }
 
-jsonObject* jsonObjectFindPath( const jsonObject* obj, const char* format, ...) {
-	if(!obj || !format || strlen(format) < 1) return NULL;	
+/**
+	@brief Compile a search path for use by jsonPathEval().
+	@param path The search path, in the form described for jsonObjectFindPath().
+	@return Pointer to the compiled path, or NULL if @a path contains no keys.
 
-	VA_LIST_TO_STRING(format);
-	char* buf = VA_BUF;
-	char* token = NULL;
-	char* tt; /* strtok storage */
+	Compiling splits the path into its keys once, so that it can be applied to any number
+	of jsonObjects without being parsed again.
 
-	/* special case where path starts with //  (start anywhere) */
-	if(buf[0] == '/' && buf[1] == '/' && buf[2] != '\0') {
+	The calling code is responsible for freeing the compiled path by calling jsonPathFree().
+*/
+jsonPath* jsonPathCompile( const char* path ) {
+	if( !path )
+		return NULL;
+
+	// Skip to the first key
+	const char* key = path;
+	while( '/' == *key )
+		++key;
+	if( '\0' == *key )
+		return NULL;
+
+	jsonPath* compiled = safe_malloc( sizeof( jsonPath ) );
+	compiled->root = NULL;
+	compiled->has_rest = 0;
+	compiled->rest = NULL;
+	compiled->steps = NULL;
+	compiled->step_count = 0;
+
+	if( path[0] == '/' && path[1] == '/' && path[2] != '\0' ) {
+
+		// Multi-path: the first key may appear anywhere in the tree
+		size_t root_len = strcspn( key, "/" );
+		compiled->root = safe_malloc( root_len + 1 );
+		memcpy( compiled->root, key, root_len );
+		compiled->root[ root_len ] = '\0';
+
+		// Anything after "/root/" applies to each match.  Note that this measures from
+		// the second slash, whether or not the key immediately follows it.
+		const char* tail = path + 1;
+		if( root_len + 2 < strlen( tail ) ) {
+			compiled->has_rest = 1;
+			compiled->rest = jsonPathCompile( tail + root_len + 1 );
+		}
 
-		/* copy the path before strtok_r destroys it */
-		char* pathcopy = strdup(buf);
+	} else {
 
-		/* grab the root of the path */
-		token = strtok_r(buf, "/", &tt);
-		if(!token) {
-			free(pathcopy);
-			return NULL;
+		// Simple path: a series of keys, separated by one or more slashes
+		int count = 0;
+		const char* p = key;
+		while( *p ) {
+			++count;
+			p += strcspn( p, "/" );
+			while( '/' == *p )
+				++p;
 		}
 
-		jsonObject* it = findMultiPath(obj, token, pathcopy + 1);
-		free(pathcopy);
-		return it;
+		compiled->steps = safe_malloc( count * sizeof( char* ) );
+		p = key;
+		while( *p ) {
+			size_t len = strcspn( p, "/" );
+			char* step = safe_malloc( len + 1 );
+			memcpy( step, p, len );
+			step[ len ] = '\0';
+			compiled->steps[ compiled->step_count++ ] = step;
+			p += len;
+			while( '/' == *p )
+				++p;
+		}
 	}
-	else
-	{
-		/* grab the root of the path */
-		token = strtok_r(buf, "/", &tt);
-		if(!token) return NULL;
-
-		do {
-			obj = jsonObjectGetKeyConst(obj, token);
-		} while( (token = strtok_r(NULL, "/", &tt)) && obj);
 
-		return jsonObjectClone(obj);
-	}
+	return compiled;
 }
 
-/* --------------------------------------------------------------- */
-
-/* Utility method. finds any object in the tree that matches the path.  
-	Use this for finding paths that start with '//' */
-static jsonObject* findMultiPath(const jsonObject* obj,
-		const char* root, const char* path) {
-
-	if(!obj || ! root || !path) return NULL;
+/**
+	@brief Apply a compiled search path to a jsonObject.
+	@param path Pointer to the compiled path.
+	@param obj Pointer to the jsonObject to be searched.
+	@return A copy of whatever the path finds, as described for jsonObjectFindPath();
+		or NULL if either parameter is NULL.
 
-	/* collect all of the potential objects */
-	jsonObject* arr = findMultiPathRecurse(obj, root);
+	The result is the same as that of jsonObjectFindPath() for the same path.  Nothing is
+	copied except the result itself.
 
-	/* path is just /root or /root/ */
-	if( strlen(root) + 2 >= strlen(path) ) {
-		return arr;
+	The calling code is responsible for freeing the result.
+*/
+jsonObject* jsonPathEval( const jsonPath* path, const jsonObject* obj ) {
+	if( !path || !obj )
+		return NULL;
 
-	} else {
+	if( !path->root )
+		return jsonObjectClone( path_walk( path, obj ) );
 
-		/* container for fully matching objects */
-		jsonObject* newarr = jsonNewObjectType(JSON_ARRAY);
-		int i;
+	// Multi-path: gather every member anywhere in the tree with the root key
+	osrfList* matches = osrfNewList();
+	path_collect( obj, path->root, matches );
 
-		/* gather all of the sub-objects that match the full path */
-		for( i = 0; i < arr->size; i++ ) {
-			const jsonObject* a = jsonObjectGetIndex(arr, i);
-			jsonObject* thing = jsonObjectFindPath(a , path + strlen(root) + 1); 
-
-			if(thing) { //jsonObjectPush(newarr, thing);
-				if(thing->type == JSON_ARRAY) {
-            		int i;
-					for( i = 0; i != thing->size; i++ )
-						jsonObjectPush(newarr, jsonObjectClone(jsonObjectGetIndex(thing,i)));
-					jsonObjectFree(thing);
-				} else {
-					jsonObjectPush(newarr, thing);
-				}
-			}
+	jsonObject* arr = jsonNewObjectType( JSON_ARRAY );
+	unsigned int i;
+	for( i = 0; i < matches->size; ++i ) {
+		const jsonObject* match = OSRF_LIST_GET_INDEX( matches, i );
+		if( !path->has_rest )
+			jsonObjectPush( arr, jsonObjectClone( match ) );
+		else if( !path->rest )
+			;   // The rest of the path has no keys, so it finds nothing
+		else if( !path->rest->root )
+			path_push_flat( arr, path_walk( path->rest, match ) );
+		else {
+			jsonObject* thing = jsonPathEval( path->rest, match );
+			path_push_flat( arr, thing );
+			jsonObjectFree( thing );
 		}
+	}
+
+	osrfListFree( matches );
+	return arr;
+}
 
-		jsonObjectFree(arr);
-		return newarr;
+/**
+	@brief Free a compiled search path.
+	@param path Pointer to the compiled path.
+*/
+void jsonPathFree( jsonPath* path ) {
+	if( path ) {
+		int i;
+		for( i = 0; i < path->step_count; ++i )
+			free( path->steps[ i ] );
+		free( path->steps );
+		free( path->root );
+		jsonPathFree( path->rest );
+		free( path );
 	}
 }
 
-/* returns a list of object whose key is 'root'.  These are used as
-	potential objects when doing a // search */
-static jsonObject* findMultiPathRecurse(const jsonObject* obj, const char* root) {
+/**
+	@brief Provide an XPATH style search interface to jsonObjects.
+	@param obj Pointer to the jsonObject to be searched.
+	@param format Pointer to a printf-style format string specifying the search path.
+		Subsequent parameters, if any, are formatted and inserted into the formatted string.
+	@return A copy of the object at the specified location, as described in osrf_json.h.
+
+	The expanded path is compiled by jsonPathCompile() and kept in a small per-thread
+	cache, so that a caller repeating the same lookups doesn't pay for parsing the path
+	each time.
+*/
+jsonObject* jsonObjectFindPath( const jsonObject* obj, const char* format, ...) {
+	if(!obj || !format || strlen(format) < 1) return NULL;	
+
+	// Without any conversions to expand, the format is the path itself
+	if( !strchr( format, '%' ) )
+		return jsonPathEval( path_cache_lookup( format ), obj );
 
-	jsonObject* arr = jsonNewObjectType(JSON_ARRAY);
-	if(!obj) return arr;
+	VA_LIST_TO_STRING(format);
+	return jsonPathEval( path_cache_lookup( VA_BUF ), obj );
+}
 
+/* --------------------------------------------------------------- */
+
+/**
+	@brief Follow a simple path from the top of a jsonObject.
+	@param path Pointer to a compiled simple path.
+	@param obj Pointer to the jsonObject to be searched.
+	@return Pointer to the jsonObject at the end of the path, or NULL if there isn't one.
+*/
+static const jsonObject* path_walk( const jsonPath* path, const jsonObject* obj ) {
 	int i;
+	for( i = 0; obj && i < path->step_count; ++i )
+		obj = jsonObjectGetKeyConst( obj, path->steps[ i ] );
+	return obj;
+}
 
-	/* if the current object has a node that matches, add it */
+/**
+	@brief Find every member of a tree with a given key.
+	@param obj Pointer to the jsonObject to be searched.
+	@param root The key to look for.
+	@param matches Pointer to an osrfList to which to append (borrowed) pointers to matches.
 
-	const jsonObject* o = jsonObjectGetKeyConst(obj, root);
-	if(o) jsonObjectPush( arr, jsonObjectClone(o) );
+	The search is depth-first, in pre-order: a node's own match comes before any matches
+	beneath it.
+*/
+static void path_collect( const jsonObject* obj, const char* root, osrfList* matches ) {
+	if( !obj )
+		return;
+
+	const jsonObject* o = jsonObjectGetKeyConst( obj, root );
+	if( o )
+		osrfListPush( matches, (void*) o );
+
+	jsonIterator* itr = jsonNewIterator( obj );
+	const jsonObject* tmp;
+	while( (tmp = jsonIteratorNext( itr )) )
+		path_collect( tmp, root, matches );
+	jsonIteratorFree( itr );
+}
 
-	jsonObject* tmp = NULL;
-	jsonObject* childarr;
-	jsonIterator* itr = jsonNewIterator(obj);
+/**
+	@brief Append copies of what a path found to the results of a multi-path search.
+	@param arr Pointer to the JSON_ARRAY of results.
+	@param thing Pointer to what was found.
 
-	/* recurse through the children and find all potential nodes */
-	while( (tmp = jsonIteratorNext(itr)) ) {
-		childarr = findMultiPathRecurse(tmp, root);
-		if(childarr && childarr->size > 0) {
-			for( i = 0; i!= childarr->size; i++ ) {
-				jsonObjectPush( arr, jsonObjectClone(jsonObjectGetIndex(childarr, i)) );
-			}
+	An array is flattened into its elements; anything else, including nothing at all,
+	is appended as a single element (NULL becoming a JSON_NULL).
+*/
+static void path_push_flat( jsonObject* arr, const jsonObject* thing ) {
+	if( thing && thing->type == JSON_ARRAY ) {
+		unsigned long i;
+		for( i = 0; i != thing->size; i++ )
+			jsonObjectPush( arr, jsonObjectClone( jsonObjectGetIndex( thing, i ) ) );
+	} else
+		jsonObjectPush( arr, jsonObjectClone( thing ) );
+}
+
+/**
+	@brief Get the compiled version of a search path from this thread's cache, compiling
+	it if necessary.
+	@param path The search path.
+	@return Pointer to the compiled path (owned by the cache), or NULL if it has no keys.
+
+	When the cache is full, the least recently used entry makes way for the new one.
+*/
+static jsonPath* path_cache_lookup( const char* path ) {
+	unsigned long hash = 5381;
+	const unsigned char* p = (const unsigned char*) path;
+	while( *p )
+		hash = hash * 33 + *p++;
+
+	++pathCacheClock;
+	PathCacheEntry* victim = &pathCache[ 0 ];
+	int i;
+	for( i = 0; i < JSON_PATH_CACHE_SIZE; ++i ) {
+		PathCacheEntry* entry = &pathCache[ i ];
+		if( entry->key && entry->hash == hash && !strcmp( entry->key, path ) ) {
+			entry->used = pathCacheClock;
+			return entry->path;
 		}
-		jsonObjectFree(childarr);
+		if( entry->used < victim->used )
+			victim = entry;
 	}
 
-	jsonIteratorFree(itr);
+	if( !pathCacheRegistered ) {
+		pthread_once( &pathCacheKeyOnce, make_path_cache_key );
+		pthread_setspecific( pathCacheKey, &pathCacheRegistered );
+		pathCacheRegistered = 1;
+	}
 
-	return arr;
+	free( victim->key );
+	jsonPathFree( victim->path );
+	victim->key = strdup( path );
+	victim->hash = hash;
+	victim->path = jsonPathCompile( path );
+	victim->used = pathCacheClock;
+	return victim->path;
+}
+
+/**
+	@brief Create the key that disposes of each thread's cache of compiled paths.
+
+	Called exactly once, via pthread_once().
+*/
+static void make_path_cache_key( void ) {
+	pthread_key_create( &pathCacheKey, release_path_cache );
+}
+
+/**
+	@brief Free the exiting thread's cache of compiled paths.
+	@param unused The thread-specific value for pathCacheKey; not used.
+*/
+static void release_path_cache( void* unused ) {
+	int i;
+	for( i = 0; i < JSON_PATH_CACHE_SIZE; ++i ) {
+		free( pathCache[ i ].key );
+		jsonPathFree( pathCache[ i ].path );
+		pathCache[ i ].key = NULL;
+		pathCache[ i ].path = NULL;
+		pathCache[ i ].used = 0;
+	}
+	pathCacheRegistered = 0;
 }
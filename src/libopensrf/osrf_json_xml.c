@@ -1,4 +1,5 @@
 #include <opensrf/osrf_json_xml.h>
+#include <limits.h>
 
 #ifdef OSRF_JSON_ENABLE_XML_UTILS
 
@@ -229,126 +230,179 @@ jsonObject* jsonXMLToJSONObject(const char* xml) {
 
 
 
-static char* _escape_xml (const char*);
-static int _recurse_jsonObjectToXML(const jsonObject*, growing_buffer*);
+/**
+	@brief Hand the staged text of a jsonSink to its writer, if enough has accumulated.
+	@param sink Pointer to the jsonSink.
+*/
+#define XML_SINK_CHECK(sink) \
+	do { \
+		if( (sink)->write && (sink)->buf->n_used >= (sink)->window ) \
+			jsonSinkFlush( sink ); \
+	} while(0)
 
+static void add_xml_to_sink( const jsonObject* obj, jsonSink* sink );
+
+/**
+	@brief Generate an XML representation of a jsonObject.
+	@param obj Pointer to the jsonObject (may be NULL).
+	@return A newly allocated string containing the XML.
+
+	The calling code is responsible for freeing the resulting string.
+*/
 char* jsonObjectToXML(const jsonObject* obj) {
 
 	if (!obj)
 		return strdup("<null/>");
-	
-	growing_buffer * res_xml = buffer_init(1024);
 
-	_recurse_jsonObjectToXML( obj, res_xml );
-	return buffer_release(res_xml);
+	jsonSink sink = { buffer_init(1024), 0, NULL, NULL, 0, 0 };
+	add_xml_to_sink( obj, &sink );
+	return buffer_release( sink.buf );
+}
+
+/**
+	@brief Generate an XML representation of a jsonObject, and deliver it through a jsonSink.
+	@param obj Pointer to the jsonObject (may be NULL).
+	@param sink Pointer to the jsonSink.
+	@return Zero if successful, or -1 upon error.
+
+	The XML is the same as that from jsonObjectToXML(), but it reaches the writer a window
+	at a time, as it is generated.  Whatever remains staged at the end is left for the
+	calling code to flush, so that it can frame the XML with other text.
+*/
+int jsonObjectToXMLSink( const jsonObject* obj, jsonSink* sink ) {
+	if( !sink || sink->error )
+		return -1;
+
+	if( obj )
+		add_xml_to_sink( obj, sink );
+	else
+		OSRF_BUFFER_ADD( sink->buf, "<null/>" );
+
+	XML_SINK_CHECK( sink );
+	return sink->error ? -1 : 0;
+}
 
+/**
+	@brief Append a class_hint attribute, if there is a class name.
+	@param buf Pointer to the growing_buffer holding an unfinished start tag.
+	@param hint The class name, or NULL.
+*/
+static void add_class_hint( growing_buffer* buf, const char* hint ) {
+	if( hint ) {
+		OSRF_BUFFER_ADD( buf, " class_hint=\"" );
+		buffer_add_xml_escaped( buf, hint, 1 );
+		OSRF_BUFFER_ADD_CHAR( buf, '"' );
+	}
 }
 
-int _recurse_jsonObjectToXML(const jsonObject* obj, growing_buffer* res_xml) {
+/**
+	@brief Append a start tag with an optional class_hint attribute.
+	@param buf Pointer to the growing_buffer.
+	@param tag The element name.
+	@param hint The class name, or NULL.
+*/
+static void add_start_tag( growing_buffer* buf, const char* tag, const char* hint ) {
+	OSRF_BUFFER_ADD_CHAR( buf, '<' );
+	OSRF_BUFFER_ADD( buf, tag );
+	add_class_hint( buf, hint );
+	OSRF_BUFFER_ADD_CHAR( buf, '>' );
+}
 
-	char * hint = NULL;
-	
-	if (obj->classname)
-		hint = strdup(obj->classname);
+/**
+	@brief Append a string to a jsonSink, escaped as XML text.
+	@param sink Pointer to the jsonSink.
+	@param str Pointer to the string.
+
+	If the sink has a writer, escape a long string in window-sized slices, flushing
+	as we go.
+*/
+static void add_xml_text_to_sink( jsonSink* sink, const char* str ) {
+	size_t len = strlen( str );
+	if( !sink->write || len <= sink->window ) {
+		buffer_add_xml_escaped_n( sink->buf, str, len, 0 );
+		return;
+	}
+
+	while( len > 0 && !sink->error ) {
+		size_t n = len < sink->window ? len : sink->window;
+		buffer_add_xml_escaped_n( sink->buf, str, n, 0 );
+		XML_SINK_CHECK( sink );
+		str += n;
+		len -= n;
+	}
+}
+
+/**
+	@brief Recursively translate a jsonObject into XML in a jsonSink.
+	@param obj Pointer to the jsonObject.
+	@param sink Pointer to the jsonSink.
+*/
+static void add_xml_to_sink( const jsonObject* obj, jsonSink* sink ) {
+
+	growing_buffer* buf = sink->buf;
+	const char* hint = obj->classname;
 
 	if(obj->type == JSON_NULL) {
 
-		if (hint)
-			buffer_fadd(res_xml, "<null class_hint=\"%s\"/>",hint);
-		else
-			buffer_add(res_xml, "<null/>");
+		OSRF_BUFFER_ADD( buf, "<null" );
+		add_class_hint( buf, hint );
+		OSRF_BUFFER_ADD( buf, "/>" );
 
 	} else if(obj->type == JSON_BOOL) {
 
-		const char* bool_val;
 		if (obj->value.b)
-			bool_val = "true";
-		else
-			bool_val = "false";
-
-		if (hint)
-			buffer_fadd(res_xml, "<boolean value=\"%s\" class_hint=\"%s\"/>", bool_val, hint);
+			OSRF_BUFFER_ADD( buf, "<boolean value=\"true\"" );
 		else
-			buffer_fadd(res_xml, "<boolean value=\"%s\"/>", bool_val);
+			OSRF_BUFFER_ADD( buf, "<boolean value=\"false\"" );
+		add_class_hint( buf, hint );
+		OSRF_BUFFER_ADD( buf, "/>" );
 
 	} else if (obj->type == JSON_STRING) {
-		if (hint) {
-			char * t = _escape_xml(jsonObjectGetString(obj));
-			buffer_fadd(res_xml,"<string class_hint=\"%s\">%s</string>", hint, t);
-			free(t);
-		} else {
-			char * t = _escape_xml(jsonObjectGetString(obj));
-			buffer_fadd(res_xml,"<string>%s</string>", t);
-			free(t);
-		}
+
+		add_start_tag( buf, "string", hint );
+		add_xml_text_to_sink( sink, jsonObjectGetString(obj) );
+		OSRF_BUFFER_ADD( buf, "</string>" );
 
 	} else if(obj->type == JSON_NUMBER) {
+
 		double x = jsonObjectGetNumber(obj);
-		if (hint) {
-			if (x == (int)x)
-				buffer_fadd(res_xml,"<number class_hint=\"%s\">%d</number>", hint, (int)x);
-			else
-				buffer_fadd(res_xml,"<number class_hint=\"%s\">%lf</number>", hint, x);
-		} else {
-			if (x == (int)x)
-				buffer_fadd(res_xml,"<number>%d</number>", (int)x);
-			else
-				buffer_fadd(res_xml,"<number>%lf</number>", x);
-		}
+		add_start_tag( buf, "number", hint );
+		if (x >= INT_MIN && x <= INT_MAX && x == (int)x)
+			buffer_fadd( buf, "%d", (int)x );
+		else
+			buffer_fadd( buf, "%lf", x );
+		OSRF_BUFFER_ADD( buf, "</number>" );
 
 	} else if (obj->type == JSON_ARRAY) {
 
-		if (hint) 
-        	       	buffer_fadd(res_xml,"<array class_hint=\"%s\">", hint);
-		else
-               		buffer_add(res_xml,"<array>");
+		add_start_tag( buf, "array", hint );
 
-        int i;
-        for ( i = 0; i!= obj->size; i++ )
-		    _recurse_jsonObjectToXML(jsonObjectGetIndex(obj,i), res_xml);
+		unsigned long i;
+		for ( i = 0; i < obj->size && !sink->error; i++ ) {
+			add_xml_to_sink( jsonObjectGetIndex(obj,i), sink );
+			XML_SINK_CHECK( sink );
+		}
 
-		buffer_add(res_xml,"</array>");
+		OSRF_BUFFER_ADD( buf, "</array>" );
 
 	} else if (obj->type == JSON_HASH) {
 
-		if (hint)
-        	       	buffer_fadd(res_xml,"<object class_hint=\"%s\">", hint);
-		else
-			buffer_add(res_xml,"<object>");
+		add_start_tag( buf, "object", hint );
 
 		jsonIterator* itr = jsonNewIterator(obj);
 		const jsonObject* tmp;
-		while( (tmp = jsonIteratorNext(itr)) ) {
-			buffer_fadd(res_xml,"<element key=\"%s\">",itr->key);
-			_recurse_jsonObjectToXML(tmp, res_xml);
-			buffer_add(res_xml,"</element>");
+		while( !sink->error && (tmp = jsonIteratorNext(itr)) ) {
+			OSRF_BUFFER_ADD( buf, "<element key=\"" );
+			buffer_add_xml_escaped( buf, itr->key, 1 );
+			OSRF_BUFFER_ADD( buf, "\">" );
+			add_xml_to_sink( tmp, sink );
+			OSRF_BUFFER_ADD( buf, "</element>" );
+			XML_SINK_CHECK( sink );
 		}
 		jsonIteratorFree(itr);
 
-		buffer_add(res_xml,"</object>");
-	}
-
-	if (hint)
-		free(hint);
-
-	return 1;
-}
-
-static char* _escape_xml (const char* text) {
-	growing_buffer* b = buffer_init(256);
-	int len = strlen(text);
-	int i;
-	for (i = 0; i < len; i++) {
-		if (text[i] == '&')
-			buffer_add(b,"&amp;");
-		else if (text[i] == '<')
-			buffer_add(b,"&lt;");
-		else if (text[i] == '>')
-			buffer_add(b,"&gt;");
-		else
-			buffer_add_char(b,text[i]);
+		OSRF_BUFFER_ADD( buf, "</object>" );
 	}
-	return buffer_release(b);
 }
 
 #endif
@@ -22,13 +22,18 @@ GNU General Public License for more details.
 int current_strlen; 
 
 
+/* The regular parser understands the legacy dialect, comments and all, and
+ * does the job much faster.  json_parse_string() is still here for anyone who
+ * needs the old parser's exact behavior.
+ */
 jsonObject* legacy_jsonParseString( const char* string) {
-	return json_parse_string( (char*) string );
+	return jsonParseLegacy( string );
 }
 
 jsonObject* legacy_jsonParseStringFmt( const char* string, ... ) {
+	if( !string ) return NULL;
 	VA_LIST_TO_STRING(string);
-	return json_parse_string( VA_BUF );
+	return jsonParseLegacy( VA_BUF );
 }
 
 
@@ -246,6 +251,7 @@ int json_parse_json_number(char* string, unsigned long* index, jsonObject* obj,
 
 	obj->type = JSON_NUMBER;
 	obj->value.s = buffer_release(buf);
+	jsonObjectCacheNumber(obj);
 	return 0;
 }
 
@@ -45,6 +45,34 @@ osrfList* osrfNewListSize( unsigned int size ) {
 	return list;
 }
 
+/**
+	@brief Create a new osrfList within an osrfArena.
+	@param arena Pointer to the osrfArena from which to allocate memory.
+	@param size How many pointers to store initially.
+	@return A pointer to the new osrfList.
+
+	The osrfList and its array live in the osrfArena.  If @a arena is NULL, the result is
+	an ordinary osrfList, as from osrfNewListSize().
+
+	Don't install a freeItem callback for an arena list unless you plan to remove items
+	explicitly; osrfListFree() won't call it.
+*/
+osrfList* osrfNewArenaList( osrfArena* arena, unsigned int size ) {
+	if( !arena )
+		return osrfNewListSize( size );
+
+	osrfList* list = osrfArenaAlloc( arena, sizeof(osrfList) );
+	list->size = 0;
+	list->freeItem = NULL;
+	list->arena = arena;
+	if( size <= 0 ) size = 16;
+	list->arrsize = size;
+	list->arrlist = osrfArenaAlloc( arena, list->arrsize * sizeof(void*) );
+	memset( list->arrlist, 0, list->arrsize * sizeof(void*) );
+
+	return list;
+}
+
 
 /**
 	@brief Add a pointer to the end of the array.
@@ -107,12 +135,21 @@ void* osrfListSet( osrfList* list, void* item, unsigned int position ) {
 
 	int newsize = list->arrsize;
 
-	while( position >= newsize )
-		newsize += OSRF_LIST_INC_SIZE;
+	if( list->arena ) {
+		// Abandoned arrays can't be reused, so grow geometrically to limit the waste
+		while( position >= newsize )
+			newsize *= 2;
+	} else {
+		while( position >= newsize )
+			newsize += OSRF_LIST_INC_SIZE;
+	}
 
 	if( newsize > list->arrsize ) { /* expand the list if necessary */
 		void** newarr;
-		OSRF_MALLOC(newarr, newsize * sizeof(void*));
+		if( list->arena )
+			newarr = osrfArenaAlloc( list->arena, newsize * sizeof(void*) );
+		else
+			OSRF_MALLOC(newarr, newsize * sizeof(void*));
 
 		// Copy the old pointers, and nullify the new ones
 
@@ -121,7 +158,8 @@ void* osrfListSet( osrfList* list, void* item, unsigned int position ) {
 			newarr[i] = list->arrlist[i];
 		for( ; i < newsize; i++ )
 			newarr[i] = NULL;
-		free(list->arrlist);
+		if( !list->arena )
+			free(list->arrlist);
 		list->arrlist = newarr;
 		list->arrsize = newsize;
 	}
@@ -154,9 +192,11 @@ void* osrfListGetIndex( const osrfList* list, unsigned int position ) {
 
 	If the calling code has specified a function for freeing items, it is called for every
 	non-NULL pointer in the array.
+
+	An osrfList allocated from an osrfArena is left alone, along with its contents.
 */
 void osrfListFree( osrfList* list ) {
-	if(!list) return;
+	if(!list || list->arena) return;
 
 	if( list->freeItem ) {
 		int i; void* val;
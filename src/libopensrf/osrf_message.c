@@ -14,6 +14,8 @@
 #include "opensrf/osrf_stack.h"
 
 static osrfMessage* deserialize_one_message( const jsonObject* message );
+static int deserialize_messages( const jsonObject* json, osrfMessage* msgs[], int count );
+static jsonObject* parse_binary_body( const char* string );
 
 static char default_locale[17] = "en-US\0\0\0\0\0\0\0\0\0\0\0\0";
 static char* current_locale = NULL;
@@ -44,6 +46,7 @@ osrfMessage* osrf_message_init( enum M_TYPE type, int thread_trace, int protocol
 	msg->sender_locale          = NULL;
 	msg->sender_tz              = NULL;
 	msg->sender_ingress         = NULL;
+	msg->binary                 = 0;
 
 	return msg;
 }
@@ -369,6 +372,40 @@ char* osrfMessageSerializeBatch( osrfMessage* msgs [], int count ) {
 	return j;
 }
 
+/**
+	@brief Turn a collection of osrfMessages into a message body in binary form.
+	@param msgs Pointer to an array of osrfMessages.
+	@param count Maximum number of messages to serialize.
+	@return Pointer to the message body.
+
+	This function is like osrfMessageSerializeBatch(), except that the result is
+	OSRF_BINARY_BODY_MARK followed by base64 text, encoding the messages one after
+	another with jsonObjectToBinary().  Send it only to a peer that has advertised
+	that it can read it.
+
+	The calling code is responsible for freeing the returned string.
+*/
+char* osrfMessageSerializeBatchBinary( osrfMessage* msgs [], int count ) {
+	if( !msgs ) return NULL;
+
+	growing_buffer* bin = buffer_init( 1024 );
+
+	int i = 0;
+	while( (i < count) && msgs[i] ) {
+		jsonObject* json = osrfMessageToJSON( msgs[i] );
+		jsonObjectToBinary( json, bin );
+		jsonObjectFree( json );
+		++i;
+	}
+
+	growing_buffer* body = buffer_init( buffer_length( bin ) / 3 * 4 + 8 );
+	OSRF_BUFFER_ADD_CHAR( body, OSRF_BINARY_BODY_MARK );
+	buffer_add_base64( body, OSRF_BUFFER_C_STR( bin ), buffer_length( bin ) );
+	buffer_free( bin );
+
+	return buffer_release( body );
+}
+
 
 /**
 	@brief Turn a single osrfMessage into a JSON string.
@@ -409,6 +446,8 @@ char* osrf_message_serialize(const osrfMessage* msg) {
 	- "locale"
 	- "tz"
 	- "ingress"
+	- "api_level" (only if msg->protocol is positive)
+	- "binary" (only if msg->binary is set)
 	- "type"
 	- "payload" (only for STATUS, REQUEST, and RESULT messages)
 
@@ -425,6 +464,9 @@ char* osrf_message_serialize(const osrfMessage* msg) {
 	(carrying msg->status_text), "statusCode" (carrying the status code as a string), and
 	"content" (carrying a jsonObject to return any results from the method call).
 
+	Unless they hold class wrappers to decode, "params" and "content" are shared with the
+	osrfMessage rather than copied (see jsonObjectShare()).  Treat them as read-only.
+
 	The calling code is responsible for freeing the returned jsonObject.
 */
 jsonObject* osrfMessageToJSON( const osrfMessage* msg ) {
@@ -456,6 +498,9 @@ jsonObject* osrfMessageToJSON( const osrfMessage* msg ) {
 	if (msg->protocol > 0) 
 		jsonObjectSetKey(json, "api_level", jsonNewNumberObject(msg->protocol));
 
+	if (msg->binary)
+		jsonObjectSetKey(json, "binary", jsonNewBoolObject(1));
+
 	switch(msg->m_type) {
 
 		case CONNECT:
@@ -481,7 +526,7 @@ jsonObject* osrfMessageToJSON( const osrfMessage* msg ) {
 			payload = jsonNewObject(NULL);
 			jsonObjectSetClass(payload, "osrfMethod");
 			jsonObjectSetKey(payload, "method", jsonNewObject(msg->method_name));
-			jsonObjectSetKey( payload, "params", jsonObjectDecodeClass( msg->_params ) );
+			jsonObjectSetKey( payload, "params", jsonObjectDecodeClassShared( msg->_params ) );
 			jsonObjectSetKey(json, "payload", payload);
 
 			break;
@@ -499,7 +544,7 @@ jsonObject* osrfMessageToJSON( const osrfMessage* msg ) {
 			jsonObjectSetKey(payload, "status", jsonNewObject(msg->status_text));
 			snprintf(sc, sizeof(sc), "%d", msg->status_code);
 			jsonObjectSetKey(payload, "statusCode", jsonNewObject(sc));
-			jsonObjectSetKey(payload, "content", jsonObjectDecodeClass( msg->_result_content ));
+			jsonObjectSetKey(payload, "content", jsonObjectDecodeClassShared( msg->_result_content ));
 			jsonObjectSetKey(json, "payload", payload);
 			break;
 	}
@@ -542,8 +587,9 @@ osrfList* osrfMessageDeserialize( const char* string, osrfList* list ) {
 		return list;                   // No string?  Return empty list.
 	}
 	
-	// Parse the JSON
-	jsonObject* json = jsonParse(string);
+	// Parse the JSON, or the binary equivalent
+	jsonObject* json = ( OSRF_BINARY_BODY_MARK == *string )
+		? parse_binary_body( string ) : jsonParse(string);
 	if(!json) {
 		osrfLogWarning( OSRF_LOG_MARK,
 				"osrfMessageDeserialize() unable to parse data: \n%s\n", string);
@@ -589,12 +635,32 @@ osrfList* osrfMessageDeserialize( const char* string, osrfList* list ) {
 	silently ignore the excess.
 */
 int osrf_message_deserialize(const char* string, osrfMessage* msgs[], int count) {
+	return osrf_message_deserialize_in_arena( string, msgs, count, NULL );
+}
+
+/**
+	@brief Translate a JSON array into an array of osrfMessages, parsing within an osrfArena.
+	@param string The JSON string to be translated.
+	@param msgs Pointer to an array of pointers to osrfMessage, to receive the results.
+	@param count How many slots are available in the @a msgs array.
+	@param arena Pointer to an osrfArena to hold the intermediate jsonObject tree, or NULL.
+	@return The number of osrfMessages created.
+
+	This function is like osrf_message_deserialize(), except that it builds the parsed
+	jsonObject tree in an osrfArena.  That tree is only a way station, since the resulting
+	osrfMessages copy whatever they need from it.  Hence the calling code may reset the
+	arena as soon as this function returns.  The osrfMessages themselves live on the heap.
+
+	If @a arena is NULL, the tree is built on the heap and freed before returning.
+*/
+int osrf_message_deserialize_in_arena( const char* string, osrfMessage* msgs[], int count,
+		osrfArena* arena ) {
 
 	if(!string || !msgs || count <= 0) return 0;
-	int numparsed = 0;
 
-	// Parse the JSON
-	jsonObject* json = jsonParse(string);
+	// Parse the JSON, or the binary equivalent
+	jsonObject* json = ( OSRF_BINARY_BODY_MARK == *string )
+		? parse_binary_body( string ) : jsonParseInArena( arena, string );
 
 	if(!json) {
 		osrfLogWarning( OSRF_LOG_MARK,
@@ -602,6 +668,113 @@ int osrf_message_deserialize(const char* string, osrfMessage* msgs[], int count)
 		return 0;
 	}
 
+	int numparsed = deserialize_messages( json, msgs, count );
+	jsonObjectFree( json );
+	return numparsed;
+}
+
+/**
+	@brief Translate a JSON array into an array of osrfMessages, parsing in place.
+	@param string Pointer to a writable buffer holding the JSON string to be translated.
+	@param msgs Pointer to an array of pointers to osrfMessage, to receive the results.
+	@param count How many slots are available in the @a msgs array.
+	@param arena Pointer to an osrfArena to hold the intermediate jsonObject tree, or NULL.
+	@return The number of osrfMessages created.
+
+	This function is like osrf_message_deserialize_in_arena(), except that it parses the
+	JSON string in place with jsonParseInSitu(), avoiding a copy of every string in it.
+	As a result the contents of @a string are destroyed.  Use this function only when the
+	calling code has no further use for the input.
+
+	As with osrf_message_deserialize_in_arena(), the resulting osrfMessages are
+	self-contained.  They don't refer to the input buffer or to the arena.
+*/
+int osrf_message_deserialize_in_situ( char* string, osrfMessage* msgs[], int count,
+		osrfArena* arena ) {
+
+	if(!string || !msgs || count <= 0) return 0;
+
+	// Parse the JSON.  Upon failure, we can't log the input, because we've clobbered it.
+	jsonObject* json = ( OSRF_BINARY_BODY_MARK == *string )
+		? parse_binary_body( string ) : jsonParseInSitu( arena, string );
+
+	if(!json) {
+		osrfLogWarning( OSRF_LOG_MARK,
+			"osrf_message_deserialize_in_situ() unable to parse data" );
+		return 0;
+	}
+
+	int numparsed = deserialize_messages( json, msgs, count );
+	jsonObjectFree( json );
+	return numparsed;
+}
+
+/**
+	@brief Decode a message body in binary form.
+	@param string Pointer to the message body, beginning with OSRF_BINARY_BODY_MARK.
+	@return Pointer to a newly created JSON_ARRAY of encoded messages, or NULL if the body
+		is invalid.
+
+	The body may consist of several comma-separated segments of base64 text, as when a
+	server bundles several responses into one transport_message.  We decode each segment
+	in turn into the same buffer, and then decode the messages one after another.
+
+	The result lives on the heap even if the calling code asked for an osrfArena, since
+	jsonObjectFromBinary() knows nothing of arenas.  The calling code is responsible for
+	freeing it.
+*/
+static jsonObject* parse_binary_body( const char* string ) {
+
+	growing_buffer* bin = buffer_init( strlen( string ) / 4 * 3 + 4 );
+
+	const char* segment = string + 1;
+	for( ;; ) {
+		const char* comma = strchr( segment, ',' );
+		size_t len = comma ? comma - segment : strlen( segment );
+		if( buffer_add_unbase64( bin, segment, len ) < 0 ) {
+			buffer_free( bin );
+			return NULL;
+		}
+		if( !comma )
+			break;
+		segment = comma + 1;
+	}
+
+	jsonObject* json = jsonNewObjectType( JSON_ARRAY );
+	const char* data = OSRF_BUFFER_C_STR( bin );
+	size_t remaining = buffer_length( bin );
+
+	while( remaining ) {
+		size_t used = 0;
+		jsonObject* message = jsonObjectFromBinary( data, remaining, &used );
+		if( !message ) {
+			jsonObjectFree( json );
+			json = NULL;
+			break;
+		}
+		jsonObjectPush( json, message );
+		data += used;
+		remaining -= used;
+	}
+
+	buffer_free( bin );
+	return json;
+}
+
+/**
+	@brief Translate a parsed JSON array into an array of osrfMessages.
+	@param json Pointer to the jsonObject to be translated.
+	@param msgs Pointer to an array of pointers to osrfMessage, to receive the results.
+	@param count How many slots are available in the @a msgs array.
+	@return The number of osrfMessages created.
+
+	Elements that don't encode an osrfMessage are ignored, as are any elements beyond what
+	will fit in the @a msgs array.
+*/
+static int deserialize_messages( const jsonObject* json, osrfMessage* msgs[], int count ) {
+
+	int numparsed = 0;
+
 	// Traverse the JSON_ARRAY, turning each element into an osrfMessage
 	int x;
 	for( x = 0; x < json->size && x < count; x++ ) {
@@ -614,7 +787,6 @@ int osrf_message_deserialize(const char* string, osrfMessage* msgs[], int count)
 		}
 	}
 
-	jsonObjectFree( json );
 	return numparsed;
 }
 
@@ -696,6 +868,11 @@ static osrfMessage* deserialize_one_message( const jsonObject* obj ) {
 		osrf_message_set_tz(msg, jsonObjectGetString(tmp));
 	}
 
+	tmp = jsonObjectGetKeyConst(obj, "binary");
+	if (tmp) {
+		msg->binary = jsonBoolIsTrue(tmp);
+	}
+
 	tmp = jsonObjectGetKeyConst( obj, "payload" );
 	if(tmp) {
 		// Get method name and parameters for a REQUEST
@@ -706,12 +883,15 @@ static osrfMessage* deserialize_one_message( const jsonObject* obj ) {
 
 		tmp0 = jsonObjectGetKeyConst(tmp,"params");
 		if(tmp0) {
-			// Note that we use jsonObjectDecodeClass() instead of
+			// Note that we use jsonObjectDecodeClassShared() instead of
 			// jsonObjectClone().  The classnames are already decoded,
 			// but jsonObjectDecodeClass removes the decoded classnames.
-			msg->_params = jsonObjectDecodeClass( tmp0 );
-			if(msg->_params && msg->_params->type == JSON_NULL)
+			// If there's nothing to decode, we can share the parsed tree.
+			msg->_params = jsonObjectDecodeClassShared( tmp0 );
+			if(msg->_params && msg->_params->type == JSON_NULL) {
+				msg->_params = jsonObjectUnshare( msg->_params );
 				msg->_params->type = JSON_ARRAY;
+			}
 		}
 
 		// Get status fields for a RESULT or STATUS
@@ -735,10 +915,11 @@ static osrfMessage* deserialize_one_message( const jsonObject* obj ) {
 		// Get the content for a RESULT
 		tmp0 = jsonObjectGetKeyConst(tmp,"content");
 		if(tmp0) {
-			// Note that we use jsonObjectDecodeClass() instead of
+			// Note that we use jsonObjectDecodeClassShared() instead of
 			// jsonObjectClone().  The classnames are already decoded,
 			// but jsonObjectDecodeClass removes the decoded classnames.
-			msg->_result_content = jsonObjectDecodeClass( tmp0 );
+			// If there's nothing to decode, we can share the parsed tree.
+			msg->_result_content = jsonObjectDecodeClassShared( tmp0 );
 		}
 
 	}
@@ -16,13 +16,20 @@ GNU General Public License for more details.
 /**
 	@file osrf_parse_json.c
 	@brief  Recursive descent parser for JSON.
+
+	The same machinery also builds a jsonTape: an index of where each token lies, from
+	which jsonObjects can be built later, for just the parts that are needed.
 */
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
 #include <opensrf/osrf_json.h>
+#include <opensrf/osrf_intern.h>
+#include "osrf_simd.h"
 
 /**
 	@brief A collection of things the parser uses to keep track of what it's doing.
@@ -32,6 +39,10 @@ typedef struct {
 	size_t index;             /**< index into input buffer */
 	const char* buff;         /**< client's buffer holding current chunk of input */
 	int decode;               /**< boolean; true if we are decoding class hints */
+	osrfArena* arena;         /**< where to build the jsonObjects; NULL for the heap */
+	char* dest;               /**< writable alias of buff when parsing in situ; else NULL */
+	int legacy;               /**< boolean; true if we accept the old comment-laden dialect */
+	char* hint;               /**< legacy class hint awaiting the next node, or NULL */
 } Parser;
 
 /**
@@ -49,20 +60,106 @@ typedef struct {
 	unsigned char buff[ 4 ];
 } Unibuff;
 
-static jsonObject* parse_it( const char* s, int decode );
+/** @brief Chunk size of the osrfArena holding strings decoded from a jsonTape. */
+#define TAPE_ARENA_CHUNK 4096
+
+/** @brief How many keys of a hash we compare one by one before hashing them instead. */
+#define TAPE_KEY_SCAN 8
+
+/**
+	@brief An entry in a jsonTape, describing one node.
+
+	The entries appear in the same order as the nodes in the text.  Hence the elements of
+	an array follow the array's own entry.  So do the members of a hash, each represented
+	by a JSON_STRING entry for the key, followed by the entry (or entries) for the value.
+*/
+typedef struct {
+	int type;             /**< JSON_* type of the node */
+	unsigned int start;   /**< Offset of the node's first character */
+	unsigned int len;     /**< Length of the node's text */
+	unsigned int next;    /**< Index of the first entry after this node and its descendants */
+	/** Number of elements or members of an array or hash; true if a string has
+		escape sequences, or if a boolean is true. */
+	unsigned int count;
+	unsigned int hint;    /**< For a class-hinted hash, the index of the class name */
+	unsigned int data;    /**< For a class-hinted hash, the index of the data, if any */
+} TapeEntry;
+
+/**
+	@brief Structure of a jsonTape.
+
+	Offsets into the text are unsigned ints, so we won't index a string of 4 GB or more.
+*/
+struct _jsonTapeStruct {
+	const char* text;         /**< The JSON string that we index */
+	TapeEntry* entries;       /**< One entry per node */
+	unsigned int size;        /**< How many entries are in use */
+	unsigned int capacity;    /**< How many entries are allocated */
+	int decode;               /**< Boolean; true if we decode class hints */
+	char** strings;           /**< Decoded strings, by entry; allocated when first needed */
+	osrfArena* arena;         /**< Where the decoded strings live */
+	growing_buffer* str_buf;  /**< Working buffer for decoding escape sequences */
+	int last_array;           /**< The array most recently searched by jsonTapeGetIndex() */
+	unsigned long last_index; /**< The index most recently found there */
+	unsigned int last_elem;   /**< The entry most recently found there */
+};
+
+
+static jsonObject* parse_it( const char* s, int decode, osrfArena* arena, int in_situ,
+		int legacy );
 
 static jsonObject* get_json_node( Parser* parser, char firstc );
 static const char* get_string( Parser* parser );
+static const char* get_string_in_situ( Parser* parser );
 static jsonObject* get_number( Parser* parser, char firstc );
+static jsonObject* get_number_in_situ( Parser* parser );
+static jsonObject* new_borrowed_node( Parser* parser, int type, char* s );
 static jsonObject* get_array( Parser* parser );
 static jsonObject* get_hash( Parser* parser );
 static jsonObject* get_decoded_hash( Parser* parser );
 static jsonObject* get_null( Parser* parser );
 static jsonObject* get_true( Parser* parser );
 static jsonObject* get_false( Parser* parser );
+static jsonObject* get_legacy_keyword( Parser* parser, char firstc );
 static int get_utf8( Parser* parser, Unibuff* unibuff );
 
+static char* copy_key( Parser* parser, const char* key );
+static void free_key( Parser* parser, char* key );
+
+static jsonTape* tape_it( const char* s, int decode );
+static unsigned int tape_push( jsonTape* tape, int type, size_t start );
+static int tape_node( Parser* parser, jsonTape* tape, char firstc );
+static int tape_string( Parser* parser, unsigned int* escaped );
+static int tape_number( Parser* parser, size_t start );
+static int tape_keyword( Parser* parser, const char* rest );
+static int tape_array( Parser* parser, jsonTape* tape, unsigned int i );
+static int tape_hash( Parser* parser, jsonTape* tape, unsigned int i );
+static int tape_key_is( const jsonTape* tape, unsigned int k, const char* key );
+static const char* tape_key_text( Parser* parser, const jsonTape* tape, unsigned int k,
+		size_t* len );
+static int tape_duplicate_key( Parser* parser, const jsonTape* tape, unsigned int i,
+		unsigned int k, osrfHash** seen );
+static inline int tape_valid( const jsonTape* tape, int node );
+static int tape_resolve( const jsonTape* tape, int node );
+
+/**
+	@brief A function that scans forward from a given position, returning where it stopped.
+*/
+typedef const char* (*Scanner)( const char* p );
+
+static const char* scan_string_select( const char* p );
+static const char* scan_space_select( const char* p );
+static void select_scanners( void );
+
+/** @brief Find the next quotation mark, backslash, or control character. */
+static Scanner scan_string = scan_string_select;
+/** @brief Find the next character that isn't white space. */
+static Scanner scan_space = scan_space_select;
+
+static inline growing_buffer* reset_str_buf( Parser* parser );
 static char skip_white_space( Parser* parser );
+static char skip_comments( Parser* parser, const char* p );
+static void set_hint( Parser* parser, const char* start, const char* end );
 static inline void parser_ungetc( Parser* parser );
 static inline char parser_nextc( Parser* parser );
 static void report_error( Parser* parser, char badchar, const char* err );
@@ -83,7 +180,7 @@ static void report_error( Parser* parser, char badchar, const char* err );
 	The calling code is responsible for freeing the resulting jsonObject.
 */
 jsonObject* jsonParse( const char* str ) {
-	return parse_it( str, 1 );
+	return parse_it( str, 1, NULL, 0, 0 );
 }
 
 /**
@@ -97,7 +194,7 @@ jsonObject* jsonParse( const char* str ) {
 	The calling code is responsible for freeing the resulting jsonObject.
 */
 jsonObject* jsonParseRaw( const char* s ) {
-	return parse_it( s, 0 );
+	return parse_it( s, 0, NULL, 0, 0 );
 }
 
 /**
@@ -115,19 +212,406 @@ jsonObject* jsonParseFmt( const char* str, ... ) {
 	if( !str )
 		return NULL;
 	VA_LIST_TO_STRING( str );
-	return parse_it( VA_BUF, 0 );
+	return parse_it( VA_BUF, 0, NULL, 0, 0 );
+}
+
+/**
+	@brief Parse a JSON string into an osrfArena, with decoding of classname hints.
+	@param arena Pointer to the osrfArena in which to build the jsonObject tree.
+	@param str Pointer to the JSON string to parse.
+	@return A pointer to the resulting JSON object, or NULL on error.
+
+	This function is like jsonParse(), except that every node of the resulting tree, and
+	everything in it, is allocated from @a arena.  The tree is valid until the arena is
+	reset or freed.  Treat it as read-only; clone any part of it that you need to keep.
+
+	If @a arena is NULL, this function behaves exactly like jsonParse().
+*/
+jsonObject* jsonParseInArena( osrfArena* arena, const char* str ) {
+	return parse_it( str, 1, arena, 0, 0 );
+}
+
+/**
+	@brief Parse a JSON string into an osrfArena, with no decoding of classname hints.
+	@param arena Pointer to the osrfArena in which to build the jsonObject tree.
+	@param str Pointer to the JSON string to parse.
+	@return A pointer to the resulting JSON object, or NULL on error.
+
+	This function is like jsonParseInArena(), except that it does not give any special
+	treatment to a JSON_HASH with the JSON_CLASS_KEY tag.
+*/
+jsonObject* jsonParseRawInArena( osrfArena* arena, const char* str ) {
+	return parse_it( str, 0, arena, 0, 0 );
+}
+
+/**
+	@brief Parse a JSON string in place, with decoding of classname hints.
+	@param arena Pointer to an osrfArena in which to build the jsonObject tree, or NULL.
+	@param str Pointer to a writable buffer holding the JSON string to parse.
+	@return A pointer to the resulting JSON object, or NULL on error.
+
+	This function is like jsonParseInArena(), except that it avoids copying strings and
+	numbers.  Instead it rewrites the input buffer, terminating each string (and decoding
+	any escape sequences) in place, and the resulting jsonObjects point into the buffer.
+	Only the occasional number that needs to be scrubbed is copied.
+
+	Hence the calling code must keep the buffer alive, and leave it alone, for as long as
+	it uses the resulting jsonObject tree.  After the call, the buffer no longer contains
+	valid JSON.  Whether or not the parse succeeds, the buffer contents are unspecified.
+
+	If @a arena is NULL, the jsonObjects live on the heap, and the calling code must free
+	the tree with jsonObjectFree() as usual.  Any of its nodes may be safely modified; a
+	modified node no longer refers to the buffer.
+*/
+jsonObject* jsonParseInSitu( osrfArena* arena, char* str ) {
+	return parse_it( str, 1, arena, 1, 0 );
+}
+
+/**
+	@brief Parse a JSON string in place, with no decoding of classname hints.
+	@param arena Pointer to an osrfArena in which to build the jsonObject tree, or NULL.
+	@param str Pointer to a writable buffer holding the JSON string to parse.
+	@return A pointer to the resulting JSON object, or NULL on error.
+
+	This function is like jsonParseInSitu(), except that it does not give any special
+	treatment to a JSON_HASH with the JSON_CLASS_KEY tag.
+*/
+jsonObject* jsonParseRawInSitu( osrfArena* arena, char* str ) {
+	return parse_it( str, 0, arena, 1, 0 );
+}
+
+/**
+	@brief Parse a JSON string written in the old dialect, with its comment-borne class hints.
+	@param str Pointer to the JSON string to parse.
+	@return A pointer to the resulting JSON object, or NULL on error.
+
+	Long ago OpenSRF marked the class of an object with comments, as in
+	<tt>/&lowast;--S aou--&lowast;/{...}/&lowast;--E aou--&lowast;/</tt>, rather than by
+	wrapping it in a JSON_HASH.  This function accepts that dialect, and the other
+	liberties that the old parser took, so that it can stand in for legacy_jsonParseString():
+
+	- Comments, in either the C or the C++ style, may appear wherever white space may.
+	- A comment of the form <tt>/&lowast;--S classname--&lowast;/</tt> before a node gives the
+	node that class name.  Other comments, including the closing <tt>--E</tt> ones, are ignored.
+	- The keywords null, true, and false are not case-sensitive.
+	- An empty slot in an array, or a missing value in a hash, is a JSON_NULL; thus
+	<tt>[1,,2]</tt> has three elements.
+	- If a hash repeats a key, the last value wins.
+	- Anything after the first complete node is ignored.
+
+	Numbers are the exception: they get the same treatment as from jsonParse().  Where the
+	old parser kept a number such as <tt>01</tt> verbatim, we tidy it up with
+	jsonScrubNumber(), so that it becomes 1.  And where the old parser rejected an exponent,
+	as in <tt>1.5e3</tt>, we accept it.
+
+	Hashes tagged with JSON_CLASS_KEY are not decoded, any more than by jsonParseRaw().
+
+	The calling code is responsible for freeing the resulting jsonObject.
+*/
+jsonObject* jsonParseLegacy( const char* str ) {
+	return parse_it( str, 0, NULL, 0, 1 );
+}
+
+/**
+	@brief Index a JSON string without parsing it into jsonObjects, with decoding of class hints.
+	@param str Pointer to the JSON string to index.
+	@return Pointer to the resulting jsonTape, or NULL on error.
+
+	A single pass over the string checks its syntax and records where each node begins and
+	ends.  Nothing else happens until someone asks for it: strings are decoded only when
+	requested through jsonTapeGetString(), and jsonObjects are built only for the subtrees
+	passed to jsonTapeToObject().  Anything else can be passed along untouched, using the
+	original text returned by jsonTapeText().
+
+	The accessors treat class hints the way jsonParse() does: a hash with a JSON_CLASS_KEY
+	member stands for the value of its JSON_DATA_KEY member (or for a JSON_NULL, if there
+	isn't one), and jsonTapeGetClass() reports the class name.
+
+	The jsonTape refers to the original string, so the string must outlive it.
+
+	The check is not quite as thorough as jsonParse(): it doesn't notice duplicate keys in
+	a hash.  jsonTapeGetKey() finds the first one.
+
+	The calling code is responsible for freeing the jsonTape by calling jsonTapeFree().
+*/
+jsonTape* jsonTapeParse( const char* str ) {
+	return tape_it( str, 1 );
+}
+
+/**
+	@brief Index a JSON string without parsing it into jsonObjects or decoding class hints.
+	@param str Pointer to the JSON string to index.
+	@return Pointer to the resulting jsonTape, or NULL on error.
+
+	This function is like jsonTapeParse(), except that it does not give any special
+	treatment to a JSON_HASH with the JSON_CLASS_KEY tag.
+*/
+jsonTape* jsonTapeParseRaw( const char* str ) {
+	return tape_it( str, 0 );
+}
+
+/**
+	@brief Free a jsonTape, along with any strings decoded from it.
+	@param tape Pointer to the jsonTape to be freed.
+
+	The original JSON string is not affected.
+*/
+void jsonTapeFree( jsonTape* tape ) {
+	if( !tape )
+		return;
+	free( tape->entries );
+	free( tape->strings );
+	osrfArenaFree( tape->arena );
+	buffer_free( tape->str_buf );
+	free( tape );
+}
+
+/**
+	@brief Get the type of a node in a jsonTape.
+	@param tape Pointer to the jsonTape.
+	@param node The node.
+	@return One of the JSON_* type codes, or -1 if there is no such node.
+*/
+int jsonTapeType( const jsonTape* tape, int node ) {
+	if( !tape_valid( tape, node ) )
+		return -1;
+	node = tape_resolve( tape, node );
+	return node < 0 ? JSON_NULL : tape->entries[ node ].type;
+}
+
+/**
+	@brief Get the number of elements in an array, or of members in a hash, in a jsonTape.
+	@param tape Pointer to the jsonTape.
+	@param node The node.
+	@return The number of elements or members, or zero if the node is not an array or hash.
+*/
+unsigned long jsonTapeSize( const jsonTape* tape, int node ) {
+	if( !tape_valid( tape, node ) )
+		return 0;
+	node = tape_resolve( tape, node );
+	if( node < 0 )
+		return 0;
+
+	const TapeEntry* entry = tape->entries + node;
+	if( JSON_ARRAY == entry->type || JSON_HASH == entry->type )
+		return entry->count;
+	else
+		return 0;
+}
+
+/**
+	@brief Find an element of an array in a jsonTape.
+	@param tape Pointer to the jsonTape.
+	@param node The array node.
+	@param index The position of the element within the array, counting from zero.
+	@return The element node, or -1 if the array has no such element, or if @a node is not
+		an array.
+
+	We have to step over the preceding elements to find the one we want.  However we
+	remember where we stopped, so visiting the elements of an array in order costs the
+	same as visiting each once.
+*/
+int jsonTapeGetIndex( const jsonTape* tape, int node, unsigned long index ) {
+	if( !tape_valid( tape, node ) )
+		return -1;
+	node = tape_resolve( tape, node );
+	if( node < 0 || tape->entries[ node ].type != JSON_ARRAY
+			|| index >= tape->entries[ node ].count )
+		return -1;
+
+	// The cache is not part of the logical state of the tape.
+	jsonTape* t = (jsonTape*) tape;
+
+	unsigned long i = 0;
+	unsigned int elem = node + 1;
+	if( t->last_array == node && t->last_index <= index ) {
+		i = t->last_index;
+		elem = t->last_elem;
+	}
+
+	for( ; i < index; ++i )
+		elem = t->entries[ elem ].next;
+
+	t->last_array = node;
+	t->last_index = index;
+	t->last_elem  = elem;
+	return elem;
+}
+
+/**
+	@brief Find the value of a hash member in a jsonTape.
+	@param tape Pointer to the jsonTape.
+	@param node The hash node.
+	@param key The key of the member.
+	@return The value node, or -1 if the hash has no such member, or if @a node is not a hash.
+
+	This is a linear search, which suits the small hashes we usually look into this way.
+*/
+int jsonTapeGetKey( jsonTape* tape, int node, const char* key ) {
+	if( !key || !tape_valid( tape, node ) )
+		return -1;
+	node = tape_resolve( tape, node );
+	if( node < 0 || tape->entries[ node ].type != JSON_HASH )
+		return -1;
+
+	size_t key_len = strlen( key );
+	unsigned int count = tape->entries[ node ].count;
+	unsigned int k = node + 1;
+	unsigned int i;
+	for( i = 0; i < count; ++i ) {
+		const TapeEntry* entry = tape->entries + k;
+		if( entry->count ) {
+			// The key has escape sequences; compare the decoded version.
+			const char* decoded = jsonTapeGetString( tape, k );
+			if( decoded && !strcmp( decoded, key ) )
+				return k + 1;
+		} else if( entry->len - 2 == key_len
+				&& !memcmp( tape->text + entry->start + 1, key, key_len ) )
+			return k + 1;
+
+		k = tape->entries[ k + 1 ].next;
+	}
+
+	return -1;
+}
+
+/**
+	@brief Get the value of a string or number in a jsonTape.
+	@param tape Pointer to the jsonTape.
+	@param node The node.
+	@return Pointer to the string, with escape sequences decoded, or to the numeric string;
+		or NULL if the node is neither a string nor a number.
+
+	The string is decoded the first time it is requested.  It belongs to the jsonTape, and
+	remains valid until the jsonTape is freed.
+*/
+const char* jsonTapeGetString( jsonTape* tape, int node ) {
+	if( !tape_valid( tape, node ) )
+		return NULL;
+	node = tape_resolve( tape, node );
+	if( node < 0 )
+		return NULL;
+
+	const TapeEntry* entry = tape->entries + node;
+	if( entry->type != JSON_STRING && entry->type != JSON_NUMBER )
+		return NULL;
+
+	if( !tape->strings ) {
+		tape->strings = safe_calloc( tape->size * sizeof( char* ) );
+		tape->arena = osrfNewArena( TAPE_ARENA_CHUNK );
+	} else if( tape->strings[ node ] )
+		return tape->strings[ node ];
+
+	const char* text = tape->text + entry->start;
+	char* str;
+	if( JSON_NUMBER == entry->type ) {
+		str = osrfArenaStrndup( tape->arena, text, entry->len );
+		if( ! jsonIsNumeric( str ) ) {
+			char* scrubbed = jsonScrubNumber( str );
+			str = osrfArenaStrdup( tape->arena, scrubbed ? scrubbed : "0" );
+			free( scrubbed );
+		}
+	} else if( !entry->count ) {
+		str = osrfArenaStrndup( tape->arena, text + 1, entry->len - 2 );
+	} else {
+		// Let get_string() decode the escape sequences.  We already know they're valid.
+		Parser parser;
+		parser.str_buf = tape->str_buf;
+		parser.index = entry->start + 1;
+		parser.buff = tape->text;
+		parser.decode = 0;
+		parser.arena = NULL;
+		parser.dest = NULL;
+		parser.legacy = 0;
+		parser.hint = NULL;
+		str = osrfArenaStrdup( tape->arena, get_string( &parser ) );
+		tape->str_buf = parser.str_buf;
+	}
+
+	tape->strings[ node ] = str;
+	return str;
+}
+
+/**
+	@brief Get the class name of a node in a jsonTape.
+	@param tape Pointer to the jsonTape.
+	@param node The node.
+	@return Pointer to the class name, or NULL if the node doesn't have one.
+
+	Only a jsonTape from jsonTapeParse() knows about class names.  The string belongs to
+	the jsonTape, and remains valid until the jsonTape is freed.
+*/
+const char* jsonTapeGetClass( jsonTape* tape, int node ) {
+	if( !tape_valid( tape, node ) || !tape->entries[ node ].hint )
+		return NULL;
+	return jsonTapeGetString( tape, tape->entries[ node ].hint );
+}
+
+/**
+	@brief Get the original text of a node in a jsonTape.
+	@param tape Pointer to the jsonTape.
+	@param node The node.
+	@param len Pointer through which to return the length of the text.
+	@return Pointer to the text within the original JSON string, or NULL if there is no
+		such node.
+
+	The text is @em not nul-terminated; use the length.  For a node with a class hint, the
+	text includes the class hint.
+*/
+const char* jsonTapeText( const jsonTape* tape, int node, size_t* len ) {
+	if( !tape_valid( tape, node ) )
+		return NULL;
+	if( len )
+		*len = tape->entries[ node ].len;
+	return tape->text + tape->entries[ node ].start;
+}
+
+/**
+	@brief Build a jsonObject for a node of a jsonTape.
+	@param tape Pointer to the jsonTape.
+	@param node The node.
+	@return Pointer to a newly created jsonObject, or NULL if there is no such node.
+
+	The result is the same as if you had passed the node's text to jsonParse(), or to
+	jsonParseRaw() for a jsonTape from jsonTapeParseRaw().  In particular a node with a
+	class hint comes back with its class name.
+
+	The calling code is responsible for freeing the jsonObject by calling jsonObjectFree().
+*/
+jsonObject* jsonTapeToObject( const jsonTape* tape, int node ) {
+	if( !tape_valid( tape, node ) )
+		return NULL;
+
+	Parser parser;
+	size_t start = tape->entries[ node ].start;
+	parser.str_buf = NULL;
+	parser.index = start + 1;
+	parser.buff = tape->text;
+	parser.decode = tape->decode;
+	parser.arena = NULL;
+	parser.dest = NULL;
+	parser.legacy = 0;
+	parser.hint = NULL;
+
+	jsonObject* obj = get_json_node( &parser, tape->text[ start ] );
+	buffer_free( parser.str_buf );
+	return obj;
 }
 
 /**
 	@brief Parse a JSON string into a jsonObject.
 	@param s Pointer to the string to be parsed.
 	@param decode A boolean; true means decode class hints, false means don't.
+	@param arena Pointer to an osrfArena in which to build the jsonObject, or NULL for the heap.
+	@param in_situ A boolean; true means that @a s is writable, and we may parse it in place.
+	@param legacy A boolean; true means accept the old dialect described at jsonParseLegacy().
 	@return Pointer to the newly created jsonObject.
 
-	Set up a Parser.  Call get_json_node() to do the real work, then make sure that there's
-	nothing but white space at the end.
+	Set up a Parser.  Call get_json_node() to do the real work, then (except in the legacy
+	dialect) make sure that there's nothing but white space at the end.
 */
-static jsonObject* parse_it( const char* s, int decode ) {
+static jsonObject* parse_it( const char* s, int decode, osrfArena* arena, int in_situ,
+		int legacy ) {
 
 	if( !s || !*s )
 		return NULL;    // Nothing to parse
@@ -138,17 +622,22 @@ static jsonObject* parse_it( const char* s, int decode ) {
 	parser.index = 0;
 	parser.buff = s;
 	parser.decode = decode;
+	parser.arena = arena;
+	parser.dest = in_situ ? (char*) s : NULL;
+	parser.legacy = legacy;
+	parser.hint = NULL;
 
 	jsonObject* obj = get_json_node( &parser, skip_white_space( &parser ) );
 
 	// Make sure there's nothing but white space at the end
 	char c;
-	if( obj && (c = skip_white_space( &parser )) ) {
+	if( obj && !legacy && (c = skip_white_space( &parser )) ) {
 		report_error( &parser, c, "Extra material follows JSON string" );
 		jsonObjectFree( obj );
 		obj = NULL;
 	}
 
+	free( parser.hint );
 	buffer_free( parser.str_buf );
 	return obj;
 }
@@ -164,18 +653,31 @@ static jsonObject* parse_it( const char* s, int decode ) {
 
 	In the case of an array or a hash, this function indirectly calls itself in order to
 	parse subordinate nodes.
+
+	In the legacy dialect, apply any class hint that skip_white_space() found in front of
+	the node.
 */
 static jsonObject* get_json_node( Parser* parser, char firstc ) {
 
 	jsonObject* obj = NULL;
+	char* hint = NULL;
+
+	// Claim the hint before parsing, so that subordinate nodes don't see it
+	if( parser->legacy ) {
+		hint = parser->hint;
+		parser->hint = NULL;
+	}
 
 	// Branch on the first character
-	if( '"' == firstc ) {
+	if( parser->legacy && firstc && strchr( "nNtTfF", firstc ) ) {
+		obj = get_legacy_keyword( parser, tolower( (unsigned char) firstc ) );
+	} else if( '"' == firstc ) {
 		const char* str = get_string( parser );
 		if( str ) {
-			obj = jsonNewObject( NULL );
-			obj->type = JSON_STRING;
-			obj->value.s = strdup( str );
+			if( parser->dest )
+				obj = new_borrowed_node( parser, JSON_STRING, (char*) str );
+			else
+				obj = jsonNewObjectInArena( parser->arena, str );
 		}
 	} else if( '[' == firstc ) {
 		obj = get_array( parser );
@@ -202,6 +704,12 @@ static jsonObject* get_json_node( Parser* parser, char firstc ) {
 		report_error( parser, firstc, "Unexpected character" );
 	}
 
+	if( hint ) {
+		if( obj )
+			jsonObjectSetClass( obj, hint );
+		free( hint );
+	}
+
 	return obj;
 }
 
@@ -215,18 +723,27 @@ static jsonObject* get_json_node( Parser* parser, char firstc ) {
 
 	Return the string we have built, without the enclosing quotation marks, in
 	parser->str_buf.  In case of error, log an error message.
+
+	When parsing in situ, let get_string_in_situ() do the work instead.
 */
 static const char* get_string( Parser* parser ) {
 
-	if( parser->str_buf )
-		buffer_reset( parser->str_buf );
-	else
-		parser->str_buf = buffer_init( 64 );
+	if( parser->dest )
+		return get_string_in_situ( parser );
 
-	growing_buffer* gb = parser->str_buf;
+	growing_buffer* gb = reset_str_buf( parser );
 
 	// Collect the characters.
 	for( ;; ) {
+
+		// Copy any run of ordinary characters in one go
+		const char* run = parser->buff + parser->index;
+		size_t run_len = scan_string( run ) - run;
+		if( run_len ) {
+			buffer_add_n( gb, run, run_len );
+			parser->index += run_len;
+		}
+
 		char c = parser_nextc( parser );
 		if( '"' == c )
 			break;
@@ -267,6 +784,101 @@ static const char* get_string( Parser* parser ) {
 	return OSRF_BUFFER_C_STR( gb );
 }
 
+/**
+	@brief Collect characters into a character string, in place.
+	@param parser Pointer to a Parser.
+	@return Pointer to the string within the input buffer if successful, or NULL upon error.
+
+	This function is the in situ counterpart of get_string().  Instead of copying the
+	characters into a growing_buffer, leave them where they are, and overwrite the closing
+	quotation mark with a terminal nul.
+
+	If we encounter an escape sequence, decode it in place.  From then on, each character
+	must be shifted down to close up the gap, since the decoded form of an escape sequence
+	is always shorter than the escape sequence itself.  Hence we never overwrite anything
+	that we haven't read yet.
+*/
+static const char* get_string_in_situ( Parser* parser ) {
+
+	char* start = parser->dest + parser->index;
+	char* out = start;
+	int shifting = 0;    // boolean; true once we have decoded an escape sequence
+
+	for( ;; ) {
+
+		// Skip over (or shift down) any run of ordinary characters in one go
+		const char* run = parser->buff + parser->index;
+		size_t run_len = scan_string( run ) - run;
+		if( run_len ) {
+			if( shifting )
+				memmove( out, run, run_len );
+			out += run_len;
+			parser->index += run_len;
+		}
+
+		char c = parser_nextc( parser );
+		if( '"' == c )
+			break;
+		else if( !c ) {
+			report_error( parser, parser->buff[ parser->index - 1  ],
+						  "Quoted string not terminated" );
+			return NULL;
+		} else if( '\\' == c ) {
+			shifting = 1;
+			c = parser_nextc( parser );
+			switch( c ) {
+				case '"'  : *out++ = '"';  break;
+				case '\\' : *out++ = '\\'; break;
+				case '/'  : *out++ = '/';  break;
+				case 'b'  : *out++ = '\b'; break;
+				case 'f'  : *out++ = '\f'; break;
+				case 'n'  : *out++ = '\n'; break;
+				case 'r'  : *out++ = '\r'; break;
+				case 't'  : *out++ = '\t'; break;
+				case 'u'  : {
+					Unibuff unibuff;
+					if( get_utf8( parser, &unibuff ) ) {
+						return NULL;       // bad UTF-8
+					} else if( unibuff.buff[0] ) {
+						const unsigned char* u = unibuff.buff;
+						while( *u )
+							*out++ = *u++;
+					} else {
+						report_error( parser, 'u', "Unicode sequence encodes a nul byte" );
+						return NULL;
+					}
+					break;
+				}
+				case '\0' :
+					report_error( parser, '\\', "Quoted string not terminated" );
+					return NULL;
+				default   : *out++ = c;    break;
+			}
+		} else if( shifting )
+			*out++ = c;
+		else
+			++out;
+	}
+
+	*out = '\0';
+	return start;
+}
+
+/**
+	@brief Create a JSON_STRING or JSON_NUMBER that borrows its string from the input buffer.
+	@param parser Pointer to a Parser.
+	@param type Either JSON_STRING or JSON_NUMBER.
+	@param s Pointer to the string, residing within the input buffer.
+	@return Pointer to the newly created jsonObject.
+*/
+static jsonObject* new_borrowed_node( Parser* parser, int type, char* s ) {
+	jsonObject* obj = jsonNewObjectInArena( parser->arena, NULL );
+	obj->type = type;
+	obj->value.s = s;
+	obj->flags |= JSON_NODE_BORROWED_STRING;
+	return obj;
+}
+
 /**
 	@brief Collect characters into a number, and create a JSON_NUMBER for it.
 	@param parser Pointer to a parser.
@@ -280,15 +892,15 @@ static const char* get_string( Parser* parser ) {
 
 	If successful, construct a jsonObject of type JSON_NUMBER containing the resulting
 	numeric string.  Otherwise log an error message and return NULL.
+
+	When parsing in situ, let get_number_in_situ() do the work instead.
 */
 static jsonObject* get_number( Parser* parser, char firstc ) {
 
-	if( parser->str_buf )
-		buffer_reset( parser->str_buf );
-	else
-		parser->str_buf = buffer_init( 64 );
+	if( parser->dest )
+		return get_number_in_situ( parser );
 
-	growing_buffer* gb = parser->str_buf;
+	growing_buffer* gb = reset_str_buf( parser );
 	OSRF_BUFFER_ADD_CHAR( gb, firstc );
 
 	char c;
@@ -309,22 +921,107 @@ static jsonObject* get_number( Parser* parser, char firstc ) {
 		}
 	}
 
-	char* s = buffer_data( gb );
+	const char* s = OSRF_BUFFER_C_STR( gb );
+	char* scrubbed = NULL;
 	if( ! jsonIsNumeric( s ) ) {
-		char* temp = jsonScrubNumber( s );
-		free( s );
-		s = temp;
-		if( !s ) {
+		scrubbed = jsonScrubNumber( s );
+		if( !scrubbed ) {
 			report_error( parser, parser->buff[ parser->index - 1 ],
 					"Invalid numeric format" );
 			return NULL;
 		}
+		s = scrubbed;
 	}
 
-	jsonObject* obj = jsonNewObject( NULL );
+	jsonObject* obj = jsonNewObjectInArena( parser->arena, NULL );
 	obj->type = JSON_NUMBER;
-	obj->value.s = s;
+	if( parser->arena ) {
+		obj->value.s = osrfArenaStrdup( parser->arena, s );
+		free( scrubbed );
+	} else
+		obj->value.s = scrubbed ? scrubbed : strdup( s );
+
+	jsonObjectCacheNumber( obj );
+	return obj;
+}
+
+/**
+	@brief Collect a number in place, and create a JSON_NUMBER for it.
+	@param parser Pointer to a parser.
+	@return Pointer to a newly created jsonObject of type JSON_NUMBER, or NULL upon error.
+
+	This function is the in situ counterpart of get_number().  The first character of the
+	number has already been consumed.
+
+	Unlike a string, a number has no closing delimiter of its own that we could overwrite
+	with a terminal nul; the next character is something we still need to read.  However
+	the character @em before the number (a bracket, comma, colon or white space) has
+	already served its purpose.  So we slide the number down by one byte, and put the nul
+	where the last digit used to be.
+
+	A number at the very beginning of the input has no such character in front of it, and
+	a number that needs scrubbing must be rewritten anyway.  In those cases, we make a copy.
+*/
+static jsonObject* get_number_in_situ( Parser* parser ) {
+
+	size_t start = parser->index - 1;    // where the first character was
+
+	char c;
+	do {
+		c = parser_nextc( parser );
+	} while( isdigit( (unsigned char) c ) ||
+			 '.' == c ||
+			 '-' == c ||
+			 '+' == c ||
+			 'e' == c ||
+			 'E' == c );
+	parser_ungetc( parser );
+
+	size_t len = parser->index - start;
+	char* s;
+	int borrowed;
+
+	if( start > 0 ) {
+		s = parser->dest + start - 1;
+		memmove( s, s + 1, len );
+		s[ len ] = '\0';
+		borrowed = 1;
+	} else {
+		if( parser->arena )
+			s = osrfArenaStrndup( parser->arena, parser->buff, len );
+		else
+			s = strndup( parser->buff, len );
+		borrowed = 0;
+	}
+
+	if( ! jsonIsNumeric( s ) ) {
+		char* scrubbed = jsonScrubNumber( s );
+		if( !borrowed && !parser->arena )
+			free( s );
+		if( !scrubbed ) {
+			report_error( parser, parser->buff[ parser->index - 1 ],
+					"Invalid numeric format" );
+			return NULL;
+		}
+
+		if( parser->arena ) {
+			s = osrfArenaStrdup( parser->arena, scrubbed );
+			free( scrubbed );
+		} else
+			s = scrubbed;
+		borrowed = 0;
+	}
 
+	jsonObject* obj;
+	if( borrowed )
+		obj = new_borrowed_node( parser, JSON_NUMBER, s );
+	else {
+		obj = jsonNewObjectInArena( parser->arena, NULL );
+		obj->type = JSON_NUMBER;
+		obj->value.s = s;
+	}
+
+	jsonObjectCacheNumber( obj );
 	return obj;
 }
 
@@ -341,24 +1038,31 @@ static jsonObject* get_number( Parser* parser, char firstc ) {
 */
 static jsonObject* get_array( Parser* parser ) {
 
-	jsonObject* array = jsonNewObjectType( JSON_ARRAY );
+	jsonObject* array = jsonNewObjectTypeInArena( parser->arena, JSON_ARRAY );
 
 	char c = skip_white_space( parser );
 	if( ']' == c )
 		return array;          // Empty array
 
 	for( ;; ) {
-		jsonObject* obj = get_json_node( parser, c );
-		if( !obj ) {
-			jsonObjectFree( array );
-			return NULL;         // Failed to get anything
+		jsonObject* obj;
+		if( parser->legacy && ( ',' == c || ']' == c ) ) {
+			// The legacy dialect treats an empty slot as a null
+			obj = jsonNewObjectInArena( parser->arena, NULL );
+		} else {
+			obj = get_json_node( parser, c );
+			if( !obj ) {
+				jsonObjectFree( array );
+				return NULL;         // Failed to get anything
+			}
+
+			// Look past the entry for a comma or right bracket
+			c = skip_white_space( parser );
 		}
 
 		// Add the entry to the array
 		jsonObjectPush( array, obj );
 
-		// Look for a comma or right bracket
-		c = skip_white_space( parser );
 		if( ']' == c )
 			break;
 		else if( c != ',' ) {
@@ -387,7 +1091,7 @@ static jsonObject* get_array( Parser* parser ) {
 	Upon error, log an error message and return NULL.
 */
 static jsonObject* get_hash( Parser* parser ) {
-	jsonObject* hash = jsonNewObjectType( JSON_HASH );
+	jsonObject* hash = jsonNewObjectTypeInArena( parser->arena, JSON_HASH );
 
 	char c = skip_white_space( parser );
 	if( '}' == c )
@@ -408,10 +1112,11 @@ static jsonObject* get_hash( Parser* parser ) {
 			jsonObjectFree( hash );
 			return NULL;
 		}
-		char* key_copy = strdup( key );
+		char* key_copy = copy_key( parser, key );
 
-		if( jsonObjectGetKeyConst( hash, key_copy ) ) {
+		if( !parser->legacy && jsonObjectGetKeyConst( hash, key_copy ) ) {
 			report_error( parser, '"', "Duplicate key in JSON object" );
+			free_key( parser, key_copy );
 			jsonObjectFree( hash );
 			return NULL;
 		}
@@ -421,25 +1126,33 @@ static jsonObject* get_hash( Parser* parser ) {
 		if( c != ':' ) {
 			report_error( parser, c,
 						  "Expected colon after hash key; didn't find it\n" );
-			free( key_copy );
+			free_key( parser, key_copy );
 			jsonObjectFree( hash );
 			return NULL;
 		}
 
 		// Get the associated value
-		jsonObject* obj = get_json_node( parser, skip_white_space( parser ) );
-		if( !obj ) {
-			free( key_copy );
-			jsonObjectFree( hash );
-			return NULL;
+		jsonObject* obj;
+		c = skip_white_space( parser );
+		if( parser->legacy && ( ',' == c || '}' == c ) ) {
+			// The legacy dialect treats a missing value as a null
+			obj = jsonNewObjectInArena( parser->arena, NULL );
+		} else {
+			obj = get_json_node( parser, c );
+			if( !obj ) {
+				free_key( parser, key_copy );
+				jsonObjectFree( hash );
+				return NULL;
+			}
+
+			// Look past the value for a comma or right brace
+			c = skip_white_space( parser );
 		}
 
 		// Add a new entry to the hash
 		jsonObjectSetKey( hash, key_copy, obj );
-		free( key_copy );
+		free_key( parser, key_copy );
 
-		// Look for comma or right brace
-		c = skip_white_space( parser );
 		if( '}' == c )
 			break;
 		else if( c != ',' ) {
@@ -470,13 +1183,14 @@ static jsonObject* get_hash( Parser* parser ) {
 	decoded as described above).
 */
 static jsonObject* get_decoded_hash( Parser* parser ) {
-	jsonObject* hash = jsonNewObjectType( JSON_HASH );
+	jsonObject* hash = jsonNewObjectTypeInArena( parser->arena, JSON_HASH );
 
 	char c = skip_white_space( parser );
 	if( '}' == c )
 		return hash;           // Empty hash
 
 	char* class_name = NULL;
+	int class_borrowed = 0;    // boolean; true if class_name points into the input buffer
 
 	for( ;; ) {
 
@@ -493,10 +1207,11 @@ static jsonObject* get_decoded_hash( Parser* parser ) {
 			jsonObjectFree( hash );
 			return NULL;
 		}
-		char* key_copy = strdup( key );
+		char* key_copy = copy_key( parser, key );
 
 		if( jsonObjectGetKeyConst( hash, key_copy ) ) {
 			report_error( parser, '"', "Duplicate key in JSON object" );
+			free_key( parser, key_copy );
 			jsonObjectFree( hash );
 			return NULL;
 		}
@@ -506,7 +1221,7 @@ static jsonObject* get_decoded_hash( Parser* parser ) {
 		if( c != ':' ) {
 			report_error( parser, c,
 					"Expected colon after hash key; didn't find it\n" );
-			free( key_copy );
+			free_key( parser, key_copy );
 			jsonObjectFree( hash );
 			return NULL;
 		}
@@ -514,7 +1229,7 @@ static jsonObject* get_decoded_hash( Parser* parser ) {
 		// Get the associated value
 		jsonObject* obj = get_json_node( parser, skip_white_space( parser ) );
 		if( !obj ) {
-			free( key_copy );
+			free_key( parser, key_copy );
 			jsonObjectFree( hash );
 			return NULL;
 		}
@@ -523,10 +1238,28 @@ static jsonObject* get_decoded_hash( Parser* parser ) {
 		jsonObjectSetKey( hash, key_copy, obj );
 
 		// Save info for class hint, if present
-		if( !strcmp( key_copy, JSON_CLASS_KEY ) )
-			class_name = jsonObjectToSimpleString( obj );
+		if( !strcmp( key_copy, JSON_CLASS_KEY ) ) {
+			if( obj->flags & JSON_NODE_BORROWED_STRING ) {
+				class_name = obj->value.s;
+				class_borrowed = 1;
+			} else if( ( class_name = jsonObjectToSimpleString( obj ) ) ) {
+				// Use the interned copy if there is one; otherwise keep our own copy,
+				// in the arena if we're using one.  The class name came from whoever
+				// sent the JSON, so don't add it to the intern table.
+				char* temp = class_name;
+				if( ( class_name = (char*) osrfInternLookup( temp ) ) )
+					;
+				else if( parser->arena )
+					class_name = osrfArenaStrdup( parser->arena, temp );
+				else {
+					class_name = temp;
+					temp = NULL;
+				}
+				free( temp );
+			}
+		}
 
-		free( key_copy );
+		free_key( parser, key_copy );
 
 		// Look for comma or right brace
 		c = skip_white_space( parser );
@@ -550,28 +1283,65 @@ static jsonObject* get_decoded_hash( Parser* parser ) {
 			hash = class_data;
 			hash->parent = NULL;
 			hash->classname = class_name;
+			if( class_borrowed )
+				hash->flags |= JSON_NODE_BORROWED_CLASS;
 		} else {
 			// Huh?  We have a class name but no data for it.
 			// Throw away what we have and return a JSON_NULL.
+			if( !class_borrowed && !parser->arena )
+				osrfInternFree( class_name );
 			jsonObjectFree( hash );
-			hash = jsonNewObjectType( JSON_NULL );
+			hash = jsonNewObjectTypeInArena( parser->arena, JSON_NULL );
 		}
 
-	} else {
-		if( class_name )
-			free( class_name );
 	}
 
 	return hash;
 }
 
 /**
-	@brief Parse the JSON keyword "null", and create a JSON_NULL for it.
+	@brief Make a working copy of a hash key.
 	@param parser Pointer to a Parser.
-	@return Pointer to a newly created jsonObject of type JSON_NULL, or NULL upon error.
+	@param key Pointer to the key, as returned by get_string().
+	@return Pointer to the copy.
 
-	We already saw an 'n', or we wouldn't be here.  Make sure that the next three characters
-	are 'u', 'l', and 'l', and that the character after that is not a letter or a digit.
+	We need a copy because parsing the associated value reuses the buffer where the key
+	resides.  If the key has been interned, the interned copy will do.  We don't intern
+	it ourselves, since the keys come from whoever sent the JSON (see osrfInternLookup()).
+	Otherwise, when parsing into an osrfArena, the copy comes from the arena too.
+
+	When parsing in situ, the key already resides safely in the input buffer, so we
+	don't need a copy at all.
+*/
+static char* copy_key( Parser* parser, const char* key ) {
+	const char* interned;
+	if( parser->dest )
+		return (char*) key;
+	else if( ( interned = osrfInternLookup( key ) ) )
+		return (char*) interned;
+	else if( parser->arena )
+		return osrfArenaStrdup( parser->arena, key );
+	else
+		return strdup( key );
+}
+
+/**
+	@brief Dispose of a working copy of a hash key made by copy_key().
+	@param parser Pointer to a Parser.
+	@param key Pointer to the copy.
+*/
+static void free_key( Parser* parser, char* key ) {
+	if( !parser->arena && !parser->dest )
+		osrfInternFree( key );
+}
+
+/**
+	@brief Parse the JSON keyword "null", and create a JSON_NULL for it.
+	@param parser Pointer to a Parser.
+	@return Pointer to a newly created jsonObject of type JSON_NULL, or NULL upon error.
+
+	We already saw an 'n', or we wouldn't be here.  Make sure that the next three characters
+	are 'u', 'l', and 'l', and that the character after that is not a letter or a digit.
 
 	If all goes well, create a jsonObject of type JSON_NULL, and return a pointer to it.
 	Otherwise log an error message and return NULL.
@@ -597,7 +1367,7 @@ static jsonObject* get_null( Parser* parser ) {
 	}
 
 	// Everything's okay.  Return a JSON_NULL.
-	return jsonNewObject( NULL );
+	return jsonNewObjectInArena( parser->arena, NULL );
 }
 
 /**
@@ -632,7 +1402,9 @@ static jsonObject* get_true( Parser* parser ) {
 	}
 
 	// Everything's okay.  Return a JSON_BOOL.
-	return jsonNewBoolObject( 1 );
+	jsonObject* obj = jsonNewObjectTypeInArena( parser->arena, JSON_BOOL );
+	obj->value.b = 1;
+	return obj;
 }
 
 /**
@@ -668,7 +1440,543 @@ static jsonObject* get_false( Parser* parser ) {
 	}
 
 	// Everything's okay.  Return a JSON_BOOL.
-	return jsonNewBoolObject( 0 );
+	return jsonNewObjectTypeInArena( parser->arena, JSON_BOOL );
+}
+
+/**
+	@brief Parse null, true, or false in any mixture of cases.
+	@param parser Pointer to a Parser.
+	@param firstc The first character of the keyword, in lower case.
+	@return Pointer to a newly created JSON_NULL or JSON_BOOL, or NULL upon error.
+
+	Like the old parser, we don't care what follows the keyword.
+*/
+static jsonObject* get_legacy_keyword( Parser* parser, char firstc ) {
+
+	const char* word = 'n' == firstc ? "null" : ( 't' == firstc ? "true" : "false" );
+	size_t len = strlen( word );
+
+	if( strncasecmp( parser->buff + parser->index - 1, word, len ) ) {
+		report_error( parser, firstc, "Unrecognized keyword" );
+		return NULL;
+	}
+	parser->index += len - 1;
+
+	if( 'n' == firstc )
+		return jsonNewObjectInArena( parser->arena, NULL );
+
+	jsonObject* obj = jsonNewObjectTypeInArena( parser->arena, JSON_BOOL );
+	obj->value.b = ( 't' == firstc );
+	return obj;
+}
+
+/**
+	@brief Index a JSON string into a jsonTape.
+	@param s Pointer to the string to be indexed.
+	@param decode A boolean; true means decode class hints, false means don't.
+	@return Pointer to the newly created jsonTape, or NULL upon error.
+
+	This is the counterpart of parse_it().
+*/
+static jsonTape* tape_it( const char* s, int decode ) {
+
+	if( !s || !*s )
+		return NULL;    // Nothing to index
+
+	Parser parser;
+
+	parser.str_buf = NULL;
+	parser.index = 0;
+	parser.buff = s;
+	parser.decode = decode;
+	parser.arena = NULL;
+	parser.dest = NULL;
+	parser.legacy = 0;
+	parser.hint = NULL;
+
+	jsonTape* tape = safe_malloc( sizeof( jsonTape ) );
+	tape->text = s;
+	tape->capacity = 64;
+	tape->entries = safe_malloc( tape->capacity * sizeof( TapeEntry ) );
+	tape->size = 0;
+	tape->decode = decode;
+	tape->strings = NULL;
+	tape->arena = NULL;
+	tape->str_buf = NULL;
+	tape->last_array = -1;
+	tape->last_index = 0;
+	tape->last_elem = 0;
+
+	int rc = tape_node( &parser, tape, skip_white_space( &parser ) );
+
+	// Make sure there's nothing but white space at the end
+	char c;
+	if( !rc && (c = skip_white_space( &parser )) ) {
+		report_error( &parser, c, "Extra material follows JSON string" );
+		rc = -1;
+	}
+
+	if( !rc && parser.index > UINT_MAX ) {
+		osrfLogError( OSRF_LOG_MARK, "JSON string too long to index" );
+		rc = -1;
+	}
+
+	buffer_free( parser.str_buf );
+	if( rc ) {
+		jsonTapeFree( tape );
+		tape = NULL;
+	}
+
+	return tape;
+}
+
+/**
+	@brief Add an entry to a jsonTape.
+	@param tape Pointer to the jsonTape.
+	@param type JSON type of the new node.
+	@param start Offset of the node's first character.
+	@return Index of the new entry.
+
+	The calling code fills in the length and the index of the next entry, once it knows them.
+*/
+static unsigned int tape_push( jsonTape* tape, int type, size_t start ) {
+	if( tape->size == tape->capacity ) {
+		tape->capacity *= 2;
+		TapeEntry* entries = realloc( tape->entries, tape->capacity * sizeof( TapeEntry ) );
+		if( !entries ) {
+			perror( "jsonTape: Out of Memory" );
+			exit( 99 );
+		}
+		tape->entries = entries;
+	}
+
+	unsigned int i = tape->size++;
+	TapeEntry* entry = tape->entries + i;
+	entry->type = type;
+	entry->start = start;
+	entry->len = 0;
+	entry->next = i + 1;
+	entry->count = 0;
+	entry->hint = 0;
+	entry->data = 0;
+	return i;
+}
+
+/**
+	@brief Index the next JSON node -- be it string, number, hash, or whatever.
+	@param parser Pointer to a Parser.
+	@param tape Pointer to the jsonTape being built.
+	@param firstc The first character in the part that we're indexing.
+	@return 0 if successful, or -1 upon error.
+
+	This is the counterpart of get_json_node().  Instead of building a jsonObject, we add an
+	entry to the jsonTape, followed by entries for any subordinate nodes.
+*/
+static int tape_node( Parser* parser, jsonTape* tape, char firstc ) {
+
+	size_t start = parser->index - 1;
+	unsigned int i;
+	int rc;
+
+	// Branch on the first character
+	if( '"' == firstc ) {
+		i = tape_push( tape, JSON_STRING, start );
+		rc = tape_string( parser, &tape->entries[ i ].count );
+	} else if( '[' == firstc ) {
+		i = tape_push( tape, JSON_ARRAY, start );
+		rc = tape_array( parser, tape, i );
+	} else if( '{' == firstc ) {
+		i = tape_push( tape, JSON_HASH, start );
+		rc = tape_hash( parser, tape, i );
+	} else if( 'n' == firstc ) {
+		i = tape_push( tape, JSON_NULL, start );
+		rc = tape_keyword( parser, "ull" );
+	} else if( 't' == firstc ) {
+		i = tape_push( tape, JSON_BOOL, start );
+		tape->entries[ i ].count = 1;
+		rc = tape_keyword( parser, "rue" );
+	} else if( 'f' == firstc ) {
+		i = tape_push( tape, JSON_BOOL, start );
+		rc = tape_keyword( parser, "alse" );
+	}
+	else if( isdigit( (unsigned char) firstc ) ||
+			 '.' == firstc ||
+			 '-' == firstc ||
+			 '+' == firstc ||
+			 'e' == firstc ||
+			 'E' == firstc ) {
+		i = tape_push( tape, JSON_NUMBER, start );
+		rc = tape_number( parser, start );
+	} else {
+		report_error( parser, firstc, "Unexpected character" );
+		return -1;
+	}
+
+	if( rc )
+		return -1;
+
+	tape->entries[ i ].len = parser->index - start;
+	tape->entries[ i ].next = tape->size;
+	return 0;
+}
+
+/**
+	@brief Skip over a string for a jsonTape.
+	@param parser Pointer to a Parser.
+	@param escaped Pointer to a flag to be set if the string contains an escape sequence.
+	@return 0 if successful, or -1 upon error.
+
+	This is the counterpart of get_string().  We check the escape sequences, but leave the
+	decoding to jsonTapeGetString(), for strings that somebody wants.
+*/
+static int tape_string( Parser* parser, unsigned int* escaped ) {
+
+	for( ;; ) {
+
+		// Skip any run of ordinary characters in one go
+		const char* run = parser->buff + parser->index;
+		parser->index += scan_string( run ) - run;
+
+		char c = parser_nextc( parser );
+		if( '"' == c )
+			return 0;
+		else if( !c ) {
+			report_error( parser, parser->buff[ parser->index - 1  ],
+						  "Quoted string not terminated" );
+			return -1;
+		} else if( '\\' == c ) {
+			*escaped = 1;
+			c = parser_nextc( parser );
+			if( 'u' == c ) {
+				Unibuff unibuff;
+				if( get_utf8( parser, &unibuff ) ) {
+					return -1;       // bad UTF-8
+				} else if( !unibuff.buff[0] ) {
+					report_error( parser, 'u', "Unicode sequence encodes a nul byte" );
+					return -1;
+				}
+			} else if( !c ) {
+				report_error( parser, '\\', "Quoted string not terminated" );
+				return -1;
+			}
+		}
+	}
+}
+
+/**
+	@brief Skip over a number for a jsonTape.
+	@param parser Pointer to a Parser.
+	@param start Offset of the first character of the number, which we have already consumed.
+	@return 0 if successful, or -1 upon error.
+
+	This is the counterpart of get_number().  We apply the same test, so that a number
+	which jsonParse() would reject doesn't get onto the tape.
+*/
+static int tape_number( Parser* parser, size_t start ) {
+
+	char c;
+	do {
+		c = parser_nextc( parser );
+	} while( isdigit( (unsigned char) c ) ||
+			 '.' == c ||
+			 '-' == c ||
+			 '+' == c ||
+			 'e' == c ||
+			 'E' == c );
+	parser_ungetc( parser );
+
+	growing_buffer* gb = reset_str_buf( parser );
+	buffer_add_n( gb, parser->buff + start, parser->index - start );
+
+	const char* s = OSRF_BUFFER_C_STR( gb );
+	if( ! jsonIsNumeric( s ) ) {
+		char* scrubbed = jsonScrubNumber( s );
+		if( !scrubbed ) {
+			report_error( parser, parser->buff[ parser->index - 1 ],
+					"Invalid numeric format" );
+			return -1;
+		}
+		free( scrubbed );
+	}
+
+	return 0;
+}
+
+/**
+	@brief Skip over the rest of a keyword (null, true, or false) for a jsonTape.
+	@param parser Pointer to a Parser.
+	@param rest The characters that must follow the first one.
+	@return 0 if successful, or -1 upon error.
+
+	This is the counterpart of get_null(), get_true(), and get_false().
+*/
+static int tape_keyword( Parser* parser, const char* rest ) {
+
+	while( *rest ) {
+		char c = parser_nextc( parser );
+		if( c != *rest++ ) {
+			report_error( parser, c, "Misspelled keyword" );
+			return -1;
+		}
+	}
+
+	// Peek at the next character to make sure that it's kosher
+	char c = parser->buff[ parser->index ];
+	if( isalnum( (unsigned char) c ) ) {
+		report_error( parser, c, "Found letter or number after keyword" );
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+	@brief Index the elements of an array for a jsonTape.
+	@param parser Pointer to a Parser.
+	@param tape Pointer to the jsonTape being built.
+	@param i Index of the entry for the array.
+	@return 0 if successful, or -1 upon error.
+
+	This is the counterpart of get_array().
+*/
+static int tape_array( Parser* parser, jsonTape* tape, unsigned int i ) {
+
+	char c = skip_white_space( parser );
+	if( ']' == c )
+		return 0;          // Empty array
+
+	for( ;; ) {
+		if( tape_node( parser, tape, c ) )
+			return -1;
+		++tape->entries[ i ].count;
+
+		// Look for a comma or right bracket
+		c = skip_white_space( parser );
+		if( ']' == c )
+			break;
+		else if( c != ',' ) {
+			report_error( parser, c, "Expected comma or bracket in array; didn't find it\n" );
+			return -1;
+		}
+		c = skip_white_space( parser );
+	}
+
+	return 0;
+}
+
+/**
+	@brief Index the members of a hash for a jsonTape.
+	@param parser Pointer to a Parser.
+	@param tape Pointer to the jsonTape being built.
+	@param i Index of the entry for the hash.
+	@return 0 if successful, or -1 upon error.
+
+	This is the counterpart of get_hash() and get_decoded_hash().  When decoding class
+	hints, note where the class name and the data are, so that the accessors can look
+	through the hash to the data.  We recognize only keys written without escape sequences.
+*/
+static int tape_hash( Parser* parser, jsonTape* tape, unsigned int i ) {
+
+	char c = skip_white_space( parser );
+	if( '}' == c )
+		return 0;           // Empty hash
+
+	osrfHash* seen = NULL;  // Keys so far, once there are too many to compare one by one
+	int rc = -1;
+
+	for( ;; ) {
+
+		// Get the key string
+		if( '"' != c ) {
+			report_error( parser, c,
+					"Expected quotation mark to begin hash key; didn't find it\n" );
+			goto done;
+		}
+
+		unsigned int k = tape_push( tape, JSON_STRING, parser->index - 1 );
+		if( tape_string( parser, &tape->entries[ k ].count ) )
+			goto done;
+		tape->entries[ k ].len = parser->index - tape->entries[ k ].start;
+
+		if( tape_duplicate_key( parser, tape, i, k, &seen ) ) {
+			report_error( parser, '"', "Duplicate key in JSON object" );
+			goto done;
+		}
+
+		// Get the colon
+		c = skip_white_space( parser );
+		if( c != ':' ) {
+			report_error( parser, c,
+					"Expected colon after hash key; didn't find it\n" );
+			goto done;
+		}
+
+		// Get the associated value
+		unsigned int v = tape->size;
+		if( tape_node( parser, tape, skip_white_space( parser ) ) )
+			goto done;
+		++tape->entries[ i ].count;
+
+		// Save info for class hint, if present
+		if( parser->decode && !tape->entries[ k ].count ) {
+			if( tape_key_is( tape, k, JSON_CLASS_KEY ) ) {
+				int r = tape_resolve( tape, v );
+				if( r >= 0 && ( JSON_STRING == tape->entries[ r ].type
+						|| JSON_NUMBER == tape->entries[ r ].type ) )
+					tape->entries[ i ].hint = v;
+			} else if( tape_key_is( tape, k, JSON_DATA_KEY ) )
+				tape->entries[ i ].data = v;
+		}
+
+		// Look for comma or right brace
+		c = skip_white_space( parser );
+		if( '}' == c )
+			break;
+		else if( c != ',' ) {
+			report_error( parser, c,
+					"Expected comma or brace in hash, didn't find it" );
+			goto done;
+		}
+		c = skip_white_space( parser );
+	}
+
+	if( !tape->entries[ i ].hint )
+		tape->entries[ i ].data = 0;
+	rc = 0;
+
+done:
+	if( seen )
+		osrfHashFree( seen );
+	return rc;
+}
+
+/**
+	@brief Determine whether a hash key in a jsonTape is a given string.
+	@param tape Pointer to the jsonTape.
+	@param k Index of the entry for the key, which must not contain escape sequences.
+	@param key The string to compare it to.
+	@return Boolean: 1 if they match, or 0 if they don't.
+*/
+static int tape_key_is( const jsonTape* tape, unsigned int k, const char* key ) {
+	const TapeEntry* entry = tape->entries + k;
+	size_t len = strlen( key );
+	return entry->len - 2 == len && !memcmp( tape->text + entry->start + 1, key, len );
+}
+
+/**
+	@brief Get the text of a hash key in a jsonTape, with escape sequences decoded.
+	@param parser Pointer to the Parser building the jsonTape.
+	@param tape Pointer to the jsonTape.
+	@param k Index of the entry for the key.
+	@param len Pointer through which to return the length of the key.
+	@return Pointer to the key, which is not nul-terminated.
+
+	If the key has no escape sequences, we point into the text.  Otherwise we decode it into
+	the parser's string buffer, where it lasts only until the next use of that buffer.
+*/
+static const char* tape_key_text( Parser* parser, const jsonTape* tape, unsigned int k,
+		size_t* len ) {
+	const TapeEntry* entry = tape->entries + k;
+	if( !entry->count ) {
+		*len = entry->len - 2;
+		return tape->text + entry->start + 1;
+	}
+
+	// Let get_string() decode it.  tape_string() has already vetted the escape sequences.
+	size_t index = parser->index;
+	parser->index = entry->start + 1;
+	const char* key = get_string( parser );
+	parser->index = index;
+	*len = strlen( key );
+	return key;
+}
+
+/**
+	@brief Determine whether a new key in a hash of a jsonTape repeats an earlier one.
+	@param parser Pointer to the Parser building the jsonTape.
+	@param tape Pointer to the jsonTape.
+	@param i Index of the entry for the hash, whose count doesn't yet include the new key.
+	@param k Index of the entry for the new key.
+	@param seen Pointer to an osrfHash of the keys so far, or to NULL if we haven't needed
+		one yet.  We create it as needed; the calling code must free it.
+	@return Boolean: 1 if the key is a duplicate, or 0 if it isn't.
+
+	jsonParse() rejects a duplicate key, so a jsonTape must too.  Otherwise a consumer of
+	the tape might act on a message that the regular parser refuses.
+
+	For the first few keys we compare the new key with each earlier one.  After that we
+	hash them all, so that a large hash doesn't cost quadratic time.
+*/
+static int tape_duplicate_key( Parser* parser, const jsonTape* tape, unsigned int i,
+		unsigned int k, osrfHash** seen ) {
+
+	unsigned int count = tape->entries[ i ].count;
+	if( !count )
+		return 0;
+
+	size_t key_len;
+	const char* key = tape_key_text( parser, tape, k, &key_len );
+
+	if( count > TAPE_KEY_SCAN ) {
+		if( !*seen ) {
+			// Load the earlier keys
+			*seen = osrfNewHash();
+			unsigned int j = i + 1;
+			unsigned int n;
+			for( n = 0; n < count; ++n ) {
+				size_t len;
+				const char* earlier = tape_key_text( parser, tape, j, &len );
+				osrfHashSetLen( *seen, (void*) tape, earlier, len );
+				j = tape->entries[ j + 1 ].next;
+			}
+			key = tape_key_text( parser, tape, k, &key_len );
+		}
+		return osrfHashSetLen( *seen, (void*) tape, key, key_len ) != NULL;
+	}
+
+	// Keep our own copy if it's in the string buffer, which we need for the earlier keys
+	char* decoded = NULL;
+	if( tape->entries[ k ].count )
+		key = decoded = strndup( key, key_len );
+
+	int found = 0;
+	unsigned int j = i + 1;
+	unsigned int n;
+	for( n = 0; n < count && !found; ++n ) {
+		size_t len;
+		const char* earlier = tape_key_text( parser, tape, j, &len );
+		found = len == key_len && !memcmp( earlier, key, len );
+		j = tape->entries[ j + 1 ].next;
+	}
+
+	free( decoded );
+	return found;
+}
+
+/**
+	@brief Determine whether a jsonTape has a given node.
+	@param tape Pointer to the jsonTape.
+	@param node The node.
+	@return Boolean: 1 if the node exists, or 0 if it doesn't.
+*/
+static inline int tape_valid( const jsonTape* tape, int node ) {
+	return tape && node >= 0 && (unsigned int) node < tape->size;
+}
+
+/**
+	@brief Look through any class hints to the node that they wrap.
+	@param tape Pointer to the jsonTape.
+	@param node A valid node.
+	@return The wrapped node (which is @a node itself if it has no class hint), or -1 if
+		a class hint wraps nothing, and so stands for a JSON_NULL.
+*/
+static int tape_resolve( const jsonTape* tape, int node ) {
+	while( tape->entries[ node ].hint ) {
+		node = tape->entries[ node ].data;
+		if( !node )
+			return -1;
+	}
+	return node;
 }
 
 /**
@@ -759,14 +2067,302 @@ static int get_utf8( Parser* parser, Unibuff* unibuff ) {
 	@brief Skip over white space.
 	@param parser Pointer to a Parser.
 	@return The next non-whitespace character.
+
+	Most JSON that we see is compact, with at most a single space here and there, so we
+	check the first couple of characters before resorting to a bulk scan.
 */
 static char skip_white_space( Parser* parser ) {
-	char c;
-	do {
-		c = parser_nextc( parser );
-	} while( isspace( (unsigned char) c ) );
+	const char* p = parser->buff + parser->index;
+	if( isspace( (unsigned char) *p ) ) {
+		++p;
+		if( isspace( (unsigned char) *p ) )
+			p = scan_space( p );
+	}
+
+	if( parser->legacy )
+		return skip_comments( parser, p );
+
+	parser->index = p - parser->buff + 1;
+	return *p;
+}
+
+/**
+	@brief Skip over comments and white space, in the legacy dialect.
+	@param parser Pointer to a Parser.
+	@param p Pointer to the next character that isn't white space.
+	@return The next character that is neither white space nor part of a comment.
+
+	A comment of the form <tt>/&lowast;--S classname--&lowast;/</tt> becomes the pending
+	class hint, replacing any earlier one.  An unterminated comment swallows the rest of
+	the input.
 
-	return c;
+	A hint lives only until the next call: if no node follows it directly, as when it
+	trails a value or precedes a hash key, nothing uses it.
+*/
+static char skip_comments( Parser* parser, const char* p ) {
+	free( parser->hint );
+	parser->hint = NULL;
+
+	while( '/' == *p ) {
+		if( '*' == p[ 1 ] ) {
+			const char* end = strstr( p + 2, "*/" );
+			if( !end ) {
+				parser->index = p - parser->buff + 1;
+				report_error( parser, '/', "Unterminated comment" );
+				p += strlen( p );
+				break;
+			}
+			if( !strncmp( p + 2, "--S", 3 ) )
+				set_hint( parser, p + 5, end );
+			p = end + 2;
+		} else if( '/' == p[ 1 ] ) {
+			p += 2;
+			while( *p && '\n' != *p )
+				++p;
+		} else
+			break;   // A lone slash; let the caller complain about it
+
+		while( isspace( (unsigned char) *p ) )
+			++p;
+	}
+
+	parser->index = p - parser->buff + 1;
+	return *p;
+}
+
+/**
+	@brief Install the class name from a legacy class hint as the pending hint.
+	@param parser Pointer to a Parser.
+	@param start Pointer to the text following "/&lowast;--S".
+	@param end Pointer to the "&lowast;/" that closes the comment.
+
+	Trim white space from both ends of the name, and dashes from the end.
+*/
+static void set_hint( Parser* parser, const char* start, const char* end ) {
+	while( start < end && isspace( (unsigned char) *start ) )
+		++start;
+	while( end > start && ( '-' == end[ -1 ] || isspace( (unsigned char) end[ -1 ] ) ) )
+		--end;
+
+	free( parser->hint );
+	parser->hint = strndup( start, end - start );
+}
+
+/* ------------------------------------- */
+/* Bulk scanners.  Each has a portable version, an SSE2 version, and an AVX2 version. */
+
+#ifndef OSRF_SIMD_X86
+
+/**
+	@brief Find the next character that may need special treatment within a string.
+	@param p Pointer to the current position within a nul-terminated string.
+	@return Pointer to the first quotation mark, backslash, or control character (including
+		the terminal nul) at or after @a p.
+*/
+static const char* scan_string_portable( const char* p ) {
+	while( '"' != *p && '\\' != *p && (unsigned char) *p >= 0x20 )
+		++p;
+	return p;
+}
+
+/**
+	@brief Skip over white space.
+	@param p Pointer to the current position within a nul-terminated string.
+	@return Pointer to the first character at or after @a p that isn't white space.
+*/
+static const char* scan_space_portable( const char* p ) {
+	while( isspace( (unsigned char) *p ) )
+		++p;
+	return p;
+}
+
+#else
+
+/**
+	@brief Flag the characters in a 16-byte block that end a run of ordinary string content.
+	@param x The block.
+	@return A bit mask with a bit set for each quotation mark, backslash, or control character.
+
+	There is no unsigned byte comparison in SSE2, but x <= 0x1F is equivalent to
+	max( x, 0x1F ) == 0x1F.
+*/
+static inline unsigned int string_stops_sse2( __m128i x ) {
+	const __m128i ctrl = _mm_set1_epi8( 0x1F );
+	__m128i hits = _mm_or_si128(
+		_mm_or_si128( _mm_cmpeq_epi8( x, _mm_set1_epi8( '"' ) ),
+					  _mm_cmpeq_epi8( x, _mm_set1_epi8( '\\' ) ) ),
+		_mm_cmpeq_epi8( _mm_max_epu8( x, ctrl ), ctrl ) );
+	return (unsigned int) _mm_movemask_epi8( hits );
+}
+
+/**
+	@brief Flag the non-whitespace characters in a 16-byte block.
+	@param x The block.
+	@return A bit mask with a bit set for each character that isn't white space.
+
+	White space is a blank, or anything from 0x09 (tab) through 0x0D (carriage return),
+	matching isspace() in the C locale.
+*/
+static inline unsigned int space_stops_sse2( __m128i x ) {
+	const __m128i four = _mm_set1_epi8( 4 );
+	__m128i t = _mm_sub_epi8( x, _mm_set1_epi8( 0x09 ) );
+	__m128i space = _mm_or_si128( _mm_cmpeq_epi8( x, _mm_set1_epi8( ' ' ) ),
+								  _mm_cmpeq_epi8( _mm_max_epu8( t, four ), four ) );
+	return ~(unsigned int) _mm_movemask_epi8( space ) & 0xFFFFu;
+}
+
+/**
+	@brief SSE2 version of scan_string_portable().
+
+	We load aligned 16-byte blocks, starting with the one containing @a p, and mask off
+	any bits for characters in front of @a p.  Because the terminal nul counts as a control
+	character, we always stop in the block containing it, if not before.
+*/
+NO_SANITIZE_ADDRESS
+static const char* scan_string_sse2( const char* p ) {
+	unsigned int offset = (uintptr_t) p & 15;
+	const char* block = p - offset;
+	unsigned int mask = string_stops_sse2( _mm_load_si128( (const __m128i*) block ) )
+			& ( 0xFFFFu << offset );
+	while( !mask ) {
+		block += 16;
+		mask = string_stops_sse2( _mm_load_si128( (const __m128i*) block ) );
+	}
+	return block + __builtin_ctz( mask );
+}
+
+/**
+	@brief SSE2 version of scan_space_portable().
+
+	The terminal nul is not white space, so we always stop in the block containing it,
+	if not before.
+*/
+NO_SANITIZE_ADDRESS
+static const char* scan_space_sse2( const char* p ) {
+	unsigned int offset = (uintptr_t) p & 15;
+	const char* block = p - offset;
+	unsigned int mask = space_stops_sse2( _mm_load_si128( (const __m128i*) block ) )
+			& ( 0xFFFFu << offset );
+	while( !mask ) {
+		block += 16;
+		mask = space_stops_sse2( _mm_load_si128( (const __m128i*) block ) );
+	}
+	return block + __builtin_ctz( mask );
+}
+
+/**
+	@brief AVX2 version of scan_string_portable().
+
+	The same as scan_string_sse2(), but with 32-byte blocks.
+*/
+__attribute__((target("avx2"))) NO_SANITIZE_ADDRESS
+static const char* scan_string_avx2( const char* p ) {
+	const __m256i quote = _mm256_set1_epi8( '"' );
+	const __m256i backslash = _mm256_set1_epi8( '\\' );
+	const __m256i ctrl = _mm256_set1_epi8( 0x1F );
+
+	unsigned int offset = (uintptr_t) p & 31;
+	const char* block = p - offset;
+	uint32_t mask = 0xFFFFFFFFu << offset;
+	for( ;; ) {
+		__m256i x = _mm256_load_si256( (const __m256i*) block );
+		__m256i hits = _mm256_or_si256(
+			_mm256_or_si256( _mm256_cmpeq_epi8( x, quote ), _mm256_cmpeq_epi8( x, backslash ) ),
+			_mm256_cmpeq_epi8( _mm256_max_epu8( x, ctrl ), ctrl ) );
+		mask &= (uint32_t) _mm256_movemask_epi8( hits );
+		if( mask )
+			return block + __builtin_ctz( mask );
+		block += 32;
+		mask = 0xFFFFFFFFu;
+	}
+}
+
+/**
+	@brief AVX2 version of scan_space_portable().
+
+	The same as scan_space_sse2(), but with 32-byte blocks.
+*/
+__attribute__((target("avx2"))) NO_SANITIZE_ADDRESS
+static const char* scan_space_avx2( const char* p ) {
+	const __m256i blank = _mm256_set1_epi8( ' ' );
+	const __m256i tab = _mm256_set1_epi8( 0x09 );
+	const __m256i four = _mm256_set1_epi8( 4 );
+
+	unsigned int offset = (uintptr_t) p & 31;
+	const char* block = p - offset;
+	uint32_t mask = 0xFFFFFFFFu << offset;
+	for( ;; ) {
+		__m256i x = _mm256_load_si256( (const __m256i*) block );
+		__m256i t = _mm256_sub_epi8( x, tab );
+		__m256i space = _mm256_or_si256( _mm256_cmpeq_epi8( x, blank ),
+				_mm256_cmpeq_epi8( _mm256_max_epu8( t, four ), four ) );
+		mask &= ~(uint32_t) _mm256_movemask_epi8( space );
+		if( mask )
+			return block + __builtin_ctz( mask );
+		block += 32;
+		mask = 0xFFFFFFFFu;
+	}
+}
+
+#endif
+
+/**
+	@brief Choose the best available scanners for this CPU.
+
+	We do this lazily, the first time we need a scanner.  See osrf_cpu_has_avx2() about
+	threads.
+*/
+static void select_scanners( void ) {
+#ifdef OSRF_SIMD_X86
+	if( osrf_cpu_has_avx2() ) {
+		scan_string = scan_string_avx2;
+		scan_space  = scan_space_avx2;
+	} else {
+		scan_string = scan_string_sse2;
+		scan_space  = scan_space_sse2;
+	}
+#else
+	scan_string = scan_string_portable;
+	scan_space  = scan_space_portable;
+#endif
+}
+
+/**
+	@brief Initial value of scan_string: pick a real scanner, and use it.
+	@param p Pointer to the current position within a nul-terminated string.
+	@return The result of the selected scanner.
+*/
+static const char* scan_string_select( const char* p ) {
+	select_scanners();
+	return scan_string( p );
+}
+
+/**
+	@brief Initial value of scan_space: pick a real scanner, and use it.
+	@param p Pointer to the current position within a nul-terminated string.
+	@return The result of the selected scanner.
+*/
+static const char* scan_space_select( const char* p ) {
+	select_scanners();
+	return scan_space( p );
+}
+
+/**
+	@brief Get an empty working buffer for building a string.
+	@param parser Pointer to a Parser.
+	@return Pointer to parser->str_buf, created if necessary and emptied.
+
+	We empty the buffer directly rather than call buffer_reset(), which would fill the
+	whole buffer -- however big it has grown -- for every string we parse.
+*/
+static inline growing_buffer* reset_str_buf( Parser* parser ) {
+	if( parser->str_buf ) {
+		parser->str_buf->n_used = 0;
+		parser->str_buf->buf[ 0 ] = '\0';
+	} else
+		parser->str_buf = buffer_init( 64 );
+
+	return parser->str_buf;
 }
 
 /**
@@ -804,6 +2400,11 @@ static inline char parser_nextc( Parser* parser ) {
 */
 static void report_error( Parser* parser, char badchar, const char* err ) {
 
+	// If we have already consumed the terminal nul, back up to it,
+	// so that we don't look past the end of the input
+	if( parser->index > 0 && '\0' == parser->buff[ parser->index - 1 ] )
+		--parser->index;
+
 	// Determine the beginning and ending points of a JSON
 	// fragment to display, from the vicinity of the error
 
@@ -125,7 +125,7 @@ int osrf_settings_retrieve(const char* hostname) {
 			);
 		} else {
 			config = osrf_settings_new_host_config(hostname);
-			config->config = jsonObjectClone(omsg->_result_content);
+			config->config = jsonObjectShare(omsg->_result_content);
 			osrfMessageFree(omsg);
 		}
 
@@ -0,0 +1,52 @@
+/**
+	@file osrf_simd.h
+	@brief Private helpers for the vectorized scanners in osrf_utf8.c and osrf_parse_json.c.
+
+	This header is not installed.  It is for use within libopensrf only.
+*/
+
+#ifndef OSRF_SIMD_H
+#define OSRF_SIMD_H
+
+/*
+	On x86 with gcc or clang, the scanners use SSE2, or AVX2 if the CPU supports it.
+	Elsewhere they fall back to plain byte-at-a-time loops.
+*/
+#if defined(__GNUC__) && defined(__SSE2__) && ( defined(__x86_64__) || defined(__i386__) )
+#define OSRF_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+	The vectorized scanners read whole aligned blocks, which may include a few bytes on
+	either side of the input string.  An aligned block never straddles a page boundary,
+	so this is safe, but AddressSanitizer doesn't know that.
+*/
+#if defined(__SANITIZE_ADDRESS__)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#endif
+#endif
+#ifndef NO_SANITIZE_ADDRESS
+#define NO_SANITIZE_ADDRESS
+#endif
+
+#ifdef OSRF_SIMD_X86
+/**
+	@brief Determine whether the CPU supports AVX2.
+	@return Boolean: 1 if it does, or 0 if it doesn't.
+
+	Each scanner is reached through a function pointer, which starts out pointing to a
+	selector.  The selector calls this function, points the function pointer at the best
+	scanner for this CPU, and passes the call along.  If two threads get there at the
+	same time, they will make the same choice, so the race is harmless.
+*/
+static inline int osrf_cpu_has_avx2( void ) {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "avx2" ) ? 1 : 0;
+}
+#endif
+
+#endif
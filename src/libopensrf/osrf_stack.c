@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include <opensrf/osrf_stack.h>
 #include <opensrf/osrf_application.h>
 
@@ -13,6 +14,49 @@
 static void _do_client( osrfAppSession*, osrfMessage* );
 static void _do_server( osrfAppSession*, osrfMessage* );
 
+/**
+	@brief Scratch space for parsing incoming message bodies.
+
+	The jsonObject tree parsed from a message body lives only until the osrfMessages have
+	been extracted from it, so we build it in an osrfArena and reset the arena right
+	afterwards.  Each thread creates its own on first use, reuses it for every message
+	thereafter, and frees it when it exits.
+*/
+static __thread osrfArena* parse_arena = NULL;
+
+/** Key whose destructor frees a thread's parse_arena when the thread exits */
+static pthread_key_t parseArenaKey;
+/** For creating parseArenaKey exactly once */
+static pthread_once_t parseArenaKeyOnce = PTHREAD_ONCE_INIT;
+
+/**
+	@brief Free a thread's parse_arena, as the thread exits.
+	@param arena Pointer to the osrfArena.
+*/
+static void free_parse_arena( void* arena ) {
+	osrfArenaFree( (osrfArena*) arena );
+}
+
+/**
+	@brief Create the key whose destructor frees each thread's parse_arena.
+*/
+static void make_parse_arena_key( void ) {
+	pthread_key_create( &parseArenaKey, free_parse_arena );
+}
+
+/**
+	@brief Get this thread's parse_arena, creating it if necessary.
+	@return Pointer to the osrfArena.
+*/
+static osrfArena* get_parse_arena( void ) {
+	if( !parse_arena ) {
+		parse_arena = osrfNewArena( 0 );
+		pthread_once( &parseArenaKeyOnce, make_parse_arena_key );
+		pthread_setspecific( parseArenaKey, parse_arena );
+	}
+	return parse_arena;
+}
+
 /**
 	@brief Read and process available transport_messages for a transport_client.
 	@param client Pointer to the transport_client whose socket is to be read.
@@ -118,7 +162,15 @@ struct osrf_app_session_struct* osrf_stack_transport_handler( transport_message*
 	osrfMessage* arr[OSRF_MAX_MSGS_PER_PACKET];
 
 	/* Convert the message body into one or more osrfMessages */
-	int num_msgs = osrf_message_deserialize(msg->body, arr, OSRF_MAX_MSGS_PER_PACKET);
+	osrfArena* arena = get_parse_arena();
+	// Nothing else needs the message body, so we may parse it in place.
+	int num_msgs = osrf_message_deserialize_in_situ( msg->body, arr,
+			OSRF_MAX_MSGS_PER_PACKET, arena );
+
+	// The osrfMessages are self-contained, so we're done with the parse tree.  Reset
+	// the arena now, before processing the messages, in case the processing leads
+	// to a recursive call to this function.
+	osrfArenaReset( arena );
 
 	osrfLogDebug( OSRF_LOG_MARK, "We received %d messages from %s", num_msgs, msg->sender );
 
@@ -153,6 +205,11 @@ struct osrf_app_session_struct* osrf_stack_transport_handler( transport_message*
 		// they will all be the same
 		if (i == 0) osrfAppSessionSetIngress(arr[i]->sender_ingress);
 
+		// Note whether the sender can read binary bodies.  A jabber error returns our
+		// own messages, which say nothing about the other party.
+		if( !msg->is_error )
+			session->binary = arr[i]->binary;
+
 		if( session->type == OSRF_SESSION_CLIENT )
 			_do_client( session, arr[i] );
 		else
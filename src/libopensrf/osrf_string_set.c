@@ -0,0 +1,188 @@
+/**
+	@file osrf_string_set.c
+	@brief Implementation of osrfStringSet, a set of strings with fast membership tests.
+
+	The members live as keys in an osrfHash.  To support prefix matching, we also keep a
+	sorted list of the distinct lengths of the members.  A string has a member as a prefix
+	if, for one of those lengths, its first so many characters are a member -- which we
+	can check with osrfHashGetLen(), without copying anything.  Since a set of prefixes
+	rarely has more than a few distinct lengths, a prefix match costs a few hash lookups,
+	rather than a string comparison against every member.
+*/
+
+#include <opensrf/osrf_hash.h>
+#include <opensrf/osrf_string_set.h>
+
+/**
+	@brief Structure of an osrfStringSet.
+*/
+struct _osrfStringSetStruct {
+	/** @brief The members, as keys; the items are all the same dummy */
+	osrfHash* hash;
+	/** @brief The distinct lengths of the members, in ascending order */
+	size_t* lengths;
+	/** @brief How many entries of lengths are in use */
+	unsigned int length_count;
+	/** @brief How many entries of lengths are allocated */
+	unsigned int length_capacity;
+};
+
+/** @brief The item stored for every member, since an osrfHash won't store a NULL. */
+static char member = '\0';
+
+/**
+	@brief Create a new, empty osrfStringSet.
+	@return Pointer to the newly created osrfStringSet.
+
+	The calling code is responsible for freeing the osrfStringSet by calling
+	osrfStringSetFree().
+*/
+osrfStringSet* osrfNewStringSet( void ) {
+	osrfStringSet* set;
+	OSRF_MALLOC( set, sizeof( osrfStringSet ) );
+	set->hash = osrfNewHash();
+	return set;
+}
+
+/**
+	@brief Create a new osrfStringSet containing the strings in an osrfStringArray.
+	@param arr Pointer to the osrfStringArray.
+	@return Pointer to the newly created osrfStringSet.
+
+	If @a arr is NULL, the osrfStringSet is empty.  Either way, the osrfStringArray is left
+	unchanged.
+
+	The calling code is responsible for freeing the osrfStringSet by calling
+	osrfStringSetFree().
+*/
+osrfStringSet* osrfNewStringSetFromArray( const osrfStringArray* arr ) {
+	osrfStringSet* set = osrfNewStringSet();
+	if( arr ) {
+		int i;
+		for( i = 0; i < arr->size; ++i )
+			osrfStringSetAdd( set, osrfStringArrayGetString( arr, i ) );
+	}
+	return set;
+}
+
+/**
+	@brief Note the length of a member of an osrfStringSet, for the sake of prefix matching.
+	@param set Pointer to the osrfStringSet.
+	@param len The length of the member.
+*/
+static void add_length( osrfStringSet* set, size_t len ) {
+	unsigned int i = 0;
+	while( i < set->length_count && set->lengths[ i ] < len )
+		++i;
+	if( i < set->length_count && set->lengths[ i ] == len )
+		return;     // We already have this length
+
+	if( set->length_count == set->length_capacity ) {
+		set->length_capacity = set->length_capacity ? set->length_capacity * 2 : 4;
+		set->lengths = realloc( set->lengths, set->length_capacity * sizeof( size_t ) );
+		if( !set->lengths ) {
+			perror( "osrfStringSetAdd(): Out of Memory" );
+			exit( 99 );
+		}
+	}
+
+	memmove( set->lengths + i + 1, set->lengths + i,
+		( set->length_count - i ) * sizeof( size_t ) );
+	set->lengths[ i ] = len;
+	++set->length_count;
+}
+
+/**
+	@brief Add a string to an osrfStringSet.
+	@param set Pointer to the osrfStringSet.
+	@param str Pointer to the string to be added.
+
+	The osrfStringSet makes its own copy of the string.  Adding a string that is already a
+	member changes nothing.
+
+	If either parameter is NULL, nothing happens.
+*/
+void osrfStringSetAdd( osrfStringSet* set, const char* str ) {
+	if( !( set && str ) )
+		return;
+
+	size_t len = strlen( str );
+	osrfHashSetLen( set->hash, &member, str, len );
+	add_length( set, len );
+}
+
+/**
+	@brief Determine whether a string is a member of an osrfStringSet.
+	@param set Pointer to the osrfStringSet.
+	@param str Pointer to the string to be sought.
+	@return A boolean: 1 if the string is a member, or 0 if it isn't.
+
+	The search is case-sensitive.
+*/
+int osrfStringSetContains( const osrfStringSet* set, const char* str ) {
+	if( !( set && str ) )
+		return 0;
+	return osrfHashGetLen( set->hash, str, strlen( str ) ) != NULL;
+}
+
+/**
+	@brief Determine whether a string, specified by its length, is a member of an
+		osrfStringSet.
+	@param set Pointer to the osrfStringSet.
+	@param str Pointer to the characters of the string, which need not be nul-terminated.
+	@param len The length of the string.
+	@return A boolean: 1 if the string is a member, or 0 if it isn't.
+
+	This function is handy for testing part of a longer string, such as the domain of a
+	Jabber ID, without copying it.
+*/
+int osrfStringSetContainsLen( const osrfStringSet* set, const char* str, size_t len ) {
+	if( !( set && str ) )
+		return 0;
+	return osrfHashGetLen( set->hash, str, len ) != NULL;
+}
+
+/**
+	@brief Determine whether any member of an osrfStringSet is a prefix of a given string.
+	@param set Pointer to the osrfStringSet.
+	@param str Pointer to the string to be examined.
+	@return A boolean: 1 if the string begins with a member, or 0 if it doesn't.
+
+	A member equal to the whole string counts as a prefix, and so does an empty member.
+	The comparison is case-sensitive.
+*/
+int osrfStringSetMatchPrefix( const osrfStringSet* set, const char* str ) {
+	if( !( set && str ) )
+		return 0;
+
+	size_t str_len = strlen( str );
+	unsigned int i;
+	for( i = 0; i < set->length_count && set->lengths[ i ] <= str_len; ++i ) {
+		if( osrfHashGetLen( set->hash, str, set->lengths[ i ] ) )
+			return 1;
+	}
+	return 0;
+}
+
+/**
+	@brief Count the members of an osrfStringSet.
+	@param set Pointer to the osrfStringSet.
+	@return The number of members, or zero if @a set is NULL.
+*/
+unsigned long osrfStringSetGetCount( const osrfStringSet* set ) {
+	if( !set )
+		return 0;
+	return osrfHashGetCount( set->hash );
+}
+
+/**
+	@brief Free an osrfStringSet, and all the strings inside it.
+	@param set Pointer to the osrfStringSet to be freed.
+*/
+void osrfStringSetFree( osrfStringSet* set ) {
+	if( !set )
+		return;
+	osrfHashFree( set->hash );
+	free( set->lengths );
+	free( set );
+}
@@ -25,6 +25,9 @@
 
 osrfStringArray* log_protect_arr = NULL;
 
+/** The strings of log_protect_arr, loaded into a set for quick prefix matching. */
+osrfStringSet* log_protect_set = NULL;
+
 /** Pointer to the global transport_client; i.e. our connection to Jabber. */
 static transport_client* osrfGlobalTransportClient = NULL;
 
@@ -362,6 +365,7 @@ int osrfSystemBootstrapClientResc( const char* config_file,
 		log_protect_arr = osrfNewStringArray(8);
 		osrfConfig* cfg_shared = osrfConfigInit(config_file, "shared");
 		osrfConfigGetValueList( cfg_shared, log_protect_arr, "/log_protect/match_string" );
+		log_protect_set = osrfNewStringSetFromArray( log_protect_arr );
 	}
 
 	char* log_file      = osrfConfigGetValue( NULL, "/logfile");
@@ -26,12 +26,24 @@ Date       Change
  2008/11/20 Initial creation
  2008/11/27 Emit surrogate pairs for code points > 0xFFFF
  ----------------------------------------------------------*/
+#include <stdint.h>
 #include <opensrf/utils.h>
 #include <opensrf/osrf_utf8.h>
+#include "osrf_simd.h"
 
 static void append_surrogate_pair(growing_buffer * buf, unsigned long code_point);
 static void append_uxxxx(growing_buffer * buf, unsigned long i);
 
+/**
+	@brief A function that scans forward from a given position, returning where it stopped.
+*/
+typedef const unsigned char* (*PlainScanner)( const unsigned char* p );
+
+static const unsigned char* scan_plain_select( const unsigned char* p );
+
+/** @brief Find the next byte that buffer_append_utf8() can't copy as it is. */
+static PlainScanner scan_plain = scan_plain_select;
+
 unsigned char osrf_utf8_mask_[] =
 {
 	193,	/* 00000000	Control character */
@@ -358,6 +370,14 @@ int buffer_append_utf8( growing_buffer* buf, const char* string ) {
 			case S_BEGIN :
 
 				while( s[i] && (s[i] < 0x80) ) {    // Handle ASCII
+					// Copy any run of characters that need no escaping in one go
+					const unsigned char* stop = scan_plain( s + i );
+					if( stop > s + i ) {
+						OSRF_BUFFER_ADD_N( buf, (const char*) s + i, stop - ( s + i ) );
+						i = stop - s;
+						continue;
+					}
+
 					if( is_utf8_print( s[i] ) ) {   // Printable
 						switch( s[i] )
 						{
@@ -568,13 +588,116 @@ static void append_surrogate_pair(growing_buffer * buf, unsigned long code_point
 */
 static void append_uxxxx( growing_buffer * buf, unsigned long i ) {
 	static const char hex_chars[] = "0123456789abcdef";
-	char hex_buf[7] = "\\u";
+	char hex_buf[6] = "\\u";
 
 	hex_buf[2] = hex_chars[ (i >> 12) & 0x000F ];
 	hex_buf[3] = hex_chars[ (i >>  8) & 0x000F ];
 	hex_buf[4] = hex_chars[ (i >>  4) & 0x000F ];
 	hex_buf[5] = hex_chars[ i         & 0x000F ];
-	hex_buf[6] = '\0';
 
-	OSRF_BUFFER_ADD(buf, hex_buf);
+	OSRF_BUFFER_ADD_N(buf, hex_buf, sizeof( hex_buf ));
+}
+
+/* ------------------------------------- */
+/* Bulk scanners.  There is a portable version, an SSE2 version, and an AVX2 version. */
+
+#ifndef OSRF_SIMD_X86
+
+/**
+	@brief Find the next byte that buffer_append_utf8() can't copy as it is.
+	@param p Pointer to the current position within a nul-terminated string.
+	@return Pointer to the first quotation mark, backslash, control character (including
+		DEL and the terminal nul), or non-ASCII byte at or after @a p.
+*/
+static const unsigned char* scan_plain_portable( const unsigned char* p ) {
+	while( *p >= 0x20 && *p < 0x7F && '"' != *p && '\\' != *p )
+		++p;
+	return p;
+}
+
+#else
+
+/**
+	@brief SSE2 version of scan_plain_portable().
+
+	We load aligned 16-byte blocks, starting with the one containing @a p, and mask off
+	any bits for characters in front of @a p.  Because the terminal nul counts as a control
+	character, we always stop in the block containing it, if not before.
+
+	A byte needs no escaping if it lies in 0x20 through 0x7E, i.e. if subtracting 0x20
+	leaves it below 0x5F, and if it isn't a quotation mark or a backslash.  SSE2 has no
+	unsigned byte comparison, but x >= 0x5F is equivalent to max( x, 0x5F ) == x.
+*/
+NO_SANITIZE_ADDRESS
+static const unsigned char* scan_plain_sse2( const unsigned char* p ) {
+	const __m128i quote = _mm_set1_epi8( '"' );
+	const __m128i backslash = _mm_set1_epi8( '\\' );
+	const __m128i blank = _mm_set1_epi8( 0x20 );
+	const __m128i range = _mm_set1_epi8( 0x5F );
+
+	unsigned int offset = (uintptr_t) p & 15;
+	const unsigned char* block = p - offset;
+	unsigned int mask = 0xFFFFu << offset;
+	for( ;; ) {
+		__m128i x = _mm_load_si128( (const __m128i*) block );
+		__m128i t = _mm_sub_epi8( x, blank );
+		__m128i hits = _mm_or_si128(
+			_mm_or_si128( _mm_cmpeq_epi8( x, quote ), _mm_cmpeq_epi8( x, backslash ) ),
+			_mm_cmpeq_epi8( _mm_max_epu8( t, range ), t ) );
+		mask &= (unsigned int) _mm_movemask_epi8( hits );
+		if( mask )
+			return block + __builtin_ctz( mask );
+		block += 16;
+		mask = 0xFFFFu;
+	}
+}
+
+/**
+	@brief AVX2 version of scan_plain_portable().
+
+	The same as scan_plain_sse2(), but with 32-byte blocks.
+*/
+__attribute__((target("avx2"))) NO_SANITIZE_ADDRESS
+static const unsigned char* scan_plain_avx2( const unsigned char* p ) {
+	const __m256i quote = _mm256_set1_epi8( '"' );
+	const __m256i backslash = _mm256_set1_epi8( '\\' );
+	const __m256i blank = _mm256_set1_epi8( 0x20 );
+	const __m256i range = _mm256_set1_epi8( 0x5F );
+
+	unsigned int offset = (uintptr_t) p & 31;
+	const unsigned char* block = p - offset;
+	uint32_t mask = 0xFFFFFFFFu << offset;
+	for( ;; ) {
+		__m256i x = _mm256_load_si256( (const __m256i*) block );
+		__m256i t = _mm256_sub_epi8( x, blank );
+		__m256i hits = _mm256_or_si256(
+			_mm256_or_si256( _mm256_cmpeq_epi8( x, quote ), _mm256_cmpeq_epi8( x, backslash ) ),
+			_mm256_cmpeq_epi8( _mm256_max_epu8( t, range ), t ) );
+		mask &= (uint32_t) _mm256_movemask_epi8( hits );
+		if( mask )
+			return block + __builtin_ctz( mask );
+		block += 32;
+		mask = 0xFFFFFFFFu;
+	}
+}
+
+#endif
+
+/**
+	@brief Initial value of scan_plain: pick the best scanner for this CPU, and use it.
+	@param p Pointer to the current position within a nul-terminated string.
+	@return The result of the selected scanner.
+
+	See osrf_cpu_has_avx2() about threads.
+*/
+static const unsigned char* scan_plain_select( const unsigned char* p ) {
+#ifdef OSRF_SIMD_X86
+	if( osrf_cpu_has_avx2() )
+		scan_plain = scan_plain_avx2;
+	else
+		scan_plain = scan_plain_sse2;
+#else
+	scan_plain = scan_plain_portable;
+#endif
+	return scan_plain( p );
 }
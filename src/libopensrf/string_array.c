@@ -33,6 +33,7 @@ osrfStringArray* osrfNewStringArray(int size) {
 	// Initialize list
 	arr->list.size = 0;
 	arr->list.freeItem = NULL;
+	arr->list.arena = NULL;
 	if( size <= 0 )
 		arr->list.arrsize = 16;
 	else
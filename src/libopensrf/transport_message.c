@@ -295,6 +295,38 @@ int message_free( transport_message* msg ){
 }
 
 
+/**
+	@brief Append an attribute to a start tag under construction.
+	@param buf Pointer to the growing_buffer holding the start tag.
+	@param name Name of the attribute.
+	@param value Value of the attribute (may be NULL, meaning an empty string).
+*/
+static void add_xml_attribute( growing_buffer* buf, const char* name, const char* value ) {
+	OSRF_BUFFER_ADD_CHAR( buf, ' ' );
+	OSRF_BUFFER_ADD( buf, name );
+	OSRF_BUFFER_ADD_N( buf, "=\"", 2 );
+	buffer_add_xml_escaped( buf, value, 1 );
+	OSRF_BUFFER_ADD_CHAR( buf, '"' );
+}
+
+/**
+	@brief Append a text-only element, unless its content is empty.
+	@param buf Pointer to the growing_buffer holding the message.
+	@param name Name of the element.
+	@param text Text content of the element (may be NULL).
+*/
+static void add_xml_text_element( growing_buffer* buf, const char* name, const char* text ) {
+	if( text && *text ) {
+		OSRF_BUFFER_ADD_CHAR( buf, '<' );
+		OSRF_BUFFER_ADD( buf, name );
+		OSRF_BUFFER_ADD_CHAR( buf, '>' );
+		buffer_add_xml_escaped( buf, text, 0 );
+		OSRF_BUFFER_ADD_N( buf, "</", 2 );
+		OSRF_BUFFER_ADD( buf, name );
+		OSRF_BUFFER_ADD_CHAR( buf, '>' );
+	}
+}
+
 /**
 	@brief Build a &lt;message&gt; element and store it as a string in the msg_xml member.
 	@param msg Pointer to a transport_message.
@@ -305,84 +337,58 @@ int message_free( transport_message* msg ){
 	The contents of the &lt;message&gt; element come from various members of the
 	transport_message.  Store the resulting string as the msg_xml member.
 
-	To build the XML we first build a DOM structure, and then export it to a string.  That
-	way we can let the XML library worry about replacing certain characters with
-	character entity references -- not a trivial task when UTF-8 characters may be present.
+	We write the XML directly into a buffer, escaping each value on the way in with
+	buffer_add_xml_escaped().  The result is the same as what libxml2 would produce from
+	the equivalent DOM, but the body -- which may be large -- is only copied once.
 */
 int message_prepare_xml( transport_message* msg ) {
 
 	if( !msg ) return 0;
 	if( msg->msg_xml ) return 1;   /* already done */
 
-	xmlNodePtr  message_node;
-	xmlNodePtr  body_node;
-	xmlNodePtr  thread_node;
-	xmlNodePtr  subject_node;
-	xmlNodePtr  error_node;
+	const char* body    = msg->body;
+	const char* subject = msg->subject;
+	const char* thread  = msg->thread;
 
-	xmlDocPtr   doc;
+	size_t body_len = body ? strlen( body ) : 0;
+	growing_buffer* buf = buffer_init( body_len + ( body_len >> 4 ) + 512 );
 
-	xmlKeepBlanksDefault(0);
+	OSRF_BUFFER_ADD_N( buf, "<message", 8 );
+	add_xml_attribute( buf, "to", msg->recipient );
+	add_xml_attribute( buf, "from", msg->sender );
+	add_xml_attribute( buf, "router_from", msg->router_from );
+	add_xml_attribute( buf, "router_to", msg->router_to );
+	add_xml_attribute( buf, "router_class", msg->router_class );
+	add_xml_attribute( buf, "router_command", msg->router_command );
+	add_xml_attribute( buf, "osrf_xid", msg->osrf_xid );
 
-	doc = xmlReadDoc( BAD_CAST "<message/>", NULL, NULL, XML_PARSE_NSCLEAN );
-	message_node = xmlDocGetRootElement(doc);
+	if( msg->broadcast )
+		add_xml_attribute( buf, "broadcast", "1" );
+
+	if( !( msg->is_error || ( thread && *thread ) || ( subject && *subject ) || body_len ) ) {
+		OSRF_BUFFER_ADD_N( buf, "/>", 2 );
+		msg->msg_xml = buffer_release( buf );
+		return 1;
+	}
+
+	OSRF_BUFFER_ADD_CHAR( buf, '>' );
 
 	if( msg->is_error ) {
-		error_node = xmlNewChild(message_node, NULL, BAD_CAST "error" , NULL );
-		xmlAddChild( message_node, error_node );
-		xmlNewProp( error_node, BAD_CAST "type", BAD_CAST msg->error_type );
 		char code_buf[16];
 		osrf_clearbuf( code_buf, sizeof(code_buf));
 		sprintf(code_buf, "%d", msg->error_code );
-		xmlNewProp( error_node, BAD_CAST "code", BAD_CAST code_buf  );
+		OSRF_BUFFER_ADD_N( buf, "<error", 6 );
+		add_xml_attribute( buf, "type", msg->error_type );
+		add_xml_attribute( buf, "code", code_buf );
+		OSRF_BUFFER_ADD_N( buf, "/>", 2 );
 	}
 
-	/* set from and to */
-	xmlNewProp( message_node, BAD_CAST "to", BAD_CAST msg->recipient );
-	xmlNewProp( message_node, BAD_CAST "from", BAD_CAST msg->sender );
-	xmlNewProp( message_node, BAD_CAST "router_from", BAD_CAST msg->router_from );
-	xmlNewProp( message_node, BAD_CAST "router_to", BAD_CAST msg->router_to );
-	xmlNewProp( message_node, BAD_CAST "router_class", BAD_CAST msg->router_class );
-	xmlNewProp( message_node, BAD_CAST "router_command", BAD_CAST msg->router_command );
-	xmlNewProp( message_node, BAD_CAST "osrf_xid", BAD_CAST msg->osrf_xid );
-
-	if( msg->broadcast )
-		xmlNewProp( message_node, BAD_CAST "broadcast", BAD_CAST "1" );
-
-	/* Now add nodes where appropriate */
-	char* body      = msg->body;
-	char* subject   = msg->subject;
-	char* thread    = msg->thread;
-
-	if( thread && *thread ) {
-		thread_node = xmlNewChild(message_node, NULL, (xmlChar*) "thread", NULL );
-		xmlNodePtr txt = xmlNewText((xmlChar*) thread);
-		xmlAddChild(thread_node, txt);
-		xmlAddChild(message_node, thread_node);
-	}
+	add_xml_text_element( buf, "thread", thread );
+	add_xml_text_element( buf, "subject", subject );
+	add_xml_text_element( buf, "body", body );
 
-	if( subject && *subject ) {
-		subject_node = xmlNewChild(message_node, NULL, (xmlChar*) "subject", NULL );
-		xmlNodePtr txt = xmlNewText((xmlChar*) subject);
-		xmlAddChild(subject_node, txt);
-		xmlAddChild( message_node, subject_node );
-	}
-
-	if( body && *body ) {
-		body_node = xmlNewChild(message_node, NULL, (xmlChar*) "body", NULL);
-		xmlNodePtr txt = xmlNewText((xmlChar*) body);
-		xmlAddChild(body_node, txt);
-		xmlAddChild( message_node, body_node );
-	}
-
-	// Export the xmlDoc to a string
-	xmlBufferPtr xmlbuf = xmlBufferCreate();
-	xmlNodeDump( xmlbuf, doc, xmlDocGetRootElement(doc), 0, 0);
-	msg->msg_xml = strdup((const char*) (xmlBufferContent(xmlbuf)));
-
-	xmlBufferFree(xmlbuf);
-	xmlFreeDoc( doc );
-	xmlCleanupParser();
+	OSRF_BUFFER_ADD_N( buf, "</message>", 10 );
+	msg->msg_xml = buffer_release( buf );
 
 	return 1;
 }
@@ -24,6 +24,9 @@ GNU General Public License for more details.
 #include <opensrf/utils.h>
 #include <opensrf/log.h>
 #include <errno.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /**
 	@brief A thin wrapper for malloc().
@@ -518,6 +521,127 @@ int buffer_add_char(growing_buffer* gb, char c ) {
 		return 0;
 }
 
+/** @brief The alphabet of base64 encoding (RFC 4648). */
+static const char base64_chars[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+	@brief Append the base64 encoding of some binary data to a growing_buffer.
+	@param gb A pointer to the growing_buffer.
+	@param data A pointer to the data to be encoded.
+	@param len How many bytes to encode.
+	@return If successful, the length of the resulting string; or if not, -1.
+
+	The encoding uses the standard alphabet, with '=' padding and no line breaks.
+	Since the result is plain text, it's a safe way to carry binary data in XML.
+*/
+int buffer_add_base64( growing_buffer* gb, const char* data, size_t len ) {
+	if( !( gb && data ) )
+		return -1;
+
+	const unsigned char* in = (const unsigned char*) data;
+	char quad[ 4 ];
+	size_t i = 0;
+
+	while( i + 3 <= len ) {
+		unsigned long n = ( in[ i ] << 16 ) | ( in[ i + 1 ] << 8 ) | in[ i + 2 ];
+		quad[ 0 ] = base64_chars[ ( n >> 18 ) & 0x3f ];
+		quad[ 1 ] = base64_chars[ ( n >> 12 ) & 0x3f ];
+		quad[ 2 ] = base64_chars[ ( n >> 6 ) & 0x3f ];
+		quad[ 3 ] = base64_chars[ n & 0x3f ];
+		if( buffer_add_n( gb, quad, 4 ) < 0 )
+			return -1;
+		i += 3;
+	}
+
+	if( i < len ) {
+		unsigned long n = in[ i ] << 16;
+		if( i + 1 < len )
+			n |= in[ i + 1 ] << 8;
+		quad[ 0 ] = base64_chars[ ( n >> 18 ) & 0x3f ];
+		quad[ 1 ] = base64_chars[ ( n >> 12 ) & 0x3f ];
+		quad[ 2 ] = ( i + 1 < len ) ? base64_chars[ ( n >> 6 ) & 0x3f ] : '=';
+		quad[ 3 ] = '=';
+		if( buffer_add_n( gb, quad, 4 ) < 0 )
+			return -1;
+	}
+
+	return gb->n_used;
+}
+
+/**
+	@brief Translate a base64 character into the six bits that it stands for.
+	@param c The character.
+	@return The value of the character, from 0 through 63; or -1 if it isn't a base64
+		character.
+*/
+static int base64_value( char c ) {
+	if( c >= 'A' && c <= 'Z' )
+		return c - 'A';
+	else if( c >= 'a' && c <= 'z' )
+		return c - 'a' + 26;
+	else if( c >= '0' && c <= '9' )
+		return c - '0' + 52;
+	else if( '+' == c )
+		return 62;
+	else if( '/' == c )
+		return 63;
+	else
+		return -1;
+}
+
+/**
+	@brief Decode base64 text, and append the resulting bytes to a growing_buffer.
+	@param gb A pointer to the growing_buffer.
+	@param text A pointer to the base64 text.
+	@param len The length of the text.
+	@return If successful, the length of the resulting contents; or -1 if the text is
+		not valid base64.
+
+	The length of the text must be a multiple of four, and padding may appear only in
+	the last group of four.  The decoded data may include nul bytes; use buffer_length()
+	to find out how much there is.
+*/
+int buffer_add_unbase64( growing_buffer* gb, const char* text, size_t len ) {
+	if( !( gb && text ) || len % 4 )
+		return -1;
+
+	size_t i;
+	for( i = 0; i < len; i += 4 ) {
+		int v0 = base64_value( text[ i ] );
+		int v1 = base64_value( text[ i + 1 ] );
+		if( v0 < 0 || v1 < 0 )
+			return -1;
+
+		char bytes[ 3 ];
+		size_t count = 1;
+		bytes[ 0 ] = ( v0 << 2 ) | ( v1 >> 4 );
+
+		if( i + 4 == len && '=' == text[ i + 2 ] ) {
+			if( '=' != text[ i + 3 ] )
+				return -1;
+		} else {
+			int v2 = base64_value( text[ i + 2 ] );
+			if( v2 < 0 )
+				return -1;
+			bytes[ 1 ] = ( ( v1 & 0x0f ) << 4 ) | ( v2 >> 2 );
+			count = 2;
+			if( !( i + 4 == len && '=' == text[ i + 3 ] ) ) {
+				int v3 = base64_value( text[ i + 3 ] );
+				if( v3 < 0 )
+					return -1;
+				bytes[ 2 ] = ( ( v2 & 0x03 ) << 6 ) | v3;
+				count = 3;
+			}
+		}
+
+		if( buffer_add_n( gb, bytes, count ) < 0 )
+			return -1;
+	}
+
+	return gb->n_used;
+}
+
 
 /**
 	@brief Translate a UTF8 string into escaped ASCII, suitable for JSON.
@@ -784,26 +908,291 @@ int osrfUtilsCheckFileDescriptor( int fd ) {
 	return 0;
 }
 
-size_t osrfXmlEscapingLength ( const char* str ) {
-	int extra = 0;
-	const char* s;
-	for (s = str; *s; ++s) {
-		switch (*s) {
-			case '>':
-			case '<':
-				extra += 3;
+/*
+	XML escaping.
+
+	The same engine serves two purposes: measuring how much longer a string will be once
+	it is XML-escaped (for deciding where to break a large response into chunks), and
+	actually escaping it (for building the outbound XMPP stanza).  Either way, most of
+	the text needs no escaping at all, so the engine skips over plain runs in bulk, and
+	only looks at characters one at a time where there's something to do.
+*/
+
+/** @brief Scan for the characters that count toward an escaped length. */
+#define XML_SCAN_MEASURE   0
+/** @brief Scan for the characters that need escaping in text content. */
+#define XML_SCAN_TEXT      1
+/** @brief Scan for the characters that need escaping in an attribute value. */
+#define XML_SCAN_ATTRIBUTE 2
+
+/**
+	@brief Find the first character that may call for XML escaping.
+	@param p Pointer to the first character to examine.
+	@param end Pointer to the end of the text.
+	@param mode XML_SCAN_MEASURE, XML_SCAN_TEXT, or XML_SCAN_ATTRIBUTE.
+	@return Pointer to the first character of interest, or @a end if there is none.
+
+	The characters of interest are '<', '>', and '&', plus:
+	- for XML_SCAN_MEASURE: double quote;
+	- for XML_SCAN_TEXT: carriage return;
+	- for XML_SCAN_ATTRIBUTE: double quote, carriage return, line feed, tab, and any
+	non-ASCII byte.
+
+	With SSE2 we examine sixteen bytes at a time, never reading past @a end.
+*/
+static inline const unsigned char* xml_scan( const unsigned char* p,
+		const unsigned char* end, int mode ) {
+#if defined(__SSE2__)
+	const __m128i lt = _mm_set1_epi8( '<' );
+	const __m128i gt = _mm_set1_epi8( '>' );
+	const __m128i amp = _mm_set1_epi8( '&' );
+	const __m128i quot = _mm_set1_epi8( '"' );
+	const __m128i cr = _mm_set1_epi8( '\r' );
+	const __m128i lf = _mm_set1_epi8( '\n' );
+	const __m128i tab = _mm_set1_epi8( '\t' );
+	while( end - p >= 16 ) {
+		__m128i block = _mm_loadu_si128( (const __m128i*) p );
+		__m128i hit = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( block, lt ),
+			_mm_cmpeq_epi8( block, gt ) ), _mm_cmpeq_epi8( block, amp ) );
+		if( mode != XML_SCAN_TEXT )
+			hit = _mm_or_si128( hit, _mm_cmpeq_epi8( block, quot ) );
+		if( mode != XML_SCAN_MEASURE )
+			hit = _mm_or_si128( hit, _mm_cmpeq_epi8( block, cr ) );
+		if( mode == XML_SCAN_ATTRIBUTE ) {
+			hit = _mm_or_si128( hit, _mm_cmpeq_epi8( block, lf ) );
+			hit = _mm_or_si128( hit, _mm_cmpeq_epi8( block, tab ) );
+			hit = _mm_or_si128( hit, block );   // high bit set for non-ASCII
+		}
+		int mask = _mm_movemask_epi8( hit );
+		if( mask )
+			return p + __builtin_ctz( mask );
+		p += 16;
+	}
+#endif
+	for( ; p < end; ++p ) {
+		switch( *p ) {
+			case '<' :
+			case '>' :
+			case '&' :
+				return p;
+			case '"' :
+				if( mode != XML_SCAN_TEXT )
+					return p;
 				break;
-			case '&':
-				extra += 4;
+			case '\r' :
+				if( mode != XML_SCAN_MEASURE )
+					return p;
 				break;
-			case '"':
-				extra += 11;
+			case '\n' :
+			case '\t' :
+				if( mode == XML_SCAN_ATTRIBUTE )
+					return p;
 				break;
-			default:
+			default :
+				if( mode == XML_SCAN_ATTRIBUTE && *p >= 0x80 )
+					return p;
 				break;
 		}
 	}
+	return p;
+}
 
-	return extra;
+/**
+	@brief Return the width of a character for purposes of estimating escaped length.
+	@param c The character.
+	@return How many bytes we budget for the character once it's escaped.
+
+	The weights are deliberately generous for a double quote, which typically picks up
+	further escaping on its way through the layers of an OSRF message.
+*/
+static inline size_t xml_escape_width( unsigned char c ) {
+	switch( c ) {
+		case '<' :
+		case '>' :
+			return 4;
+		case '&' :
+			return 5;
+		case '"' :
+			return 12;
+		default :
+			return 1;
+	}
+}
+
+/**
+	@brief Measure how much of a string fits within a limit once it is XML-escaped.
+	@param str Pointer to the text, which need not be nul-terminated.
+	@param len Length of the text.
+	@param limit Maximum escaped length.
+	@param width Pointer to a receiving size_t (may be NULL).
+	@return The number of leading bytes of @a str whose escaped length fits within @a limit.
+
+	The escaped length uses the same weights as osrfXmlEscapingLength().  Store the escaped
+	length of the bytes that fit in *@a width, if @a width is not NULL.
+
+	The scan stops as soon as the limit is reached, so it's cheap to ask whether something
+	fits even when the answer is no.
+*/
+size_t osrfXmlEscapeSpan( const char* str, size_t len, size_t limit, size_t* width ) {
+	const unsigned char* start = (const unsigned char*) str;
+	const unsigned char* end = start + len;
+	const unsigned char* p = start;
+	size_t used = 0;
+
+	while( p < end ) {
+		const unsigned char* stop = xml_scan( p, end, XML_SCAN_MEASURE );
+		size_t run = stop - p;
+		if( used + run > limit ) {
+			p += limit - used;
+			used = limit;
+			break;
+		}
+		used += run;
+		p = stop;
+		if( p == end )
+			break;
+
+		size_t w = xml_escape_width( *p );
+		if( used + w > limit )
+			break;
+		used += w;
+		++p;
+	}
+
+	if( width )
+		*width = used;
+	return p - start;
+}
+
+/**
+	@brief Estimate the additional length of a string once it is XML-escaped.
+	@param str Pointer to a nul-terminated string.
+	@return The number of bytes that escaping would add.
+
+	See osrfXmlEscapeSpan() for the weights.
+*/
+size_t osrfXmlEscapingLength ( const char* str ) {
+	size_t len = strlen( str );
+	size_t width;
+	osrfXmlEscapeSpan( str, len, (size_t) -1, &width );
+	return width - len;
+}
+
+/**
+	@brief Append a character reference for a non-ASCII UTF-8 character.
+	@param gb Pointer to the growing_buffer.
+	@param p Pointer to the lead byte of the character.
+	@param end Pointer to the end of the text.
+	@return The number of bytes consumed.
+
+	If the bytes don't form a valid UTF-8 encoding of a character allowed in XML, refer to
+	the lead byte by itself.
+*/
+static size_t add_xml_char_ref( growing_buffer* gb, const unsigned char* p,
+		const unsigned char* end ) {
+	unsigned long cp = *p;
+	size_t n = 1;
+
+	if( cp >= 0xC2 && cp <= 0xF4 ) {
+		size_t need = cp >= 0xF0 ? 4 : cp >= 0xE0 ? 3 : 2;
+		unsigned long code = cp & ( 0x3F >> ( need - 1 ) );
+		size_t i;
+		for( i = 1; i < need && p + i < end && ( p[ i ] & 0xC0 ) == 0x80; ++i )
+			code = ( code << 6 ) | ( p[ i ] & 0x3F );
+
+		if( i == need
+				&& !( need == 3 && code < 0x800 )
+				&& !( need == 4 && ( code < 0x10000 || code > 0x10FFFF ) )
+				&& !( code >= 0xD800 && code <= 0xDFFF )
+				&& code != 0xFFFE && code != 0xFFFF ) {
+			cp = code;
+			n = need;
+		}
+	}
+
+	buffer_fadd( gb, "&#x%lX;", cp );
+	return n;
+}
+
+/**
+	@brief Append a string to a growing_buffer, escaped for XML.
+	@param gb Pointer to the growing_buffer.
+	@param str Pointer to a nul-terminated string (may be NULL, meaning an empty string).
+	@param attribute Boolean; true if the string is to be an attribute value.
+	@return If successful, the length of the resulting string; or if not, -1.
+
+	See buffer_add_xml_escaped_n().
+*/
+int buffer_add_xml_escaped( growing_buffer* gb, const char* str, int attribute ) {
+	if( !gb )
+		return -1;
+	if( !str )
+		return gb->n_used;
+	return buffer_add_xml_escaped_n( gb, str, strlen( str ), attribute );
 }
 
+/**
+	@brief Append some text to a growing_buffer, escaped for XML.
+	@param gb Pointer to the growing_buffer.
+	@param str Pointer to the text, which need not be nul-terminated.
+	@param len Length of the text.
+	@param attribute Boolean; true if the text is to be an attribute value.
+	@return If successful, the length of the resulting string; or if not, -1.
+
+	In text content, replace '&', '<', and '>' with entity references, and carriage return
+	with a character reference.  In an attribute value, do likewise with double quotes,
+	and use character references for line feed, tab, and non-ASCII characters.
+
+	The output matches what libxml2 produces when it serializes the same content in a
+	document with no declared encoding.
+
+	Text content may be escaped a piece at a time, cut anywhere.  An attribute value
+	may be cut only between UTF-8 characters.
+*/
+int buffer_add_xml_escaped_n( growing_buffer* gb, const char* str, size_t len, int attribute ) {
+	if( !( gb && str ) )
+		return -1;
+
+	const unsigned char* p = (const unsigned char*) str;
+	const unsigned char* end = p + len;
+	int mode = attribute ? XML_SCAN_ATTRIBUTE : XML_SCAN_TEXT;
+
+	while( p < end ) {
+		const unsigned char* stop = xml_scan( p, end, mode );
+		if( stop > p )
+			OSRF_BUFFER_ADD_N( gb, (const char*) p, stop - p );
+		if( stop == end )
+			break;
+
+		p = stop;
+		switch( *p ) {
+			case '<' :
+				OSRF_BUFFER_ADD_N( gb, "&lt;", 4 );
+				break;
+			case '>' :
+				OSRF_BUFFER_ADD_N( gb, "&gt;", 4 );
+				break;
+			case '&' :
+				OSRF_BUFFER_ADD_N( gb, "&amp;", 5 );
+				break;
+			case '"' :
+				OSRF_BUFFER_ADD_N( gb, "&quot;", 6 );
+				break;
+			case '\r' :
+				OSRF_BUFFER_ADD_N( gb, "&#13;", 5 );
+				break;
+			case '\n' :
+				OSRF_BUFFER_ADD_N( gb, "&#10;", 5 );
+				break;
+			case '\t' :
+				OSRF_BUFFER_ADD_N( gb, "&#9;", 4 );
+				break;
+			default :
+				p += add_xml_char_ref( gb, p, end );
+				continue;
+		}
+		++p;
+	}
+
+	return gb->n_used;
+}
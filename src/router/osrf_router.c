@@ -5,6 +5,7 @@
 #include "opensrf/osrf_list.h"
 #include "opensrf/string_array.h"
 #include "opensrf/osrf_hash.h"
+#include "opensrf/osrf_string_set.h"
 #include "osrf_router.h"
 #include "opensrf/transport_client.h"
 #include "opensrf/transport_message.h"
@@ -42,10 +43,10 @@ struct osrfRouterStruct {
 	int port;             /**< Jabber's port number. */
 	volatile sig_atomic_t stop; /**< To be set by signal handler to interrupt main loop. */
 
-	/** Array of client domains that we allow to send requests through us. */
-	osrfStringArray* trustedClients;
-	/** Array of server domains that we allow to register, etc. with us. */
-	osrfStringArray* trustedServers;
+	/** Set of client domains that we allow to send requests through us. */
+	osrfStringSet* trustedClients;
+	/** Set of server domains that we allow to register, etc. with us. */
+	osrfStringSet* trustedServers;
 	/** List of osrfMessages to be returned from osrfMessageDeserialize() */
 	osrfList* message_list;
 
@@ -142,6 +143,9 @@ void router_stop( osrfRouter* router )
 	@param trustedServers Array of server domains that we allow to register, etc. with us.
 	@return Pointer to the newly allocated osrfRouter, or NULL upon error.
 
+	The osrfRouter takes ownership of the arrays of trusted domains, and frees them after
+	loading them into osrfStringSets for quick lookups.
+
 	Don't connect to Jabber yet.  We'll do that later, upon a call to osrfRouterConnect().
 
 	The calling code is responsible for freeing the osrfRouter by calling osrfRouterFree().
@@ -162,8 +166,10 @@ osrfRouter* osrfNewRouter(
 	router->port           = port;
 	router->stop           = 0;
 
-	router->trustedClients = trustedClients;
-	router->trustedServers = trustedServers;
+	router->trustedClients = osrfNewStringSetFromArray( trustedClients );
+	router->trustedServers = osrfNewStringSetFromArray( trustedServers );
+	osrfStringArrayFree( trustedClients );
+	osrfStringArrayFree( trustedServers );
 
 
 	router->classes = osrfNewHash();
@@ -289,7 +295,7 @@ static void osrfRouterHandleIncoming( osrfRouter* router ) {
 			char domain[len];
 			jid_get_domain( msg->sender, domain, len - 1 );
 
-			if(osrfStringArrayContains( router->trustedServers, domain)) {
+			if(osrfStringSetContains( router->trustedServers, domain)) {
 
 				// If there's a command, obey it.  Otherwise, treat
 				// the message as an app session level request.
@@ -339,7 +345,7 @@ static void osrfRouterClassHandleIncoming( osrfRouter* router, const char* class
 			char domain[len];
 			jid_get_domain( msg->sender, domain, len - 1 );
 
-			if(osrfStringArrayContains( router->trustedClients, domain )) {
+			if(osrfStringSetContains( router->trustedClients, domain )) {
 
 				if( msg->is_error )  {
 
@@ -453,7 +459,7 @@ static osrfRouterClass* osrfRouterAddClass( osrfRouter* router, const char* clas
 		return NULL;
 	}
 
-	osrfHashSet( router->classes, class, classname );
+	osrfHashSetLen( router->classes, class, classname, strlen( classname ) );
 	return class;
 }
 
@@ -473,7 +479,7 @@ static void osrfRouterClassAddNode( osrfRouterClass* rclass, const char* remoteI
 	node->lastMessage = NULL;
 	node->remoteId = strdup(remoteId);
 
-	osrfHashSet( rclass->nodes, node, remoteId );
+	osrfHashSetLen( rclass->nodes, node, remoteId, strlen( remoteId ) );
 }
 
 /**
@@ -612,7 +618,7 @@ static void osrfRouterClassHandleMessage(
 static void osrfRouterRemoveClass( osrfRouter* router, const char* classname ) {
 	if( router && router->classes && classname ) {
 		osrfLogInfo( OSRF_LOG_MARK, "Removing router class %s", classname );
-		osrfHashRemove( router->classes, classname );
+		osrfHashRemoveLen( router->classes, classname, strlen( classname ) );
 	}
 }
 
@@ -633,7 +639,7 @@ static void osrfRouterClassRemoveNode(
 
 	osrfRouterClass* class = osrfRouterFindClass( router, classname );
 	if( class ) {
-		osrfHashRemove( class->nodes, remoteId );
+		osrfHashRemoveLen( class->nodes, remoteId, strlen( remoteId ) );
 		if( osrfHashGetCount(class->nodes) == 0 ) {
 			osrfRouterRemoveClass( router, classname );
 		}
@@ -660,7 +666,7 @@ static void osrfRouterClassFree( char* classname, void* c ) {
 	osrfRouterNode* node;
 
 	while( (node = osrfHashIteratorNext(rclass->itr)) )
-		osrfHashRemove( rclass->nodes, node->remoteId );
+		osrfHashRemoveLen( rclass->nodes, node->remoteId, strlen( node->remoteId ) );
 
 	osrfHashIteratorFree(rclass->itr);
 	osrfHashFree(rclass->nodes);
@@ -701,8 +707,8 @@ void osrfRouterFree( osrfRouter* router ) {
 	free(router->resource);
 	free(router->password);
 
-	osrfStringArrayFree( router->trustedClients );
-	osrfStringArrayFree( router->trustedServers );
+	osrfStringSetFree( router->trustedClients );
+	osrfStringSetFree( router->trustedServers );
 	osrfListFree( router->message_list );
 
 	client_free( router->connection );
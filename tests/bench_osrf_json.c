@@ -0,0 +1,513 @@
+/**
+	@file bench_osrf_json.c
+	@brief Benchmark the JSON engine against representative OpenSRF payloads.
+
+	Synopsis:
+
+		bench_osrf_json  [ -t seconds ]  [ pattern [ ... ] ]
+
+	For each corpus and each operation, run the operation repeatedly for at least the
+	specified number of seconds (default 0.5), and report:
+
+	- MB/s: megabytes of JSON per second.  For the parsers, that's the input text; for
+	the serializer, the output text; for operations on jsonObject trees (cloning and
+	class encoding or decoding), the size of the tree's JSON text.
+	- ops/s: operations per second.
+	- allocs/op: calls to malloc(), calloc(), and realloc() per operation, if we can count
+	them (i.e. with glibc).
+
+	If any patterns are given, run only the measurements whose corpus name or operation
+	name contains one of them.
+
+	The corpora are built in memory, from a fixed pseudo-random seed, so that every run
+	measures the same thing:
+
+	- envelope: a typical REQUEST message, with an authtoken and a few parameters.
+	- fieldmapper: a RESULT carrying a wide array of class-hinted fieldmapper objects,
+	such as a copy search might return.
+	- deep: a RESULT carrying a hierarchy nested hundreds of levels deep.
+	- utf8: a RESULT carrying bibliographic text in many scripts.
+
+	Every corpus is a complete message, so that osrf_message_deserialize() can parse it
+	too.  The legacy parser gets the same tree written by legacy_jsonObjectToJSON().
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "opensrf/utils.h"
+#include "opensrf/osrf_json.h"
+#include "opensrf/osrf_legacy_json.h"
+#include "opensrf/osrf_message.h"
+
+/* ------------------------------------------------------------------------- */
+/* Allocation counting.  With glibc we can interpose on the allocator, and pass the
+   calls along to the real one. */
+
+#ifdef __GLIBC__
+#define COUNT_ALLOCS 1
+
+extern void* __libc_malloc( size_t size );
+extern void* __libc_calloc( size_t nmemb, size_t size );
+extern void* __libc_realloc( void* ptr, size_t size );
+
+static unsigned long long alloc_count = 0;
+
+void* malloc( size_t size ) {
+	++alloc_count;
+	return __libc_malloc( size );
+}
+
+void* calloc( size_t nmemb, size_t size ) {
+	++alloc_count;
+	return __libc_calloc( nmemb, size );
+}
+
+void* realloc( void* ptr, size_t size ) {
+	++alloc_count;
+	return __libc_realloc( ptr, size );
+}
+#else
+static unsigned long long alloc_count = 0;
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+/**
+	@brief One payload, in all the forms that the operations need.
+*/
+typedef struct {
+	const char* name;        /**< Name of the corpus, for reporting and filtering. */
+	char* json;              /**< The message as jsonObjectToJSON() writes it. */
+	char* legacy;            /**< The message as legacy_jsonObjectToJSON() writes it. */
+	jsonObject* tree;        /**< The message with class names decoded. */
+	jsonObject* raw_tree;    /**< The message with class hints left as hashes. */
+} Corpus;
+
+/**
+	@brief An operation to be timed.
+
+	The function performs the operation once on a Corpus, and returns the number of bytes
+	of JSON that it accounts for.
+*/
+typedef struct {
+	const char* name;
+	size_t (*run)( const Corpus* corpus );
+} Operation;
+
+static jsonObject* make_envelope( void );
+static jsonObject* make_fieldmapper( void );
+static jsonObject* make_deep( void );
+static jsonObject* make_utf8( void );
+static jsonObject* wrap_result( jsonObject* content );
+static void load_corpus( Corpus* corpus, const char* name, jsonObject* tree );
+static void free_corpus( Corpus* corpus );
+static unsigned next_random( void );
+
+static size_t run_parse( const Corpus* corpus );
+static size_t run_parse_raw( const Corpus* corpus );
+static size_t run_to_json( const Corpus* corpus );
+static size_t run_clone( const Corpus* corpus );
+static size_t run_encode_class( const Corpus* corpus );
+static size_t run_decode_class( const Corpus* corpus );
+static size_t run_legacy_parse( const Corpus* corpus );
+static size_t run_deserialize( const Corpus* corpus );
+
+static void measure( const Corpus* corpus, const Operation* op, double min_seconds );
+static double now( void );
+static int selected( int argc, char* argv[], const Corpus* corpus, const Operation* op );
+
+static const Operation operations[] = {
+	{ "jsonParse",                 run_parse },
+	{ "jsonParseRaw",              run_parse_raw },
+	{ "jsonObjectToJSON",          run_to_json },
+	{ "jsonObjectClone",           run_clone },
+	{ "jsonObjectEncodeClass",     run_encode_class },
+	{ "jsonObjectDecodeClass",     run_decode_class },
+	{ "legacy_jsonParseString",    run_legacy_parse },
+	{ "osrf_message_deserialize",  run_deserialize }
+};
+
+#define OPERATION_COUNT ( sizeof( operations ) / sizeof( operations[ 0 ] ) )
+#define CORPUS_COUNT 4
+
+/**
+	@brief The usual.
+	@param argc Number of command line parameters, plus one.
+	@param argv Pointer to ragged array representing the command line.
+	@return EXIT_SUCCESS on success, or EXIT_FAILURE upon failure.
+*/
+int main( int argc, char* argv[] ) {
+
+	double min_seconds = 0.5;
+
+	int opt;
+	while( (opt = getopt( argc, argv, "t:" )) != -1 ) {
+		if( 't' == opt && atof( optarg ) > 0 )
+			min_seconds = atof( optarg );
+		else {
+			fprintf( stderr, "Usage: %s [ -t seconds ] [ pattern [ ... ] ]\n", argv[ 0 ] );
+			return EXIT_FAILURE;
+		}
+	}
+
+	Corpus corpora[ CORPUS_COUNT ];
+	load_corpus( &corpora[ 0 ], "envelope", make_envelope() );
+	load_corpus( &corpora[ 1 ], "fieldmapper", wrap_result( make_fieldmapper() ) );
+	load_corpus( &corpora[ 2 ], "deep", wrap_result( make_deep() ) );
+	load_corpus( &corpora[ 3 ], "utf8", wrap_result( make_utf8() ) );
+
+	int i;
+	for( i = 0; i < CORPUS_COUNT; ++i )
+		printf( "%-12s %9lu bytes JSON, %9lu bytes legacy JSON\n", corpora[ i ].name,
+			(unsigned long) strlen( corpora[ i ].json ),
+			(unsigned long) strlen( corpora[ i ].legacy ) );
+
+	printf( "\n%-12s %-26s %10s %12s %10s\n",
+		"corpus", "operation", "MB/s", "ops/s", "allocs/op" );
+
+	for( i = 0; i < CORPUS_COUNT; ++i ) {
+		size_t j;
+		for( j = 0; j < OPERATION_COUNT; ++j ) {
+			if( selected( argc, argv, &corpora[ i ], &operations[ j ] ) )
+				measure( &corpora[ i ], &operations[ j ], min_seconds );
+		}
+	}
+
+	for( i = 0; i < CORPUS_COUNT; ++i )
+		free_corpus( &corpora[ i ] );
+
+	return EXIT_SUCCESS;
+}
+
+/**
+	@brief Time an operation on a corpus, and print the results.
+	@param corpus Pointer to the Corpus.
+	@param op Pointer to the Operation.
+	@param min_seconds The minimum time to spend on the measurement.
+
+	After one untimed run to warm up caches and free lists, run the operation in batches
+	of doubling size until the total time reaches @a min_seconds.
+*/
+static void measure( const Corpus* corpus, const Operation* op, double min_seconds ) {
+
+	op->run( corpus );
+
+	unsigned long long allocs = alloc_count;
+	double start = now();
+	double elapsed = 0.0;
+	unsigned long ops = 0;
+	unsigned long batch = 1;
+	double bytes = 0.0;
+
+	while( elapsed < min_seconds ) {
+		unsigned long k;
+		for( k = 0; k < batch; ++k )
+			bytes += op->run( corpus );
+		ops += batch;
+		batch *= 2;
+		elapsed = now() - start;
+	}
+
+	allocs = alloc_count - allocs;
+
+	printf( "%-12s %-26s %10.1f %12.0f ", corpus->name, op->name,
+		bytes / ( 1024.0 * 1024.0 ) / elapsed, ops / elapsed );
+#ifdef COUNT_ALLOCS
+	printf( "%10.1f\n", (double) allocs / ops );
+#else
+	printf( "%10s\n", "n/a" );
+#endif
+	fflush( stdout );
+}
+
+/**
+	@brief Get the current time from a monotonic clock.
+	@return The time in seconds.
+*/
+static double now( void ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+	@brief Decide whether the command line asks for a given measurement.
+	@param argc Number of command line parameters, plus one.
+	@param argv Pointer to ragged array representing the command line.
+	@param corpus Pointer to the Corpus.
+	@param op Pointer to the Operation.
+	@return 1 if there are no patterns, or if any pattern occurs in the name of the corpus
+		or the operation; otherwise 0.
+*/
+static int selected( int argc, char* argv[], const Corpus* corpus, const Operation* op ) {
+	if( optind >= argc )
+		return 1;
+
+	int i;
+	for( i = optind; i < argc; ++i ) {
+		if( strstr( corpus->name, argv[ i ] ) || strstr( op->name, argv[ i ] ) )
+			return 1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* The operations */
+
+static size_t run_parse( const Corpus* corpus ) {
+	jsonObjectFree( jsonParse( corpus->json ) );
+	return strlen( corpus->json );
+}
+
+static size_t run_parse_raw( const Corpus* corpus ) {
+	jsonObjectFree( jsonParseRaw( corpus->json ) );
+	return strlen( corpus->json );
+}
+
+static size_t run_to_json( const Corpus* corpus ) {
+	char* json = jsonObjectToJSON( corpus->tree );
+	size_t len = strlen( json );
+	free( json );
+	return len;
+}
+
+static size_t run_clone( const Corpus* corpus ) {
+	jsonObjectFree( jsonObjectClone( corpus->tree ) );
+	return strlen( corpus->json );
+}
+
+static size_t run_encode_class( const Corpus* corpus ) {
+	jsonObjectFree( jsonObjectEncodeClass( corpus->tree ) );
+	return strlen( corpus->json );
+}
+
+static size_t run_decode_class( const Corpus* corpus ) {
+	jsonObjectFree( jsonObjectDecodeClass( corpus->raw_tree ) );
+	return strlen( corpus->json );
+}
+
+static size_t run_legacy_parse( const Corpus* corpus ) {
+	jsonObjectFree( legacy_jsonParseString( corpus->legacy ) );
+	return strlen( corpus->legacy );
+}
+
+static size_t run_deserialize( const Corpus* corpus ) {
+	osrfMessage* msgs[ 16 ];
+	int count = osrf_message_deserialize( corpus->json, msgs, 16 );
+	int i;
+	for( i = 0; i < count; ++i )
+		osrfMessageFree( msgs[ i ] );
+	return strlen( corpus->json );
+}
+
+/* ------------------------------------------------------------------------- */
+/* The corpora */
+
+/**
+	@brief Fill in a Corpus from a jsonObject tree.
+	@param corpus Pointer to the Corpus.
+	@param name Name of the corpus.
+	@param tree Pointer to the message, with class names decoded.  The Corpus takes
+		ownership of it.
+*/
+static void load_corpus( Corpus* corpus, const char* name, jsonObject* tree ) {
+	corpus->name = name;
+	corpus->tree = tree;
+	corpus->json = jsonObjectToJSON( tree );
+	corpus->legacy = legacy_jsonObjectToJSON( tree );
+	corpus->raw_tree = jsonParseRaw( corpus->json );
+}
+
+/**
+	@brief Free everything in a Corpus.
+	@param corpus Pointer to the Corpus.
+*/
+static void free_corpus( Corpus* corpus ) {
+	jsonObjectFree( corpus->tree );
+	jsonObjectFree( corpus->raw_tree );
+	free( corpus->json );
+	free( corpus->legacy );
+}
+
+/**
+	@brief Generate pseudo-random numbers, the same ones every time.
+	@return The next number in the sequence.
+*/
+static unsigned next_random( void ) {
+	static unsigned long long state = 0x2545F4914F6CDD1DULL;
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return (unsigned) ( state >> 16 );
+}
+
+/**
+	@brief Build a small REQUEST message.
+	@return Pointer to a message array holding one osrfMessage.
+*/
+static jsonObject* make_envelope( void ) {
+	return jsonParse(
+		"[{\"__c\":\"osrfMessage\",\"__p\":{\"threadTrace\":\"3\",\"type\":\"REQUEST\","
+		"\"locale\":\"en-US\",\"tz\":\"America/New_York\",\"api_level\":1,"
+		"\"ingress\":\"opensrf\",\"payload\":{\"__c\":\"osrfMethod\",\"__p\":{"
+		"\"method\":\"open-ils.circ.checkout.full\",\"params\":["
+		"\"5f3c1a8e2d4b6f7a9c0e1d2b3a4f5e6d\","
+		"{\"patron_id\":1045221,\"copy_barcode\":\"31234001234567\","
+		"\"permit_override\":false,\"due_date\":null,\"checkout_time\":"
+		"\"2024-03-01T14:22:07-0500\",\"circ_lib\":4}]}}}}]" );
+}
+
+/**
+	@brief Build an array of fieldmapper objects, as from a copy search.
+	@return Pointer to an array of 400 "acp" objects, each carrying a fleshed "acn".
+
+	A fieldmapper object is an array of field values with a class hint, so the array is
+	wide rather than deep.
+*/
+static jsonObject* make_fieldmapper( void ) {
+	static const char* statuses[] = { "0", "1", "7", "11", "15" };
+	char buf[ 64 ];
+	jsonObject* list = jsonNewObjectType( JSON_ARRAY );
+
+	int i;
+	for( i = 0; i < 400; ++i ) {
+		jsonObject* copy = jsonNewObjectType( JSON_ARRAY );
+		int field;
+		for( field = 0; field < 40; ++field ) {
+			jsonObject* value;
+			switch( next_random() % 6 ) {
+				case 0 :
+					value = jsonNewObject( NULL );
+					break;
+				case 1 :
+					value = jsonNewObject( next_random() % 2 ? "t" : "f" );
+					break;
+				case 2 :
+					value = jsonNewNumberObject( next_random() % 2000000 );
+					break;
+				case 3 :
+					snprintf( buf, sizeof( buf ), "2024-%02u-%02uT%02u:%02u:%02u-0500",
+						next_random() % 12 + 1, next_random() % 28 + 1, next_random() % 24,
+						next_random() % 60, next_random() % 60 );
+					value = jsonNewObject( buf );
+					break;
+				case 4 :
+					snprintf( buf, sizeof( buf ), "3123400%07u", next_random() % 10000000 );
+					value = jsonNewObject( buf );
+					break;
+				default :
+					value = jsonNewObject( statuses[ next_random() % 5 ] );
+					break;
+			}
+			jsonObjectPush( copy, value );
+		}
+
+		jsonObject* call_number = jsonNewObjectType( JSON_ARRAY );
+		jsonObjectPush( call_number, jsonNewNumberObject( next_random() % 500000 ) );
+		snprintf( buf, sizeof( buf ), "%u.%u SMI", next_random() % 1000, next_random() % 100 );
+		jsonObjectPush( call_number, jsonNewObject( buf ) );
+		jsonObjectPush( call_number, jsonNewNumberObject( next_random() % 300 ) );
+		jsonObjectPush( call_number, jsonNewObject( "f" ) );
+		jsonObjectSetClass( call_number, "acn" );
+		jsonObjectSetIndex( copy, 5, call_number );
+
+		jsonObjectSetClass( copy, "acp" );
+		jsonObjectPush( list, copy );
+	}
+
+	return list;
+}
+
+/**
+	@brief Build a deeply nested hierarchy, like an org unit tree fleshed all the way down.
+	@return Pointer to a chain of 300 nested "aou" objects.
+*/
+static jsonObject* make_deep( void ) {
+	char buf[ 64 ];
+	jsonObject* node = NULL;
+
+	int depth;
+	for( depth = 300; depth > 0; --depth ) {
+		jsonObject* org = jsonNewObjectType( JSON_HASH );
+		jsonObjectSetKey( org, "id", jsonNewNumberObject( depth ) );
+		snprintf( buf, sizeof( buf ), "Branch %d", depth );
+		jsonObjectSetKey( org, "name", jsonNewObject( buf ) );
+		jsonObjectSetKey( org, "opac_visible", jsonNewObject( "t" ) );
+		jsonObject* children = jsonNewObjectType( JSON_ARRAY );
+		if( node )
+			jsonObjectPush( children, node );
+		jsonObjectSetKey( org, "children", children );
+		jsonObjectSetClass( org, "aou" );
+		node = org;
+	}
+
+	return node;
+}
+
+/**
+	@brief Build a list of bibliographic records in a mixture of scripts.
+	@return Pointer to an array of 300 records.
+
+	The serializer escapes every non-ASCII character, so parsing this corpus exercises
+	the decoding of \\u escapes, including surrogate pairs.
+*/
+static jsonObject* make_utf8( void ) {
+	static const char* titles[] = {
+		"Les Misérables : édition illustrée",
+		"Война и мир. Том первый",
+		"日本語の文法と語彙の研究",
+		"Η Οδύσσεια του Ομήρου",
+		"كتاب الأغاني",
+		"한국어 문법 사전",
+		"Ein \"Märchen\" für Kinder\tund Erwachsene",
+		"Emoji in catalogs \xF0\x9F\x93\x9A \xF0\x9F\x8C\x8D"
+	};
+	static const char* authors[] = {
+		"Hugo, Victor", "Толстой, Лев Николаевич", "山田太郎", "Ὅμηρος", "Zoë Ångström"
+	};
+	char buf[ 64 ];
+	jsonObject* list = jsonNewObjectType( JSON_ARRAY );
+
+	int i;
+	for( i = 0; i < 300; ++i ) {
+		jsonObject* rec = jsonNewObjectType( JSON_HASH );
+		jsonObjectSetKey( rec, "id", jsonNewNumberObject( 100000 + i ) );
+		jsonObjectSetKey( rec, "title", jsonNewObject( titles[ next_random() % 8 ] ) );
+		jsonObjectSetKey( rec, "author", jsonNewObject( authors[ next_random() % 5 ] ) );
+		snprintf( buf, sizeof( buf ), "978-%u-%05u-%03u-%u", next_random() % 10,
+			next_random() % 100000, next_random() % 1000, next_random() % 10 );
+		jsonObjectSetKey( rec, "isbn", jsonNewObject( buf ) );
+		jsonObjectSetKey( rec, "summary", jsonNewObject( titles[ next_random() % 8 ] ) );
+		jsonObjectSetClass( rec, "mvr" );
+		jsonObjectPush( list, rec );
+	}
+
+	return list;
+}
+
+/**
+	@brief Wrap content in a RESULT message, as a server would return it.
+	@param content Pointer to the content.  The message takes ownership of it.
+	@return Pointer to a message array holding one osrfMessage.
+*/
+static jsonObject* wrap_result( jsonObject* content ) {
+	jsonObject* result = jsonNewObjectType( JSON_HASH );
+	jsonObjectSetKey( result, "status", jsonNewObject( "OK" ) );
+	jsonObjectSetKey( result, "statusCode", jsonNewNumberObject( 200 ) );
+	jsonObjectSetKey( result, "content", content );
+	jsonObjectSetClass( result, "osrfResult" );
+
+	jsonObject* msg = jsonNewObjectType( JSON_HASH );
+	jsonObjectSetKey( msg, "threadTrace", jsonNewObject( "3" ) );
+	jsonObjectSetKey( msg, "type", jsonNewObject( "RESULT" ) );
+	jsonObjectSetKey( msg, "locale", jsonNewObject( "en-US" ) );
+	jsonObjectSetKey( msg, "payload", result );
+	jsonObjectSetClass( msg, "osrfMessage" );
+
+	jsonObject* envelope = jsonNewObjectType( JSON_ARRAY );
+	jsonObjectPush( envelope, msg );
+	return envelope;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <check.h>
+#include "opensrf/osrf_app_session.h"
+
+#define SESSION_THREADS 4
+#define SESSIONS_PER_THREAD 200
+
+transport_client a_client;
+
+//Set up the test fixture
+void setup(void) {
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  osrfAppSessionCleanup();
+}
+
+// Stub functions to stand in for the transport and settings that
+// osrf_app_server_session_init() would otherwise need (to isolate system under test)
+
+transport_client* osrfSystemGetTransportClient( void ) {
+  return &a_client;
+}
+
+char* osrf_settings_host_value(const char* format, ...) {
+  return NULL;
+}
+
+/*
+ * Register a batch of sessions, look each one up, and remove them again, twice over.
+ * Returns the number of lookups that came back wrong.
+*/
+static void* churn_sessions(void *arg) {
+  long t = (long) arg;
+  long errors = 0;
+  osrfAppSession *sessions[SESSIONS_PER_THREAD];
+  char id[64];
+  int round, i;
+
+  for (round = 0; round < 2; round++) {
+    for (i = 0; i < SESSIONS_PER_THREAD; i++) {
+      snprintf(id, sizeof(id), "session.%ld.%d", t, i);
+      sessions[i] = osrf_app_server_session_init(id, "opensrf.test", "client@test/1");
+      if (!sessions[i])
+        return (void*) -1L;
+    }
+
+    for (i = 0; i < SESSIONS_PER_THREAD; i++) {
+      snprintf(id, sizeof(id), "session.%ld.%d", t, i);
+      if (osrf_app_session_find_session(id) != sessions[i])
+        ++errors;
+    }
+
+    for (i = 0; i < SESSIONS_PER_THREAD; i++) {
+      osrfAppSessionFree(sessions[i]);
+      snprintf(id, sizeof(id), "session.%ld.%d", t, i);
+      if (osrf_app_session_find_session(id) != NULL)
+        ++errors;
+    }
+  }
+
+  return (void*) errors;
+}
+
+//Tests
+
+START_TEST(test_osrf_app_session_threaded_cache)
+  pthread_t threads[SESSION_THREADS];
+  long t;
+  for (t = 0; t < SESSION_THREADS; t++)
+    fail_unless(pthread_create(&threads[t], NULL, churn_sessions, (void*) t) == 0,
+        "pthread_create should succeed");
+  for (t = 0; t < SESSION_THREADS; t++) {
+    void *errors;
+    pthread_join(threads[t], &errors);
+    fail_unless(errors == NULL,
+        "Each thread should find exactly the sessions it registered");
+  }
+
+  fail_unless(osrf_app_session_find_session("session.0.0") == NULL,
+      "The session cache should be empty once every session is freed");
+END_TEST
+
+//END Tests
+
+Suite *osrf_app_session_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_app_session");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrf_app_session_threaded_cache);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_app_session_suite());
+}
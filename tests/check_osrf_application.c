@@ -0,0 +1,67 @@
+#include <check.h>
+#include "opensrf/osrf_application.h"
+
+// Private to osrf_application.c
+#define OSRF_METHOD_ATOMIC 4
+
+osrfMethod method;
+osrfMethodContext ctx;
+
+//Set up the test fixture
+void setup(void) {
+  method.name = "opensrf.test.atomic";
+  method.options = OSRF_METHOD_ATOMIC;
+  ctx.session = NULL;
+  ctx.method = &method;
+  ctx.params = NULL;
+  ctx.request = 1;
+  ctx.responses = NULL;
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  jsonObjectFree(ctx.responses);
+}
+
+//Tests
+
+START_TEST(test_osrfAppRespond_atomic_reuse)
+  // A method may fill one object, respond with it, and refill it for the next response
+  jsonObject *row = jsonNewObjectType(JSON_HASH);
+  int i;
+  for (i = 0; i < 3; i++) {
+    jsonObjectSetKey(row, "id", jsonNewNumberObject(i));
+    fail_unless(osrfAppRespond(&ctx, row) == 0,
+        "osrfAppRespond should cache a response for an atomic method");
+  }
+  jsonObjectFree(row);
+
+  fail_unless(ctx.responses && ctx.responses->size == 3,
+      "osrfAppRespond should cache every response for an atomic method");
+  for (i = 0; i < 3; i++) {
+    const jsonObject *id = jsonObjectGetKeyConst(jsonObjectGetIndex(ctx.responses, i), "id");
+    fail_unless(jsonObjectGetNumber(id) == i,
+        "Each cached response should keep the value it was sent with");
+  }
+END_TEST
+
+//END Tests
+
+Suite *osrf_application_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_application");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrfAppRespond_atomic_reuse);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_application_suite());
+}
@@ -0,0 +1,280 @@
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include "opensrf/osrf_hash.h"
+
+osrfHash *testOsrfHash;
+int globalItem1 = 7;
+int globalItem2 = 11;
+int globalItem3 = 15;
+
+//Keep track of how many items have been freed by the callback
+unsigned int freedItemsSize;
+
+//Define a custom freeing function for hash items
+void osrfCustomHashFree(char *key, void *item) {
+  freedItemsSize++;
+}
+
+//Set up the test fixture
+void setup(void) {
+  freedItemsSize = 0;
+  testOsrfHash = osrfNewHash();
+  osrfHashSet(testOsrfHash, &globalItem1, "one");
+  osrfHashSet(testOsrfHash, &globalItem2, "two");
+  osrfHashSet(testOsrfHash, &globalItem3, "three");
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  osrfHashFree(testOsrfHash);
+}
+
+// BEGIN TESTS
+
+START_TEST(test_osrf_hash_osrfHashSet)
+  fail_unless(osrfHashSet(NULL, &globalItem1, "one") == NULL,
+      "osrfHashSet should return NULL if the hash is NULL");
+  fail_unless(osrfHashSet(testOsrfHash, NULL, "one") == NULL,
+      "osrfHashSet should return NULL if the item is NULL");
+  fail_unless(osrfHashSet(testOsrfHash, &globalItem3, "one") == &globalItem1,
+      "osrfHashSet should return the item that it replaces");
+  fail_unless(osrfHashGet(testOsrfHash, "one") == &globalItem3,
+      "osrfHashSet should replace an existing item");
+  fail_unless(osrfHashGetCount(testOsrfHash) == 3,
+      "Replacing an item should not change the count");
+
+  osrfHashSet(testOsrfHash, &globalItem1, "key_%d", 4);
+  fail_unless(osrfHashGet(testOsrfHash, "key_4") == &globalItem1,
+      "osrfHashSet should expand a format string into the key");
+END_TEST
+
+START_TEST(test_osrf_hash_osrfHashGet)
+  fail_unless(osrfHashGet(testOsrfHash, "two") == &globalItem2,
+      "osrfHashGet should find a stored item");
+  fail_unless(osrfHashGet(testOsrfHash, "four") == NULL,
+      "osrfHashGet should return NULL for a missing key");
+  fail_unless(osrfHashGetFmt(testOsrfHash, "t%s", "hree") == &globalItem3,
+      "osrfHashGetFmt should expand a format string into the key");
+END_TEST
+
+START_TEST(test_osrf_hash_osrfHashRemove)
+  osrfHashSetCallback(testOsrfHash, osrfCustomHashFree);
+  fail_unless(osrfHashRemove(testOsrfHash, "two") == NULL,
+      "osrfHashRemove should return NULL when there is a callback");
+  fail_unless(freedItemsSize == 1, "osrfHashRemove should call the callback");
+  fail_unless(osrfHashGet(testOsrfHash, "two") == NULL,
+      "osrfHashRemove should remove the item");
+  fail_unless(osrfHashGetCount(testOsrfHash) == 2,
+      "osrfHashRemove should decrement the count");
+  fail_unless(osrfHashExtract(testOsrfHash, "three") == &globalItem3,
+      "osrfHashExtract should return the item");
+  fail_unless(freedItemsSize == 1, "osrfHashExtract should not call the callback");
+  fail_unless(osrfHashRemove(testOsrfHash, "three") == NULL,
+      "osrfHashRemove should return NULL for a missing key");
+END_TEST
+
+START_TEST(test_osrf_hash_largeHash)
+  // Enough keys to need an index, several times over
+  osrfHash *hash = osrfNewHash();
+  char key[32];
+  int i;
+  for (i = 0; i < 2000; i++) {
+    snprintf(key, sizeof(key), "open-ils.app_%d", i);
+    osrfHashSet(hash, &globalItem1 + (i % 3), key);
+  }
+  fail_unless(osrfHashGetCount(hash) == 2000, "A large osrfHash should hold every item");
+  for (i = 0; i < 2000; i++) {
+    snprintf(key, sizeof(key), "open-ils.app_%d", i);
+    fail_unless(osrfHashGet(hash, key) == &globalItem1 + (i % 3),
+        "A large osrfHash should find every item");
+  }
+  fail_unless(osrfHashGet(hash, "open-ils.app_2000") == NULL,
+      "A large osrfHash should not find a missing key");
+
+  // Iteration follows the order of insertion
+  osrfStringArray *keys = osrfHashKeys(hash);
+  fail_unless(keys->size == 2000, "osrfHashKeys should return every key");
+  fail_unless(strcmp(osrfStringArrayGetString(keys, 1234), "open-ils.app_1234") == 0,
+      "osrfHashKeys should return the keys in order of insertion");
+  osrfStringArrayFree(keys);
+  osrfHashFree(hash);
+END_TEST
+
+START_TEST(test_osrf_hash_turnover)
+  // A hash whose entries come and go, like a session cache
+  osrfHash *hash = osrfNewHash();
+  osrfHashSetCallback(hash, osrfCustomHashFree);
+  char key[32];
+  int i;
+  for (i = 0; i < 100000; i++) {
+    snprintf(key, sizeof(key), "session_%d", i);
+    osrfHashSet(hash, &globalItem1, key);
+    if (i >= 20) {
+      snprintf(key, sizeof(key), "session_%d", i - 20);
+      osrfHashRemove(hash, key);
+    }
+  }
+  fail_unless(osrfHashGetCount(hash) == 20, "The count should reflect the turnover");
+  fail_unless(freedItemsSize == 100000 - 20, "Every removed item should be freed");
+  fail_unless(osrfHashGet(hash, "session_99979") == NULL,
+      "A removed key should stay removed");
+  fail_unless(osrfHashGet(hash, "session_99980") == &globalItem1,
+      "The remaining keys should be found");
+
+  // The survivors remain in order of insertion
+  osrfHashIterator *itr = osrfNewHashIterator(hash);
+  i = 99980;
+  while (osrfHashIteratorNext(itr)) {
+    snprintf(key, sizeof(key), "session_%d", i++);
+    fail_unless(strcmp(osrfHashIteratorKey(itr), key) == 0,
+        "Turnover should not disturb the order of insertion");
+  }
+  fail_unless(i == 100000, "The iterator should visit every survivor");
+  osrfHashIteratorFree(itr);
+  osrfHashFree(hash);
+END_TEST
+
+START_TEST(test_osrf_hash_osrfHashIterator)
+  osrfHashIterator *itr = osrfNewHashIterator(testOsrfHash);
+  fail_unless(osrfHashIteratorNext(itr) == &globalItem1,
+      "osrfHashIteratorNext should return the first item");
+  fail_unless(strcmp(osrfHashIteratorKey(itr), "one") == 0,
+      "osrfHashIteratorKey should return the current key");
+
+  // Freeing another iterator leaves this one's slots in place
+  osrfHashIteratorFree(osrfNewHashIterator(testOsrfHash));
+
+  // Removing the current entry and adding others doesn't derail the iterator
+  osrfHashRemove(testOsrfHash, "one");
+  char key[32];
+  int i;
+  for (i = 0; i < 8; i++) {
+    snprintf(key, sizeof(key), "churn%d", i);
+    osrfHashSet(testOsrfHash, &globalItem1, key);
+    osrfHashRemove(testOsrfHash, key);
+  }
+  for (i = 0; i < 40; i++) {
+    snprintf(key, sizeof(key), "extra%d", i);
+    osrfHashSet(testOsrfHash, &globalItem1, key);
+    if (i % 2) {
+      snprintf(key, sizeof(key), "extra%d", i - 1);
+      osrfHashRemove(testOsrfHash, key);
+    }
+  }
+  fail_unless(osrfHashIteratorNext(itr) == &globalItem2,
+      "The iterator should advance past a removed entry");
+  fail_unless(osrfHashIteratorNext(itr) == &globalItem3,
+      "The iterator should keep its place while the hash changes");
+  int count = 0;
+  while (osrfHashIteratorNext(itr))
+    count++;
+  fail_unless(count == 20, "The iterator should visit entries added during the traversal");
+  fail_unless(!osrfHashIteratorHasNext(itr), "The iterator should be exhausted");
+
+  osrfHashIteratorReset(itr);
+  fail_unless(osrfHashIteratorKey(itr) == NULL,
+      "osrfHashIteratorKey should return NULL after a reset");
+  fail_unless(osrfHashIteratorNext(itr) == &globalItem2,
+      "osrfHashIteratorReset should return to the first remaining item");
+  osrfHashIteratorFree(itr);
+END_TEST
+
+START_TEST(test_osrf_hash_osrfHashIteratorFree)
+  osrfHash *hash = osrfNewHash();
+  osrfHashSet(hash, &globalItem1, "one");
+  osrfHashIterator *first = osrfNewHashIterator(hash);
+  osrfHashIterator *second = osrfNewHashIterator(hash);
+  osrfHashIterator *third = osrfNewHashIterator(hash);
+
+  // Iterators may be freed in any order, before or after the hash
+  osrfHashIteratorFree(second);
+  osrfHashFree(hash);
+  fail_unless(osrfHashIteratorNext(first) == NULL,
+      "An iterator for a freed hash should return nothing more");
+  fail_unless(osrfHashIteratorKey(third) == NULL,
+      "An iterator for a freed hash should have no current key");
+  osrfHashIteratorFree(third);
+  osrfHashIteratorFree(first);
+END_TEST
+
+START_TEST(test_osrf_hash_osrfHashSetLen)
+  // The key may be part of a longer string, and may contain a percent sign
+  const char *jid = "router@private.localhost/open-ils.%cstore";
+  fail_unless(osrfHashSetLen(testOsrfHash, &globalItem1, jid, 6) == NULL,
+      "osrfHashSetLen should return NULL for a new key");
+  fail_unless(osrfHashGet(testOsrfHash, "router") == &globalItem1,
+      "osrfHashSetLen should store only the first len characters of the key");
+  fail_unless(osrfHashGetLen(testOsrfHash, jid, 3) == NULL,
+      "osrfHashGetLen should not match a prefix of a key");
+  fail_unless(osrfHashGetLen(testOsrfHash, "twofold", 3) == &globalItem2,
+      "osrfHashGetLen should match the first len characters of the key");
+
+  osrfHashSetLen(testOsrfHash, &globalItem2, jid, strlen(jid));
+  fail_unless(osrfHashGetLen(testOsrfHash, jid, strlen(jid)) == &globalItem2,
+      "osrfHashSetLen should not treat the key as a format string");
+  fail_unless(osrfHashExtractLen(testOsrfHash, jid, strlen(jid)) == &globalItem2,
+      "osrfHashExtractLen should return the item");
+  fail_unless(osrfHashRemoveLen(testOsrfHash, "one", 3) == &globalItem1,
+      "osrfHashRemoveLen should return the item when there is no callback");
+  fail_unless(osrfHashGetCount(testOsrfHash) == 3,
+      "osrfHashRemoveLen and osrfHashExtractLen should decrement the count");
+END_TEST
+
+START_TEST(test_osrf_hash_osrfHashMakeKey)
+  osrfHashKey key;
+  osrfHashMakeKey(&key, "three", 5);
+  fail_unless(osrfHashGetKey(testOsrfHash, &key) == &globalItem3,
+      "osrfHashGetKey should find a stored item");
+
+  // A prepared key stays good as the hash grows an index
+  osrfHashMakeKey(&key, "session_17", 10);
+  char buf[32];
+  int i;
+  for (i = 0; i < 40; i++) {
+    snprintf(buf, sizeof(buf), "session_%d", i);
+    if (i == 17)
+      osrfHashSetKey(testOsrfHash, &globalItem1, &key);
+    else
+      osrfHashSet(testOsrfHash, &globalItem2, buf);
+  }
+  fail_unless(osrfHashGetKey(testOsrfHash, &key) == &globalItem1,
+      "osrfHashGetKey should find an item stored with osrfHashSetKey");
+  fail_unless(osrfHashGet(testOsrfHash, "session_17") == &globalItem1,
+      "osrfHashGet should find an item stored with osrfHashSetKey");
+  fail_unless(osrfHashExtractKey(testOsrfHash, &key) == &globalItem1,
+      "osrfHashExtractKey should return the item");
+  fail_unless(osrfHashRemoveKey(testOsrfHash, &key) == NULL,
+      "osrfHashRemoveKey should return NULL for a missing key");
+  fail_unless(osrfHashGetCount(testOsrfHash) == 42,
+      "osrfHashExtractKey should decrement the count");
+END_TEST
+
+//END TESTS
+
+Suite *osrf_hash_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_hash");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashSet);
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashGet);
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashRemove);
+  tcase_add_test(tc_core, test_osrf_hash_largeHash);
+  tcase_add_test(tc_core, test_osrf_hash_turnover);
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashIterator);
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashIteratorFree);
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashSetLen);
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashMakeKey);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_hash_suite());
+}
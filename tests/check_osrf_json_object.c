@@ -1,5 +1,11 @@
 #include <check.h>
+#include <pthread.h>
+#include <math.h>
 #include "opensrf/osrf_json.h"
+#include "opensrf/osrf_intern.h"
+#include "opensrf/jsonpush.h"
+#include "opensrf/osrf_legacy_json.h"
+#include "opensrf/osrf_json_xml.h"
 
 jsonObject *jsonObj;
 jsonObject *jsonHash;
@@ -182,16 +188,28 @@ START_TEST(test_osrf_json_object_jsonObjectToJSON)
 END_TEST
 
 START_TEST(test_osrf_json_object_doubleToString)
-  fail_unless(strcmp(doubleToString(123.456),
-      "123.456000000000003069544618484") == 0,
-      "doubleToString should return a string version of the given double, with a precision of 30 digits");
+  fail_unless(strcmp(doubleToString(123.456), "123.456") == 0,
+      "doubleToString should return the shortest string that reads back as the given double");
+  fail_unless(strcmp(doubleToString(-9007199254740993.0), "-9007199254740992") == 0,
+      "doubleToString should format an integral double as an integer");
+  fail_unless(strcmp(doubleToString(1e21), "1e+21") == 0 &&
+      strcmp(doubleToString(1e20), "100000000000000000000") == 0,
+      "doubleToString should switch to scientific notation for large numbers");
+  fail_unless(strcmp(doubleToString(1e-7), "1e-7") == 0 &&
+      strcmp(doubleToString(-2.5e-6), "-0.0000025") == 0,
+      "doubleToString should switch to scientific notation for small numbers");
+  fail_unless(strcmp(doubleToString(5e-324), "5e-324") == 0 &&
+      strcmp(doubleToString(1.7976931348623157e308), "1.7976931348623157e+308") == 0,
+      "doubleToString should handle the extremes of the double range");
+  fail_unless(strcmp(doubleToString(-0.0), "-0") == 0 &&
+      strcmp(doubleToString(0.1 + 0.2), "0.30000000000000004") == 0,
+      "doubleToString should preserve the exact value");
 END_TEST
 
 START_TEST(test_osrf_json_object_jsonObjectGetString)
   fail_unless(strcmp(jsonObjectGetString(jsonObj), "test") == 0,
       "jsonObjectGetString should return the value of the given object, if it is of type JSON_STRING");
-  fail_unless(strcmp(jsonObjectGetString(jsonNumber),
-      "123.456000000000003069544618484") == 0,
+  fail_unless(strcmp(jsonObjectGetString(jsonNumber), "123.456") == 0,
       "jsonObjectGetString should return the value of the given JSON_NUMBER object if it is not NULL");
   jsonObject *jsonNullNumber = jsonNewNumberObject(0);
   jsonObjectSetNumberString(jsonNullNumber, "NaN"); //set jsonNullNumber->value to NULL
@@ -216,6 +234,91 @@ START_TEST(test_osrf_json_object_jsonObjectGetNumber)
       "jsonObjectGetNumber should return the value of the given obj in double form");
 END_TEST
 
+START_TEST(test_osrf_json_object_jsonObjectGetInt64)
+  fail_unless(jsonObjectGetInt64(NULL) == 0,
+      "jsonObjectGetInt64 should return 0 if given arg is NULL");
+  fail_unless(jsonObjectGetInt64(jsonHash) == 0,
+      "jsonObjectGetInt64 should return 0 if given arg is not of type JSON_NUMBER");
+  fail_unless(jsonObjectGetInt64(jsonNumber) == 123,
+      "jsonObjectGetInt64 should truncate a fractional number");
+
+  jsonObject *big = jsonNewNumberStringObject("9223372036854775807");
+  fail_unless(jsonObjectGetInt64(big) == INT64_MAX,
+      "jsonObjectGetInt64 should return an int64 exactly");
+  fail_unless(jsonObjectGetInt64(big) == INT64_MAX,
+      "jsonObjectGetInt64 should return the same value from the cache");
+  fail_unless(jsonObjectGetNumber(big) == 9223372036854775807.0,
+      "jsonObjectGetNumber should agree with strtod for a cached integer");
+  jsonObjectSetNumberString(big, "-9223372036854775808");
+  fail_unless(jsonObjectGetInt64(big) == INT64_MIN,
+      "jsonObjectSetNumberString should invalidate the cached value");
+  jsonObjectSetNumberString(big, "9223372036854775808");
+  fail_unless(jsonObjectGetInt64(big) == INT64_MAX,
+      "jsonObjectGetInt64 should clamp a number too big for an int64");
+  fail_unless(jsonObjectGetNumber(big) == 9223372036854775808.0,
+      "jsonObjectGetNumber should handle an integer too big for an int64");
+  jsonObjectSetNumber(big, -42);
+  fail_unless(jsonObjectGetInt64(big) == -42,
+      "jsonObjectSetNumber should replace the cached value");
+  jsonObjectSetNumber(big, 2.5);
+  fail_unless(jsonObjectGetNumber(big) == 2.5 && jsonObjectGetInt64(big) == 2,
+      "jsonObjectSetNumber should cache a fractional number");
+  jsonObjectFree(big);
+
+  jsonObject *parsed = jsonParse("[12345678901234567, 1e3, -0.5]");
+  fail_unless(jsonObjectGetInt64(jsonObjectGetIndex(parsed, 0)) == 12345678901234567LL,
+      "jsonObjectGetInt64 should not lose the precision of a parsed integer");
+  fail_unless(jsonObjectGetInt64(jsonObjectGetIndex(parsed, 1)) == 1000,
+      "jsonObjectGetInt64 should convert an exponent");
+  fail_unless(jsonObjectGetInt64(jsonObjectGetIndex(parsed, 2)) == 0,
+      "jsonObjectGetInt64 should truncate toward zero");
+  jsonObject *clone = jsonObjectClone(parsed);
+  fail_unless(jsonObjectGetInt64(jsonObjectGetIndex(clone, 0)) == 12345678901234567LL,
+      "jsonObjectClone should carry over the number");
+  jsonObjectFree(clone);
+  jsonObjectSetString(jsonObjectGetIndex(parsed, 0), "text");
+  jsonObjectSetNumberString(jsonObjectGetIndex(parsed, 0), "7");
+  fail_unless(jsonObjectGetInt64(jsonObjectGetIndex(parsed, 0)) == 7,
+      "Changing the type of a number should invalidate the cached value");
+  jsonObjectFree(parsed);
+
+  // Negative zero keeps its sign
+  parsed = jsonParse("[-0, -0.0]");
+  fail_unless(signbit(jsonObjectGetNumber(jsonObjectGetIndex(parsed, 0))),
+      "jsonObjectGetNumber should not lose the sign of -0");
+  fail_unless(signbit(jsonObjectGetNumber(jsonObjectGetIndex(parsed, 1))),
+      "jsonObjectGetNumber should not lose the sign of -0.0");
+  jsonObjectFree(parsed);
+  jsonObject *zero = jsonNewNumberObject(-0.0);
+  fail_unless(signbit(jsonObjectGetNumber(zero)) && jsonObjectGetInt64(zero) == 0,
+      "jsonNewNumberObject should cache -0 as a double");
+  jsonObjectFree(zero);
+END_TEST
+
+START_TEST(test_osrf_json_object_numberCache)
+  // The cache is filled when the number is built or parsed...
+  jsonObject *parsed = jsonParse("[42, 2.5]");
+  fail_unless(jsonObjectGetIndex(parsed, 0)->flags & JSON_NODE_NUM_INT,
+      "jsonParse should cache a parsed integer");
+  fail_unless(jsonObjectGetIndex(parsed, 1)->flags & JSON_NODE_NUM_DOUBLE,
+      "jsonParse should cache a parsed double");
+  jsonObjectFree(parsed);
+  jsonObject *num = jsonNewNumberStringObject("17");
+  fail_unless(num->flags & JSON_NODE_NUM_INT,
+      "jsonNewNumberStringObject should cache the number");
+
+  // ...and reading never writes to it.
+  num->flags &= ~JSON_NODE_NUM_CACHED;
+  fail_unless(jsonObjectGetInt64(num) == 17 && jsonObjectGetNumber(num) == 17.0,
+      "The getters should convert a number without a cached value");
+  fail_unless(!(num->flags & JSON_NODE_NUM_CACHED),
+      "The getters should not fill in the cache");
+  jsonObjectCacheNumber(num);
+  fail_unless((num->flags & JSON_NODE_NUM_INT) && num->num.i == 17,
+      "jsonObjectCacheNumber should cache the number");
+  jsonObjectFree(num);
+END_TEST
+
 START_TEST(test_osrf_json_object_jsonObjectSetString)
   jsonObjectSetString(jsonObj, NULL);
   fail_unless(strcmp(jsonObj->value.s, "test") == 0,
@@ -242,7 +345,7 @@ END_TEST
 
 START_TEST(test_osrf_json_object_jsonObjectSetNumber)
   jsonObjectSetNumber(jsonNumber, 999.999);
-  fail_unless(strcmp(jsonNumber->value.s, "999.999000000000023646862246096") == 0,
+  fail_unless(strcmp(jsonNumber->value.s, "999.999") == 0,
       "jsonObjectSetNumber should set dest->value.s to the stringified version of the num arg");
 END_TEST
 
@@ -262,7 +365,7 @@ START_TEST(test_osrf_json_object_jsonObjectClone)
   jsonObject *numberClone = jsonObjectClone(jsonNumber);
   fail_unless(numberClone->type == JSON_NUMBER,
       "jsonObjectClone should return a clone of a JSON_NUMBER object");
-  fail_unless(strcmp(numberClone->value.s, "123.456000000000003069544618484") == 0,
+  fail_unless(strcmp(numberClone->value.s, "123.456") == 0,
       "jsonObjectClone should return a clone of a JSON_NUMBER object");
 
   jsonObject *boolClone = jsonObjectClone(jsonBool);
@@ -302,6 +405,829 @@ START_TEST(test_osrf_json_object_jsonBoolIsTrue)
       "jsonBoolIsTrue should return 1 if the value of boolObj is not 0");
 END_TEST
 
+START_TEST(test_osrf_json_object_jsonParseInArena)
+  osrfArena *arena = osrfNewArena(256);
+  jsonObject *parsed = jsonParseInArena(arena,
+      "{\"a\":[1,\"two\",true,null],\"b\":{\"__c\":\"cls\",\"__p\":[\"x\"]}}");
+  fail_if(parsed == NULL, "jsonParseInArena should parse a valid JSON string");
+  fail_unless(parsed->flags & JSON_NODE_ARENA,
+      "jsonParseInArena should mark the nodes it creates as living in the arena");
+
+  char *json = jsonObjectToJSON(parsed);
+  fail_unless(strcmp(json, "{\"a\":[1,\"two\",true,null],\"b\":{\"__c\":\"cls\",\"__p\":[\"x\"]}}") == 0,
+      "A tree built by jsonParseInArena should serialize like one built by jsonParse");
+  free(json);
+
+  fail_unless(strcmp(jsonObjectGetClass(jsonObjectGetKeyConst(parsed, "b")), "cls") == 0,
+      "jsonParseInArena should decode class hints");
+
+  jsonObject *clone = jsonObjectClone(parsed);
+  fail_if(clone->flags & JSON_NODE_ARENA,
+      "jsonObjectClone should copy an arena tree onto the heap");
+
+  // Class names given to arena nodes come from the arena, so nothing leaks
+  jsonObject *two = jsonObjectGetIndex(jsonObjectGetKeyConst(parsed, "a"), 1);
+  jsonObjectSetClass(two, "1 arena class");
+  jsonObject *loose = jsonNewObjectInArena(arena, "x");
+  jsonObjectSetClassInArena(arena, loose, "looseClass");
+  fail_unless(strcmp(jsonObjectGetClass(two), "1 arena class") == 0 &&
+      strcmp(jsonObjectGetClass(loose), "looseClass") == 0,
+      "jsonObjectSetClass should name an arena node from its arena");
+  jsonObjectFree(parsed);
+  osrfArenaReset(arena);
+
+  fail_unless(jsonParseInArena(arena, "[1,") == NULL,
+      "jsonParseInArena should return NULL for invalid JSON");
+  json = jsonObjectToJSON(clone);
+  fail_unless(strcmp(json, "{\"a\":[1,\"two\",true,null],\"b\":{\"__c\":\"cls\",\"__p\":[\"x\"]}}") == 0,
+      "A clone of an arena tree should survive a reset of the arena");
+  free(json);
+  jsonObjectFree(clone);
+  osrfArenaFree(arena);
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonParseInSitu)
+  char buf[] = "{\"k\":[12,\"plain\",\"esc\\\"aped\\u00e9\",-3.5e2],"
+      "\"c\":{\"__c\":\"cls\",\"__p\":{\"n\":7}}}";
+  jsonObject *parsed = jsonParseInSitu(NULL, buf);
+  fail_if(parsed == NULL, "jsonParseInSitu should parse a valid JSON string");
+
+  const jsonObject *arr = jsonObjectGetKeyConst(parsed, "k");
+  const jsonObject *plain = jsonObjectGetIndex(arr, 1);
+  fail_unless(strcmp(jsonObjectGetString(plain), "plain") == 0,
+      "jsonParseInSitu should parse an unescaped string");
+  fail_unless(plain->value.s > buf && plain->value.s < buf + sizeof(buf),
+      "jsonParseInSitu should leave an unescaped string in the input buffer");
+  fail_unless(strcmp(jsonObjectGetString(jsonObjectGetIndex(arr, 2)), "esc\"aped\xc3\xa9") == 0,
+      "jsonParseInSitu should decode escape sequences in place");
+  fail_unless(strcmp(jsonObjectGetString(jsonObjectGetIndex(arr, 0)), "12") == 0,
+      "jsonParseInSitu should terminate a number without losing the following delimiter");
+  fail_unless(strcmp(jsonObjectGetString(jsonObjectGetIndex(arr, 3)), "-3.5e2") == 0,
+      "jsonParseInSitu should parse a number at the end of an array");
+
+  const jsonObject *classed = jsonObjectGetKeyConst(parsed, "c");
+  fail_unless(strcmp(jsonObjectGetClass(classed), "cls") == 0,
+      "jsonParseInSitu should decode class hints");
+  fail_unless(jsonObjectGetNumber(jsonObjectGetKeyConst(classed, "n")) == 7,
+      "jsonParseInSitu should parse the data of a classed object");
+
+  jsonObjectSetString(jsonObjectGetIndex(arr, 1), "changed");
+  fail_unless(strcmp(jsonObjectGetString(jsonObjectGetIndex(arr, 1)), "changed") == 0,
+      "A node from jsonParseInSitu should be modifiable");
+  jsonObjectFree(parsed);
+
+  char num[] = "42";
+  parsed = jsonParseInSitu(NULL, num);
+  fail_unless(parsed != NULL && strcmp(jsonObjectGetString(parsed), "42") == 0,
+      "jsonParseInSitu should parse a number at the start of the input");
+  jsonObjectFree(parsed);
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonParseStringScan)
+  // Strings and white space long enough, and misaligned enough, to exercise
+  // every path through the bulk scanners
+  char json[ 200 ];
+  char expected[ 100 ];
+  int len, esc;
+  for (len = 0; len < 70; len++) {
+    for (esc = 0; esc <= len; esc += 7) {
+      int i, j = 0, k = 0;
+      for (i = 0; i < esc % 40; i++)
+        json[j++] = (i % 3) ? ' ' : '\n';
+      json[j++] = '"';
+      for (i = 0; i < len; i++) {
+        if (i == esc) {
+          json[j++] = '\\';
+          json[j++] = 't';
+          expected[k++] = '\t';
+        }
+        json[j++] = 'a' + i % 26;
+        expected[k++] = 'a' + i % 26;
+      }
+      json[j++] = '"';
+      json[j++] = '\t';
+      json[j] = '\0';
+      expected[k] = '\0';
+
+      jsonObject *parsed = jsonParse(json);
+      fail_unless(parsed != NULL && strcmp(jsonObjectGetString(parsed), expected) == 0,
+          "jsonParse should parse a string of length %d with an escape at %d", len, esc);
+      jsonObjectFree(parsed);
+
+      parsed = jsonParseInSitu(NULL, json);
+      fail_unless(parsed != NULL && strcmp(jsonObjectGetString(parsed), expected) == 0,
+          "jsonParseInSitu should parse a string of length %d with an escape at %d", len, esc);
+      jsonObjectFree(parsed);
+    }
+  }
+
+  fail_unless(jsonParse("\"unterminated") == NULL,
+      "jsonParse should reject an unterminated string");
+END_TEST
+
+//Collects serialized JSON, consuming it only in multiples of 7 bytes
+static size_t sink_max_offered = 0;
+static long collect_sevens(void* userdata, const char* data, size_t len) {
+  if (len > sink_max_offered)
+    sink_max_offered = len;
+  size_t n = len - len % 7;
+  buffer_add_n((growing_buffer*) userdata, data, n);
+  return n;
+}
+
+START_TEST(test_osrf_json_object_jsonObjectToSink)
+  // Long strings with multibyte characters, nested classed containers
+  growing_buffer *longstr = buffer_init(64);
+  int i;
+  for (i = 0; i < 300; i++)
+    buffer_add(longstr, (i % 5) ? "abc\"\n" : "\xc3\xa9\xe2\x82\xac");
+  jsonObject *tree = jsonNewObjectType(JSON_ARRAY);
+  for (i = 0; i < 40; i++) {
+    jsonObject *item = jsonNewObject(NULL);
+    jsonObjectSetClass(item, "aou");
+    jsonObjectSetKey(item, "id", jsonNewNumberObject(i));
+    jsonObjectSetKey(item, "name", jsonNewObject(OSRF_BUFFER_C_STR(longstr) + i));
+    jsonObjectPush(tree, item);
+  }
+  char *expected = jsonObjectToJSON(tree);
+
+  growing_buffer *out = buffer_init(64);
+  jsonSink *sink = jsonNewSink(64, collect_sevens, out);
+  fail_unless(jsonSinkAdd(sink, "[", 1) == 0, "jsonSinkAdd should succeed");
+  fail_unless(jsonObjectToSink(tree, sink) == 0, "jsonObjectToSink should succeed");
+  fail_unless(jsonSinkAdd(sink, "]", 1) == 0, "jsonSinkAdd should succeed");
+  fail_unless(jsonSinkFlush(sink) == 0, "jsonSinkFlush should succeed");
+  fail_unless(sink->total > 0 && sink->buf->n_used < 7,
+      "jsonSinkFlush should leave only what the writer declined");
+  buffer_add_n(out, OSRF_BUFFER_C_STR(sink->buf), sink->buf->n_used);
+
+  fail_unless(out->n_used == strlen(expected) + 2
+      && strncmp(OSRF_BUFFER_C_STR(out) + 1, expected, strlen(expected)) == 0,
+      "jsonObjectToSink should deliver the same JSON as jsonObjectToJSON");
+  // Escaping can expand a window-sized slice of a string at most sixfold
+  fail_unless(sink_max_offered < 64 * 8,
+      "jsonObjectToSink should stage a bounded multiple of its window");
+
+  jsonSinkFree(sink);
+  buffer_free(out);
+  buffer_free(longstr);
+
+  FILE *tmp = tmpfile();
+  fail_unless(jsonObjectToFd(tree, fileno(tmp), 100) == 0, "jsonObjectToFd should succeed");
+  fail_unless(jsonObjectToFd(NULL, fileno(tmp), 100) == -1,
+      "jsonObjectToFd should reject a NULL jsonObject");
+  rewind(tmp);
+  size_t len = strlen(expected);
+  char *written = malloc(len + 1);
+  fail_unless(fread(written, 1, len + 1, tmp) == len && strncmp(written, expected, len) == 0,
+      "jsonObjectToFd should write the same JSON as jsonObjectToJSON");
+  free(written);
+  fclose(tmp);
+
+  free(expected);
+  jsonObjectFree(tree);
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonObjectToXMLSink)
+  jsonObject *tree = jsonNewObjectType(JSON_ARRAY);
+  int i;
+  for (i = 0; i < 30; i++) {
+    jsonObject *item = jsonNewObjectType(JSON_HASH);
+    jsonObjectSetClass(item, "aou");
+    jsonObjectSetKey(item, "id", jsonNewNumberObject(i));
+    jsonObjectSetKey(item, "a<b", jsonNewObject("x & y \xc3\xa9 long enough to span a window or two"));
+    jsonObjectSetKey(item, "ok", jsonNewBoolObject(i % 2));
+    jsonObjectPush(tree, item);
+  }
+  jsonObjectPush(tree, NULL);
+  char *expected = jsonObjectToXML(tree);
+  fail_unless(strncmp(expected, "<array><object class_hint=\"aou\"><element key=\"id\"><number>0</number>"
+      "</element><element key=\"a&lt;b\"><string>x &amp; y \xc3\xa9 long", 125) == 0,
+      "jsonObjectToXML should escape keys and text");
+
+  growing_buffer *out = buffer_init(64);
+  sink_max_offered = 0;
+  jsonSink *sink = jsonNewSink(32, collect_sevens, out);
+  fail_unless(jsonObjectToXMLSink(tree, sink) == 0, "jsonObjectToXMLSink should succeed");
+  fail_unless(jsonObjectToXMLSink(NULL, sink) == 0, "jsonObjectToXMLSink should accept NULL");
+  fail_unless(jsonSinkFlush(sink) == 0, "jsonSinkFlush should succeed");
+  buffer_add_n(out, OSRF_BUFFER_C_STR(sink->buf), sink->buf->n_used);
+
+  fail_unless(out->n_used == strlen(expected) + 7
+      && strncmp(OSRF_BUFFER_C_STR(out), expected, strlen(expected)) == 0
+      && strcmp(OSRF_BUFFER_C_STR(out) + strlen(expected), "<null/>") == 0,
+      "jsonObjectToXMLSink should deliver the same XML as jsonObjectToXML");
+  fail_unless(sink_max_offered < 32 * 8,
+      "jsonObjectToXMLSink should stage a bounded multiple of its window");
+
+  jsonSinkFree(sink);
+  buffer_free(out);
+  free(expected);
+  jsonObjectFree(tree);
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonObjectSetKeyMany)
+  // Enough keys to outgrow the small-hash layout, with deletions along the way
+  jsonObject *hash = jsonNewObjectType(JSON_HASH);
+  char key[ 16 ];
+  int i;
+  for (i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    jsonObjectSetKey(hash, key, jsonNewNumberObject(i));
+    if (i % 3 == 0 && i > 0) {
+      snprintf(key, sizeof(key), "key%d", i - 1);
+      jsonObjectRemoveKey(hash, key);
+    }
+  }
+  jsonObjectSetKey(hash, "key4", jsonNewObject("replaced"));
+
+  for (i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    const jsonObject *value = jsonObjectGetKeyConst(hash, key);
+    if (i % 3 == 2 && i < 99)
+      fail_unless(value == NULL, "jsonObjectGetKey should not find removed %s", key);
+    else if (i == 4)
+      fail_unless(strcmp(jsonObjectGetString(value), "replaced") == 0,
+          "jsonObjectSetKey should replace an existing key in place");
+    else
+      fail_unless(value != NULL && jsonObjectGetNumber(value) == i,
+          "jsonObjectGetKey should find %s", key);
+  }
+  fail_unless(hash->size == 67, "A hash should count only the keys not removed");
+
+  // Iteration follows insertion order, even after removing the current key
+  jsonIterator *itr = jsonNewIterator(hash);
+  jsonObject *item;
+  int count = 0, last = -1;
+  while ((item = jsonIteratorNext(itr))) {
+    int n = atoi(itr->key + 3);
+    fail_unless(n > last, "jsonIteratorNext should follow insertion order");
+    last = n;
+    if (n % 10 == 0)
+      jsonObjectRemoveKey(hash, itr->key);
+    count++;
+  }
+  jsonIteratorFree(itr);
+  fail_unless(count == 67, "jsonIteratorNext should visit every key");
+  fail_unless(osrfHashGetCount(hash->value.h) == 60, "jsonObjectRemoveKey should work during iteration");
+
+  char *json = jsonObjectToJSON(hash);
+  fail_unless(strncmp(json, "{\"key1\":1,\"key3\":3,\"key4\":\"replaced\",", 36) == 0,
+      "jsonObjectToJSON should list the keys in insertion order");
+  free(json);
+  jsonObjectFree(hash);
+END_TEST
+
+START_TEST(test_osrf_json_object_internedKeys)
+  const char *type = osrfIntern("threadTrace");
+  fail_unless(type != NULL && strcmp(type, "threadTrace") == 0 && osrfIsInterned(type),
+      "osrfIntern should intern an identifier");
+  fail_unless(osrfIntern("threadTrace") == type,
+      "osrfIntern should return the same copy every time");
+  fail_unless(osrfIntern("12345") == NULL, "osrfIntern should not intern a number");
+  fail_unless(osrfIntern("a_key_that_is_much_too_long_to_be_interned") == NULL,
+      "osrfIntern should not intern a long string");
+
+  // Class names from the wire are shared only once the application has interned them
+  jsonObject *wire = jsonParse("{\"__c\":\"wire_class\",\"__p\":[]}");
+  jsonObject *cloned = jsonObjectClone(wire);
+  fail_unless(osrfInternLookup("wire_class") == NULL,
+      "Parsed class names should not add to the intern table");
+  jsonObjectFree(cloned);
+  jsonObjectFree(wire);
+  osrfIntern("aou");
+
+  jsonObject *one = jsonParse("{\"__c\":\"aou\",\"__p\":{\"threadTrace\":1,\"99\":2}}");
+  jsonObject *two = jsonParse("{\"threadTrace\":3,\"99\":4}");
+  jsonObjectSetClass(two, "aou");
+
+  fail_unless(jsonObjectGetClass(one) == jsonObjectGetClass(two),
+      "Class names should be shared");
+  jsonIterator *itr1 = jsonNewIterator(one);
+  jsonIterator *itr2 = jsonNewIterator(two);
+  jsonIteratorNext(itr1);
+  jsonIteratorNext(itr2);
+  fail_unless(itr1->key == type && itr2->key == type, "Hash keys should be shared");
+  jsonIteratorNext(itr1);
+  jsonIteratorNext(itr2);
+  fail_unless(strcmp(itr1->key, "99") == 0 && itr1->key != itr2->key,
+      "Numeric hash keys should not be interned");
+  jsonIteratorFree(itr1);
+  jsonIteratorFree(itr2);
+
+  fail_unless(jsonObjectGetNumber(jsonObjectGetKeyConst(two, type)) == 3,
+      "jsonObjectGetKey should find a key by its interned copy");
+  jsonObjectFree(one);
+  jsonObjectFree(two);
+
+  jsonObject *unknown = jsonParse("{\"client_supplied_key\":1}");
+  jsonObjectSetKey(unknown, "another_new_key", NULL);
+  fail_unless(osrfInternLookup("client_supplied_key") == NULL &&
+      osrfInternLookup("another_new_key") == NULL,
+      "Hash keys should not add to the intern table");
+  jsonObjectFree(unknown);
+  const char *added = osrfIntern("client_supplied_key");
+  fail_unless(added != NULL && osrfInternLookup("client_supplied_key") == added,
+      "osrfInternLookup should find a string interned by osrfIntern");
+END_TEST
+
+//Builds and frees jsonObjects; frees those handed over by another thread, too
+static void* churn_objects(void* arg) {
+  jsonObject **handoff = arg;
+  int i, j;
+  for (i = 0; i < 200; i++) {
+    jsonObject *tree = jsonNewObjectType(JSON_ARRAY);
+    for (j = 0; j < 50; j++)
+      jsonObjectPush(tree, jsonNewObjectFmt("item %d", j));
+    jsonObjectFree(tree);
+  }
+  jsonObject *tree = jsonNewObjectType(JSON_ARRAY);
+  for (j = 0; j < 300; j++)
+    jsonObjectPush(tree, jsonNewNumberObject(j));
+  *handoff = tree;
+  return NULL;
+}
+
+START_TEST(test_osrf_json_object_threadedFreeList)
+  pthread_t threads[4];
+  jsonObject *handoff[4];
+  int i;
+  for (i = 0; i < 4; i++)
+    fail_unless(pthread_create(&threads[i], NULL, churn_objects, &handoff[i]) == 0,
+        "pthread_create should succeed");
+  for (i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+    fail_unless(handoff[i]->size == 300 &&
+        jsonObjectGetNumber(jsonObjectGetIndex(handoff[i], 299)) == 299,
+        "A jsonObject built by one thread should be intact in another");
+    jsonObjectFree(handoff[i]);
+  }
+
+  // The free lists of the exited threads should be reusable here
+  jsonObject *obj = jsonNewObject("reused");
+  fail_unless(strcmp(jsonObjectGetString(obj), "reused") == 0,
+      "jsonNewObject should work after other threads exit");
+  jsonObjectFree(obj);
+  jsonObjectFreeUnused();
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonTape)
+  const char *text = "[{\"__c\":\"osrfMessage\",\"__p\":{\"threadTrace\":\"1\","
+      "\"type\":\"STATUS\",\"payload\":{\"__c\":\"osrfConnectStatus\",\"__p\":"
+      "{\"status\":\"OK\",\"statusCode\":200}}}}, [1, 2.5e1, true, null, \"\\u00e9\\n\"],"
+      " {\"k\\u0065y\":  {\"a\": [ ] }  } ]";
+  jsonTape *tape = jsonTapeParse(text);
+  fail_unless(tape != NULL, "jsonTapeParse should index valid JSON");
+  fail_unless(jsonTapeType(tape, 0) == JSON_ARRAY && jsonTapeSize(tape, 0) == 3,
+      "jsonTapeParse should index the outer array");
+
+  int msg = jsonTapeGetIndex(tape, 0, 0);
+  fail_unless(strcmp(jsonTapeGetClass(tape, msg), "osrfMessage") == 0,
+      "jsonTapeGetClass should report a class hint");
+  fail_unless(jsonTapeType(tape, msg) == JSON_HASH && jsonTapeSize(tape, msg) == 3,
+      "The accessors should look through a class hint");
+  fail_unless(strcmp(jsonTapeGetString(tape, jsonTapeGetKey(tape, msg, "type")), "STATUS") == 0,
+      "jsonTapeGetKey should find a key within a class hint");
+  int payload = jsonTapeGetKey(tape, msg, "payload");
+  fail_unless(strcmp(jsonTapeGetClass(tape, payload), "osrfConnectStatus") == 0,
+      "jsonTapeGetClass should report a nested class hint");
+  fail_unless(strcmp(jsonTapeGetString(tape, jsonTapeGetKey(tape, payload, "statusCode")),
+      "200") == 0, "jsonTapeGetString should return the text of a number");
+  fail_unless(jsonTapeGetKey(tape, payload, "nothing") == -1,
+      "jsonTapeGetKey should return -1 for a missing key");
+
+  size_t len;
+  const char *verbatim = jsonTapeText(tape, payload, &len);
+  fail_unless(len == 66 && strncmp(verbatim, "{\"__c\":\"osrfConnectStatus\"", 26) == 0,
+      "jsonTapeText should return the original text of a node");
+
+  int arr = jsonTapeGetIndex(tape, 0, 1);
+  fail_unless(jsonTapeType(tape, jsonTapeGetIndex(tape, arr, 2)) == JSON_BOOL &&
+      jsonTapeType(tape, jsonTapeGetIndex(tape, arr, 3)) == JSON_NULL,
+      "jsonTapeType should identify keywords");
+  fail_unless(strcmp(jsonTapeGetString(tape, jsonTapeGetIndex(tape, arr, 4)), "\xc3\xa9\n") == 0,
+      "jsonTapeGetString should decode escape sequences");
+  fail_unless(jsonTapeGetIndex(tape, arr, 1) > jsonTapeGetIndex(tape, arr, 0) &&
+      jsonTapeGetIndex(tape, arr, 5) == -1,
+      "jsonTapeGetIndex should find elements in any order");
+  fail_unless(jsonTapeGetString(tape, arr) == NULL,
+      "jsonTapeGetString should return NULL for an array");
+  int inner = jsonTapeGetKey(tape, jsonTapeGetIndex(tape, 0, 2), "key");
+  fail_unless(jsonTapeType(tape, jsonTapeGetKey(tape, inner, "a")) == JSON_ARRAY,
+      "jsonTapeGetKey should match a key with escape sequences");
+
+  jsonObject *obj = jsonTapeToObject(tape, msg);
+  char *json = jsonObjectToJSON(obj);
+  jsonObject *expected = jsonParse("{\"__c\":\"osrfMessage\",\"__p\":{\"threadTrace\":\"1\","
+      "\"type\":\"STATUS\",\"payload\":{\"__c\":\"osrfConnectStatus\",\"__p\":"
+      "{\"status\":\"OK\",\"statusCode\":200}}}}");
+  char *expected_json = jsonObjectToJSON(expected);
+  fail_unless(strcmp(obj->classname, "osrfMessage") == 0 && strcmp(json, expected_json) == 0,
+      "jsonTapeToObject should build the same jsonObject as jsonParse");
+  free(json);
+  free(expected_json);
+  jsonObjectFree(obj);
+  jsonObjectFree(expected);
+  jsonTapeFree(tape);
+
+  tape = jsonTapeParseRaw(text);
+  msg = jsonTapeGetIndex(tape, 0, 0);
+  fail_unless(jsonTapeGetClass(tape, msg) == NULL && jsonTapeGetKey(tape, msg, "__p") > 0,
+      "jsonTapeParseRaw should not decode class hints");
+  jsonTapeFree(tape);
+
+  fail_unless(jsonTapeParse("[1, 2") == NULL,
+      "jsonTapeParse should reject an unterminated array");
+  fail_unless(jsonTapeParse("{\"a\" 1}") == NULL,
+      "jsonTapeParse should reject a missing colon");
+  fail_unless(jsonTapeParse("[nulll]") == NULL,
+      "jsonTapeParse should reject a misspelled keyword");
+  fail_unless(jsonTapeParse("\"\\u12\"") == NULL,
+      "jsonTapeParse should reject a bad escape sequence");
+  fail_unless(jsonTapeParse("[1] 2") == NULL,
+      "jsonTapeParse should reject extra material");
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonTape_duplicate_key)
+  fail_unless(jsonTapeParse("{\"a\":1,\"a\":2}") == NULL,
+      "jsonTapeParse should reject a duplicate key, as jsonParse does");
+  fail_unless(jsonTapeParse("[{\"b\":1,\"\\u0062\":2}]") == NULL,
+      "jsonTapeParse should reject a duplicate key spelled with escape sequences");
+  fail_unless(jsonTapeParseRaw("{\"__c\":\"x\",\"__c\":\"y\"}") == NULL,
+      "jsonTapeParseRaw should reject a duplicate key");
+
+  const char *many = "{\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,"
+      "\"k6\":6,\"k7\":7,\"k8\":8,\"k\\u0039\":9,\"k10\":10,\"k11\":{\"k0\":0}}";
+  jsonTape *tape = jsonTapeParse(many);
+  fail_unless(tape != NULL && jsonTapeSize(tape, 0) == 12,
+      "jsonTapeParse should accept a large hash with distinct keys");
+  jsonTapeFree(tape);
+  fail_unless(jsonTapeParse("{\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,"
+      "\"k6\":6,\"k7\":7,\"k8\":8,\"k9\":9,\"k\\u0035\":10}") == NULL,
+      "jsonTapeParse should reject a duplicate key in a large hash");
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonObjectToBinary)
+  const char *text = "{\"__c\":\"aou\",\"__p\":[\"007\",1.50,-42,18446744073709551615,"
+      "-9223372036854775808,0,null,true,false,\"tab\\tquote\\\" \\u00e9\",{\"k\":[]}]}";
+  jsonObject *obj = jsonParse(text);
+  growing_buffer *buf = buffer_init(64);
+  fail_unless(jsonObjectToBinary(obj, buf) == 0,
+      "jsonObjectToBinary should encode a jsonObject");
+  fail_unless(jsonObjectToBinary(NULL, buf) == -1,
+      "jsonObjectToBinary should reject a NULL jsonObject");
+  size_t used = 0;
+  jsonObject *copy = jsonObjectFromBinary(OSRF_BUFFER_C_STR(buf), buffer_length(buf), &used);
+  fail_unless(copy != NULL && used == buffer_length(buf),
+      "jsonObjectFromBinary should decode the whole encoding");
+  fail_unless(strcmp(jsonObjectGetClass(copy), "aou") == 0,
+      "jsonObjectFromBinary should restore a class name");
+  char *json1 = jsonObjectToJSON(obj);
+  char *json2 = jsonObjectToJSON(copy);
+  fail_unless(strcmp(json1, json2) == 0,
+      "A binary round trip should preserve every value, including numeric strings");
+  fail_unless(jsonObjectGetInt64(jsonObjectGetIndex(copy, 2)) == -42,
+      "jsonObjectFromBinary should decode a negative integer");
+  free(json1);
+  free(json2);
+  jsonObjectFree(copy);
+
+  fail_unless(jsonObjectFromBinary(OSRF_BUFFER_C_STR(buf), buffer_length(buf) - 1, NULL)
+      == NULL, "jsonObjectFromBinary should reject a truncated encoding");
+  fail_unless(jsonObjectFromBinary("\x9f\xff", 2, NULL) == NULL,
+      "jsonObjectFromBinary should reject an indefinite-length array");
+  fail_unless(jsonObjectFromBinary("\xa1\x01\xf6", 3, NULL) == NULL,
+      "jsonObjectFromBinary should reject a map with a non-text key");
+  copy = jsonObjectFromBinary("\xfb\x3f\xf8\0\0\0\0\0\0", 9, NULL);
+  fail_unless(copy && jsonObjectGetNumber(copy) == 1.5,
+      "jsonObjectFromBinary should decode a double");
+  jsonObjectFree(copy);
+  fail_unless(jsonObjectFromBinary("\xfb\x7f\xf8\0\0\0\0\0\0", 9, NULL) == NULL,
+      "jsonObjectFromBinary should reject a NaN");
+  fail_unless(jsonObjectFromBinary("\xfb\xff\xf0\0\0\0\0\0\0", 9, NULL) == NULL,
+      "jsonObjectFromBinary should reject an infinity");
+  buffer_free(buf);
+  jsonObjectFree(obj);
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonObjectShare)
+  jsonObject *tree = jsonParse("{\"list\":[1,2,3],\"name\":\"x\"}");
+  jsonObject *list = jsonObjectGetKey(tree, "list");
+  fail_unless(!jsonObjectIsShared(list),
+      "A freshly parsed jsonObject should not be shared");
+
+  jsonObject *ref = jsonObjectShare(tree);
+  fail_unless(ref == tree && jsonObjectIsShared(list),
+      "jsonObjectShare should return the same jsonObject, now shared");
+
+  // Attach a shared subtree to another tree; it should survive both owners in turn
+  jsonObject *other = jsonNewObjectType(JSON_ARRAY);
+  jsonObjectPush(other, jsonObjectShare(list));
+  jsonObjectFree(tree);
+  jsonObjectFree(ref);
+  fail_unless(jsonObjectGetNumber(jsonObjectGetIndex(
+      jsonObjectGetIndex(other, 0), 2)) == 3,
+      "A shared subtree should outlive the tree it came from");
+  jsonObjectFree(other);
+
+  jsonObject *orig = jsonNewObject("before");
+  jsonObject *copy = jsonObjectShare(orig);
+  copy = jsonObjectUnshare(copy);
+  fail_unless(copy != orig, "jsonObjectUnshare should copy a shared jsonObject");
+  jsonObjectSetString(copy, "after");
+  fail_unless(strcmp(jsonObjectGetString(orig), "before") == 0,
+      "Changing an unshared copy should not affect the original");
+  fail_unless(jsonObjectUnshare(orig) == orig,
+      "jsonObjectUnshare should return a jsonObject with only one owner");
+  jsonObjectFree(orig);
+  jsonObjectFree(copy);
+
+  osrfArena *arena = osrfNewArena(0);
+  jsonObject *transient = jsonParseInArena(arena, "[\"a\"]");
+  jsonObject *kept = jsonObjectShare(transient);
+  fail_unless(kept != transient && !(kept->flags & JSON_NODE_ARENA),
+      "jsonObjectShare should copy a jsonObject from an arena");
+  osrfArenaFree(arena);
+  fail_unless(strcmp(jsonObjectGetString(jsonObjectGetIndex(kept, 0)), "a") == 0,
+      "The copy should outlive the arena");
+  jsonObjectFree(kept);
+
+  char insitu[] = "[{\"deep\":[\"borrowed\"]}]";
+  jsonObject *borrower = jsonParseInSitu(NULL, insitu);
+  jsonObject *owned = jsonObjectShare(borrower);
+  fail_unless(owned != borrower,
+      "jsonObjectShare should copy a tree that borrows strings below its root");
+  jsonObjectFree(borrower);
+  jsonObjectFree(owned);
+
+  jsonObject *plain = jsonParse("[{\"a\":1}]");
+  jsonObject *decoded = jsonObjectDecodeClassShared(plain);
+  fail_unless(decoded == plain,
+      "jsonObjectDecodeClassShared should share a tree with no class wrappers");
+  jsonObjectFree(decoded);
+  jsonObjectFree(plain);
+  jsonObject *raw = jsonParseRaw("[{\"__c\":\"aou\",\"__p\":[1]}]");
+  decoded = jsonObjectDecodeClassShared(raw);
+  fail_unless(decoded != raw &&
+      strcmp(jsonObjectGetClass(jsonObjectGetIndex(decoded, 0)), "aou") == 0,
+      "jsonObjectDecodeClassShared should decode class wrappers");
+  jsonObjectFree(decoded);
+  jsonObjectFree(raw);
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonObjectToJSONDecoded)
+  const char *json = "[{\"__c\":\"aou\",\"__p\":[1,{\"__c\":\"au\",\"__p\":{\"a\":\"b\"}}]},"
+      "{\"__c\":\"acp\"},{\"x\":null}]";
+  jsonObject *raw = jsonParseRaw(json);
+  jsonObject *decoded = jsonObjectDecodeClass(raw);
+  char *expected = jsonObjectToJSONRaw(decoded);
+  char *fused = jsonObjectToJSONDecoded(raw);
+  fail_unless(strcmp(fused, "[[1,{\"a\":\"b\"}],null,{\"x\":null}]") == 0 &&
+      strcmp(fused, expected) == 0,
+      "jsonObjectToJSONDecoded should match jsonObjectToJSONRaw of the decoded tree");
+  free(fused);
+  free(expected);
+
+  // A tree that was decoded as it was parsed writes the same way, ignoring class names
+  jsonObject *parsed = jsonParse(json);
+  fused = jsonObjectToJSONDecoded(parsed);
+  expected = jsonObjectToJSONRaw(parsed);
+  fail_unless(strcmp(fused, expected) == 0,
+      "jsonObjectToJSONDecoded should not expand class names");
+  free(fused);
+  free(expected);
+
+  jsonObject *encoded = jsonObjectEncodeClass(decoded);
+  expected = jsonObjectToJSONRaw(encoded);
+  fused = jsonObjectToJSON(decoded);
+  fail_unless(strcmp(fused, expected) == 0,
+      "jsonObjectToJSON should match jsonObjectToJSONRaw of the encoded tree");
+  free(fused);
+  free(expected);
+
+  fail_unless(jsonObjectToJSONDecoded(NULL) == NULL,
+      "jsonObjectToJSONDecoded should return NULL for a NULL jsonObject");
+
+  jsonObjectFree(encoded);
+  jsonObjectFree(parsed);
+  jsonObjectFree(decoded);
+  jsonObjectFree(raw);
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonPathEval)
+  jsonObject *tree = jsonParse("{\"a\":{\"b\":{\"c\":1},\"x\":[{\"b\":{\"c\":2}},{\"b\":[5,6]}]},"
+      "\"b\":{\"c\":3}}");
+  const char *paths[] = { "/a/b/c", "a//b/c", "/a/nope", "//b", "//b/c", "//a//b//c", "/", "//y" };
+  const char *expected[] = { "1", "1", "null", "[{\"c\":3},{\"c\":1},{\"c\":2},[5,6]]",
+      "[3,1,2,null]", "[1,2]", NULL, "[]" };
+  int i;
+  for (i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+    jsonPath *path = jsonPathCompile(paths[i]);
+    jsonObject *found = jsonPathEval(path, tree);
+    jsonObject *cached = jsonObjectFindPath(tree, paths[i]);
+    char *found_json = found ? jsonObjectToJSON(found) : NULL;
+    char *cached_json = cached ? jsonObjectToJSON(cached) : NULL;
+    if (expected[i]) {
+      fail_unless(found_json && strcmp(found_json, expected[i]) == 0,
+          "jsonPathEval should find what the path describes");
+      fail_unless(cached_json && strcmp(cached_json, expected[i]) == 0,
+          "jsonObjectFindPath should agree with jsonPathEval");
+    } else
+      fail_unless(path == NULL && found == NULL && cached == NULL,
+          "A path without keys should find nothing");
+    free(found_json);
+    free(cached_json);
+    jsonObjectFree(found);
+    jsonObjectFree(cached);
+    jsonPathFree(path);
+  }
+
+  // Formatted paths, and more distinct paths than the cache holds
+  char key[16];
+  for (i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    jsonObjectSetKey(tree, key, jsonNewNumberObject(i));
+  }
+  for (i = 0; i < 200; i++) {
+    jsonObject *found = jsonObjectFindPath(tree, "/k%d", i % 100);
+    fail_unless(found && jsonObjectGetNumber(found) == i % 100,
+        "jsonObjectFindPath should expand a formatted path");
+    jsonObjectFree(found);
+  }
+  jsonObjectFree(tree);
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonPushBuilder)
+  const char *json = "{\"a\":[1,-2.5e3,\"x\\\"y\\u00e9\",true,false,null,{}],"
+      "\"obj\":{\"__c\":\"aou\",\"__p\":[\"b\",{\"__c\":\"au\"}]},\"n\":42}";
+  jsonObject *expected = jsonParse(json);
+  char *expected_json = jsonObjectToJSON(expected);
+  size_t len = strlen(json);
+
+  // Split the text at every possible point, even in the middle of tokens
+  JSONPushBuilder *builder = jsonNewPushBuilder(1);
+  size_t i;
+  for (i = 0; i <= len; i++) {
+    fail_unless(jsonPushBuilderPush(builder, json, i) == 0 &&
+        jsonPushBuilderPush(builder, json + i, len - i) == 0,
+        "jsonPushBuilderPush should accept any split of valid JSON");
+    jsonObject *built = jsonPushBuilderFinish(builder);
+    fail_unless(built != NULL, "jsonPushBuilderFinish should return the tree");
+    char *built_json = jsonObjectToJSON(built);
+    fail_unless(strcmp(built_json, expected_json) == 0,
+        "jsonPushBuilder should build the same tree as jsonParse");
+    fail_unless(strcmp(jsonObjectGetClass(jsonObjectGetKeyConst(built, "obj")), "aou") == 0,
+        "jsonPushBuilder should decode class hints");
+    free(built_json);
+    jsonObjectFree(built);
+  }
+  free(expected_json);
+  jsonObjectFree(expected);
+
+  // A bare number at the very end is only recognized when the input is finished
+  jsonPushBuilderPush(builder, "12", 2);
+  jsonPushBuilderPush(builder, "34", 2);
+  jsonObject *num = jsonPushBuilderFinish(builder);
+  fail_unless(num != NULL && jsonObjectGetNumber(num) == 1234,
+      "jsonPushBuilder should finish a trailing number");
+  jsonObjectFree(num);
+
+  // Errors and incomplete input yield NULL, and leave the builder reusable
+  fail_unless(jsonPushBuilderPush(builder, "[1,}", 4) != 0,
+      "jsonPushBuilderPush should report invalid JSON");
+  fail_unless(jsonPushBuilderFinish(builder) == NULL,
+      "jsonPushBuilderFinish should return NULL after an error");
+  jsonPushBuilderPush(builder, "{\"a\":[1,", 8);
+  fail_unless(jsonPushBuilderFinish(builder) == NULL,
+      "jsonPushBuilderFinish should return NULL for incomplete JSON");
+  jsonPushBuilderPush(builder, "[\"ok\"]", 6);
+  jsonObject *ok = jsonPushBuilderFinish(builder);
+  fail_unless(ok != NULL && strcmp(jsonObjectGetString(jsonObjectGetIndex(ok, 0)), "ok") == 0,
+      "A JSONPushBuilder should be reusable after an error");
+  jsonObjectFree(ok);
+  jsonPushBuilderFree(builder);
+
+  builder = jsonNewPushBuilder(0);
+  jsonPushBuilderPush(builder, "{\"__c\":\"aou\",\"__p\":[]}", 22);
+  jsonObject *raw = jsonPushBuilderFinish(builder);
+  fail_unless(raw != NULL && raw->type == JSON_HASH && jsonObjectGetClass(raw) == NULL,
+      "A raw jsonPushBuilder should leave class hints alone");
+  jsonObjectFree(raw);
+  jsonPushBuilderFree(builder);
+END_TEST
+
+//Collects the strings and numbers reported by a JSONPushParser, one per line
+static int collect_token(void *blob, const char *str) {
+  buffer_add((growing_buffer*) blob, str);
+  buffer_add_char((growing_buffer*) blob, '\n');
+  return 0;
+}
+
+START_TEST(test_osrf_json_object_jsonPush)
+  JSONHandlerMap map = { collect_token, collect_token };
+  growing_buffer *tokens = buffer_init(64);
+  JSONPushParser *parser = jsonNewPushParser(&map, tokens);
+
+  // UTF-8 in a string literal, split at every point, including inside a character
+  const char *json = "[\"h\xc3\xa9llo w\xc3\xb6rld \xe2\x82\xac\",\"a\\\"b\",17]";
+  size_t len = strlen(json);
+  size_t i;
+  for (i = 0; i <= len; i++) {
+    buffer_reset(tokens);
+    jsonPushParserReset(parser);
+    fail_unless(jsonPush(parser, json, i) == 0 && jsonPush(parser, json + i, len - i) == 0 &&
+        jsonPushParserFinish(parser) == 0,
+        "jsonPush should accept UTF-8 in a string split across chunks");
+    fail_unless(strcmp(OSRF_BUFFER_C_STR(tokens),
+        "h\xc3\xa9llo w\xc3\xb6rld \xe2\x82\xac\na\"b\n17\n") == 0,
+        "jsonPush should deliver a split string intact");
+  }
+
+  // A chunk that isn't nul-terminated: the byte after it must not be read
+  char *chunk = malloc(6);
+  memcpy(chunk, "[\"abcX", 6);
+  buffer_reset(tokens);
+  jsonPushParserReset(parser);
+  fail_unless(jsonPush(parser, chunk, 5) == 0 && jsonPush(parser, "\",12", 4) == 0 &&
+      jsonPush(parser, "3]", 2) == 0 && jsonPushParserFinish(parser) == 0,
+      "jsonPush should accept chunks that aren't nul-terminated");
+  fail_unless(strcmp(OSRF_BUFFER_C_STR(tokens), "abc\n123\n") == 0,
+      "jsonPush should read no further than the length of each chunk");
+  free(chunk);
+
+  jsonPushParserReset(parser);
+  fail_unless(jsonPush(parser, "[\"a\tb\"]", 7) != 0,
+      "jsonPush should reject a control character in a string");
+
+  jsonPushParserFree(parser);
+  buffer_free(tokens);
+END_TEST
+
+START_TEST(test_osrf_json_object_jsonParseLegacy)
+  // Whatever the legacy serializer writes, the legacy parser reads back
+  jsonObject *inner = jsonNewObjectType(JSON_ARRAY);
+  jsonObjectPush(inner, jsonNewNumberObject(1));
+  jsonObjectSetClass(inner, "au");
+  jsonObject *outer = jsonNewObjectType(JSON_HASH);
+  jsonObjectSetKey(outer, "a", inner);
+  jsonObjectSetKey(outer, "b", jsonNewObject("x/*y*/z"));
+  jsonObjectSetClass(outer, "aou");
+  char *legacy = legacy_jsonObjectToJSON(outer);
+  fail_unless(strstr(legacy, "/*--S aou--*/") == legacy,
+      "legacy_jsonObjectToJSON should write class hints as comments");
+  jsonObject *back = legacy_jsonParseString(legacy);
+  char *expected = jsonObjectToJSON(outer);
+  char *actual = back ? jsonObjectToJSON(back) : NULL;
+  fail_unless(actual != NULL && strcmp(actual, expected) == 0,
+      "legacy_jsonParseString should restore the class hints");
+  free(actual);
+  free(expected);
+  jsonObjectFree(back);
+  free(legacy);
+  jsonObjectFree(outer);
+
+  // Comments go anywhere, and a hint belongs only to the node right after it
+  jsonObject *obj = jsonParseLegacy(
+      "// leading\n[ /* note */ 1, [2 /*--S x--*/], /*--S  acp --*/ {\"k\": 3}]");
+  fail_unless(obj != NULL && obj->size == 3, "jsonParseLegacy should skip comments");
+  fail_unless(jsonObjectGetClass(jsonObjectGetIndex(jsonObjectGetIndex(obj, 1), 0)) == NULL &&
+      jsonObjectGetClass(jsonObjectGetIndex(obj, 2)) != NULL &&
+      strcmp(jsonObjectGetClass(jsonObjectGetIndex(obj, 2)), "acp") == 0,
+      "jsonParseLegacy should apply a hint to the following node only");
+  jsonObjectFree(obj);
+
+  // The old parser's other liberties
+  obj = jsonParseLegacy("[True,NULL,,] trailing");
+  fail_unless(obj != NULL && obj->size == 4 &&
+      jsonBoolIsTrue(jsonObjectGetIndex(obj, 0)) &&
+      jsonObjectGetIndex(obj, 2)->type == JSON_NULL &&
+      jsonObjectGetIndex(obj, 3)->type == JSON_NULL,
+      "jsonParseLegacy should accept the old dialect");
+  jsonObjectFree(obj);
+
+  obj = jsonParseLegacy("{\"a\":1,\"a\":}");
+  fail_unless(obj != NULL && jsonObjectGetKeyConst(obj, "a")->type == JSON_NULL,
+      "jsonParseLegacy should let the last of repeated keys win");
+  jsonObjectFree(obj);
+
+  // Numbers follow the regular parser, not the old one
+  obj = jsonParseLegacy("[1.5e3, -0, 01, 00, -00.5, 0e2]");
+  char *json = obj ? jsonObjectToJSON(obj) : NULL;
+  fail_unless(json != NULL && strcmp(json, "[1.5e3,-0,1,0,-0.5,0e2]") == 0,
+      "jsonParseLegacy should accept exponents and drop extra leading zeros");
+  free(json);
+  jsonObjectFree(obj);
+  json = jsonScrubNumber("000");
+  fail_unless(json != NULL && strcmp(json, "0") == 0,
+      "jsonScrubNumber should keep one zero of a string of zeros");
+  free(json);
+
+  fail_unless(jsonParseLegacy("[1 /* unterminated") == NULL,
+      "jsonParseLegacy should reject an unterminated comment");
+  fail_unless(jsonParse("/*--S aou--*/{}") == NULL,
+      "jsonParse should still reject comments");
+END_TEST
+
 //END Tests
 
 
@@ -328,6 +1254,8 @@ Suite *osrf_json_object_suite (void) {
   tcase_add_test(tc_core, test_osrf_json_object_doubleToString);
   tcase_add_test(tc_core, test_osrf_json_object_jsonObjectGetString);
   tcase_add_test(tc_core, test_osrf_json_object_jsonObjectGetNumber);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonObjectGetInt64);
+  tcase_add_test(tc_core, test_osrf_json_object_numberCache);
   tcase_add_test(tc_core, test_osrf_json_object_jsonObjectSetString);
   tcase_add_test(tc_core, test_osrf_json_object_jsonObjectSetNumberString);
   tcase_add_test(tc_core, test_osrf_json_object_jsonObjectSetNumber);
@@ -335,6 +1263,23 @@ Suite *osrf_json_object_suite (void) {
   tcase_add_test(tc_core, test_osrf_json_object_jsonObjectSetIndex);
   tcase_add_test(tc_core, test_osrf_json_object_jsonObjectGetIndex);
   tcase_add_test(tc_core, test_osrf_json_object_jsonObjectClone);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonParseInArena);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonParseInSitu);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonParseStringScan);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonObjectToSink);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonObjectToXMLSink);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonObjectSetKeyMany);
+  tcase_add_test(tc_core, test_osrf_json_object_internedKeys);
+  tcase_add_test(tc_core, test_osrf_json_object_threadedFreeList);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonTape);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonTape_duplicate_key);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonObjectToBinary);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonObjectShare);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonPushBuilder);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonPush);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonObjectToJSONDecoded);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonPathEval);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonParseLegacy);
 
   //Add test case to test suite
   suite_add_tcase(s, tc_core);
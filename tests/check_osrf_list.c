@@ -54,6 +54,26 @@ START_TEST(test_osrf_list_osrfNewListSize)
       "osrfNewListSize called with a size of 0 or less should have an array size of 16");
 END_TEST
 
+START_TEST(test_osrf_list_osrfNewArenaList)
+  osrfArena *arena = osrfNewArena(0);
+  osrfList *arenaList = osrfNewArenaList(arena, 2);
+  fail_if(arenaList == NULL, "arenaList not successfully created");
+  fail_unless(arenaList->arena == arena, "arenaList should remember its arena");
+  fail_unless(arenaList->arrsize == 2, "arenaList wasn't created with the size 2");
+
+  osrfListPush(arenaList, &globalItem1);
+  osrfListPush(arenaList, &globalItem3);
+  osrfListPush(arenaList, &globalItem1);
+  fail_unless(arenaList->arrsize == 4, "An arena list should double in size when it grows");
+  fail_unless(osrfListGetIndex(arenaList, 1) == &globalItem3,
+      "Growing an arena list should preserve its contents");
+
+  arenaList->freeItem = (void(*)(void*)) osrfCustomListFree;
+  osrfListFree(arenaList);
+  fail_unless(freedItemsSize == 0, "osrfListFree should leave an arena list alone");
+  osrfArenaFree(arena);
+END_TEST
+
 START_TEST(test_osrf_list_osrfListPush)
   fail_unless(osrfListPush(NULL, NULL) == -1,
       "Passing a null list to osrfListPush should return -1");
@@ -362,6 +382,7 @@ Suite *osrf_list_suite(void) {
   //Add tests to test case
   tcase_add_test(tc_core, test_osrf_list_osrfNewList);
   tcase_add_test(tc_core, test_osrf_list_osrfNewListSize);
+  tcase_add_test(tc_core, test_osrf_list_osrfNewArenaList);
   tcase_add_test(tc_core, test_osrf_list_osrfListPush);
   tcase_add_test(tc_core, test_osrf_list_osrfListPushFirst);
   tcase_add_test(tc_core, test_osrf_list_osrfListSet);
@@ -68,9 +68,99 @@ START_TEST(test_osrf_message_set_params)
   fail_unless(strcmp(jsonObjectGetIndex(o->_params, 0)->value.s, "test") == 0,
       "osrf_message_set_params should set msg->_params to an array containing the\
       jsonObject passed");
+  jsonObjectSetString(testJSONObject, "changed");
+  fail_unless(strcmp(jsonObjectGetString(jsonObjectGetIndex(o->_params, 0)), "test") == 0,
+      "osrf_message_set_params should copy the jsonObject passed");
   jsonObjectFree(testJSONObject);
 END_TEST
 
+START_TEST(test_osrfMessageSerializeBatchBinary)
+  osrfMessage *msgs[2];
+  msgs[0] = osrf_message_init(RESULT, 7, 1);
+  osrf_message_set_status_info(msgs[0], NULL, "OK", 200);
+  jsonObject *content = jsonParse("{\"__c\":\"aou\",\"__p\":[\"1\",\"a<b>&c\"]}");
+  osrf_message_set_result(msgs[0], content);
+  jsonObjectFree(content);
+  msgs[0]->binary = 1;
+  msgs[1] = osrf_message_init(STATUS, 7, 1);
+  osrf_message_set_status_info(msgs[1], "osrfConnectStatus", "Request Complete", 205);
+
+  char *body = osrfMessageSerializeBatchBinary(msgs, 2);
+  fail_unless(body[0] == OSRF_BINARY_BODY_MARK && strpbrk(body, "<>&\"") == NULL,
+      "osrfMessageSerializeBatchBinary should produce a marked body safe for XML");
+
+  osrfMessage *parsed[4];
+  fail_unless(osrf_message_deserialize(body, parsed, 4) == 2,
+      "osrf_message_deserialize should decode a binary body");
+  fail_unless(parsed[0]->m_type == RESULT && parsed[0]->thread_trace == 7 &&
+      parsed[0]->binary && !parsed[1]->binary,
+      "osrf_message_deserialize should restore message headers from a binary body");
+  fail_unless(strcmp(jsonObjectGetClass(osrfMessageGetResult(parsed[0])), "aou") == 0 &&
+      strcmp(jsonObjectGetString(jsonObjectGetIndex(osrfMessageGetResult(parsed[0]), 1)),
+      "a<b>&c") == 0, "osrf_message_deserialize should restore content from a binary body");
+  fail_unless(parsed[1]->status_code == 205,
+      "osrf_message_deserialize should restore a status code from a binary body");
+  osrfMessageFree(parsed[0]);
+  osrfMessageFree(parsed[1]);
+
+  // Bundled responses arrive as comma-separated segments
+  char *second = osrfMessageSerializeBatchBinary(&msgs[1], 1);
+  growing_buffer *bundle = buffer_init(256);
+  buffer_add(bundle, body);
+  buffer_add_char(bundle, ',');
+  buffer_add(bundle, second + 1);
+  fail_unless(osrf_message_deserialize(OSRF_BUFFER_C_STR(bundle), parsed, 4) == 3,
+      "osrf_message_deserialize should decode every segment of a binary body");
+  osrfMessageFree(parsed[0]);
+  osrfMessageFree(parsed[1]);
+  osrfMessageFree(parsed[2]);
+  fail_unless(osrf_message_deserialize("!AAA", parsed, 4) == 0,
+      "osrf_message_deserialize should reject a corrupt binary body");
+
+  buffer_free(bundle);
+  free(second);
+  free(body);
+  osrfMessageFree(msgs[0]);
+  osrfMessageFree(msgs[1]);
+END_TEST
+
+START_TEST(test_osrf_message_deserialize_in_situ)
+  osrfMessage *msgs[2];
+  msgs[0] = osrf_message_init(REQUEST, 3, 1);
+  osrf_message_set_method(msgs[0], "open-ils.search.biblio.record.retrieve");
+  jsonObject *params = jsonParse("[\"abc\",{\"__c\":\"aou\",\"__p\":[\"1\",\"Main\"]}]");
+  osrf_message_set_params(msgs[0], params);
+  jsonObjectFree(params);
+  msgs[1] = osrf_message_init(RESULT, 3, 1);
+  osrf_message_set_status_info(msgs[1], NULL, "OK", 200);
+  osrf_message_set_result_content(msgs[1], "{\"name\":\"Main Branch\"}");
+  char *expected = osrfMessageSerializeBatch(msgs, 2);
+
+  // Without an arena, the messages must not depend on the input buffer
+  char *buf = strdup(expected);
+  osrfMessage *parsed[4];
+  fail_unless(osrf_message_deserialize_in_situ(buf, parsed, 4, NULL) == 2,
+      "osrf_message_deserialize_in_situ should decode every message");
+  memset(buf, 'x', strlen(expected));
+  free(buf);
+
+  fail_unless(strcmp(jsonObjectGetString(jsonObjectGetIndex(parsed[0]->_params, 0)), "abc") == 0,
+      "osrf_message_deserialize_in_situ should produce self-contained params");
+  fail_unless(strcmp(jsonObjectGetString(jsonObjectGetKeyConst(
+      osrfMessageGetResult(parsed[1]), "name")), "Main Branch") == 0,
+      "osrf_message_deserialize_in_situ should produce self-contained content");
+  char *reserialized = osrfMessageSerializeBatch(parsed, 2);
+  fail_unless(strcmp(reserialized, expected) == 0,
+      "Messages from osrf_message_deserialize_in_situ should serialize as before");
+
+  free(reserialized);
+  free(expected);
+  osrfMessageFree(parsed[0]);
+  osrfMessageFree(parsed[1]);
+  osrfMessageFree(msgs[0]);
+  osrfMessageFree(msgs[1]);
+END_TEST
+
 //END Tests
 
 Suite *osrf_message_suite(void) {
@@ -86,6 +176,8 @@ Suite *osrf_message_suite(void) {
   tcase_add_test(tc_core, test_osrf_message_set_default_locale);
   tcase_add_test(tc_core, test_osrf_message_set_method);
   tcase_add_test(tc_core, test_osrf_message_set_params);
+  tcase_add_test(tc_core, test_osrfMessageSerializeBatchBinary);
+  tcase_add_test(tc_core, test_osrf_message_deserialize_in_situ);
 
   //Add test case to test suite
   suite_add_tcase(s, tc_core);
@@ -0,0 +1,107 @@
+#include <check.h>
+#include "opensrf/osrf_string_set.h"
+
+osrfStringSet *testStringSet;
+
+//Set up the test fixture
+void setup(void) {
+  osrfStringArray *arr = osrfNewStringArray(4);
+  osrfStringArrayAdd(arr, "open-ils.auth");
+  osrfStringArrayAdd(arr, "open-ils.actor.patron.password");
+  osrfStringArrayAdd(arr, "open-ils.auth");
+  osrfStringArrayAdd(arr, "private.localhost");
+  testStringSet = osrfNewStringSetFromArray(arr);
+  osrfStringArrayFree(arr);
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  osrfStringSetFree(testStringSet);
+}
+
+// BEGIN TESTS
+
+START_TEST(test_osrf_string_set_osrfNewStringSetFromArray)
+  fail_unless(osrfStringSetGetCount(testStringSet) == 3,
+      "osrfNewStringSetFromArray should load each distinct string once");
+  osrfStringSet *set = osrfNewStringSetFromArray(NULL);
+  fail_unless(osrfStringSetGetCount(set) == 0,
+      "osrfNewStringSetFromArray should return an empty set for a NULL array");
+  osrfStringSetFree(set);
+END_TEST
+
+START_TEST(test_osrf_string_set_osrfStringSetContains)
+  fail_unless(osrfStringSetContains(testStringSet, "private.localhost") == 1,
+      "osrfStringSetContains should find a member");
+  fail_unless(osrfStringSetContains(testStringSet, "private.localhost.org") == 0,
+      "osrfStringSetContains should not match a longer string");
+  fail_unless(osrfStringSetContains(testStringSet, "Private.localhost") == 0,
+      "osrfStringSetContains should be case-sensitive");
+  fail_unless(osrfStringSetContains(NULL, "private.localhost") == 0,
+      "osrfStringSetContains should return 0 for a NULL set");
+
+  const char *jid = "router@private.localhost/router";
+  fail_unless(osrfStringSetContainsLen(testStringSet, jid + 7, 17) == 1,
+      "osrfStringSetContainsLen should find a member within a longer string");
+  fail_unless(osrfStringSetContainsLen(testStringSet, jid + 7, 16) == 0,
+      "osrfStringSetContainsLen should not match part of a member");
+END_TEST
+
+START_TEST(test_osrf_string_set_osrfStringSetMatchPrefix)
+  fail_unless(osrfStringSetMatchPrefix(testStringSet, "open-ils.auth.authenticate.init") == 1,
+      "osrfStringSetMatchPrefix should match a string beginning with a member");
+  fail_unless(osrfStringSetMatchPrefix(testStringSet, "open-ils.auth") == 1,
+      "osrfStringSetMatchPrefix should match a string equal to a member");
+  fail_unless(osrfStringSetMatchPrefix(testStringSet, "open-ils.au") == 0,
+      "osrfStringSetMatchPrefix should not match a prefix of a member");
+  fail_unless(osrfStringSetMatchPrefix(testStringSet, "open-ils.actor.user.retrieve") == 0,
+      "osrfStringSetMatchPrefix should not match a string without a member as a prefix");
+
+  osrfStringSetAdd(testStringSet, "");
+  fail_unless(osrfStringSetMatchPrefix(testStringSet, "open-ils.actor.user.retrieve") == 1,
+      "An empty member should be a prefix of any string");
+  fail_unless(osrfStringSetMatchPrefix(NULL, "open-ils.auth") == 0,
+      "osrfStringSetMatchPrefix should return 0 for a NULL set");
+END_TEST
+
+START_TEST(test_osrf_string_set_largeSet)
+  osrfStringSet *set = osrfNewStringSet();
+  char buf[64];
+  int i;
+  for (i = 0; i < 500; i++) {
+    snprintf(buf, sizeof(buf), "open-ils.app%d.%s", i, i % 2 ? "retrieve" : "update");
+    osrfStringSetAdd(set, buf);
+  }
+  fail_unless(osrfStringSetGetCount(set) == 500, "A large osrfStringSet should hold every string");
+  fail_unless(osrfStringSetContains(set, "open-ils.app321.retrieve") == 1,
+      "A large osrfStringSet should find a member");
+  fail_unless(osrfStringSetMatchPrefix(set, "open-ils.app42.update.batch") == 1,
+      "A large osrfStringSet should match a prefix");
+  fail_unless(osrfStringSetMatchPrefix(set, "open-ils.app42.retrieve") == 0,
+      "A large osrfStringSet should not match a string without a member as a prefix");
+  osrfStringSetFree(set);
+END_TEST
+
+//END TESTS
+
+Suite *osrf_string_set_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_string_set");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrf_string_set_osrfNewStringSetFromArray);
+  tcase_add_test(tc_core, test_osrf_string_set_osrfStringSetContains);
+  tcase_add_test(tc_core, test_osrf_string_set_osrfStringSetMatchPrefix);
+  tcase_add_test(tc_core, test_osrf_string_set_largeSet);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_string_set_suite());
+}
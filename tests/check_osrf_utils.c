@@ -1,5 +1,6 @@
 #include <check.h>
 #include "opensrf/utils.h"
+#include "opensrf/osrf_utf8.h"
 
 
 
@@ -21,6 +22,99 @@ START_TEST(test_osrfXmlEscapingLength)
   ck_assert_int_eq(osrfXmlEscapingLength(special), 38);
 END_TEST
 
+START_TEST(test_osrfXmlEscapeSpan)
+  const char* text = "abc<de\"f";
+  size_t width;
+  ck_assert_int_eq(osrfXmlEscapeSpan(text, 9, 100, &width), 9);
+  ck_assert_int_eq(width, 9 + 3 + 11);
+  ck_assert_int_eq(osrfXmlEscapeSpan(text, 9, 2, &width), 2);
+  ck_assert_int_eq(width, 2);
+  fail_unless(osrfXmlEscapeSpan(text, 9, 6, &width) == 3 && width == 3,
+      "osrfXmlEscapeSpan should not split an escaped character");
+  fail_unless(osrfXmlEscapeSpan(text, 9, 7, &width) == 4 && width == 7,
+      "osrfXmlEscapeSpan should count an escaped character at full width");
+  fail_unless(osrfXmlEscapeSpan(text, 9, 18, &width) == 6 && width == 9,
+      "osrfXmlEscapeSpan should stop short of a character that doesn't fit");
+  fail_unless(osrfXmlEscapeSpan(text, 3, 100, NULL) == 3,
+      "osrfXmlEscapeSpan should stop at the given length");
+END_TEST
+
+START_TEST(test_buffer_add_xml_escaped)
+  growing_buffer *buf = buffer_init(16);
+  buffer_add_xml_escaped(buf, "a<b>&\"c'\r\n\t\xc3\xa9 plain text plain text", 0);
+  fail_unless(strcmp(OSRF_BUFFER_C_STR(buf),
+      "a&lt;b&gt;&amp;\"c'&#13;\n\t\xc3\xa9 plain text plain text") == 0,
+      "buffer_add_xml_escaped should escape markup characters in text content");
+  buffer_reset(buf);
+  buffer_add_xml_escaped(buf, "a<b>&\"c'\r\n\t\xc3\xa9\xf0\x9f\x98\x80\xff", 1);
+  fail_unless(strcmp(OSRF_BUFFER_C_STR(buf),
+      "a&lt;b&gt;&amp;&quot;c'&#13;&#10;&#9;&#xE9;&#x1F600;&#xFF;") == 0,
+      "buffer_add_xml_escaped should use character references in an attribute value");
+  buffer_reset(buf);
+  fail_unless(buffer_add_xml_escaped(buf, NULL, 1) == 0,
+      "buffer_add_xml_escaped should treat NULL as an empty string");
+  buffer_free(buf);
+END_TEST
+
+START_TEST(test_buffer_add_base64)
+  growing_buffer *encoded = buffer_init(16);
+  buffer_add_base64(encoded, "any carnal pleas", 16);
+  fail_unless(strcmp(OSRF_BUFFER_C_STR(encoded), "YW55IGNhcm5hbCBwbGVhcw==") == 0,
+      "buffer_add_base64 should pad a partial group");
+  buffer_reset(encoded);
+  buffer_add_base64(encoded, "a\0b\xff", 4);
+  fail_unless(strcmp(OSRF_BUFFER_C_STR(encoded), "YQBi/w==") == 0,
+      "buffer_add_base64 should encode nul and high bytes");
+
+  growing_buffer *decoded = buffer_init(16);
+  fail_unless(buffer_add_unbase64(decoded, "YQBi/w==", 8) == 4 &&
+      memcmp(OSRF_BUFFER_C_STR(decoded), "a\0b\xff", 4) == 0,
+      "buffer_add_unbase64 should reverse buffer_add_base64");
+  fail_unless(buffer_add_unbase64(decoded, "YW5", 3) == -1,
+      "buffer_add_unbase64 should reject a partial group");
+  fail_unless(buffer_add_unbase64(decoded, "Y=55", 4) == -1,
+      "buffer_add_unbase64 should reject misplaced padding");
+  fail_unless(buffer_add_unbase64(decoded, "YW5<", 4) == -1,
+      "buffer_add_unbase64 should reject a character outside the alphabet");
+  buffer_free(encoded);
+  buffer_free(decoded);
+END_TEST
+
+START_TEST(test_buffer_append_utf8)
+  growing_buffer *buf = buffer_init(16);
+  fail_unless(buffer_append_utf8(buf, "a \"q\" b\\c\n\x01\x7f\xc3\xa9\xf0\x9f\x98\x80") == 0 &&
+      strcmp(OSRF_BUFFER_C_STR(buf),
+      "a \\\"q\\\" b\\\\c\\n\\u0001\\u007f\\u00e9\\ud83d\\ude00") == 0,
+      "buffer_append_utf8 should escape quotes, backslashes, controls, and non-ASCII");
+
+  // Special characters on either side of long runs, at every alignment
+  char text[100];
+  char expected[200];
+  int i;
+  for (i = 0; i < 48; i++) {
+    memset(text, 'x', 80);
+    text[80] = '\0';
+    text[i] = '"';
+    text[i + 16] = '\xc3';
+    text[i + 17] = '\xa9';
+    memset(expected, 'x', 80);
+    strcpy(expected + i, "\\\"");
+    memset(expected + i + 2, 'x', 15);
+    strcpy(expected + i + 17, "\\u00e9");
+    memset(expected + i + 23, 'x', 62 - i);
+    expected[85] = '\0';
+    buffer_reset(buf);
+    buffer_append_utf8(buf, text);
+    fail_unless(strcmp(OSRF_BUFFER_C_STR(buf), expected) == 0,
+        "buffer_append_utf8 should copy runs of plain text intact");
+  }
+
+  buffer_reset(buf);
+  fail_unless(buffer_append_utf8(buf, "ok\xc3") != 0,
+      "buffer_append_utf8 should report a truncated character");
+  buffer_free(buf);
+END_TEST
+
 //END TESTS
 
 Suite *osrf_utils_suite(void) {
@@ -31,6 +125,10 @@ Suite *osrf_utils_suite(void) {
 
   //Add tests to test case
   tcase_add_test(tc_core, test_osrfXmlEscapingLength);
+  tcase_add_test(tc_core, test_osrfXmlEscapeSpan);
+  tcase_add_test(tc_core, test_buffer_add_xml_escaped);
+  tcase_add_test(tc_core, test_buffer_add_base64);
+  tcase_add_test(tc_core, test_buffer_append_utf8);
 
   //Add test case to test suite
   suite_add_tcase(s, tc_core);